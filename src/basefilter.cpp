@@ -17,6 +17,8 @@
  */
 
 #include "basefilter.hpp"
+#include <cassert>
+#include <cstdlib>
 #include <iostream>
 
 using namespace std;
@@ -33,3 +35,84 @@ BaseFilter::~BaseFilter()
     cerr << __PRETTY_FUNCTION__ << endl;
 }
 
+
+const vector<BaseFilter::Port> &BaseFilter::inputPorts() const
+{
+    return m_inputPorts;
+}
+
+
+const vector<BaseFilter::Port> &BaseFilter::outputPorts() const
+{
+    return m_outputPorts;
+}
+
+
+BaseFilter::Fusion BaseFilter::fusion() const
+{
+    return FusionNone;
+}
+
+
+unsigned int BaseFilter::stencilRadius() const
+{
+    return 0;
+}
+
+
+void BaseFilter::processRow(const unsigned char *, unsigned char *, unsigned int)
+{
+    /* fusion() promised a kernel, which is not there */
+    cerr << __PRETTY_FUNCTION__ << " not implemented, but fusion() is FusionPerPixel" << endl;
+    abort();
+}
+
+
+void BaseFilter::processRowHorizontal(const unsigned char *, unsigned char *, unsigned int)
+{
+    cerr << __PRETTY_FUNCTION__ << " not implemented, but fusion() is FusionSeparableStencil" << endl;
+    abort();
+}
+
+
+void BaseFilter::processRowVertical(const unsigned char * const *, unsigned char *, unsigned int)
+{
+    cerr << __PRETTY_FUNCTION__ << " not implemented, but fusion() is FusionSeparableStencil" << endl;
+    abort();
+}
+
+
+bool BaseFilter::saveState(vector<unsigned char> &) const
+{
+    return false;
+}
+
+
+bool BaseFilter::restoreState(const vector<unsigned char> &)
+{
+    return false;
+}
+
+
+unsigned int BaseFilter::addInputPort(const string &name, PortType type)
+{
+    Port port = {name, type, -1};
+    m_inputPorts.push_back(port);
+
+    return m_inputPorts.size() - 1;
+}
+
+
+unsigned int BaseFilter::addOutputPort(const string &name, PortType type, int inPlaceInput)
+{
+    /* a time is given, not computed */
+    assert(type != PortTypeTime);
+    assert(inPlaceInput == -1 || (type == PortTypeImage
+            && inPlaceInput < (int) m_inputPorts.size()
+            && m_inputPorts[inPlaceInput].type == PortTypeImage));
+
+    Port port = {name, type, inPlaceInput};
+    m_outputPorts.push_back(port);
+
+    return m_outputPorts.size() - 1;
+}
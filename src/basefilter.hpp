@@ -22,6 +22,10 @@
 
 #include "prereqs.hpp"
 
+#include <ctime>
+#include <string>
+#include <vector>
+
 
 class BaseFilter;
 
@@ -29,19 +33,278 @@ class BaseFilter;
 typedef BaseFilter* (*CreateFilterFunction)();
 typedef void (*DestroyFilterFunction)(BaseFilter*);
 
+/**
+ * A filter plugin is a shared library exporting (extern "C")
+ *  - BaseFilter* create();
+ *  - void destroy(BaseFilter*);
+ *  - const unsigned int filterAbiVersion = BaseFilter::AbiVersion;
+ *  - optionally const BaseFilter::Descriptor filterDescriptor = {...};
+ * The host reads filterAbiVersion and filterDescriptor out of the file, before loading it -
+ * see FilterRegistry.
+ */
+
+/* *** the Simd flags of the compiler settings, for Descriptor::simd *** */
+#ifdef __SSE2__
+#define FILTER_SIMD_SSE2 BaseFilter::SimdSse2
+#else
+#define FILTER_SIMD_SSE2 0
+#endif
+#ifdef __SSE4_1__
+#define FILTER_SIMD_SSE41 BaseFilter::SimdSse41
+#else
+#define FILTER_SIMD_SSE41 0
+#endif
+#ifdef __AVX__
+#define FILTER_SIMD_AVX BaseFilter::SimdAvx
+#else
+#define FILTER_SIMD_AVX 0
+#endif
+#ifdef __AVX2__
+#define FILTER_SIMD_AVX2 BaseFilter::SimdAvx2
+#else
+#define FILTER_SIMD_AVX2 0
+#endif
+#ifdef __ARM_NEON__
+#define FILTER_SIMD_NEON BaseFilter::SimdNeon
+#else
+#define FILTER_SIMD_NEON 0
+#endif
+#define FILTER_BUILD_SIMD (FILTER_SIMD_SSE2 | FILTER_SIMD_SSE41 | FILTER_SIMD_AVX | FILTER_SIMD_AVX2 | FILTER_SIMD_NEON)
 
 
+
+/**
+ * a filter plugin
+ *
+ * A filter declares its typed input and output ports in its constructor. The host then
+ *  - calls prepare() with the first inputs and whenever an input image changes its format,
+ *    the filter describes its outputs there (e.g. the output image size may differ from the
+ *    input image size),
+ *  - allocates the outputs as described,
+ *  - calls process() for every frame with the same, pre-allocated outputs.
+ *
+ * process() must not allocate, it runs for every captured frame.
+ *
+ * Filters with one image input and one image output of the same size may additionally
+ * offer row kernels (see fusion()). The host then may merge a chain of them into a single
+ * pass, which streams rows through all filters, so intermediate images never hit memory.
+ */
 class BaseFilter
 {
+public:
+
+    /** changes with every incompatible change of this class or the plugin functions */
+    static const unsigned int AbiVersion = 2;
+
+    enum PortType
+    {
+        PortTypeImage,
+        PortTypePoint,
+        PortTypePointList,
+        PortTypeColor,
+        PortTypeFactor,
+        /** input only - the time of the frame */
+        PortTypeTime
+    };
+
+    struct Image
+    {
+        /** owned by the host, aligned to 64 bytes */
+        unsigned char *data;
+        unsigned int width;
+        unsigned int height;
+        /** 0 in prepare() lets the host choose - the smallest multiple of 64 bytes */
+        unsigned int bytesPerLine;
+        /** fourcc code, see V4L2_PIX_FMT_* */
+        unsigned int pixelFormat;
+    };
+
+    struct Point
+    {
+        double x;
+        double y;
+    };
+
+    struct PointList
+    {
+        /** owned by the host, room for capacity points */
+        Point *points;
+        unsigned int count;
+        /** set in prepare() for outputs */
+        unsigned int capacity;
+    };
+
+    struct Color
+    {
+        unsigned char red;
+        unsigned char green;
+        unsigned char blue;
+    };
+
+    /** the value at a port */
+    struct Value
+    {
+        PortType type;
+        union
+        {
+            Image image;
+            Point point;
+            PointList pointList;
+            Color color;
+            double factor;
+            timespec time;
+        };
+    };
+
+    /** how the output image depends on the input image */
+    enum Fusion
+    {
+        /** no row kernels - only process() */
+        FusionNone,
+        /** output pixel (x, y) depends on input pixel (x, y) only - see processRow() */
+        FusionPerPixel,
+        /** separable stencil - see processRowHorizontal() and processRowVertical() */
+        FusionSeparableStencil
+    };
+
+    struct Port
+    {
+        std::string name;
+        PortType type;
+        /** for image outputs: index of an image input of the same format, which the host
+            may pass as this output too - processing in place. -1 if the filter needs distinct memory */
+        int inPlaceInput;
+    };
+
+    /* *** the descriptor - what the host learns about a filter without loading its plugin *** */
+
+    /** changes with every field appended to Descriptor */
+    static const unsigned int DescriptorVersion = 1;
+    static const unsigned int MaxDescriptorPorts = 8;
+    static const unsigned int MaxDescriptorPixelFormats = 8;
+
+    /** instruction set extensions */
+    enum Simd
+    {
+        SimdSse2 = 1,
+        SimdSse41 = 2,
+        SimdAvx = 4,
+        SimdAvx2 = 8,
+        SimdNeon = 16
+    };
+
+    enum DescriptorFlags
+    {
+        /** the outputs depend on the current inputs only, nothing is carried from frame to frame */
+        FlagStateless = 1,
+        /** process() may run on several frames at the same time */
+        FlagReentrant = 2
+    };
+
+    struct PortDescriptor
+    {
+        char name[32];
+        /** PortType */
+        unsigned int type;
+        /** see Port */
+        int inPlaceInput;
+    };
+
+    /**
+     * exported by the plugin as filterDescriptor
+     *
+     * Plain data without pointers, so the host reads it straight out of the file - there is
+     * nothing to relocate. Fields are only ever appended: the host takes the first 'size'
+     * bytes and zeroes the rest.
+     */
+    struct Descriptor
+    {
+        /** DescriptorVersion of the plugin */
+        unsigned int version;
+        /** sizeof(Descriptor) of the plugin */
+        unsigned int size;
+        /** the same as name() */
+        char name[64];
+        /** the ports as added in the constructor */
+        unsigned int inputCount;
+        PortDescriptor inputs[MaxDescriptorPorts];
+        unsigned int outputCount;
+        PortDescriptor outputs[MaxDescriptorPorts];
+        /** fourcc codes the first image input takes, 0 terminated - none for any */
+        unsigned int inputPixelFormats[MaxDescriptorPixelFormats];
+        /** fourcc code of the first image output, 0 for the one of the first image input */
+        unsigned int outputPixelFormat;
+        /** Fusion */
+        unsigned int fusion;
+        /** Simd flags of the instructions the plugin uses - FILTER_BUILD_SIMD */
+        unsigned int simd;
+        /** DescriptorFlags */
+        unsigned int flags;
+    };
+
+
 protected:
     BaseFilter();
 public:
     virtual ~BaseFilter();
     BaseFilter(const BaseFilter&) = delete;
     BaseFilter& operator=(const BaseFilter&) = delete;
+
+    /** @returns something like "example filter" */
+    virtual std::string name() const = 0;
+
+    const std::vector<Port> &inputPorts() const;
+    const std::vector<Port> &outputPorts() const;
+
+    /**
+     * @param inputs one value per input port, image data may be 0
+     * @param outputs one value per output port, types preset by the host - the filter sets
+     *    the format of images and the capacity of point lists
+     * @returns false if the filter cannot process these inputs
+     */
+    virtual bool prepare(const Value *inputs, Value *outputs) = 0;
+
+    /**
+     * @param inputs one value per input port
+     * @param outputs one value per output port, as set up by the last prepare() and allocated by the host
+     * @note must not allocate
+     */
+    virtual void process(const Value *inputs, Value *outputs) = 0;
+
+    /* *** row kernels - for fusing filters, only called after prepare() *** */
+
+    /** Default: FusionNone */
+    virtual Fusion fusion() const;
+    /** half the size of the stencil for FusionSeparableStencil, e.g. 1 for 3x3 */
+    virtual unsigned int stencilRadius() const;
+    /** FusionPerPixel: one row of width pixels, in and out in the prepared formats */
+    virtual void processRow(const unsigned char *in, unsigned char *out, unsigned int width);
+    /** FusionSeparableStencil: horizontal pass over an input row, out in the output format */
+    virtual void processRowHorizontal(const unsigned char *in, unsigned char *out, unsigned int width);
+    /** FusionSeparableStencil: vertical pass
+        @param rows 2 * stencilRadius() + 1 horizontally filtered rows centered on the output row,
+            repeating the first/last row at the borders */
+    virtual void processRowVertical(const unsigned char * const *rows, unsigned char *out, unsigned int width);
+
+    /* *** state handed over, when the plugin is reloaded - see FilterGraph::replaceFilter() *** */
+
+    /** called on the old filter, between frames
+        @returns false (default) if the filter has no state to hand over */
+    virtual bool saveState(std::vector<unsigned char> &state) const;
+    /** called on the new filter, before its first prepare() - the state may come from an
+        older build of the plugin
+        @returns false (default) if the state is not taken */
+    virtual bool restoreState(const std::vector<unsigned char> &state);
+
+protected:
+    /** @returns the index of the port */
+    unsigned int addInputPort(const std::string &name, PortType);
+    unsigned int addOutputPort(const std::string &name, PortType, int inPlaceInput = -1);
+
 private:
+    std::vector<Port> m_inputPorts;
+    std::vector<Port> m_outputPorts;
 };
 
 
 #endif /* BASE_FILTER_HPP */
-
@@ -18,14 +18,20 @@
 
 #include "capturedevice.hpp"
 
+#include "capturereactor.hpp"
+#include "framepool.hpp"
+#include "pixelformat.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cerrno>
-#include <cmath>
 #include <cstring>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <thread>
 #include <vector>
 
@@ -33,19 +39,59 @@
 
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 using namespace std;
 
 
+/** buffers, which stay queued in the driver in addition to the ones in the ring (IoMethodMmap) */
+static const unsigned int driverQueuedBufferCount = 2;
+
+
+static long long nanoseconds(const timespec &time)
+{
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+
+static timespec timespecOf(long long nanoseconds)
+{
+    timespec ret;
+    ret.tv_sec = nanoseconds / 1000000000LL;
+    ret.tv_nsec = nanoseconds % 1000000000LL;
+    if (ret.tv_nsec < 0) {
+        ret.tv_nsec += 1000000000LL;
+        --ret.tv_sec;
+    }
+    return ret;
+}
+
+
 CaptureDevice::CaptureDevice() :
         m_captureHeight(0),
         m_captureWidth(0),
+        m_pixelFormat(V4L2_PIX_FMT_RGB24),
+        m_bytesPerLine(0),
         m_bufferCount(2),
         m_fileDescriptor(-1),
+        m_ioMethod(IoMethodRead),
+        m_bufferSize(0),
+        m_timestampSource(TimestampCaptured),
+        m_frameNumbered(false),
+        m_lastFrameNumber(0),
+        m_lastFrameTime({0, 0}),
+        m_droppedFrames(0),
         m_captureThread(0),
+        m_captureThreadCancellationFlag(false),
+        m_captureFailed(false),
+        m_scratchBuffer(0),
+        m_discardedFrames(0),
+        m_captureReactor(0),
+        m_activeCaptureReactor(0),
         m_capturingPaused(false)
 {
     // cerr << __PRETTY_FUNCTION__ << endl;
@@ -79,6 +125,22 @@ pair<unsigned int, unsigned int> CaptureDevice::captureSize() const
 }
 
 
+void CaptureDevice::setPixelFormat(__u32 pixelFormat)
+{
+    assert(pixelFormat != 0);
+
+    m_pixelFormat = pixelFormat;
+}
+__u32 CaptureDevice::pixelFormat() const
+{
+    return m_pixelFormat;
+}
+unsigned int CaptureDevice::bytesPerLine() const
+{
+    return m_bytesPerLine;
+}
+
+
 void CaptureDevice::setFileName(const std::string& name)
 {
     assert(name.empty() == false);
@@ -103,16 +165,39 @@ unsigned int CaptureDevice::bufferCount() const
 }
 
 
+CaptureDevice::IoMethod CaptureDevice::ioMethod() const
+{
+    return m_ioMethod;
+}
+
+
+CaptureDevice::TimestampSource CaptureDevice::timestampSource() const
+{
+    return m_timestampSource;
+}
+
+
+unsigned long long CaptureDevice::droppedFrames() const
+{
+    return m_droppedFrames;
+}
+
+
 bool CaptureDevice::init()
 {
     // cerr << __PRETTY_FUNCTION__ << endl;
-    assert(m_fileName.empty() == false);
-    assert(m_captureWidth > 0);
-    assert(m_captureHeight > 0);
     assert(m_fileDescriptor == -1);
     assert(m_bufferCount > 1);
 
     m_captureThreadCancellationFlag = false;
+    m_captureFailed = false;
+    m_discardedFrames = 0;
+    m_timestampSource = TimestampCaptured;
+    m_frameNumbered = false;
+    m_lastFrameNumber = 0;
+    m_droppedFrames = 0;
+    m_rateEstimator.reset();
+    m_publishLatency.reset();
 
     /* *** initialize timer *** */
     int clockret = clock_gettime(CLOCK_MONOTONIC, &m_timerStart);
@@ -130,17 +215,40 @@ bool CaptureDevice::init()
     }
 
 
+    if (initSource() == false) {
+        finish(); return false;
+    }
+
+    /* every picture is described by its buffer, consumers need not ask us */
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+        it->bytesUsed = 0;
+        it->pixelFormat = m_pixelFormat;
+        it->width = m_captureWidth;
+        it->height = m_captureHeight;
+        it->bytesPerLine = m_bytesPerLine;
+    }
+
+    return true;
+}
+
+
+bool CaptureDevice::initSource()
+{
+    assert(m_fileName.empty() == false);
+    assert(m_captureWidth > 0);
+    assert(m_captureHeight > 0);
+
     /* *** open the device file *** */
     struct stat st;
 
     if (stat(m_fileName.c_str(), &st) == -1) {
         cerr << __PRETTY_FUNCTION__ << " Cannot identify file. " << errno << " " << strerror(errno) << endl;
-        finish(); return false;
+        return false;
     }
 
     if (!S_ISCHR (st.st_mode)) {
         cerr << "File is no device."  << endl;
-        finish(); return false;
+        return false;
     }
 
     m_fileAccessMutex.lock();
@@ -149,7 +257,7 @@ bool CaptureDevice::init()
 
     if (m_fileDescriptor == -1) {
         cerr << "Cannot open file. " << errno << " " << strerror (errno) << endl;
-        finish(); return false;
+        return false;
     }
 
    
@@ -159,21 +267,25 @@ bool CaptureDevice::init()
     if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_QUERYCAP, &cap) == -1) {
         if (EINVAL == errno) {
             cerr << "File is no V4L2 device." << endl;
-            finish(); return false;
+            return false;
         } else {
             cerr << __PRETTY_FUNCTION__ << " VIDIOC_QUERYCAP " << errno << " " << strerror(errno) << endl;
-            finish(); return false;
+            return false;
         }
     }
 
     if (!(cap.capabilities  &V4L2_CAP_VIDEO_CAPTURE)) {
         cerr << "File is no video capture device." << endl;
-        finish(); return false;
+        return false;
     }
 
-    if (!(cap.capabilities  &V4L2_CAP_READWRITE)) {
-        cerr << "File does not support read i/o." << endl;
-        finish(); return false;
+    if (cap.capabilities & V4L2_CAP_STREAMING) {
+        m_ioMethod = IoMethodMmap;
+    } else if (cap.capabilities & V4L2_CAP_READWRITE) {
+        m_ioMethod = IoMethodRead;
+    } else {
+        cerr << "File does support neither streaming nor read i/o." << endl;
+        return false;
     }
 
 
@@ -195,51 +307,157 @@ bool CaptureDevice::init()
     fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     fmt.fmt.pix.width = m_captureWidth;
     fmt.fmt.pix.height = m_captureHeight;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+    fmt.fmt.pix.pixelformat = m_pixelFormat;
     fmt.fmt.pix.field = V4L2_FIELD_NONE;
 
     if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_S_FMT, &fmt) == -1) {
         cerr << __PRETTY_FUNCTION__ << " VIDIOC_S_FMT " << errno << " " << strerror(errno) << endl;
-        finish(); return false;
+        return false;
     }
 
     if (fmt.fmt.pix.width != m_captureWidth || fmt.fmt.pix.height != m_captureHeight ||
-            fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_RGB24 ||
+            fmt.fmt.pix.pixelformat != m_pixelFormat ||
             fmt.fmt.pix.field != V4L2_FIELD_NONE) {
 
         cerr << "Your parameters were changed: "
                 << m_captureWidth << "x" << m_captureHeight << " in "
-                << pixelFormatString(V4L2_PIX_FMT_RGB24) << ", fieldFormat " << V4L2_FIELD_NONE << " -> ";
+                << pixelFormatString(m_pixelFormat) << ", fieldFormat " << V4L2_FIELD_NONE << " -> ";
 
         m_captureWidth = fmt.fmt.pix.width;
         m_captureHeight = fmt.fmt.pix.height;
+        m_pixelFormat = fmt.fmt.pix.pixelformat;
 
         cerr << m_captureWidth << "x" << m_captureHeight << " in "
                 << pixelFormatString(fmt.fmt.pix.pixelformat) << ", fieldFormat " << fmt.fmt.pix.field<< endl;
     }
 
 
-    /* Buggy driver paranoia. */
-    unsigned int min;
-    min = fmt.fmt.pix.width * 2;
-    if (fmt.fmt.pix.bytesperline < min)
-        fmt.fmt.pix.bytesperline = min;
-    min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
-    if (fmt.fmt.pix.sizeimage < min)
-        fmt.fmt.pix.sizeimage = min;
+    /* Buggy driver paranoia. Compressed formats have no stride, sizeimage is
+       the driver's upper bound for a picture then. */
+    unsigned int minimumBytesPerLine = PixelFormat::minimumBytesPerLine(fmt.fmt.pix.pixelformat, fmt.fmt.pix.width);
+    if (minimumBytesPerLine != 0) {
+        if (fmt.fmt.pix.bytesperline < minimumBytesPerLine)
+            fmt.fmt.pix.bytesperline = minimumBytesPerLine;
+        size_t minimumImageSize = PixelFormat::imageSize(fmt.fmt.pix.pixelformat,
+                fmt.fmt.pix.bytesperline, fmt.fmt.pix.height);
+        if (fmt.fmt.pix.sizeimage < minimumImageSize)
+            fmt.fmt.pix.sizeimage = minimumImageSize;
+    } else if (fmt.fmt.pix.sizeimage == 0) {
+        cerr << __PRETTY_FUNCTION__ << " The driver reports no image size for "
+                << pixelFormatString(fmt.fmt.pix.pixelformat) << "." << endl;
+        return false;
+    }
 
     m_bufferSize = fmt.fmt.pix.sizeimage;
+    m_bytesPerLine = fmt.fmt.pix.bytesperline;
 
     /* *** allocate buffers *** */
-    for (unsigned int a=0; a < m_bufferCount; ++a) {
-        m_buffers.push_front(Buffer());
+    if (m_ioMethod == IoMethodMmap) return initMmap();
+
+    m_scratchBuffer = FramePool::instance().allocate(m_bufferSize);
+    if (m_scratchBuffer == 0) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot allocate " << m_bufferSize << " bytes." << endl;
+        return false;
+    }
+    return initMemoryBuffers();
+}
 
-        m_buffers.front().time = {numeric_limits<time_t>::min(), 0};
-        m_buffers.front().readerCount = 0;
-        m_buffers.front().buffer = (unsigned char*) malloc(sizeof(unsigned char)*m_bufferSize); 
-        assert(m_buffers.front().buffer != 0);
 
-        m_timelySortedBuffers.push_back(&(m_buffers.front()));
+bool CaptureDevice::initMemoryBuffers()
+{
+    m_buffers.resize(m_bufferCount);
+
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+        it->time = {numeric_limits<time_t>::min(), 0};
+        it->readerCount = 0;
+        it->buffer = 0;
+        it->length = 0;
+        it->index = it - m_buffers.begin();
+    }
+
+    /* the buffers of the last initialization, if nothing else took them meanwhile */
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+        it->buffer = FramePool::instance().allocate(m_bufferSize);
+        if (it->buffer == 0) {
+            cerr << __PRETTY_FUNCTION__ << " Cannot allocate " << m_bufferSize << " bytes." << endl;
+            return false;
+        }
+        it->length = m_bufferSize;
+    }
+
+    m_ring.setBuffers(&m_buffers[0], m_buffers.size());
+
+    return true;
+}
+
+
+bool CaptureDevice::initMmap()
+{
+    struct v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(v4l2_requestbuffers));
+
+    request.count = m_bufferCount + driverQueuedBufferCount;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+
+    if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_REQBUFS, &request) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " VIDIOC_REQBUFS " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    /* at least one buffer has to stay with the driver, while readers hold the ring */
+    if (request.count <= m_bufferCount) {
+        cerr << "Insufficient buffer memory. Got " << request.count << " driver buffers." << endl;
+        return false;
+    }
+
+    /* the buffers are pointed to from the ring -> never reallocate after this point */
+    m_buffers.resize(request.count);
+
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+
+        struct v4l2_buffer driverBuffer;
+        memset(&driverBuffer, 0, sizeof(v4l2_buffer));
+
+        driverBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        driverBuffer.memory = V4L2_MEMORY_MMAP;
+        driverBuffer.index = it - m_buffers.begin();
+
+        it->time = {numeric_limits<time_t>::min(), 0};
+        it->readerCount = FrameRing::Claimed; /* owned by the driver */
+        it->buffer = 0;
+        it->length = 0;
+        it->index = driverBuffer.index;
+
+        if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_QUERYBUF, &driverBuffer) == -1) {
+            cerr << __PRETTY_FUNCTION__ << " VIDIOC_QUERYBUF " << errno << " " << strerror(errno) << endl;
+            return false;
+        }
+
+        m_fileAccessMutex.lock();
+        void *start = v4l2_mmap(0, driverBuffer.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                m_fileDescriptor, driverBuffer.m.offset);
+        m_fileAccessMutex.unlock();
+
+        if (start == MAP_FAILED) {
+            cerr << __PRETTY_FUNCTION__ << " Cannot map buffer. " << errno << " " << strerror(errno) << endl;
+            return false;
+        }
+
+        it->buffer = (unsigned char*) start;
+        it->length = driverBuffer.length;
+    }
+
+    /* the ring starts out empty, all buffers are owned by the driver */
+    m_ring.setBuffers(&m_buffers[0], m_buffers.size());
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+        if (queueBuffer(&(*it)) == false) return false;
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_STREAMON, &type) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " VIDIOC_STREAMON " << errno << " " << strerror(errno) << endl;
+        return false;
     }
 
     return true;
@@ -249,11 +467,32 @@ bool CaptureDevice::init()
 void CaptureDevice::finish()
 {
     /* *** stop capturing *** */
-    if (m_captureThread != 0) {
+    if (isCapturing() == true) {
         stopCapturing();
     }
 
 
+    m_ring.setBuffers(0, 0);
+    finishSource();
+    m_bufferSize = 0;
+    m_bytesPerLine = 0;
+}
+
+
+void CaptureDevice::finishSource()
+{
+    /* *** free buffers *** */
+    if (m_buffers.empty() == false) {
+        if (m_ioMethod == IoMethodMmap) {
+            finishMmap();
+        } else {
+            finishMemoryBuffers();
+        }
+    }
+    FramePool::instance().release(m_scratchBuffer);
+    m_scratchBuffer = 0;
+
+
     /* *** close device *** */
     if (m_fileDescriptor != -1) {
         m_fileAccessMutex.lock();
@@ -264,17 +503,117 @@ void CaptureDevice::finish()
         }
         m_fileDescriptor = -1;
     }
+}
 
 
-    /* *** free buffers *** */
-    if (m_buffers.empty() == false) {
-        for (auto a = m_buffers.begin(); a != m_buffers.end(); ++a) {
-            assert(a->buffer != 0);
-            free (a->buffer); a->buffer = 0;
+void CaptureDevice::finishMemoryBuffers()
+{
+    for (auto a = m_buffers.begin(); a != m_buffers.end(); ++a) {
+        FramePool::instance().release(a->buffer); a->buffer = 0;
+    }
+    m_buffers.clear();
+}
+
+
+bool CaptureDevice::initFrameTimer(double framesPerSecond)
+{
+    assert(m_fileDescriptor == -1);
+    assert(framesPerSecond >= 0.0);
+
+    m_fileDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (m_fileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot create timer. " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    /* a zero interval would disarm the timer */
+    long long period = framesPerSecond > 0.0 ? (long long) (1000000000.0 / framesPerSecond) : 1;
+    if (period < 1) period = 1;
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = period / 1000000000;
+    spec.it_interval.tv_nsec = period % 1000000000;
+    spec.it_value = spec.it_interval;
+
+    if (timerfd_settime(m_fileDescriptor, 0, &spec, 0) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot arm timer. " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+bool CaptureDevice::armFrameTimer(const timespec &time)
+{
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value = time;
+
+    /* zero would disarm */
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+
+    if (timerfd_settime(m_fileDescriptor, TFD_TIMER_ABSTIME, &spec, 0) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot arm timer. " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+unsigned long long CaptureDevice::consumeFrameTimer()
+{
+    unsigned long long expirations = 0;
+    ssize_t readlen = read(m_fileDescriptor, &expirations, sizeof(expirations));
+
+    if (readlen == -1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            cerr << __PRETTY_FUNCTION__ << " Read error. " << errno << " " << strerror(errno) << endl;
         }
-        m_buffers.clear();
+        return 0;
     }
-    m_bufferSize = 0;
+
+    return expirations;
+}
+
+
+void CaptureDevice::finishFrameTimer()
+{
+    if (m_fileDescriptor != -1) {
+        close(m_fileDescriptor);
+        m_fileDescriptor = -1;
+    }
+}
+
+
+void CaptureDevice::finishMmap()
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xv4l2_ioctl(m_fileDescriptor, VIDIOC_STREAMOFF, &type); /* ignore errors, maybe never started */
+
+    for (auto a = m_buffers.begin(); a != m_buffers.end(); ++a) {
+        if (a->buffer == 0) continue;
+
+        m_fileAccessMutex.lock();
+        int ret = v4l2_munmap(a->buffer, a->length);
+        m_fileAccessMutex.unlock();
+        if (ret == -1) {
+            cerr << __PRETTY_FUNCTION__ << " Cannot unmap buffer. " << errno << " " << strerror(errno) << endl;
+        }
+        a->buffer = 0;
+    }
+
+    /* release the driver buffers */
+    struct v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(v4l2_requestbuffers));
+    request.count = 0;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    xv4l2_ioctl(m_fileDescriptor, VIDIOC_REQBUFS, &request); /* ignore errors */
+
+    m_buffers.clear();
 }
 
 
@@ -283,6 +622,11 @@ void CaptureDevice::printDeviceInfo()
     // cerr << __PRETTY_FUNCTION__ << endl;
     assert(m_fileDescriptor != -1);
 
+    if (m_ioMethod == IoMethodGenerated) {
+        cout << "Device info:" << endl << "  no device, generated frames" << endl;
+        return;
+    }
+
 	struct v4l2_capability cap;
 	/* check capabilities */
 	if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_QUERYCAP, &cap) == -1) {
@@ -505,86 +849,305 @@ void CaptureDevice::printFormats()
 }
 
 
-deque<const CaptureDevice::Buffer*> CaptureDevice::lockFirstNBuffers(unsigned int n)
+list<struct v4l2_fmtdesc> CaptureDevice::pixelFormats()
 {
-    std::deque<const Buffer*> ret;
+    assert(m_fileDescriptor != -1);
+
+    list<struct v4l2_fmtdesc> ret;
+    if (m_ioMethod == IoMethodGenerated) return ret;
 
-    m_timelySortedBuffersMutex.lock();
-    unsigned int a = 0;
-    for (auto it = m_timelySortedBuffers.begin(); a < n && it != m_timelySortedBuffers.end(); ++it, ++a) {
+    for (__u32 index = 0;; ++index) {
+        struct v4l2_fmtdesc format;
+        memset(&format, 0, sizeof(v4l2_fmtdesc));
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.index = index;
 
-        ret.push_back(*it);
-        ++(*it)->readerCount;
+        /* plain ioctl - libv4l would add the formats it converts to */
+        m_fileAccessMutex.lock();
+        int ioctlError = ioctl(m_fileDescriptor, VIDIOC_ENUM_FMT, &format);
+        m_fileAccessMutex.unlock();
 
+        if (ioctlError != 0) break;
+        ret.push_back(format);
     }
-    m_timelySortedBuffersMutex.unlock();
+
+    return ret;
+}
 
 
+unsigned int CaptureDevice::lockFirstNBuffers(unsigned int n, FrameHandle *handles)
+{
+    assert(n < m_bufferCount);
+    return m_ring.lockNewest(n, handles);
+}
+
+
+CaptureDevice::FrameHandle CaptureDevice::lockNewestBuffer()
+{
+    FrameHandle ret;
+    m_ring.lockNewest(1, &ret);
     return ret;
 }
 
 
-void CaptureDevice::unlock(const deque<const Buffer*> &buffers)
+unsigned int CaptureDevice::lockNewerBuffers(unsigned long long *sequence, unsigned int n, FrameHandle *handles)
 {
-    m_timelySortedBuffersMutex.lock();
-    for (auto it = buffers.begin(); it != buffers.end(); ++it) {
-        for (auto it2 = m_timelySortedBuffers.begin(); it2 != m_timelySortedBuffers.end(); ++it2) {
+    assert(n < m_bufferCount);
+    assert(sequence != 0);
 
-            if (*it == *it2) {
-                --((*it2)->readerCount);
-                assert((*it2)->readerCount >= 0);
-            }
+    unsigned int ret = m_ring.lockNewer(*sequence, n, handles);
+    if (ret > 0) *sequence = handles[ret-1]->sequence;
+    return ret;
+}
+
+
+unsigned long long CaptureDevice::publishedSequence() const
+{
+    return m_ring.publishedSequence();
+}
+
+
+unsigned int CaptureDevice::newerBuffersAvailable(const timespec &newerThan)
+{
+    return m_ring.newerThan(newerThan);
+}
+
+
+void CaptureDevice::subscribe(FrameNotifier *notifier)
+{
+    assert(notifier != 0);
+
+    m_subscribersMutex.lock();
+    assert(find(m_subscribers.begin(), m_subscribers.end(), notifier) == m_subscribers.end());
+    m_subscribers.push_back(notifier);
+    m_subscribersMutex.unlock();
+}
+
+
+void CaptureDevice::unsubscribe(FrameNotifier *notifier)
+{
+    m_subscribersMutex.lock();
+    auto it = find(m_subscribers.begin(), m_subscribers.end(), notifier);
+    if (it != m_subscribers.end()) m_subscribers.erase(it);
+    m_subscribersMutex.unlock();
+}
+
+
+void CaptureDevice::stampFrame(Buffer *buffer, unsigned long long frameNumber)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stampFrame(buffer, frameNumber, now, TimestampCaptured);
+}
+
+
+void CaptureDevice::stampFrame(Buffer *buffer, unsigned long long frameNumber, const timespec &time,
+        TimestampSource source)
+{
+    /* the clocks drift apart (NTP), so their offset is taken anew for every frame */
+    timespec monotonic, real;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    buffer->time = time;
+    buffer->realTime = timespecOf(nanoseconds(time) + nanoseconds(real) - nanoseconds(monotonic));
+    buffer->frameNumber = frameNumber;
+
+    if (m_frameNumbered == true && frameNumber > m_lastFrameNumber) {
+        if (frameNumber > m_lastFrameNumber + 1) {
+            __sync_add_and_fetch(&m_droppedFrames, frameNumber - m_lastFrameNumber - 1);
+        }
+
+        /* across dropped frames, the time is spread over the periods missed */
+        long long elapsed = nanoseconds(time) - nanoseconds(m_lastFrameTime);
+        if (elapsed > 0) {
+            m_rateEstimator.add(elapsed / 1e9 / (frameNumber - m_lastFrameNumber));
         }
     }
-    m_timelySortedBuffersMutex.unlock();
+    m_frameNumbered = true;
+    m_lastFrameNumber = frameNumber;
+    m_lastFrameTime = time;
+    m_timestampSource = source;
 }
 
 
-unsigned int CaptureDevice::newerBuffersAvailable(const timespec &newerThan)
+unsigned long long CaptureDevice::nextFrameNumber() const
 {
-    unsigned int ret = 0;
-    auto it = m_timelySortedBuffers.begin();
+    return m_frameNumbered == true ? m_lastFrameNumber + 1 : 0;
+}
+
 
-    m_timelySortedBuffersMutex.lock();
+void CaptureDevice::restartFrameNumbering()
+{
+    m_frameNumbered = false;
+}
 
-    // cerr << (*it)->time.tv_sec - newerThan.tv_sec << " " << (*it)->time.tv_nsec - newerThan.tv_nsec << endl;
 
-    for (; it != m_timelySortedBuffers.end(); ++it) {
-        if (((*it)->time.tv_sec < newerThan.tv_sec) ||
-                (((*it)->time.tv_sec == newerThan.tv_sec) && ((*it)->time.tv_nsec <= newerThan.tv_nsec))
-                ) {
-            break;
+void CaptureDevice::publish(Buffer *buffer)
+{
+    clock_gettime(CLOCK_MONOTONIC, &buffer->publishTime);
+    if (m_timestampSource != TimestampRecorded) {
+        m_publishLatency.record(nanoseconds(buffer->publishTime) - nanoseconds(buffer->time));
+    }
+
+    m_ring.publish(buffer);
+
+    /* only contended while somebody (un)subscribes */
+    m_subscribersMutex.lock();
+    for (auto it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+        (*it)->notify();
+    }
+    m_subscribersMutex.unlock();
+}
+
+
+void CaptureDevice::failCapturing()
+{
+    if (m_captureFailed == true) return;
+
+    cerr << "Capturing from " << m_fileName << " stopped, the device failed." << endl;
+    m_captureFailed = true;
+}
+
+
+bool CaptureDevice::queueBuffer(Buffer *buffer)
+{
+    assert(m_ioMethod == IoMethodMmap);
+
+    struct v4l2_buffer driverBuffer;
+    memset(&driverBuffer, 0, sizeof(v4l2_buffer));
+
+    driverBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    driverBuffer.memory = V4L2_MEMORY_MMAP;
+    driverBuffer.index = buffer->index;
+
+    if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_QBUF, &driverBuffer) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " VIDIOC_QBUF " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+CaptureDevice::Buffer *CaptureDevice::dequeueBuffer()
+{
+    assert(m_ioMethod == IoMethodMmap);
+
+    struct v4l2_buffer driverBuffer;
+    memset(&driverBuffer, 0, sizeof(v4l2_buffer));
+
+    driverBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    driverBuffer.memory = V4L2_MEMORY_MMAP;
+
+    if (xv4l2_ioctl(m_fileDescriptor, VIDIOC_DQBUF, &driverBuffer) == -1) {
+        if (errno == EAGAIN) {
+            /* nothing filled yet */
+            return 0;
         }
-        ++ret;
+        cerr << __PRETTY_FUNCTION__ << " VIDIOC_DQBUF " << errno << " " << strerror(errno) << endl;
+        failCapturing();
+        return 0;
+    }
+
+    assert(driverBuffer.index < m_buffers.size());
+    Buffer *buffer = &m_buffers[driverBuffer.index];
+    buffer->bytesUsed = driverBuffer.bytesused;
 
+    /* the driver counts in 32 bits - we do not wrap */
+    unsigned long long frameNumber = driverBuffer.sequence;
+    if (m_frameNumbered == true) {
+        frameNumber = m_lastFrameNumber + (__u32) (driverBuffer.sequence - (__u32) m_lastFrameNumber);
     }
-    m_timelySortedBuffersMutex.unlock();
 
-    return ret;
+    /* the driver's time is taken in the interrupt, without our scheduling in it - if it is
+       CLOCK_MONOTONIC. Older drivers take the wall clock, which may jump, those we do not trust */
+    TimestampSource source = TimestampCaptured;
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
+    if ((driverBuffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC &&
+            (driverBuffer.timestamp.tv_sec != 0 || driverBuffer.timestamp.tv_usec != 0)) {
+        source = TimestampDriverEndOfFrame;
+#ifdef V4L2_BUF_FLAG_TSTAMP_SRC_SOE
+        if ((driverBuffer.flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_SOE) {
+            source = TimestampDriverStartOfExposure;
+        }
+#endif
+    }
+#endif
+
+    if (source == TimestampCaptured) {
+        stampFrame(buffer, frameNumber);
+    } else {
+        timespec time;
+        time.tv_sec = driverBuffer.timestamp.tv_sec;
+        time.tv_nsec = driverBuffer.timestamp.tv_usec * 1000;
+        stampFrame(buffer, frameNumber, time, source);
+    }
+
+    return buffer;
+}
+
+
+void CaptureDevice::requeueOutdatedBuffers()
+{
+    unsigned long long newest = m_ring.publishedSequence();
+
+    /* everything behind the newest 'bufferCount' buffers belongs back to the driver, unless it is locked */
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+        if (it->sequence + m_bufferCount <= newest && m_ring.claim(&(*it)) == true) {
+            if (queueBuffer(&(*it)) == false) {
+                failCapturing();
+                return;
+            }
+        }
+    }
 }
 
 
-pair<double, double> CaptureDevice::determineCapturePeriod(double secondsToIterate)
+const RateEstimator &CaptureDevice::rateEstimator() const
 {
-    pair<double, double> ret;
+    return m_rateEstimator;
+}
 
-    thread t(bind(determineCapturePeriodThread, secondsToIterate, this, &ret));
-    t.join();
-    
-    return ret;
+
+const LatencyHistogram &CaptureDevice::publishLatency() const
+{
+    return m_publishLatency;
+}
+
+
+void CaptureDevice::setCaptureReactor(CaptureReactor *reactor)
+{
+    m_captureReactor = reactor;
+}
+CaptureReactor *CaptureDevice::captureReactor() const
+{
+    return m_captureReactor;
 }
 
 
 void CaptureDevice::startCapturing()
 {
-    assert(m_captureThread == 0);
-    m_captureThread = new thread(bind(captureThread, this));
+    assert(isCapturing() == false);
+
+    if (m_captureReactor != 0) {
+        m_activeCaptureReactor = m_captureReactor;
+        m_activeCaptureReactor->add(this);
+    } else {
+        m_captureThread = new thread(bind(captureThread, this));
+    }
 }
 
 
 void CaptureDevice::stopCapturing()
 {
-    if (m_captureThread != 0) {
+    if (m_activeCaptureReactor != 0) {
+
+        if (isCapturingPaused() == false) m_activeCaptureReactor->remove(this);
+        m_capturingPaused = false;
+        m_activeCaptureReactor = 0;
+
+    } else if (m_captureThread != 0) {
         assert(m_captureThread->joinable() == true);
 
         if (isCapturingPaused() == true) pauseCapturing(false);
@@ -601,7 +1164,7 @@ void CaptureDevice::stopCapturing()
 
 bool CaptureDevice::isCapturing() const
 {
-    return m_captureThread != 0;
+    return m_captureThread != 0 || m_activeCaptureReactor != 0;
 }
 
 
@@ -609,6 +1172,17 @@ void CaptureDevice::pauseCapturing(bool pause)
 {
     if (isCapturing() == false) return;
 
+    if (m_activeCaptureReactor != 0) {
+        /* the reactor just stops watching us */
+        if (pause == true && m_capturingPaused == false) {
+            m_activeCaptureReactor->remove(this);
+        } else if (pause == false && m_capturingPaused == true && m_captureFailed == false) {
+            m_activeCaptureReactor->add(this);
+        }
+        m_capturingPaused = pause;
+        return;
+    }
+
     if (pause == true ) {
         m_pauseCapturingMutex.try_lock();
         m_capturingPaused = true;
@@ -625,9 +1199,16 @@ bool CaptureDevice::isCapturingPaused() const
 }
 
 
+bool CaptureDevice::hasFailed() const
+{
+    return m_captureFailed;
+}
+
+
 pair<list<struct v4l2_queryctrl>, list<struct v4l2_querymenu> > CaptureDevice::controls()
 {
     pair<list<struct v4l2_queryctrl>, list<struct v4l2_querymenu> > ret;
+    if (m_ioMethod == IoMethodGenerated) return ret;
 
     struct v4l2_queryctrl ctl;
 
@@ -664,6 +1245,8 @@ pair<list<struct v4l2_queryctrl>, list<struct v4l2_querymenu> > CaptureDevice::c
 
 bool CaptureDevice::control(struct v4l2_control &ctl)
 {
+    if (m_ioMethod == IoMethodGenerated) return false;
+
     bool ret;
     /* which errors VIDIOC_G_CTRL can throw:
         http://www.linuxtv.org/downloads/video4linux/API/V4L2_API/spec-single/v4l2.html#VIDIOC-G-CTRL */
@@ -685,6 +1268,8 @@ bool CaptureDevice::control(struct v4l2_control &ctl)
 
 bool CaptureDevice::setControl(const struct v4l2_control &ctl)
 {
+    if (m_ioMethod == IoMethodGenerated) return false;
+
     bool ret;
     struct v4l2_control copiedCtl = ctl;
     /* which errors VIDIOC_S_CTRL can throw:
@@ -747,162 +1332,122 @@ list<v4l2_querymenu> CaptureDevice::menus(const struct v4l2_queryctrl &ctl)
 
 
 /* *** static functions ***************************************************** */
-void CaptureDevice::determineCapturePeriodThread(double secondsToIterate,
-        CaptureDevice *camera, std::pair<double,double> *ret)
+void CaptureDevice::captureThread(CaptureDevice *camera)
 {
+    Tracer::setThreadName("capture");
+
     int fileDescriptor = camera->m_fileDescriptor;
-    unsigned int bufferSize = camera->m_bufferSize;
-    void *buffer = malloc(camera->m_bufferSize);
-    std::mutex &fileAccessMutex = camera->m_fileAccessMutex;
+    std::mutex &pauseCapturingMutex = camera->m_pauseCapturingMutex;
     fd_set filedescriptorset;
     struct timeval tv;
     int sel;
-    ssize_t readlen;
-    vector<struct timespec> times;
 
 
-    for (;;) {
-        times.resize(times.size()+1);
-        clock_gettime(CLOCK_MONOTONIC, &times.back());
+    /* a failed device just stops its own thread, stopCapturing() joins it as usual */
+    while (camera->m_captureThreadCancellationFlag == false && camera->m_captureFailed == false) {
 
-        if (difftime(times.back().tv_sec, times.front().tv_sec) > secondsToIterate) {
-            break;
-        }
+        pauseCapturingMutex.lock();
+        pauseCapturingMutex.unlock();
 
         FD_ZERO(&filedescriptorset);
         FD_SET(fileDescriptor, &filedescriptorset);
-        tv.tv_sec = 2;
-        tv.tv_usec = 0;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
 
-        /* watch the file handle for new readable data */
+        /* watch the file handle for new readable data - no need to block the controls meanwhile */
         sel = select(fileDescriptor + 1, &filedescriptorset, 0, 0, &tv);
 
         if (sel == -1 && errno != EINTR) {
             cerr << __PRETTY_FUNCTION__ << " Select error. " << errno << " " << strerror(errno) << endl;
             abort();
         } else if (sel == 0) {
-            cerr << __PRETTY_FUNCTION__ << " Select timeout. " << errno << " " << strerror(errno) << endl;
-            abort();
-        }
-
-        /* read from the device */
-        fileAccessMutex.lock();
-        readlen = v4l2_read(fileDescriptor, buffer, bufferSize);
-        fileAccessMutex.unlock();
-
-        if (readlen == -1) {
-            cerr << __PRETTY_FUNCTION__ << " Read error. " << errno << " " << strerror(errno) << endl;
-            abort();
+            /* select timeout */
+            camera->captureIdle();
+            continue;
+        } else if (sel == -1) {
+            /* interrupted */
+            continue;
         }
-    }
-    free(buffer);
-
-
-    /* *** compute interval from timestamps *** */
-    vector<double> intervals;
-    for (auto a = times.begin(); a != (times.end()-1); ++a) {
-        auto b = a+1;
-        intervals.push_back(
-                (b->tv_sec + b->tv_nsec / 1000000000.0) -
-                (a->tv_sec + a->tv_nsec / 1000000000.0));
-    }
-
-    /* *** compute period *** */
-    double mean = 0.0;
-    for (auto a = intervals.begin(); a != intervals.end(); ++a) {
-        mean += *a;
-    }
-    mean /= intervals.size();
 
-    /* *** compute standard deviation **/
-    double addedSquares = 0.0;
-    for (auto a = intervals.begin(); a != intervals.end(); ++a) {
-        addedSquares = ((*a - mean) * (*a - mean));
+        VTN("capture")
+        camera->captureFrame();
     }
-    double standardDeviation = sqrt(addedSquares / intervals.size());
-
-    ret->first = mean;
-    ret->second = standardDeviation;
 }
 
 
-void CaptureDevice::captureThread(CaptureDevice *camera)
+void CaptureDevice::captureFrame()
 {
-    int fileDescriptor = camera->m_fileDescriptor;
-    unsigned int bufferSize = camera->m_bufferSize;
-    std::deque<Buffer*> &sortedBuffers = camera->m_timelySortedBuffers;
-    std::mutex &sortedBuffersMutex =  camera->m_timelySortedBuffersMutex;
-    std::mutex &fileAccessMutex = camera->m_fileAccessMutex;
-    std::mutex &pauseCapturingMutex = camera->m_pauseCapturingMutex;
-    fd_set filedescriptorset;
-    struct timeval tv;
-    int sel;
-    ssize_t readlen;
-
-
-    while (camera->m_captureThreadCancellationFlag == false) {
+    if (m_ioMethod == IoMethodMmap) {
+        /* stamped with the driver's time and sequence number */
+        Buffer *buffer = dequeueBuffer();
+        if (buffer == 0) return;
 
-        pauseCapturingMutex.lock();
-        pauseCapturingMutex.unlock();
+        /* no copy - the driver buffer itself becomes the newest picture taken */
+        publish(buffer);
 
-        FD_ZERO(&filedescriptorset);
-        FD_SET(fileDescriptor, &filedescriptorset);
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000;
+        requeueOutdatedBuffers();
+        return;
+    }
 
-        /* watch the file handle for new readable data */
-        fileAccessMutex.lock();
-        sel = select(fileDescriptor + 1, &filedescriptorset, 0, 0, &tv);
-        fileAccessMutex.unlock();
+    /* take the oldest unlocked buffer if possible - readers never block us */
+    Buffer *buffer = m_ring.claimOldest();
+    if (buffer == 0) {
+        /* every buffer is locked - the frame is read anyway and dropped, the device would stay
+           readable otherwise and we would spin */
+        m_fileAccessMutex.lock();
+        ssize_t readlen = v4l2_read(m_fileDescriptor, m_scratchBuffer, m_bufferSize);
+        m_fileAccessMutex.unlock();
 
-        if (sel == -1 && errno != EINTR) {
-            cerr << __PRETTY_FUNCTION__ << " Select error. " << errno << " " << strerror(errno) << endl;
-            abort();
-        } else if (sel == 0) {
-            /* select timeout */
-            continue;
+        if (readlen != -1) {
+            ++m_discardedFrames;
+        } else if (errno != EAGAIN) {
+            cerr << __PRETTY_FUNCTION__ << " Read error. " << errno << " " << strerror(errno) << endl;
+            failCapturing();
         }
+        return;
+    }
 
-        /* remove the last element if possible */
-        sortedBuffersMutex.lock();
 
-        if (sortedBuffers.back()->readerCount > 0) {
-            cerr << "no writeable buffer present. trying hard" << endl;
-            continue;
-        }
-        Buffer *buffer = sortedBuffers.back();
-        sortedBuffers.pop_back();
+    /* read from the device into the buffer - the frame is complete, since the device is readable.
+       Taken after the read, the time would contain the copy and the wait for the lock */
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    m_fileAccessMutex.lock();
+    ssize_t readlen = v4l2_read(m_fileDescriptor, buffer->buffer, m_bufferSize);
+    m_fileAccessMutex.unlock();
 
-        sortedBuffersMutex.unlock();
+    if (readlen == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Read error. " << errno << " " << strerror(errno);
+        if (errno != EAGAIN) {
+            cerr << endl;
+            m_ring.unclaim(buffer);
+            failCapturing();
+            return;
+        }
+        /* ignore Resource temporarily not available errors and just try again */
+        cerr << ". ignored" << endl;
 
+        /* nothing new in there, keep the old picture */
+        m_ring.unclaim(buffer);
+        return;
+    }
+    buffer->bytesUsed = readlen;
 
-        /* read from the device into the buffer */
-        clock_gettime(CLOCK_MONOTONIC, &(buffer->time));
-        fileAccessMutex.lock();
-        readlen = v4l2_read(fileDescriptor, buffer->buffer, bufferSize);
-        fileAccessMutex.unlock();
+    /* only a frame actually read is counted */
+    stampFrame(buffer, nextFrameNumber() + m_discardedFrames, time, TimestampCaptured);
+    m_discardedFrames = 0;
 
-        if (readlen == -1) {
-            cerr << __PRETTY_FUNCTION__ << " Read error. " << errno << " " << strerror(errno);
-            if (errno != EAGAIN) {
-                cerr << endl;
-                /* ignore Resource temporarily not available errors and just try again */
-                abort();
-            }
-            cerr << ". ignored" << endl;
-        }
 
+    /* the newly read buffer becomes the newest picture taken */
+    publish(buffer);
+}
 
-        /* insert the newly read buffer as first element - newest picture taken */
-        sortedBuffersMutex.lock();
-        sortedBuffers.push_front(buffer);
-        sortedBuffersMutex.unlock();
 
-        /*cerr << "wrote ";
-        for (auto it = sortedBuffers.begin(); it != sortedBuffers.end(); ++it) {
-            cerr << (*it)->time.tv_sec << " " << *it << ", ";
-        }
-        cerr << endl;*/
+void CaptureDevice::captureIdle()
+{
+    if (m_ioMethod == IoMethodMmap) {
+        /* readers may have released buffers meanwhile, the driver might be starving */
+        requeueOutdatedBuffers();
     }
 }
 
@@ -933,3 +1478,13 @@ string CaptureDevice::pixelFormatString(__u32 pixelFormat)
     return  ret;
 }
 
+
+__u32 CaptureDevice::pixelFormatFromString(const string &name)
+{
+    if (name.empty() == true || name.length() > 4) return 0;
+
+    /* short codes like "Y16" are padded with spaces */
+    string padded = name + string(4 - name.length(), ' ');
+    return v4l2_fourcc(padded[0], padded[1], padded[2], padded[3]);
+}
+
@@ -21,16 +21,23 @@
 
 #include "prereqs.hpp"
 
+#include "framenotifier.hpp"
+#include "framering.hpp"
+#include "latencyhistogram.hpp"
+#include "rateestimator.hpp"
+
 #include <ctime>
-#include <deque>
 #include <list>
 #include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <linux/videodev2.h>
 #include <sys/time.h>
 
+class CaptureReactor;
+
 namespace std
 {
     class thread;
@@ -41,24 +48,48 @@ namespace std
  * @note
  *    changes to most of the settings will take effect when newly initializing the
  *    capture device
+ *
+ * Captures from a V4L2 device. Sources without a device (see SyntheticCaptureDevice,
+ * FileCaptureDevice) derive from it and replace initSource(), finishSource(), captureFrame()
+ * and captureIdle(); everything else - ring, subscribers, threading, reactor - is shared.
  */
 class CaptureDevice
 {
 public:
 
-    struct Buffer
+    typedef FrameRing::Buffer Buffer;
+    /** @see FrameRing::Handle */
+    typedef FrameRing::Handle FrameHandle;
+
+    /** how frames get from the driver into the buffers */
+    enum IoMethod
+    {
+        /** v4l2_read() into buffers owned by us - one copy per frame */
+        IoMethodRead,
+        /** driver buffers mapped into our address space - no copy */
+        IoMethodMmap,
+        /** no device, the source produces the frames into buffers owned by us */
+        IoMethodGenerated
+    };
+
+    /** who took the time of the frames */
+    enum TimestampSource
     {
-        timespec time;
-        /** if 0 -> writeable, readable; if > 0 -> readable */
-        int readerCount;
-        unsigned char *buffer;
+        /** we did, as soon as the frame was ready to be read */
+        TimestampCaptured,
+        /** the driver did, at the end of the frame */
+        TimestampDriverEndOfFrame,
+        /** the driver did, at the start of the exposure */
+        TimestampDriverStartOfExposure,
+        /** the frames are replayed, the times are the recorded ones */
+        TimestampRecorded
     };
 
 
     CaptureDevice();
     CaptureDevice(const CaptureDevice&) = delete;
     CaptureDevice(CaptureDevice&&) = delete;
-    ~CaptureDevice();
+    virtual ~CaptureDevice();
     CaptureDevice &operator=(const CaptureDevice&) = delete;
     CaptureDevice &operator=(CaptureDevice&&) = delete;
 
@@ -69,6 +100,16 @@ public:
     void setCaptureSize(unsigned int width, unsigned int height);
     std::pair<unsigned int, unsigned int> captureSize() const;
 
+    /** fourcc code, see V4L2_PIX_FMT_*. Default: V4L2_PIX_FMT_RGB24
+        @note
+        Anything but a format of the device itself (see pixelFormats()) gets converted
+        by libv4l on the capture thread.
+        @note possibly changed during initialization by the device */
+    void setPixelFormat(__u32 pixelFormat);
+    __u32 pixelFormat() const;
+    /** @note valid after initialization */
+    unsigned int bytesPerLine() const;
+
     void setFileName(const std::string&);
     const std::string &fileName() const;
 
@@ -76,9 +117,20 @@ public:
     void setBufferCount(unsigned int);
     unsigned int bufferCount() const;
 
+    /** @note chosen during initialization - streaming if the device supports it, read otherwise,
+        IoMethodGenerated for sources without a device */
+    IoMethod ioMethod() const;
+
+    /** @note known after the first frame */
+    TimestampSource timestampSource() const;
+    /** @returns number of frames the source dropped before they reached the ring - the gaps
+            in Buffer::frameNumber since init()
+        @note frames skipped by the ring because consumers were slow are not counted */
+    unsigned long long droppedFrames() const;
+
     /**
-     * @pre captureSize() has to be set
-     * @pre fileName() has to be set
+     * @pre captureSize() has to be set - unless the source knows it
+     * @pre fileName() has to be set - unless the source needs none
      * @returns true on success, false on failure
      *
      * @note on failure, finish() is called implicitly
@@ -88,18 +140,47 @@ public:
     void finish();
 
 
-    /** n has to be less than  'buffersCount' */
-    std::deque<const Buffer*> lockFirstNBuffers(unsigned int n);
-    void unlock(const std::deque<const Buffer*> &buffers);
+    /** locks the n newest buffers, newest first, into handles[0..n-1]
+        @returns the number of buffers actually locked, the remaining handles are reset
+        @note n has to be less than 'bufferCount' */
+    unsigned int lockFirstNBuffers(unsigned int n, FrameHandle *handles);
+    /** @returns the newest buffer or a null handle, if nothing has been captured so far */
+    FrameHandle lockNewestBuffer();
+    /** locks the buffers published after *sequence, oldest first, into handles[0..n-1], and
+        advances *sequence to the last one locked - of more than n the n newest, the ones gone
+        already show up as gaps in the sequence numbers
+        @returns the number of buffers actually locked, the remaining handles are reset
+        @note n has to be less than 'bufferCount' - a consumer of every frame calls this
+        whenever notified, starting with publishedSequence() */
+    unsigned int lockNewerBuffers(unsigned long long *sequence, unsigned int n, FrameHandle *handles);
+    /** @returns the sequence number of the newest buffer, 0 if nothing has been captured so far */
+    unsigned long long publishedSequence() const;
     /** @returns number of newer buffers
         @note
         When actually locking the buffer this number might differ due to threading.
         It can be larger, or it can be n-1, when previously n */
     unsigned int newerBuffersAvailable(const timespec &newerThan);
 
-    /** @returns average period for capturing an image and the standard deviation
-        @note blocks for several seconds */
-    std::pair<double, double> determineCapturePeriod(double secondsToIterate = 5.0);
+    /** @returns the pixel formats the device delivers without conversion, none without a device */
+    std::list<struct v4l2_fmtdesc> pixelFormats();
+
+    /** the notifier gets notified each time a new buffer has been published
+        @note the notifier has to stay alive until it is unsubscribed */
+    void subscribe(FrameNotifier*);
+    void unsubscribe(FrameNotifier*);
+
+    /** period and jitter of the frames captured since init(), from their timestamps -
+        periods of dropped frames are left out
+        @note cheap and never blocks, see RateEstimator */
+    const RateEstimator &rateEstimator() const;
+    /** time from taking the frames (Buffer::time) to publishing them, since init() - with
+        driver timestamps the way through the driver and into the ring, none for recordings */
+    const LatencyHistogram &publishLatency() const;
+
+    /** capture through the reactor instead of an own thread, 0 (default) for an own thread
+        @note takes effect with the next startCapturing() */
+    void setCaptureReactor(CaptureReactor*);
+    CaptureReactor *captureReactor() const;
 
     void startCapturing();
     void stopCapturing();
@@ -107,8 +188,13 @@ public:
 
     void pauseCapturing(bool pause);
     bool isCapturingPaused() const;
+    /** @returns true if capturing stopped on its own, because the device failed - e.g. it was
+            unplugged. The other devices go on, stopCapturing() still has to be called
+        @note reset by init() */
+    bool hasFailed() const;
 
-    /** @returns all controls and control menu items, which the capture device provides
+    /** @returns all controls and control menu items, which the capture device provides,
+            none without a device
         @see http://www.linuxtv.org/downloads/video4linux/API/V4L2_API/spec-single/v4l2.html#V4L2-QUERYCTRL
         @see http://www.linuxtv.org/downloads/video4linux/API/V4L2_API/spec-single/v4l2.html#V4L2-QUERYMENU */
     std::pair<std::list<struct v4l2_queryctrl>, std::list<struct v4l2_querymenu> > controls();
@@ -124,30 +210,99 @@ public:
     void printControls();
     void printFormats();
 
+    /** @returns the fourcc code as string, e.g. "YUYV" */
+    static std::string pixelFormatString(__u32 pixelFormat);
+    /** @returns the fourcc code of a string like "YUYV", 0 if it is no fourcc code */
+    static __u32 pixelFormatFromString(const std::string&);
+
+protected:
+
+    /** opens the source and sets up m_buffers, m_bufferSize, m_bytesPerLine and the ring
+        @returns false on failure - finishSource() is called anyway */
+    virtual bool initSource();
+    /** undoes initSource(), also after a partial one */
+    virtual void finishSource();
+
+    /** captures a frame - m_fileDescriptor has to be readable */
+    virtual void captureFrame();
+    /** called regularly, while no frame arrives */
+    virtual void captureIdle();
+
+    /** takes m_bufferCount buffers of m_bufferSize bytes from the FramePool and hands them to the ring */
+    bool initMemoryBuffers();
+    void finishMemoryBuffers();
+
+    /** makes m_fileDescriptor a timer, which becomes readable framesPerSecond times a second,
+        as fast as possible for 0 */
+    bool initFrameTimer(double framesPerSecond);
+    /** makes the frame timer readable once at the given CLOCK_MONOTONIC time instead */
+    bool armFrameTimer(const timespec &time);
+    /** @returns number of frame periods elapsed since the last call, 0 if none */
+    unsigned long long consumeFrameTimer();
+    void finishFrameTimer();
+
+    /** sets time and realTime of the buffer to now and its frame number - a gap to the
+        frame number stamped before counts as dropped frames */
+    void stampFrame(Buffer*, unsigned long long frameNumber);
+    /** @param time CLOCK_MONOTONIC time the frame was taken */
+    void stampFrame(Buffer*, unsigned long long frameNumber, const timespec &time, TimestampSource);
+    /** @returns the frame number following the one stamped last, 0 for the first frame */
+    unsigned long long nextFrameNumber() const;
+    /** the next frame number stamped is no gap to the one before, whatever it is - e.g. after seeking */
+    void restartFrameNumbering();
+
+    /** publishes the buffer and wakes up the subscribers */
+    void publish(Buffer*);
+    /** stops capturing from this device, called by the capturing thread after a device error */
+    void failCapturing();
+
+
+    unsigned int m_captureHeight;
+    unsigned int m_captureWidth;
+    __u32 m_pixelFormat;
+    unsigned int m_bytesPerLine;
+    std::string m_fileName;
+    unsigned int m_bufferCount;
+
+    /** the device, or whatever signals readability of the next frame */
+    int m_fileDescriptor;
+    IoMethod m_ioMethod;
+    unsigned int m_bufferSize;
+    std::vector<Buffer> m_buffers;
+    FrameRing m_ring;
+
 private:
 
+    friend class CaptureReactor;
+
+    bool initMmap();
+    void finishMmap();
+
+    bool queueBuffer(Buffer*);
+    /** @returns the buffer filled by the driver, 0 if none is ready yet */
+    Buffer *dequeueBuffer();
+    /** hands buffers back to the driver, which dropped out of the ring and are not locked anymore */
+    void requeueOutdatedBuffers();
+
     bool queryControl(struct v4l2_queryctrl&);
     std::list<struct v4l2_querymenu> menus(const struct v4l2_queryctrl&);
 
     static void captureThread(CaptureDevice *camera);
-    static void determineCapturePeriodThread(double, CaptureDevice*,
-            std::pair<double,double>*);
 
     int xv4l2_ioctl(int fileDescriptor, int request, void *arg);
 
-    static std::string pixelFormatString(__u32 pixelFormat);
 
+    TimestampSource m_timestampSource;
+    /** only touched by the capturing thread */
+    bool m_frameNumbered;
+    unsigned long long m_lastFrameNumber;
+    timespec m_lastFrameTime;
+    unsigned long long m_droppedFrames;
+    RateEstimator m_rateEstimator;
+    LatencyHistogram m_publishLatency;
 
-    unsigned int m_captureHeight;
-    unsigned int m_captureWidth;
-    std::string m_fileName;
-    unsigned int m_bufferCount;
-
-    int m_fileDescriptor;
-    unsigned int m_bufferSize;
-    std::list<Buffer> m_buffers;
-    std::deque<Buffer*> m_timelySortedBuffers;
-    std::mutex m_timelySortedBuffersMutex;
+    std::vector<FrameNotifier*> m_subscribers;
+    std::mutex m_subscribersMutex;
 
     struct timespec m_timerResolution;
     struct timespec m_timerStart;
@@ -155,6 +310,16 @@ private:
 
     std::thread *m_captureThread;
     bool m_captureThreadCancellationFlag;
+    bool m_captureFailed;
+
+    /** IoMethodRead: frames arriving while every buffer is locked are read into it and dropped */
+    unsigned char *m_scratchBuffer;
+    /** frames dropped that way since the last one stamped - a gap in the frame numbers */
+    unsigned long long m_discardedFrames;
+
+    CaptureReactor *m_captureReactor;
+    /** the reactor capturing at the moment, if not the own thread */
+    CaptureReactor *m_activeCaptureReactor;
 
     std::mutex m_fileAccessMutex;
     std::mutex m_pauseCapturingMutex;
@@ -17,6 +17,9 @@
  */
 
 #include "capturedevicestab.hpp"
+#include "colorconversion.hpp"
+#include "framepool.hpp"
+#include "tracer.hpp"
 
 #include <QPainter>
 #include <QPaintEvent>
@@ -32,6 +35,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <sstream>
@@ -43,9 +47,11 @@ using namespace std;
 
 template <typename T>
 static string anythingToString(T t);
+static long long nanosecondsBetween(const timespec &from, const timespec &to);
 
 
-CaptureDevicesTab::CaptureDevicesTab(QWidget *parent, const set<CaptureDevice*> &captureDevices)
+CaptureDevicesTab::CaptureDevicesTab(QWidget *parent, const set<CaptureDevice*> &captureDevices,
+        unsigned int synchronizerQueueDepth)
         : QWidget(parent), m_paintThread(0), m_paintThreadCancellationFlag(false)
 {
     /* *** init ui *** */
@@ -76,6 +82,13 @@ CaptureDevicesTab::CaptureDevicesTab(QWidget *parent, const set<CaptureDevice*>
         captureDevice.imageLabel = new QLabel(captureDevice.groupBox);
         captureDevice.currentImage = QImage();
         captureDevice.currentImageMutex = new mutex();
+        captureDevice.conversionBuffer = 0;
+        captureDevice.conversionBufferSize = 0;
+        captureDevice.lockLatency = new LatencyHistogram();
+        captureDevice.imageLatency = new LatencyHistogram();
+        captureDevice.displayLatency = new LatencyHistogram();
+        captureDevice.ageOnScreen = new LatencyHistogram();
+        captureDevice.imagePending = false;
 
         captureDevice.layout->setAlignment(Qt::AlignLeft | Qt::AlignTop);
         captureDevice.imageLabel->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
@@ -86,7 +99,10 @@ CaptureDevicesTab::CaptureDevicesTab(QWidget *parent, const set<CaptureDevice*>
         m_mainLayout->addWidget(captureDevice.groupBox);
 
         createCaptureDeviceControlWidgets(captureDevice.device, qobject_cast<QWidget*>(captureDevice.groupBox));
+
+        if (synchronizerQueueDepth > 0) m_frameSynchronizer.addSource(captureDevice.device);
     }
+    m_frameSynchronizer.setQueueDepth(synchronizerQueueDepth);
 
     m_globalButtonsLayout->addWidget(m_startStopAllDevicesButton);
     m_globalButtonsLayout->addWidget(m_updateAllDeviceControlsButton);
@@ -107,13 +123,21 @@ CaptureDevicesTab::~CaptureDevicesTab()
     }
 
     for (auto it = m_captureDevices.begin(); it != m_captureDevices.end(); ++it) {
+        it->currentImage = QImage();
+        FramePool::instance().release(it->conversionBuffer);
         delete it->currentImageMutex;
+        delete it->lockLatency;
+        delete it->imageLatency;
+        delete it->displayLatency;
+        delete it->ageOnScreen;
     }
 }
 
 
 void CaptureDevicesTab::paintEvent(QPaintEvent *event)
 {
+    VT
+
     /* KLUDGE
      * pixmaps can only be used from the gui thread.
      *
@@ -127,6 +151,16 @@ void CaptureDevicesTab::paintEvent(QPaintEvent *event)
         /* update image */
         it->currentImageMutex->lock();
         it->imageLabel->setPixmap(QPixmap::fromImage(it->currentImage));
+        if (it->imagePending == true) {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            it->displayLatency->record(nanosecondsBetween(it->imageReadyTime, now));
+            /* recorded times are from back then */
+            if (it->device->timestampSource() != CaptureDevice::TimestampRecorded) {
+                it->ageOnScreen->record(nanosecondsBetween(it->imageFrameTime, now));
+            }
+            it->imagePending = false;
+        }
         it->currentImageMutex->unlock();
 
         /* update info label text */
@@ -339,6 +373,7 @@ void CaptureDevicesTab::buttonControlClicked(bool checked)
 void CaptureDevicesTab::startPaintThread()
 {
     assert(isPainting() == false);
+    if (m_frameSynchronizer.sourceCount() > 1) m_frameSynchronizer.start();
     m_paintThread = new std::thread(bind(paintThread, this));
 }
 
@@ -349,11 +384,14 @@ void CaptureDevicesTab::stopPaintThread()
         assert(m_paintThread->joinable() == true);
 
         m_paintThreadCancellationFlag = true;
+        m_frameNotifier.notify();
         m_paintThread->join();
         m_paintThreadCancellationFlag = false;
 
         delete m_paintThread;
         m_paintThread = 0;
+
+        m_frameSynchronizer.stop();
     }
 }
 
@@ -468,12 +506,17 @@ void CaptureDevicesTab::paintThread(CaptureDevicesTab *window)
 {
     std::mutex &pausePaintingMutex = window->m_pausePaintingMutex;
     bool &m_paintThreadCancellationFlag = window->m_paintThreadCancellationFlag;
+    FrameNotifier &frameNotifier = window->m_frameNotifier;
+
+    Tracer::setThreadName("paint");
 
     /* init list of last image times */
     list<timespec> lastImageTimes;
     for (auto it = window->m_captureDevices.begin(); it != window->m_captureDevices.end(); ++it) {
         lastImageTimes.push_back(timespec());
         lastImageTimes.back() = {numeric_limits<time_t>::min(), 0};
+
+        it->device->subscribe(&frameNotifier);
     }
 
 
@@ -485,47 +528,108 @@ void CaptureDevicesTab::paintThread(CaptureDevicesTab *window)
         pausePaintingMutex.lock();
         pausePaintingMutex.unlock();
 
+        /* taken before looking, so a frame published meanwhile ends the wait below at once */
+        unsigned long long generation = frameNotifier.generation();
+
+        VTN_START("paint")
+
         auto itImageTimes = lastImageTimes.begin();
         for (auto it = window->m_captureDevices.begin();
                 it != window->m_captureDevices.end()
                 ; ++it, ++itImageTimes) {
-        
-            if (it->device->newerBuffersAvailable(*itImageTimes) > 0) {
 
+            /* no more frames coming - the last one stays on screen */
+            if (it->device->hasFailed() == true && it->infoLabelContents.count("error") == 0) {
+                it->infoLabelContents["error"] = "the device failed, capturing stopped";
+                updateGUI = true;
+            } else if (it->device->hasFailed() == false && it->infoLabelContents.count("error") > 0) {
+                it->infoLabelContents.erase("error");
                 updateGUI = true;
+            }
 
-                deque<const CaptureDevice::Buffer*> buffers;
-                const CaptureDevice::Buffer *buffer = buffers[0];
+            if (it->device->newerBuffersAvailable(*itImageTimes) > 0) {
 
-                buffers = it->device->lockFirstNBuffers(1);
-                buffer = buffers[0];
+                CaptureDevice::FrameHandle frame = it->device->lockNewestBuffer();
+                if (frame.isNull() == true) continue;
 
-                *itImageTimes = buffer->time;
+                timespec lockTime;
+                clock_gettime(CLOCK_MONOTONIC, &lockTime);
+                it->lockLatency->record(nanosecondsBetween(frame->publishTime, lockTime));
+
+                updateGUI = true;
+
+                *itImageTimes = frame->time;
 
                 it->infoLabelContents["time"] = anythingToString(
                         (itImageTimes->tv_sec + itImageTimes->tv_nsec / 1000000000.0));
 
-                it->currentImageMutex->lock();
-                it->currentImage = QImage(buffer->buffer, it->device->captureSize().first,
-                        it->device->captureSize().second, QImage::Format_RGB888);
-                it->currentImageMutex->unlock();
-                
-                it->device->unlock(buffers);
+                it->infoLabelContents["format"] = CaptureDevice::pixelFormatString(frame->pixelFormat);
+
+                RateEstimator::Estimate rate = it->device->rateEstimator().estimate();
+                if (rate.count > 0) {
+                    it->infoLabelContents["rate"] = anythingToString(1.0 / rate.recentMean) + " fps, jitter "
+                            + anythingToString(rate.recentStandardDeviation * 1000.0) + " ms";
+                }
+
+                it->infoLabelContents["latency 1 publish"] = it->device->publishLatency().summary();
+                it->infoLabelContents["latency 2 lock"] = it->lockLatency->summary();
+                it->infoLabelContents["latency 3 image"] = it->imageLatency->summary();
+                it->infoLabelContents["latency 4 display"] = it->displayLatency->summary();
+                it->infoLabelContents["age on screen"] = it->ageOnScreen->summary();
+
+                if (frame->pixelFormat == V4L2_PIX_FMT_RGB24
+                        || ColorConversion::isSupported(frame->pixelFormat) == true) {
+
+                    /* copied or converted into memory of our own, which is only replaced, when the
+                       frames grow - the frame goes back to the ring right away, not when the next
+                       one is shown */
+                    unsigned int bytesPerLine = FramePool::paddedBytesPerLine(frame->width * 3);
+                    it->currentImageMutex->lock();
+                    if (it->currentImage.width() != (int) frame->width
+                            || it->currentImage.height() != (int) frame->height) {
+                        size_t size = (size_t) bytesPerLine * frame->height;
+                        if (size > it->conversionBufferSize) {
+                            FramePool::instance().release(it->conversionBuffer);
+                            it->conversionBuffer = FramePool::instance().allocate(size);
+                            assert(it->conversionBuffer != 0);
+                            it->conversionBufferSize = size;
+                        }
+                        it->currentImage = QImage(it->conversionBuffer, frame->width, frame->height,
+                                bytesPerLine, QImage::Format_RGB888);
+                    }
+                    if (frame->pixelFormat == V4L2_PIX_FMT_RGB24) {
+                        for (unsigned int y = 0; y < frame->height; ++y) {
+                            memcpy(it->conversionBuffer + y * bytesPerLine,
+                                    frame->buffer + y * frame->bytesPerLine, frame->width * 3);
+                        }
+                    } else {
+                        ColorConversion::convert(frame->buffer, frame->pixelFormat,
+                                frame->width, frame->height, frame->bytesPerLine,
+                                it->conversionBuffer, ColorConversion::Rgb24, bytesPerLine);
+                    }
+                    imageReady(*it, *frame, lockTime);
+                    it->currentImageMutex->unlock();
+                }
             }
+        }
+
 
-            /*
-             does not work with N capture devices TODO
+        /* skew of the matched frames against the first camera */
+        if (updateGUI == true && window->m_frameSynchronizer.isRunning() == true) {
+            unsigned int source = 0;
+            for (auto it = window->m_captureDevices.begin(); it != window->m_captureDevices.end(); ++it, ++source) {
+                if (source == 0) continue;
 
-             if (window->m_camera1InfoLabelContents.find("time") !=window->m_camera1InfoLabelContents.end() &&
-                    window->m_camera2InfoLabelContents.find("time") !=window->m_camera2InfoLabelContents.end()) {
-                double t1 = atof(window->m_camera1InfoLabelContents["time"].c_str());
-                double t2 = atof(window->m_camera2InfoLabelContents["time"].c_str());
+                FrameSynchronizer::SkewStatistics skew = window->m_frameSynchronizer.skew(source, 0);
+                if (skew.count == 0) continue;
 
-                window->m_camera1InfoLabelContents["deviation"] = window->m_camera2InfoLabelContents["deviation"]
-                        = anythingToString(fabs(t1-t2));
-            }*/
+                it->infoLabelContents["skew to camera 0"] = anythingToString(skew.mean * 1000.0) + " ms, deviation "
+                        + anythingToString(skew.standardDeviation * 1000.0) + " ms";
+            }
         }
 
+        VTN_END("paint")
+
 
         if (updateGUI == true) {
 
@@ -533,14 +637,28 @@ void CaptureDevicesTab::paintThread(CaptureDevicesTab *window)
 
         } else {
 
-            struct timespec sleepLength = { 0, 1000 };
-            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleepLength, 0);
+            /* sleep until any device publishes a frame - the timeout is for noticing cancellation */
+            frameNotifier.wait(generation, 100);
+
+        }
+    }
 
-        } 
+    for (auto it = window->m_captureDevices.begin(); it != window->m_captureDevices.end(); ++it) {
+        it->device->unsubscribe(&frameNotifier);
     }
 }
 
 
+void CaptureDevicesTab::imageReady(PerCaptureDevice &captureDevice, const CaptureDevice::Buffer &frame,
+        const timespec &lockTime)
+{
+    clock_gettime(CLOCK_MONOTONIC, &captureDevice.imageReadyTime);
+    captureDevice.imageLatency->record(nanosecondsBetween(lockTime, captureDevice.imageReadyTime));
+    captureDevice.imageFrameTime = frame.time;
+    captureDevice.imagePending = true;
+}
+
+
 /* *** local *************************************************************** */
 template <typename T>
 string anythingToString(T t)
@@ -550,3 +668,8 @@ string anythingToString(T t)
     return os.str();
 }
 
+
+long long nanosecondsBetween(const timespec &from, const timespec &to)
+{
+    return (to.tv_sec - from.tv_sec) * 1000000000LL + (to.tv_nsec - from.tv_nsec);
+}
@@ -22,6 +22,9 @@
 #include "prereqs.hpp"
 
 #include "capturedevice.hpp"
+#include "framenotifier.hpp"
+#include "framesynchronizer.hpp"
+#include "latencyhistogram.hpp"
 
 #include <QImage>
 #include <QMap>
@@ -45,7 +48,10 @@ class CaptureDevicesTab : public QWidget
 {
     Q_OBJECT
 public:
-    CaptureDevicesTab(QWidget *parent, const std::set<CaptureDevice*> &captureDevices);
+    /** @param synchronizerQueueDepth frames per device waiting for a match, 0 for no
+        FrameSynchronizer - the devices need that many buffers more */
+    CaptureDevicesTab(QWidget *parent, const std::set<CaptureDevice*> &captureDevices,
+            unsigned int synchronizerQueueDepth);
     ~CaptureDevicesTab();
 
 protected:
@@ -90,10 +96,32 @@ private:
         std::map<std::string,std::string> infoLabelContents;
         QLabel *imageLabel;
 
+        /** shows conversionBuffer */
         QImage currentImage;
         std::mutex *currentImageMutex;
+        /** from the FramePool - the newest frame, copied or converted to RGB24 */
+        unsigned char *conversionBuffer;
+        size_t conversionBufferSize;
+
+        /* *** latencies on the way to the screen, after the device published the frame *** */
+        /** publishing to locking by the paint thread */
+        LatencyHistogram *lockLatency;
+        /** locking to currentImage being ready */
+        LatencyHistogram *imageLatency;
+        /** currentImage being ready to being set as pixmap */
+        LatencyHistogram *displayLatency;
+        /** taking the frame to setting it as pixmap - how old the frame on screen is */
+        LatencyHistogram *ageOnScreen;
+        /** guarded by currentImageMutex: currentImage was not set as pixmap yet */
+        bool imagePending;
+        timespec imageReadyTime;
+        timespec imageFrameTime;
     };
 
+    /** takes the times of a new currentImage
+        @pre currentImageMutex is locked */
+    static void imageReady(PerCaptureDevice&, const CaptureDevice::Buffer &frame, const timespec &lockTime);
+
     std::list<PerCaptureDevice> m_captureDevices;
 
 
@@ -111,7 +139,12 @@ private:
 
     std::thread *m_paintThread;
     bool m_paintThreadCancellationFlag;
+    /** subscribed to all capture devices while painting */
+    FrameNotifier m_frameNotifier;
     std::mutex m_pausePaintingMutex;
+    /** matches the frames of all devices while painting, for their skew - without sources,
+        unless asked for */
+    FrameSynchronizer m_frameSynchronizer;
 
 };
 
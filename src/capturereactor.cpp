@@ -0,0 +1,213 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "capturereactor.hpp"
+
+#include "capturedevice.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+/** events fetched per epoll_wait() */
+static const int maxEvents = 32;
+/** milliseconds between idle calls to every device */
+static const int idleInterval = 100;
+
+
+CaptureReactor::CaptureReactor(unsigned int threadCount) :
+        m_nextWorker(0),
+        m_cancellationFlag(false)
+{
+    assert(threadCount > 0);
+
+    m_wakeupFileDescriptor = eventfd(0, EFD_NONBLOCK);
+    if (m_wakeupFileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " eventfd " << errno << " " << strerror(errno) << endl;
+        abort();
+    }
+
+    for (unsigned int a = 0; a < threadCount; ++a) {
+        Worker *worker = new Worker();
+
+        worker->epollFileDescriptor = epoll_create(maxEvents);
+        if (worker->epollFileDescriptor == -1) {
+            cerr << __PRETTY_FUNCTION__ << " epoll_create " << errno << " " << strerror(errno) << endl;
+            abort();
+        }
+
+        /* data.ptr == 0 -> wakeup */
+        struct epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN;
+        event.data.ptr = 0;
+        if (epoll_ctl(worker->epollFileDescriptor, EPOLL_CTL_ADD, m_wakeupFileDescriptor, &event) == -1) {
+            cerr << __PRETTY_FUNCTION__ << " epoll_ctl " << errno << " " << strerror(errno) << endl;
+            abort();
+        }
+
+        worker->thread = new thread(bind(reactorThread, this, worker));
+        m_workers.push_back(worker);
+    }
+}
+
+
+CaptureReactor::~CaptureReactor()
+{
+    m_cancellationFlag = true;
+    eventfd_write(m_wakeupFileDescriptor, 1);
+
+    for (auto it = m_workers.begin(); it != m_workers.end(); ++it) {
+        assert((*it)->devices.empty() == true);
+
+        (*it)->thread->join();
+        delete (*it)->thread;
+        close((*it)->epollFileDescriptor);
+        delete *it;
+    }
+
+    close(m_wakeupFileDescriptor);
+}
+
+
+unsigned int CaptureReactor::threadCount() const
+{
+    return m_workers.size();
+}
+
+
+void CaptureReactor::add(CaptureDevice *device)
+{
+    assert(device->m_fileDescriptor != -1);
+
+    lock_guard<mutex> lock(m_addRemoveMutex);
+
+    Worker *worker = m_workers[m_nextWorker];
+    m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+
+    worker->dispatchMutex.lock();
+    assert(find(worker->devices.begin(), worker->devices.end(), device) == worker->devices.end());
+    worker->devices.push_back(device);
+    worker->dispatchMutex.unlock();
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN;
+    event.data.ptr = device;
+
+    if (epoll_ctl(worker->epollFileDescriptor, EPOLL_CTL_ADD, device->m_fileDescriptor, &event) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " epoll_ctl " << errno << " " << strerror(errno) << endl;
+        abort();
+    }
+}
+
+
+void CaptureReactor::remove(CaptureDevice *device)
+{
+    lock_guard<mutex> lock(m_addRemoveMutex);
+
+    for (auto it = m_workers.begin(); it != m_workers.end(); ++it) {
+        Worker *worker = *it;
+
+        /* events fetched before the removal are filtered by the device list */
+        worker->dispatchMutex.lock();
+        auto itDevice = find(worker->devices.begin(), worker->devices.end(), device);
+        if (itDevice == worker->devices.end()) {
+            worker->dispatchMutex.unlock();
+            continue;
+        }
+        worker->devices.erase(itDevice);
+        worker->dispatchMutex.unlock();
+
+        if (epoll_ctl(worker->epollFileDescriptor, EPOLL_CTL_DEL, device->m_fileDescriptor, 0) == -1) {
+            cerr << __PRETTY_FUNCTION__ << " epoll_ctl " << errno << " " << strerror(errno) << endl;
+        }
+        return;
+    }
+}
+
+
+/* *** static functions ***************************************************** */
+void CaptureReactor::reactorThread(CaptureReactor *reactor, Worker *worker)
+{
+    struct epoll_event events[maxEvents];
+    struct timespec lastIdle;
+    struct timespec now;
+
+    Tracer::setThreadName("capture reactor");
+    clock_gettime(CLOCK_MONOTONIC, &lastIdle);
+
+    while (reactor->m_cancellationFlag == false) {
+
+        int eventCount = epoll_wait(worker->epollFileDescriptor, events, maxEvents, idleInterval);
+
+        if (eventCount == -1) {
+            if (errno == EINTR) continue;
+            cerr << __PRETTY_FUNCTION__ << " epoll_wait " << errno << " " << strerror(errno) << endl;
+            abort();
+        }
+
+        worker->dispatchMutex.lock();
+
+        for (int a = 0; a < eventCount; ++a) {
+            CaptureDevice *device = static_cast<CaptureDevice*>(events[a].data.ptr);
+
+            /* wakeup or removed meanwhile */
+            if (device == 0 ||
+                    find(worker->devices.begin(), worker->devices.end(), device) == worker->devices.end()) {
+                continue;
+            }
+
+            VTN("capture")
+            device->captureFrame();
+
+            /* a failed device stops by itself, the others go on */
+            if (device->m_captureFailed == true) {
+                worker->devices.erase(find(worker->devices.begin(), worker->devices.end(), device));
+                if (epoll_ctl(worker->epollFileDescriptor, EPOLL_CTL_DEL, device->m_fileDescriptor, 0) == -1) {
+                    cerr << __PRETTY_FUNCTION__ << " epoll_ctl " << errno << " " << strerror(errno) << endl;
+                }
+            }
+        }
+
+        /* busy devices must not keep the quiet ones from getting their buffers back to the driver */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - lastIdle.tv_sec) * 1000 + (now.tv_nsec - lastIdle.tv_nsec) / 1000000 >= idleInterval) {
+            for (auto it = worker->devices.begin(); it != worker->devices.end(); ++it) {
+                (*it)->captureIdle();
+            }
+            lastIdle = now;
+        }
+
+        worker->dispatchMutex.unlock();
+    }
+}
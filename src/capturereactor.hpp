@@ -0,0 +1,85 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef CAPTURE_REACTOR_HPP
+#define CAPTURE_REACTOR_HPP
+
+#include "prereqs.hpp"
+
+#include <mutex>
+#include <vector>
+
+class CaptureDevice;
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * captures many devices on a few threads
+ *
+ * Each thread waits with epoll on the file descriptors of the devices assigned to it and
+ * captures a frame from whichever device became readable. A device is always served by the
+ * same thread, so frames of one device are never captured concurrently.
+ *
+ * @see CaptureDevice::setCaptureReactor
+ */
+class CaptureReactor
+{
+public:
+    /** @param threadCount number of epoll threads, devices are distributed round robin */
+    explicit CaptureReactor(unsigned int threadCount = 1);
+    CaptureReactor(const CaptureReactor&) = delete;
+    CaptureReactor &operator=(const CaptureReactor&) = delete;
+    /** @pre all devices have been removed */
+    ~CaptureReactor();
+
+    unsigned int threadCount() const;
+
+    /** starts capturing from the device
+        @pre the device is initialized */
+    void add(CaptureDevice*);
+    /** stops capturing from the device - no frame of it is being captured anymore afterwards */
+    void remove(CaptureDevice*);
+
+private:
+
+    struct Worker
+    {
+        int epollFileDescriptor;
+        std::thread *thread;
+        /** held while dispatching - remove() synchronizes on it */
+        std::mutex dispatchMutex;
+        std::vector<CaptureDevice*> devices;
+    };
+
+    static void reactorThread(CaptureReactor *reactor, Worker *worker);
+
+    std::vector<Worker*> m_workers;
+    unsigned int m_nextWorker;
+    std::mutex m_addRemoveMutex;
+
+    /** readable once the threads shall quit */
+    int m_wakeupFileDescriptor;
+    bool m_cancellationFlag;
+};
+
+
+#endif /* CAPTURE_REACTOR_HPP */
@@ -0,0 +1,535 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "colorconversion.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#include <linux/videodev2.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+    #define HAVE_X86_KERNELS
+    #include <cpuid.h>
+    #include <emmintrin.h>
+    #include <immintrin.h>
+
+    /* missing in older cpuid.h */
+    #ifndef bit_OSXSAVE
+        #define bit_OSXSAVE (1 << 27)
+    #endif
+    #ifndef bit_AVX
+        #define bit_AVX (1 << 28)
+    #endif
+    #ifndef bit_AVX2
+        #define bit_AVX2 (1 << 5)
+    #endif
+#endif
+
+typedef ColorConversion::OutputFormat OutputFormat;
+
+
+/*
+ * BT.601 limited range with 6 fractional bits:
+ *
+ *   yy = (Y - 16) * 74                       74 / 64 = 1.156
+ *   R  = (yy + 102 * V' + 32) >> 6          102 / 64 = 1.594
+ *   G  = (yy - 52 * V' - 25 * U' + 32) >> 6  52 / 64 = 0.813, 25 / 64 = 0.391
+ *   B  = (yy + 129 * U' + 32) >> 6          129 / 64 = 2.016
+ *
+ * with U' = U - 128, V' = V - 128, clamped to 0..255. All intermediates fit into 16 bits,
+ * except for B, where the SIMD kernels saturate - only for results clamped to 255 anyway.
+ */
+
+/** the row kernels of one instruction set, chroma is always horizontally subsampled by 2 */
+struct Kernels
+{
+    /** u and v hold (width + 1) / 2 samples */
+    void (*yuvToRgb)(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+            unsigned char *out, unsigned int width, OutputFormat);
+    void (*greyToRgb)(const unsigned char *y, unsigned char *out, unsigned int width, OutputFormat);
+    /** YUYV (lumaFirst) or UYVY to planar */
+    void (*splitPacked)(const unsigned char *packed, unsigned char *y, unsigned char *u, unsigned char *v,
+            unsigned int width, bool lumaFirst);
+    /** interleaved chroma of NV12 (uFirst) or NV21 to planar */
+    void (*splitChroma)(const unsigned char *uv, unsigned char *u, unsigned char *v,
+            unsigned int count, bool uFirst);
+};
+
+/** pixels converted at once - the split kernels write to stack buffers of this size */
+static const unsigned int chunkWidth = 512;
+
+static const Kernels *kernels = 0;
+static ColorConversion::InstructionSet kernelsInstructionSet = ColorConversion::Scalar;
+
+static const Kernels *kernelsOf(ColorConversion::InstructionSet);
+
+
+bool ColorConversion::isSupported(unsigned int pixelFormat)
+{
+    switch (pixelFormat) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_GREY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+bool ColorConversion::convert(const unsigned char *source, unsigned int pixelFormat,
+        unsigned int width, unsigned int height, unsigned int sourceBytesPerLine,
+        unsigned char *destination, OutputFormat outputFormat, unsigned int destinationBytesPerLine)
+{
+    VT
+
+    if (isSupported(pixelFormat) == false) return false;
+
+    if (kernels == 0) setInstructionSet(detectInstructionSet());
+    const Kernels &k = *kernels;
+
+    const unsigned int bytesPerPixel = outputFormat == Rgb24 ? 3 : 4;
+
+    /* planes following the luma plane */
+    const unsigned char *chromaPlane = source + sourceBytesPerLine * height;
+    const unsigned int chromaBytesPerLine = sourceBytesPerLine / 2;
+    const unsigned char *vPlane = chromaPlane + chromaBytesPerLine * ((height + 1) / 2);
+
+    unsigned char yScratch[chunkWidth];
+    unsigned char uScratch[chunkWidth / 2];
+    unsigned char vScratch[chunkWidth / 2];
+
+    for (unsigned int row = 0; row < height; ++row) {
+
+        const unsigned char *in = source + row * sourceBytesPerLine;
+        unsigned char *out = destination + row * destinationBytesPerLine;
+
+        for (unsigned int x = 0; x < width; x += chunkWidth) {
+
+            unsigned int n = width - x < chunkWidth ? width - x : chunkWidth;
+            unsigned char *outChunk = out + x * bytesPerPixel;
+
+            switch (pixelFormat) {
+            case V4L2_PIX_FMT_YUYV:
+            case V4L2_PIX_FMT_UYVY:
+                k.splitPacked(in + x * 2, yScratch, uScratch, vScratch, n, pixelFormat == V4L2_PIX_FMT_YUYV);
+                k.yuvToRgb(yScratch, uScratch, vScratch, outChunk, n, outputFormat);
+                break;
+            case V4L2_PIX_FMT_NV12:
+            case V4L2_PIX_FMT_NV21:
+                /* interleaved chroma plane with full stride */
+                k.splitChroma(chromaPlane + (row / 2) * sourceBytesPerLine + x, uScratch, vScratch,
+                        (n + 1) / 2, pixelFormat == V4L2_PIX_FMT_NV12);
+                k.yuvToRgb(in + x, uScratch, vScratch, outChunk, n, outputFormat);
+                break;
+            case V4L2_PIX_FMT_YUV420:
+                k.yuvToRgb(in + x,
+                        chromaPlane + (row / 2) * chromaBytesPerLine + x / 2,
+                        vPlane + (row / 2) * chromaBytesPerLine + x / 2,
+                        outChunk, n, outputFormat);
+                break;
+            case V4L2_PIX_FMT_GREY:
+                k.greyToRgb(in + x, outChunk, n, outputFormat);
+                break;
+            default:
+                assert(0);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+ColorConversion::InstructionSet ColorConversion::detectInstructionSet()
+{
+#ifdef HAVE_X86_KERNELS
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) return Scalar;
+
+    bool sse2 = (edx & bit_SSE2) != 0;
+
+    if ((ecx & bit_OSXSAVE) != 0 && (ecx & bit_AVX) != 0 && __get_cpuid_max(0, 0) >= 7) {
+
+        /* the OS has to save the ymm registers too */
+        unsigned int xcr0Low, xcr0High;
+        __asm__ ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+
+        if ((xcr0Low & 6) == 6) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if ((ebx & bit_AVX2) != 0) return Avx2;
+        }
+    }
+
+    if (sse2 == true) return Sse2;
+#endif
+
+    return Scalar;
+}
+
+
+void ColorConversion::setInstructionSet(InstructionSet instructionSet)
+{
+    kernels = kernelsOf(instructionSet);
+    kernelsInstructionSet = instructionSet;
+}
+
+
+ColorConversion::InstructionSet ColorConversion::instructionSet()
+{
+    if (kernels == 0) setInstructionSet(detectInstructionSet());
+    return kernelsInstructionSet;
+}
+
+
+const char *ColorConversion::instructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+    case Scalar:
+        return "scalar";
+    case Sse2:
+        return "SSE2";
+    case Avx2:
+        return "AVX2";
+    }
+    return "unknown";
+}
+
+
+/* *** scalar kernels ******************************************************* */
+static inline unsigned char clamp(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+
+static void yuvToRgbScalar(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+        unsigned char *out, unsigned int width, OutputFormat format)
+{
+    const unsigned int bytesPerPixel = format == ColorConversion::Rgb24 ? 3 : 4;
+
+    for (unsigned int x = 0; x < width; ++x, out += bytesPerPixel) {
+        int yy = (y[x] - 16) * 74;
+        int uu = u[x / 2] - 128;
+        int vv = v[x / 2] - 128;
+
+        out[0] = clamp((yy + 102 * vv + 32) >> 6);
+        out[1] = clamp((yy - 52 * vv - 25 * uu + 32) >> 6);
+        out[2] = clamp((yy + 129 * uu + 32) >> 6);
+        if (bytesPerPixel == 4) out[3] = 0xff;
+    }
+}
+
+
+static void greyToRgbScalar(const unsigned char *y, unsigned char *out, unsigned int width, OutputFormat format)
+{
+    const unsigned int bytesPerPixel = format == ColorConversion::Rgb24 ? 3 : 4;
+
+    for (unsigned int x = 0; x < width; ++x, out += bytesPerPixel) {
+        out[0] = out[1] = out[2] = y[x];
+        if (bytesPerPixel == 4) out[3] = 0xff;
+    }
+}
+
+
+static void splitPackedScalar(const unsigned char *packed, unsigned char *y, unsigned char *u, unsigned char *v,
+        unsigned int width, bool lumaFirst)
+{
+    const unsigned int lumaOffset = lumaFirst ? 0 : 1;
+    const unsigned int chromaOffset = lumaFirst ? 1 : 0;
+
+    for (unsigned int x = 0; x < width; ++x) {
+        y[x] = packed[2 * x + lumaOffset];
+    }
+    for (unsigned int x = 0; x < (width + 1) / 2; ++x) {
+        u[x] = packed[4 * x + chromaOffset];
+        v[x] = packed[4 * x + chromaOffset + 2];
+    }
+}
+
+
+static void splitChromaScalar(const unsigned char *uv, unsigned char *u, unsigned char *v,
+        unsigned int count, bool uFirst)
+{
+    unsigned char *first = uFirst ? u : v;
+    unsigned char *second = uFirst ? v : u;
+
+    for (unsigned int x = 0; x < count; ++x) {
+        first[x] = uv[2 * x];
+        second[x] = uv[2 * x + 1];
+    }
+}
+
+
+static const Kernels scalarKernels = { yuvToRgbScalar, greyToRgbScalar, splitPackedScalar, splitChromaScalar };
+
+
+#ifdef HAVE_X86_KERNELS
+/* *** SSE2 kernels ********************************************************* */
+
+/** drops the X byte of 4 RGBX pixels and stores the 12 remaining bytes */
+__attribute__((target("sse2")))
+static inline void storeRgb4(__m128i rgbx, unsigned char *out)
+{
+    const __m128i pixel0 = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+    const __m128i pixel1 = _mm_set_epi32(0x0000ffff, 0xff000000, 0x0000ffff, 0xff000000);
+    const __m128i lowHalf = _mm_set_epi32(0, 0, 0x0000ffff, 0xffffffff);
+    const __m128i highHalf = _mm_set_epi32(0, 0xffffffff, 0xffff0000, 0);
+
+    /* 2 pixels per 64 bit half, then close the gap between the halves */
+    __m128i halves = _mm_or_si128(_mm_and_si128(rgbx, pixel0),
+            _mm_and_si128(_mm_srli_epi64(rgbx, 8), pixel1));
+    __m128i rgb = _mm_or_si128(_mm_and_si128(halves, lowHalf),
+            _mm_and_si128(_mm_srli_si128(halves, 2), highHalf));
+
+    _mm_storel_epi64((__m128i*) out, rgb);
+    int last = _mm_cvtsi128_si32(_mm_srli_si128(rgb, 8));
+    memcpy(out + 8, &last, 4);
+}
+
+
+/** interleaves 16 pixels */
+__attribute__((target("sse2")))
+static inline void storeRgb16(__m128i r, __m128i g, __m128i b, unsigned char *out, OutputFormat format)
+{
+    const __m128i x = _mm_set1_epi8((char) 0xff);
+
+    __m128i rg0 = _mm_unpacklo_epi8(r, g);
+    __m128i rg1 = _mm_unpackhi_epi8(r, g);
+    __m128i bx0 = _mm_unpacklo_epi8(b, x);
+    __m128i bx1 = _mm_unpackhi_epi8(b, x);
+
+    __m128i pixels[4] = {
+            _mm_unpacklo_epi16(rg0, bx0), _mm_unpackhi_epi16(rg0, bx0),
+            _mm_unpacklo_epi16(rg1, bx1), _mm_unpackhi_epi16(rg1, bx1) };
+
+    if (format == ColorConversion::Rgbx32) {
+        for (int a = 0; a < 4; ++a) {
+            _mm_storeu_si128((__m128i*) (out + 16 * a), pixels[a]);
+        }
+    } else {
+        for (int a = 0; a < 4; ++a) {
+            storeRgb4(pixels[a], out + 12 * a);
+        }
+    }
+}
+
+
+__attribute__((target("sse2")))
+static void yuvToRgbSse2(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+        unsigned char *out, unsigned int width, OutputFormat format)
+{
+    const unsigned int bytesPerPixel = format == ColorConversion::Rgb24 ? 3 : 4;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c16 = _mm_set1_epi16(16);
+    const __m128i c32 = _mm_set1_epi16(32);
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i cY = _mm_set1_epi16(74);
+    const __m128i cRV = _mm_set1_epi16(102);
+    const __m128i cGV = _mm_set1_epi16(52);
+    const __m128i cGU = _mm_set1_epi16(25);
+    const __m128i cBU = _mm_set1_epi16(129);
+
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i*) (y + x));
+        __m128i u16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (u + x / 2)), zero), c128);
+        __m128i v16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (v + x / 2)), zero), c128);
+
+        __m128i rv = _mm_mullo_epi16(v16, cRV);
+        __m128i gv = _mm_mullo_epi16(v16, cGV);
+        __m128i gu = _mm_mullo_epi16(u16, cGU);
+        __m128i bu = _mm_mullo_epi16(u16, cBU);
+
+        /* two neighbouring pixels share their chroma */
+        __m128i rv0 = _mm_unpacklo_epi16(rv, rv), rv1 = _mm_unpackhi_epi16(rv, rv);
+        __m128i gv0 = _mm_unpacklo_epi16(gv, gv), gv1 = _mm_unpackhi_epi16(gv, gv);
+        __m128i gu0 = _mm_unpacklo_epi16(gu, gu), gu1 = _mm_unpackhi_epi16(gu, gu);
+        __m128i bu0 = _mm_unpacklo_epi16(bu, bu), bu1 = _mm_unpackhi_epi16(bu, bu);
+
+        __m128i yy0 = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), c16), cY);
+        __m128i yy1 = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y8, zero), c16), cY);
+
+        __m128i r0 = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy0, rv0), c32), 6);
+        __m128i r1 = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy1, rv1), c32), 6);
+        __m128i g0 = _mm_srai_epi16(_mm_adds_epi16(_mm_subs_epi16(_mm_subs_epi16(yy0, gv0), gu0), c32), 6);
+        __m128i g1 = _mm_srai_epi16(_mm_adds_epi16(_mm_subs_epi16(_mm_subs_epi16(yy1, gv1), gu1), c32), 6);
+        __m128i b0 = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy0, bu0), c32), 6);
+        __m128i b1 = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy1, bu1), c32), 6);
+
+        storeRgb16(_mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(b0, b1),
+                out + x * bytesPerPixel, format);
+    }
+
+    yuvToRgbScalar(y + x, u + x / 2, v + x / 2, out + x * bytesPerPixel, width - x, format);
+}
+
+
+__attribute__((target("sse2")))
+static void greyToRgbSse2(const unsigned char *y, unsigned char *out, unsigned int width, OutputFormat format)
+{
+    const unsigned int bytesPerPixel = format == ColorConversion::Rgb24 ? 3 : 4;
+
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i*) (y + x));
+        storeRgb16(y8, y8, y8, out + x * bytesPerPixel, format);
+    }
+
+    greyToRgbScalar(y + x, out + x * bytesPerPixel, width - x, format);
+}
+
+
+__attribute__((target("sse2")))
+static void splitPackedSse2(const unsigned char *packed, unsigned char *y, unsigned char *u, unsigned char *v,
+        unsigned int width, bool lumaFirst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (packed + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*) (packed + 2 * x + 16));
+
+        __m128i evens = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+        __m128i odds = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        __m128i chroma = lumaFirst ? odds : evens;
+
+        _mm_storeu_si128((__m128i*) (y + x), lumaFirst ? evens : odds);
+        _mm_storel_epi64((__m128i*) (u + x / 2), _mm_packus_epi16(_mm_and_si128(chroma, lowBytes), zero));
+        _mm_storel_epi64((__m128i*) (v + x / 2), _mm_packus_epi16(_mm_srli_epi16(chroma, 8), zero));
+    }
+
+    splitPackedScalar(packed + 2 * x, y + x, u + x / 2, v + x / 2, width - x, lumaFirst);
+}
+
+
+__attribute__((target("sse2")))
+static void splitChromaSse2(const unsigned char *uv, unsigned char *u, unsigned char *v,
+        unsigned int count, bool uFirst)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    unsigned char *first = uFirst ? u : v;
+    unsigned char *second = uFirst ? v : u;
+
+    unsigned int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (uv + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*) (uv + 2 * x + 16));
+
+        _mm_storeu_si128((__m128i*) (first + x),
+                _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128((__m128i*) (second + x),
+                _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    splitChromaScalar(uv + 2 * x, u + x, v + x, count - x, uFirst);
+}
+
+
+static const Kernels sse2Kernels = { yuvToRgbSse2, greyToRgbSse2, splitPackedSse2, splitChromaSse2 };
+
+
+/* *** AVX2 kernels ********************************************************* */
+__attribute__((target("avx2")))
+static void yuvToRgbAvx2(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+        unsigned char *out, unsigned int width, OutputFormat format)
+{
+    const unsigned int bytesPerPixel = format == ColorConversion::Rgb24 ? 3 : 4;
+
+    const __m256i c16 = _mm256_set1_epi16(16);
+    const __m256i c32 = _mm256_set1_epi16(32);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    const __m256i cY = _mm256_set1_epi16(74);
+    const __m256i cRV = _mm256_set1_epi16(102);
+    const __m256i cGV = _mm256_set1_epi16(52);
+    const __m256i cGU = _mm256_set1_epi16(25);
+    const __m256i cBU = _mm256_set1_epi16(129);
+
+    unsigned int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (y + x)));
+        __m256i y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (y + x + 16)));
+        __m256i u16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (u + x / 2))), c128);
+        __m256i v16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (v + x / 2))), c128);
+
+        /* unpacking works within 128 bit lanes - reorder the quad words so it keeps the pixel order */
+        u16 = _mm256_permute4x64_epi64(u16, 0xd8);
+        v16 = _mm256_permute4x64_epi64(v16, 0xd8);
+
+        __m256i rv = _mm256_mullo_epi16(v16, cRV);
+        __m256i gv = _mm256_mullo_epi16(v16, cGV);
+        __m256i gu = _mm256_mullo_epi16(u16, cGU);
+        __m256i bu = _mm256_mullo_epi16(u16, cBU);
+
+        __m256i rv0 = _mm256_unpacklo_epi16(rv, rv), rv1 = _mm256_unpackhi_epi16(rv, rv);
+        __m256i gv0 = _mm256_unpacklo_epi16(gv, gv), gv1 = _mm256_unpackhi_epi16(gv, gv);
+        __m256i gu0 = _mm256_unpacklo_epi16(gu, gu), gu1 = _mm256_unpackhi_epi16(gu, gu);
+        __m256i bu0 = _mm256_unpacklo_epi16(bu, bu), bu1 = _mm256_unpackhi_epi16(bu, bu);
+
+        __m256i yy0 = _mm256_mullo_epi16(_mm256_sub_epi16(y0, c16), cY);
+        __m256i yy1 = _mm256_mullo_epi16(_mm256_sub_epi16(y1, c16), cY);
+
+        __m256i r0 = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy0, rv0), c32), 6);
+        __m256i r1 = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy1, rv1), c32), 6);
+        __m256i g0 = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_subs_epi16(_mm256_subs_epi16(yy0, gv0), gu0), c32), 6);
+        __m256i g1 = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_subs_epi16(_mm256_subs_epi16(yy1, gv1), gu1), c32), 6);
+        __m256i b0 = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy0, bu0), c32), 6);
+        __m256i b1 = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy1, bu1), c32), 6);
+
+        /* packing interleaves the lanes again */
+        __m256i r8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(r0, r1), 0xd8);
+        __m256i g8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(g0, g1), 0xd8);
+        __m256i b8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(b0, b1), 0xd8);
+
+        storeRgb16(_mm256_castsi256_si128(r8), _mm256_castsi256_si128(g8), _mm256_castsi256_si128(b8),
+                out + x * bytesPerPixel, format);
+        storeRgb16(_mm256_extracti128_si256(r8, 1), _mm256_extracti128_si256(g8, 1), _mm256_extracti128_si256(b8, 1),
+                out + (x + 16) * bytesPerPixel, format);
+    }
+
+    yuvToRgbSse2(y + x, u + x / 2, v + x / 2, out + x * bytesPerPixel, width - x, format);
+}
+
+
+/* the splitting kernels are bound by memory already */
+static const Kernels avx2Kernels = { yuvToRgbAvx2, greyToRgbSse2, splitPackedSse2, splitChromaSse2 };
+#endif /* HAVE_X86_KERNELS */
+
+
+/* *** local *************************************************************** */
+const Kernels *kernelsOf(ColorConversion::InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+#ifdef HAVE_X86_KERNELS
+    case ColorConversion::Avx2:
+        return &avx2Kernels;
+    case ColorConversion::Sse2:
+        return &sse2Kernels;
+#endif
+    default:
+        return &scalarKernels;
+    }
+}
@@ -0,0 +1,80 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef COLOR_CONVERSION_HPP
+#define COLOR_CONVERSION_HPP
+
+#include "prereqs.hpp"
+
+
+/**
+ * converts native capture formats to RGB
+ *
+ * Sources: YUYV, UYVY, NV12, NV21, YUV420 (planar) with BT.601 limited range, and GREY.
+ * Every instruction set computes exactly the same bytes - the SIMD kernels are just
+ * faster versions of the scalar ones. The fastest instruction set supported by the CPU
+ * is chosen at the first conversion.
+ *
+ * No memory is allocated while converting.
+ */
+class ColorConversion
+{
+public:
+
+    enum OutputFormat
+    {
+        /** bytes R, G, B - QImage::Format_RGB888 */
+        Rgb24,
+        /** bytes R, G, B, 0xff */
+        Rgbx32
+    };
+
+    enum InstructionSet
+    {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    ColorConversion() = delete;
+
+    /** @returns true if the fourcc code (see V4L2_PIX_FMT_*) can be converted */
+    static bool isSupported(unsigned int pixelFormat);
+
+    /**
+     * @param sourceBytesPerLine stride of the luma (or packed) plane, chroma planes
+     *    follow the V4L2 conventions for the format
+     * @returns false if the source format is not supported
+     */
+    static bool convert(const unsigned char *source, unsigned int pixelFormat,
+            unsigned int width, unsigned int height, unsigned int sourceBytesPerLine,
+            unsigned char *destination, OutputFormat outputFormat, unsigned int destinationBytesPerLine);
+
+    /** the fastest instruction set this CPU supports */
+    static InstructionSet detectInstructionSet();
+
+    /** forces the kernels of an instruction set - for testing and benchmarking
+        @pre the CPU supports it */
+    static void setInstructionSet(InstructionSet);
+    static InstructionSet instructionSet();
+
+    static const char *instructionSetName(InstructionSet);
+};
+
+
+#endif /* COLOR_CONVERSION_HPP */
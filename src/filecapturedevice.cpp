@@ -0,0 +1,189 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filecapturedevice.hpp"
+
+#include "pixelformat.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+FileCaptureDevice::FileCaptureDevice() :
+        m_frameRate(30.0),
+        m_looping(true),
+        m_dataFileDescriptor(-1),
+        m_frameCount(0),
+        m_nextFrame(0)
+{
+}
+
+
+void FileCaptureDevice::setFrameRate(double framesPerSecond)
+{
+    assert(framesPerSecond >= 0.0);
+    m_frameRate = framesPerSecond;
+}
+double FileCaptureDevice::frameRate() const
+{
+    return m_frameRate;
+}
+
+
+void FileCaptureDevice::setLooping(bool looping)
+{
+    m_looping = looping;
+}
+bool FileCaptureDevice::isLooping() const
+{
+    return m_looping;
+}
+
+
+unsigned int FileCaptureDevice::frameCount() const
+{
+    return m_frameCount;
+}
+
+
+/* *** protected ************************************************************ */
+bool FileCaptureDevice::initSource()
+{
+    assert(m_fileName.empty() == false);
+    assert(m_dataFileDescriptor == -1);
+    assert(m_captureWidth > 0);
+    assert(m_captureHeight > 0);
+
+    m_ioMethod = IoMethodGenerated;
+
+    m_bytesPerLine = PixelFormat::minimumBytesPerLine(m_pixelFormat, m_captureWidth);
+    if (m_bytesPerLine == 0) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot replay pixel format "
+                << pixelFormatString(m_pixelFormat) << endl;
+        return false;
+    }
+    m_bufferSize = PixelFormat::imageSize(m_pixelFormat, m_bytesPerLine, m_captureHeight);
+
+
+    /* *** open the file *** */
+    m_dataFileDescriptor = open(m_fileName.c_str(), O_RDONLY|O_CLOEXEC);
+    if (m_dataFileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot open '" << m_fileName << "'. "
+                << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_dataFileDescriptor, &st) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot identify file. " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    m_frameCount = st.st_size / m_bufferSize;
+    if (m_frameCount == 0) {
+        cerr << __PRETTY_FUNCTION__ << " '" << m_fileName << "' holds not a single frame of "
+                << m_bufferSize << " bytes" << endl;
+        return false;
+    }
+    if (st.st_size % m_bufferSize != 0) {
+        cerr << "'" << m_fileName << "' does not end on a frame boundary - "
+                << "size or pixel format might be wrong" << endl;
+    }
+    m_nextFrame = 0;
+
+    /* read ahead, we go through it front to back */
+    posix_fadvise(m_dataFileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+
+    if (initMemoryBuffers() == false) {
+        return false;
+    }
+
+    return initFrameTimer(m_frameRate);
+}
+
+
+void FileCaptureDevice::finishSource()
+{
+    finishFrameTimer();
+    if (m_buffers.empty() == false) {
+        finishMemoryBuffers();
+    }
+
+    if (m_dataFileDescriptor != -1) {
+        close(m_dataFileDescriptor);
+        m_dataFileDescriptor = -1;
+    }
+    m_frameCount = 0;
+}
+
+
+void FileCaptureDevice::captureFrame()
+{
+    /* late periods are not made up for - the next frame is just late */
+    if (consumeFrameTimer() == 0) return;
+
+    if (m_nextFrame == m_frameCount) {
+        if (m_looping == false) return;
+        m_nextFrame = 0;
+    }
+
+    Buffer *buffer = m_ring.claimOldest();
+    if (buffer == 0) {
+        /* every buffer is locked - try again with the next period */
+        return;
+    }
+
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    off_t offset = (off_t) m_nextFrame * m_bufferSize;
+    size_t done = 0;
+    while (done < m_bufferSize) {
+        ssize_t readlen = pread(m_dataFileDescriptor, buffer->buffer + done, m_bufferSize - done, offset + done);
+        if (readlen == -1 && errno == EINTR) continue;
+        if (readlen <= 0) {
+            cerr << __PRETTY_FUNCTION__ << " Read error. " << errno << " " << strerror(errno) << endl;
+            m_ring.unclaim(buffer);
+            return;
+        }
+        done += readlen;
+    }
+
+    buffer->bytesUsed = m_bufferSize;
+    ++m_nextFrame;
+
+    /* only a frame actually read is counted */
+    stampFrame(buffer, nextFrameNumber(), time, TimestampCaptured);
+
+    publish(buffer);
+}
+
+
+void FileCaptureDevice::captureIdle()
+{
+}
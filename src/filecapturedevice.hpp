@@ -0,0 +1,72 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILE_CAPTURE_DEVICE_HPP
+#define FILE_CAPTURE_DEVICE_HPP
+
+#include "prereqs.hpp"
+
+#include "capturedevice.hpp"
+
+#include <cstddef>
+
+
+/**
+ * replays raw frames from a file instead of capturing from a device
+ *
+ * The file (see setFileName()) holds nothing but pictures of captureSize() in pixelFormat(),
+ * tightly packed (PixelFormat::minimumBytesPerLine()), one after the other - what e.g.
+ * 'ffmpeg -f rawvideo' writes. Frames are delivered in order at the set frame rate, every one
+ * of them, unless all buffers are locked by consumers.
+ */
+class FileCaptureDevice : public CaptureDevice
+{
+public:
+    FileCaptureDevice();
+
+    /** frames per second, 0 for as fast as the consumers allow. Default: 30 */
+    void setFrameRate(double);
+    double frameRate() const;
+
+    /** start over after the last frame, otherwise stop delivering. Default: true */
+    void setLooping(bool);
+    bool isLooping() const;
+
+    /** @note valid after initialization */
+    unsigned int frameCount() const;
+
+protected:
+
+    virtual bool initSource();
+    virtual void finishSource();
+    virtual void captureFrame();
+    virtual void captureIdle();
+
+private:
+
+    double m_frameRate;
+    bool m_looping;
+
+    int m_dataFileDescriptor;
+    unsigned int m_frameCount;
+    /** index of the frame delivered next */
+    unsigned int m_nextFrame;
+};
+
+
+#endif /* FILE_CAPTURE_DEVICE_HPP */
@@ -18,10 +18,7 @@
 
 #include "filtereditortab.hpp"
 
-using std::pair;
-using std::set;
-
-FilterEditorTab::FilterEditorTab(QWidget *parent, const set<pair<CreateFilterFunction, DestroyFilterFunction> > &filters
+FilterEditorTab::FilterEditorTab(QWidget *parent, FilterRegistry &filters
         ) : QWidget(parent)
 {
 }
@@ -22,19 +22,16 @@
 
 #include "prereqs.hpp"
 
-#include "basefilter.hpp"
-
 #include <QWidget>
 
-#include <set>
-#include <utility>
+class FilterRegistry;
 
 
 class FilterEditorTab : public QWidget
 {
     Q_OBJECT
 public:
-    FilterEditorTab(QWidget *parent, const std::set<std::pair<CreateFilterFunction, DestroyFilterFunction> > &filters);
+    FilterEditorTab(QWidget *parent, FilterRegistry &filters);
 };
 
 
@@ -0,0 +1,173 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filterfusion.hpp"
+#include "filterinstance.hpp"
+#include <cassert>
+#include <iostream>
+
+using namespace std;
+
+
+bool FilterFusion::isFusable(const BaseFilter *filter)
+{
+    const vector<BaseFilter::Port> &inputs = filter->inputPorts();
+    const vector<BaseFilter::Port> &outputs = filter->outputPorts();
+
+    return filter->fusion() != BaseFilter::FusionNone
+            && inputs.size() == 1 && inputs.front().type == BaseFilter::PortTypeImage
+            && outputs.size() == 1 && outputs.front().type == BaseFilter::PortTypeImage;
+}
+
+
+FilterFusion::FilterFusion() :
+        m_savedBytes(0),
+        m_input(0),
+        m_inputBytesPerLine(0)
+{
+}
+
+
+bool FilterFusion::setUp(const vector<BaseFilter*> &filters, const vector<BaseFilter::Image> &images)
+{
+    VT
+
+    assert(filters.empty() == false);
+    assert(images.size() == filters.size() + 1);
+
+    m_stages.clear();
+    m_images.clear();
+    m_savedBytes = 0;
+
+    for (unsigned int a = 0; a < images.size(); ++a) {
+        if (images[a].width != images[0].width || images[a].height != images[0].height
+                || FilterInstance::minimumBytesPerLine(images[a]) == 0) {
+            return false;
+        }
+    }
+
+    m_stages.resize(filters.size());
+    for (unsigned int a = 0; a < filters.size(); ++a) {
+
+        assert(isFusable(filters[a]) == true);
+
+        Stage &stage = m_stages[a];
+        stage.filter = filters[a];
+        stage.fusion = filters[a]->fusion();
+        stage.radius = stage.fusion == BaseFilter::FusionSeparableStencil ? filters[a]->stencilRadius() : 0;
+        stage.rowLength = FilterInstance::minimumBytesPerLine(images[a + 1]);
+        stage.row.resize(stage.rowLength);
+        stage.fetched = 0;
+
+        if (stage.fusion == BaseFilter::FusionSeparableStencil) {
+            stage.ring.resize((2 * stage.radius + 1) * stage.rowLength);
+            stage.window.resize(2 * stage.radius + 1);
+        }
+
+        /* every intermediate image would be written once and read once */
+        if (a + 1 < filters.size()) m_savedBytes += 2ull * FilterInstance::imageSize(images[a + 1]);
+    }
+
+    m_images = images;
+
+    return true;
+}
+
+
+bool FilterFusion::isSetUpFor(const vector<BaseFilter::Image> &images) const
+{
+    if (m_stages.empty() == true || images.size() != m_images.size()) return false;
+
+    for (unsigned int a = 0; a < images.size(); ++a) {
+        if (images[a].width != m_images[a].width || images[a].height != m_images[a].height
+                || images[a].bytesPerLine != m_images[a].bytesPerLine
+                || images[a].pixelFormat != m_images[a].pixelFormat) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void FilterFusion::run(const BaseFilter::Image &input, const BaseFilter::Image &output)
+{
+    VT
+
+    assert(m_stages.empty() == false);
+
+    m_input = input.data;
+    m_inputBytesPerLine = input.bytesPerLine;
+
+    for (auto it = m_stages.begin(); it != m_stages.end(); ++it) {
+        it->fetched = 0;
+    }
+
+    for (unsigned int y = 0; y < output.height; ++y) {
+        produceRow(m_stages.size() - 1, y, output.data + y * output.bytesPerLine);
+    }
+}
+
+
+unsigned long long FilterFusion::savedBytes() const
+{
+    return m_savedBytes;
+}
+
+
+/* *** private ************************************************************ */
+void FilterFusion::produceRow(unsigned int stageIndex, unsigned int y, unsigned char *out)
+{
+    Stage &stage = m_stages[stageIndex];
+    const unsigned int width = m_images[0].width;
+
+    if (stage.fusion == BaseFilter::FusionPerPixel) {
+        stage.filter->processRow(inputRow(stageIndex, y), out, width);
+        return;
+    }
+
+    /* stencil - filter the input rows up to y + radius horizontally into the ring */
+    const unsigned int height = m_images[0].height;
+    const unsigned int size = 2 * stage.radius + 1;
+    const unsigned int last = y + stage.radius < height ? y + stage.radius : height - 1;
+
+    for (; stage.fetched <= last; ++stage.fetched) {
+        stage.filter->processRowHorizontal(inputRow(stageIndex, stage.fetched),
+                &stage.ring[(stage.fetched % size) * stage.rowLength], width);
+    }
+
+    for (unsigned int a = 0; a < size; ++a) {
+        int row = (int) y - (int) stage.radius + (int) a;
+        if (row < 0) row = 0;
+        if (row >= (int) height) row = height - 1;
+        stage.window[a] = &stage.ring[(row % size) * stage.rowLength];
+    }
+
+    stage.filter->processRowVertical(&stage.window[0], out, width);
+}
+
+
+const unsigned char *FilterFusion::inputRow(unsigned int stageIndex, unsigned int y)
+{
+    if (stageIndex == 0) return m_input + y * m_inputBytesPerLine;
+
+    Stage &previous = m_stages[stageIndex - 1];
+    produceRow(stageIndex - 1, y, &previous.row[0]);
+
+    return &previous.row[0];
+}
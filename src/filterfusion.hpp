@@ -0,0 +1,103 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILTER_FUSION_HPP
+#define FILTER_FUSION_HPP
+
+#include "prereqs.hpp"
+
+#include "basefilter.hpp"
+
+#include <vector>
+
+
+/**
+ * runs a chain of filters with row kernels as a single pass over the image
+ *
+ * Rows are pulled through the chain one at a time: a per-pixel filter turns the row of its
+ * predecessor into its own, a stencil keeps the 2 * radius + 1 horizontally filtered rows it
+ * needs in a ring. So only the input and the output image are touched in memory, the
+ * intermediate rows stay in the cache, instead of writing and reading back an image per filter.
+ *
+ * @see BaseFilter::fusion()
+ */
+class FilterFusion
+{
+public:
+
+    /** @returns true if the filter can be part of a fused chain - decided by its ports and
+        row kernels, the image formats are checked in setUp() */
+    static bool isFusable(const BaseFilter*);
+
+    FilterFusion();
+    FilterFusion(const FilterFusion&) = delete;
+    FilterFusion &operator=(const FilterFusion&) = delete;
+
+    /**
+     * @param filters the chain, each one feeding the next, all prepared for the images
+     * @param images input image of the first filter, then the output image of each filter
+     *    - only the formats matter
+     * @returns false if the images differ in size or have unknown formats
+     */
+    bool setUp(const std::vector<BaseFilter*> &filters, const std::vector<BaseFilter::Image> &images);
+
+    /** @returns true if setUp() was called with images of these formats */
+    bool isSetUpFor(const std::vector<BaseFilter::Image> &images) const;
+
+    /** runs the chain from input to output, formats as set up */
+    void run(const BaseFilter::Image &input, const BaseFilter::Image &output);
+
+    /** @returns bytes per run not written to and read back from memory, because the
+        intermediate images are never built */
+    unsigned long long savedBytes() const;
+
+private:
+
+    struct Stage
+    {
+        BaseFilter *filter;
+        BaseFilter::Fusion fusion;
+        unsigned int radius;
+        /** bytes of an output row */
+        unsigned int rowLength;
+        /** the output row, when feeding the next stage */
+        std::vector<unsigned char> row;
+        /** stencils: horizontally filtered rows, row y at y % (2 * radius + 1) */
+        std::vector<unsigned char> ring;
+        /** stencils: rows in the ring so far */
+        unsigned int fetched;
+        std::vector<const unsigned char*> window;
+    };
+
+    /** computes output row y of a stage into out
+        @note rows have to be requested in ascending order */
+    void produceRow(unsigned int stage, unsigned int y, unsigned char *out);
+    /** @returns input row y of a stage */
+    const unsigned char *inputRow(unsigned int stage, unsigned int y);
+
+    std::vector<Stage> m_stages;
+    std::vector<BaseFilter::Image> m_images;
+    unsigned long long m_savedBytes;
+
+    /** the current run's input */
+    const unsigned char *m_input;
+    unsigned int m_inputBytesPerLine;
+};
+
+
+#endif /* FILTER_FUSION_HPP */
@@ -0,0 +1,789 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filtergraph.hpp"
+#include "filterfusion.hpp"
+#include "filterinstance.hpp"
+#include "threadpool.hpp"
+#include "tracer.hpp"
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+using namespace std;
+
+
+FilterGraph::FilterGraph(unsigned int threadCount, unsigned int framesInFlight) :
+        m_built(false),
+        m_fusionEnabled(true),
+        m_paused(false),
+        m_threadPool(new ThreadPool(threadCount)),
+        m_framesInFlight(framesInFlight),
+        m_submittedSequence(0),
+        m_finishedSequence(0),
+        m_failedCount(0),
+        m_frameFinishedFunction(0),
+        m_frameFinishedUserData(0),
+        m_feederThread(0),
+        m_feederCancellationFlag(false)
+{
+    assert(framesInFlight > 0);
+}
+
+
+FilterGraph::~FilterGraph()
+{
+    stop();
+    waitUntilIdle();
+
+    /* finishes the last tasks, which already freed their slots */
+    delete m_threadPool;
+
+    for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it) {
+        delete it->fusion;
+        delete it->instance;
+    }
+}
+
+
+unsigned int FilterGraph::addSource(CaptureDevice *device)
+{
+    assert(device != 0);
+    assert(isRunning() == false);
+
+    m_sources.push_back(device);
+    m_built = false;
+
+    return m_sources.size() - 1;
+}
+
+
+unsigned int FilterGraph::addFilter(CreateFilterFunction create, DestroyFilterFunction destroy)
+{
+    assert(isRunning() == false);
+
+    Node node;
+    node.instance = new FilterInstance(create, destroy, m_framesInFlight);
+
+    Connection unconnected = {-1, 0, SourcePortImage};
+    node.inputs.resize(node.instance->filter()->inputPorts().size(), unconnected);
+    node.consumerCount.resize(node.instance->filter()->outputPorts().size(), 0);
+    node.predecessorCount = 0;
+    node.fusedInto = -1;
+    node.fusion = 0;
+    node.fusionSavedBytes = 0;
+    node.nextSequence = m_submittedSequence + 1;
+    node.running = false;
+
+    m_nodes.push_back(node);
+    m_built = false;
+
+    return m_nodes.size() - 1;
+}
+
+
+void FilterGraph::connect(unsigned int fromFilter, unsigned int outputPort, unsigned int toFilter, unsigned int inputPort)
+{
+    assert(isRunning() == false);
+    assert(fromFilter < m_nodes.size() && toFilter < m_nodes.size());
+
+    const vector<BaseFilter::Port> &outputs = m_nodes[fromFilter].instance->filter()->outputPorts();
+    const vector<BaseFilter::Port> &inputs = m_nodes[toFilter].instance->filter()->inputPorts();
+    assert(outputPort < outputs.size() && inputPort < inputs.size());
+    assert(outputs[outputPort].type == inputs[inputPort].type);
+
+    Connection connection = {(int) fromFilter, outputPort, SourcePortImage};
+    m_nodes[toFilter].inputs[inputPort] = connection;
+    m_built = false;
+}
+
+
+void FilterGraph::connectSource(unsigned int source, SourcePort sourcePort, unsigned int toFilter, unsigned int inputPort)
+{
+    assert(isRunning() == false);
+    assert(source < m_sources.size() && toFilter < m_nodes.size());
+
+    const vector<BaseFilter::Port> &inputs = m_nodes[toFilter].instance->filter()->inputPorts();
+    assert(inputPort < inputs.size());
+    assert(inputs[inputPort].type == (sourcePort == SourcePortImage
+            ? BaseFilter::PortTypeImage : BaseFilter::PortTypeTime));
+
+    Connection connection = {-2, source, sourcePort};
+    m_nodes[toFilter].inputs[inputPort] = connection;
+    m_built = false;
+}
+
+
+bool FilterGraph::build()
+{
+    VT
+
+    assert(isRunning() == false);
+
+    if (m_built == true) return true;
+
+    waitUntilIdle();
+
+    for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it) {
+        it->successors.clear();
+        it->predecessorCount = 0;
+        for (auto itCount = it->consumerCount.begin(); itCount != it->consumerCount.end(); ++itCount) {
+            *itCount = 0;
+        }
+    }
+
+    /* edges */
+    for (unsigned int a = 0; a < m_nodes.size(); ++a) {
+
+        const vector<BaseFilter::Port> &ports = m_nodes[a].instance->filter()->inputPorts();
+
+        for (unsigned int b = 0; b < m_nodes[a].inputs.size(); ++b) {
+
+            const Connection &connection = m_nodes[a].inputs[b];
+
+            if (connection.fromFilter == -1) {
+                cerr << __PRETTY_FUNCTION__ << " input \"" << ports[b].name << "\" of filter " << a
+                        << " \"" << m_nodes[a].instance->filter()->name() << "\" is not connected" << endl;
+                return false;
+            }
+            if (connection.fromFilter < 0) continue;
+
+            Node &from = m_nodes[connection.fromFilter];
+            ++from.consumerCount[connection.from];
+
+            bool known = false;
+            for (auto it = from.successors.begin(); it != from.successors.end(); ++it) {
+                if (*it == a) known = true;
+            }
+            if (known == false) {
+                from.successors.push_back(a);
+                ++m_nodes[a].predecessorCount;
+            }
+        }
+    }
+
+    /* topological order - Kahn's algorithm */
+    m_order.clear();
+    vector<unsigned int> pending(m_nodes.size());
+    for (unsigned int a = 0; a < m_nodes.size(); ++a) {
+        pending[a] = m_nodes[a].predecessorCount;
+        if (pending[a] == 0) m_order.push_back(a);
+    }
+    for (unsigned int a = 0; a < m_order.size(); ++a) {
+        const vector<unsigned int> &successors = m_nodes[m_order[a]].successors;
+        for (auto it = successors.begin(); it != successors.end(); ++it) {
+            if (--pending[*it] == 0) m_order.push_back(*it);
+        }
+    }
+    if (m_order.size() != m_nodes.size()) {
+        cerr << __PRETTY_FUNCTION__ << " the filters form a cycle" << endl;
+        return false;
+    }
+
+    fuse();
+
+    /* everything needed while running, so nothing gets allocated per frame */
+    m_slots.resize(m_framesInFlight);
+    for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+        it->busy = false;
+        it->failed = false;
+        it->sequence = 0;
+        it->frames.resize(m_sources.size());
+        it->pendingPredecessors.resize(m_nodes.size());
+        it->remainingFilters = 0;
+    }
+
+    m_tasks.resize(m_nodes.size() * m_framesInFlight);
+    for (unsigned int a = 0; a < m_tasks.size(); ++a) {
+        m_tasks[a].graph = this;
+        m_tasks[a].filter = a / m_framesInFlight;
+        m_tasks[a].slot = a % m_framesInFlight;
+    }
+
+    m_built = true;
+
+    return true;
+}
+
+
+void FilterGraph::setFrameFinishedFunction(FrameFinishedFunction function, void *userData)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    m_frameFinishedFunction = function;
+    m_frameFinishedUserData = userData;
+}
+
+
+void FilterGraph::setFusionEnabled(bool enabled)
+{
+    assert(isRunning() == false);
+
+    m_fusionEnabled = enabled;
+    m_built = false;
+}
+
+
+bool FilterGraph::isFusionEnabled() const
+{
+    return m_fusionEnabled;
+}
+
+
+unsigned long long FilterGraph::fusionSavedBytes()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    unsigned long long ret = 0;
+    for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it) {
+        ret += it->fusionSavedBytes;
+    }
+
+    return ret;
+}
+
+
+unsigned int FilterGraph::sourceCount() const
+{
+    return m_sources.size();
+}
+
+
+unsigned int FilterGraph::filterCount() const
+{
+    return m_nodes.size();
+}
+
+
+BaseFilter *FilterGraph::filter(unsigned int filter) const
+{
+    assert(filter < m_nodes.size());
+
+    return m_nodes[filter].instance->filter();
+}
+
+
+const vector<unsigned int> &FilterGraph::order() const
+{
+    return m_order;
+}
+
+
+bool FilterGraph::submit(const CaptureDevice::FrameHandle *frames)
+{
+    if (m_built == false && build() == false) return false;
+
+    int slot;
+    do {
+        slot = acquireSlot(100);
+    } while (slot == -1);
+
+    submitSlot(slot, frames);
+
+    return true;
+}
+
+
+bool FilterGraph::start()
+{
+    assert(isRunning() == false);
+
+    if (m_sources.empty() == true) {
+        cerr << __PRETTY_FUNCTION__ << " no sources" << endl;
+        return false;
+    }
+    if (m_built == false && build() == false) return false;
+
+    m_feederCancellationFlag = false;
+    m_feederThread = new thread(bind(feederThread, this));
+
+    return true;
+}
+
+
+void FilterGraph::stop()
+{
+    if (m_feederThread == 0) return;
+
+    m_feederCancellationFlag = true;
+    m_frameNotifier.notify();
+    m_feederThread->join();
+    delete m_feederThread;
+    m_feederThread = 0;
+
+    waitUntilIdle();
+}
+
+
+bool FilterGraph::isRunning() const
+{
+    return m_feederThread != 0;
+}
+
+
+void FilterGraph::waitUntilIdle()
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    for (;;) {
+        bool busy = false;
+        for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+            if (it->busy == true) busy = true;
+        }
+        if (busy == false) break;
+
+        m_slotFinished.wait(lock);
+    }
+}
+
+
+bool FilterGraph::replaceFilter(unsigned int filter, CreateFilterFunction create, DestroyFilterFunction destroy)
+{
+    VT
+
+    assert(filter < m_nodes.size());
+
+    Node &node = m_nodes[filter];
+    FilterInstance *instance = new FilterInstance(create, destroy, m_framesInFlight);
+
+    const vector<BaseFilter::Port> &oldInputs = node.instance->filter()->inputPorts();
+    const vector<BaseFilter::Port> &oldOutputs = node.instance->filter()->outputPorts();
+    const vector<BaseFilter::Port> &newInputs = instance->filter()->inputPorts();
+    const vector<BaseFilter::Port> &newOutputs = instance->filter()->outputPorts();
+
+    bool samePorts = oldInputs.size() == newInputs.size() && oldOutputs.size() == newOutputs.size();
+    for (unsigned int a = 0; samePorts == true && a < oldInputs.size(); ++a) {
+        if (oldInputs[a].type != newInputs[a].type) samePorts = false;
+    }
+    for (unsigned int a = 0; samePorts == true && a < oldOutputs.size(); ++a) {
+        if (oldOutputs[a].type != newOutputs[a].type) samePorts = false;
+    }
+    if (samePorts == false) {
+        cerr << __PRETTY_FUNCTION__ << " the ports of the new \"" << instance->filter()->name()
+                << "\" differ from the old ones" << endl;
+        delete instance;
+        return false;
+    }
+
+    /* the frame boundary */
+    m_mutex.lock();
+    m_paused = true;
+    m_mutex.unlock();
+
+    waitUntilIdle();
+
+    vector<unsigned char> state;
+    if (node.instance->filter()->saveState(state) == true) {
+        if (instance->filter()->restoreState(state) == false) {
+            cerr << __PRETTY_FUNCTION__ << " the new \"" << instance->filter()->name()
+                    << "\" does not take the state of the old one" << endl;
+        }
+    }
+
+    delete node.instance;
+    node.instance = instance;
+
+    m_mutex.lock();
+
+    /* the fused chains point to the filters, and the new one may fuse differently */
+    if (m_built == true) fuse();
+
+    m_paused = false;
+    m_mutex.unlock();
+
+    m_slotFinished.notify_all();
+
+    return true;
+}
+
+
+const BaseFilter::Value &FilterGraph::output(unsigned int slot, unsigned int filter, unsigned int outputPort) const
+{
+    assert(slot < m_slots.size() && filter < m_nodes.size());
+
+    return m_nodes[filter].instance->output(outputPort, slot);
+}
+
+
+const CaptureDevice::FrameHandle &FilterGraph::frame(unsigned int slot, unsigned int source) const
+{
+    assert(slot < m_slots.size() && source < m_sources.size());
+
+    return m_slots[slot].frames[source];
+}
+
+
+unsigned long long FilterGraph::sequence(unsigned int slot) const
+{
+    assert(slot < m_slots.size());
+
+    return m_slots[slot].sequence;
+}
+
+
+unsigned long long FilterGraph::failedCount()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return m_failedCount;
+}
+
+
+/* *** private ************************************************************ */
+int FilterGraph::acquireSlot(unsigned int timeoutMilliseconds)
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    MonotonicClock::time_point timeout = MonotonicClock::now() + chrono::milliseconds(timeoutMilliseconds);
+
+    for (;;) {
+        for (unsigned int a = 0; a < m_slots.size() && m_paused == false; ++a) {
+            if (m_slots[a].busy == false) {
+                m_slots[a].busy = true;
+                return a;
+            }
+        }
+
+        if (m_slotFinished.wait_until(lock, timeout) == cv_status::timeout) return -1;
+    }
+}
+
+
+void FilterGraph::releaseSlot(unsigned int slot)
+{
+    m_mutex.lock();
+    m_slots[slot].busy = false;
+    m_mutex.unlock();
+
+    m_slotFinished.notify_all();
+}
+
+
+void FilterGraph::submitSlot(unsigned int slot, const CaptureDevice::FrameHandle *frames)
+{
+    VT
+
+    Slot &s = m_slots[slot];
+
+    m_mutex.lock();
+
+    for (unsigned int a = 0; a < m_sources.size(); ++a) {
+        assert(frames[a].isNull() == false);
+        s.frames[a] = frames[a];
+    }
+    s.failed = false;
+    s.sequence = ++m_submittedSequence;
+    s.remainingFilters = m_nodes.size();
+    for (unsigned int a = 0; a < m_nodes.size(); ++a) {
+        s.pendingPredecessors[a] = m_nodes[a].predecessorCount;
+    }
+
+    for (unsigned int a = 0; a < m_nodes.size() && m_nodes[m_order[a]].predecessorCount == 0; ++a) {
+        tryStart(m_order[a], slot);
+    }
+
+    m_mutex.unlock();
+
+    if (m_nodes.empty() == true) finishSlot(slot);
+}
+
+
+void FilterGraph::tryStart(unsigned int filter, unsigned int slot)
+{
+    Node &node = m_nodes[filter];
+    Slot &s = m_slots[slot];
+
+    if (node.running == true || node.nextSequence != s.sequence || s.pendingPredecessors[filter] > 0) return;
+
+    node.running = true;
+    m_threadPool->post(filterTask, &m_tasks[filter * m_framesInFlight + slot]);
+}
+
+
+int FilterGraph::slotOfSequence(unsigned long long sequence) const
+{
+    for (unsigned int a = 0; a < m_slots.size(); ++a) {
+        if (m_slots[a].busy == true && m_slots[a].sequence == sequence) return a;
+    }
+
+    return -1;
+}
+
+
+void FilterGraph::fuse()
+{
+    for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it) {
+        it->fusedChain.clear();
+        it->fusedInto = -1;
+        delete it->fusion;
+        it->fusion = 0;
+        it->fusionSavedBytes = 0;
+    }
+
+    if (m_fusionEnabled == false) return;
+
+    /* in topological order, so a chain is always found from its head */
+    for (auto it = m_order.begin(); it != m_order.end(); ++it) {
+
+        Node &head = m_nodes[*it];
+        if (head.fusedInto != -1 || FilterFusion::isFusable(head.instance->filter()) == false) continue;
+
+        vector<unsigned int> chain(1, *it);
+        for (;;) {
+            const Node &last = m_nodes[chain.back()];
+
+            /* the intermediate image has to be used by the next filter only */
+            if (last.consumerCount[0] != 1 || last.successors.size() != 1) break;
+
+            unsigned int next = last.successors.front();
+            if (FilterFusion::isFusable(m_nodes[next].instance->filter()) == false) break;
+
+            chain.push_back(next);
+        }
+
+        if (chain.size() < 2) continue;
+
+        head.fusedChain = chain;
+        head.fusion = new FilterFusion();
+        head.fusedFilters.resize(chain.size());
+        head.fusedImages.resize(chain.size() + 1);
+        for (unsigned int a = 0; a < chain.size(); ++a) {
+            head.fusedFilters[a] = m_nodes[chain[a]].instance->filter();
+            if (a > 0) m_nodes[chain[a]].fusedInto = *it;
+        }
+    }
+}
+
+
+void FilterGraph::setInputs(unsigned int filter, unsigned int slot)
+{
+    Node &node = m_nodes[filter];
+    Slot &s = m_slots[slot];
+
+    /* the predecessors are done with this slot, their outputs stay untouched until it is reused */
+    for (unsigned int a = 0; a < node.inputs.size(); ++a) {
+
+        const Connection &connection = node.inputs[a];
+
+        if (connection.fromFilter >= 0) {
+
+            const Node &from = m_nodes[connection.fromFilter];
+            node.instance->setInput(a, from.instance->output(connection.from, slot),
+                    from.consumerCount[connection.from] == 1, slot);
+
+        } else if (connection.sourcePort == SourcePortImage) {
+
+            node.instance->setInput(a, *s.frames[connection.from], slot);
+
+        } else {
+
+            BaseFilter::Value time;
+            time.type = BaseFilter::PortTypeTime;
+            time.time = s.frames[connection.from]->time;
+            node.instance->setInput(a, time, false, slot);
+        }
+    }
+}
+
+
+void FilterGraph::runFilter(unsigned int filter, unsigned int slot)
+{
+    VT
+
+    Node &node = m_nodes[filter];
+    Slot &s = m_slots[slot];
+
+    m_mutex.lock();
+    bool failed = s.failed;
+    m_mutex.unlock();
+
+    /* filters fused into a chain were run by its head already */
+    if (failed == false && node.fusedInto == -1) {
+
+        setInputs(filter, slot);
+
+        if (node.fusedChain.empty() == true) {
+            failed = node.instance->process(slot) == false;
+        } else {
+            failed = runFusedChain(filter, slot) == false;
+        }
+    }
+
+    m_mutex.lock();
+
+    if (failed == true) s.failed = true;
+
+    node.running = false;
+    ++node.nextSequence;
+
+    for (auto it = node.successors.begin(); it != node.successors.end(); ++it) {
+        --s.pendingPredecessors[*it];
+        tryStart(*it, slot);
+    }
+
+    int nextSlot = slotOfSequence(node.nextSequence);
+    if (nextSlot != -1) tryStart(filter, nextSlot);
+
+    bool finished = --s.remainingFilters == 0;
+
+    m_mutex.unlock();
+
+    if (finished == true) finishSlot(slot);
+}
+
+
+void FilterGraph::finishSlot(unsigned int slot)
+{
+    VT
+
+    Slot &s = m_slots[slot];
+
+    unique_lock<mutex> lock(m_mutex);
+
+    /* report in order */
+    while (m_finishedSequence + 1 != s.sequence) {
+        m_slotFinished.wait(lock);
+    }
+
+    FrameFinishedFunction function = m_frameFinishedFunction;
+    void *userData = m_frameFinishedUserData;
+    bool failed = s.failed;
+
+    lock.unlock();
+
+    if (failed == false && function != 0) function(this, slot, userData);
+
+    lock.lock();
+
+    for (auto it = s.frames.begin(); it != s.frames.end(); ++it) {
+        it->reset();
+    }
+    if (failed == true) ++m_failedCount;
+    m_finishedSequence = s.sequence;
+    s.busy = false;
+
+    lock.unlock();
+
+    m_slotFinished.notify_all();
+}
+
+
+bool FilterGraph::runFusedChain(unsigned int filter, unsigned int slot)
+{
+    VT
+
+    Node &head = m_nodes[filter];
+    const vector<unsigned int> &chain = head.fusedChain;
+
+    /* prepares the filters and their outputs, as if they ran one after another */
+    for (unsigned int a = 0; a < chain.size(); ++a) {
+
+        FilterInstance *instance = m_nodes[chain[a]].instance;
+
+        if (a > 0) instance->setInput(0, m_nodes[chain[a - 1]].instance->output(0, slot), false, slot);
+        if (instance->prepareSlot(slot) == false) return false;
+
+        head.fusedImages[a + 1] = instance->output(0, slot).image;
+    }
+    head.fusedImages[0] = head.instance->input(0, slot).image;
+
+    if (head.fusion->isSetUpFor(head.fusedImages) == false) {
+
+        bool fusable = head.fusion->setUp(head.fusedFilters, head.fusedImages);
+
+        m_mutex.lock();
+        head.fusionSavedBytes = fusable == true ? head.fusion->savedBytes() : 0;
+        m_mutex.unlock();
+
+        if (fusable == true) {
+            cerr << "Fused " << chain.size() << " filters starting with \"" << head.instance->filter()->name()
+                    << "\", saving " << head.fusion->savedBytes() << " bytes of memory traffic per frame" << endl;
+        }
+    }
+
+    if (head.fusion->isSetUpFor(head.fusedImages) == false) {
+
+        /* the image sizes change along the chain - one filter after another then */
+        for (auto it = chain.begin(); it != chain.end(); ++it) {
+            if (m_nodes[*it].instance->process(slot) == false) return false;
+        }
+        return true;
+    }
+
+    head.fusion->run(head.fusedImages.front(), head.fusedImages.back());
+
+    return true;
+}
+
+
+/* *** static functions ***************************************************** */
+void FilterGraph::filterTask(void *argument)
+{
+    Task *task = static_cast<Task*>(argument);
+
+    task->graph->runFilter(task->filter, task->slot);
+}
+
+
+void FilterGraph::feederThread(FilterGraph *graph)
+{
+    Tracer::setThreadName("filter graph feeder");
+
+    CaptureDevice *primary = graph->m_sources.front();
+    vector<CaptureDevice::FrameHandle> frames(graph->m_sources.size());
+    timespec lastTime = {numeric_limits<time_t>::min(), 0};
+
+    primary->subscribe(&graph->m_frameNotifier);
+
+    while (graph->m_feederCancellationFlag == false) {
+
+        /* taken before looking, so a frame published meanwhile ends the wait below at once */
+        unsigned long long generation = graph->m_frameNotifier.generation();
+
+        if (primary->newerBuffersAvailable(lastTime) == 0) {
+            graph->m_frameNotifier.wait(generation, 100);
+            continue;
+        }
+
+        /* wait for a slot first, so the newest frames are taken */
+        int slot = graph->acquireSlot(100);
+        if (slot == -1) continue;
+
+        bool complete = true;
+        for (unsigned int a = 0; a < frames.size(); ++a) {
+            frames[a] = graph->m_sources[a]->lockNewestBuffer();
+            if (frames[a].isNull() == true) complete = false;
+        }
+
+        if (complete == true) {
+            lastTime = frames.front()->time;
+            graph->submitSlot(slot, &frames[0]);
+        } else {
+            graph->releaseSlot(slot);
+        }
+
+        for (auto it = frames.begin(); it != frames.end(); ++it) {
+            it->reset();
+        }
+    }
+
+    primary->unsubscribe(&graph->m_frameNotifier);
+}
@@ -0,0 +1,255 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILTER_GRAPH_HPP
+#define FILTER_GRAPH_HPP
+
+#include "prereqs.hpp"
+
+#include "basefilter.hpp"
+#include "capturedevice.hpp"
+#include "framenotifier.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+class FilterFusion;
+class FilterInstance;
+class ThreadPool;
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * runs a directed acyclic graph of filters on captured frames - no GUI needed
+ *
+ * Sources are capture devices, their frames (image and time) are fed into filter inputs.
+ * Each submitted frame set occupies one of 'framesInFlight' slots until every filter
+ * processed it. Filters run on a thread pool as soon as their inputs are ready, so
+ * independent branches run in parallel and successive frames are pipelined: frame N+1 is
+ * in the first filter, while frame N is in the third.
+ *
+ * A filter sees the frames strictly in order and never two at a time, so filters may keep
+ * state between frames and need not be thread safe.
+ *
+ * An output consumed by exactly one filter may be overwritten by it (processing in place).
+ *
+ * Chains of filters with row kernels are fused into single passes (see FilterFusion), the
+ * outputs of all but the last filter of such a chain are not written then.
+ */
+class FilterGraph
+{
+public:
+
+    /** called on a pool thread for each processed frame set, in order, before the slot is reused */
+    typedef void (*FrameFinishedFunction)(FilterGraph*, unsigned int slot, void *userData);
+
+    enum SourcePort
+    {
+        SourcePortImage,
+        SourcePortTime
+    };
+
+    /** @param threadCount 0 for one thread per processor
+        @param framesInFlight frame sets processed at the same time at most */
+    explicit FilterGraph(unsigned int threadCount = 0, unsigned int framesInFlight = 3);
+    /** stops and waits for the frames in flight */
+    ~FilterGraph();
+    FilterGraph(const FilterGraph&) = delete;
+    FilterGraph &operator=(const FilterGraph&) = delete;
+
+    /* *** building - not while running *** */
+
+    /** @returns index of the source */
+    unsigned int addSource(CaptureDevice*);
+    /** @returns index of the filter */
+    unsigned int addFilter(CreateFilterFunction, DestroyFilterFunction);
+
+    void connect(unsigned int fromFilter, unsigned int outputPort, unsigned int toFilter, unsigned int inputPort);
+    void connectSource(unsigned int source, SourcePort, unsigned int toFilter, unsigned int inputPort);
+
+    /** checks the graph and orders the filters - done by submit() and start() if needed
+        @returns false if inputs are unconnected or the graph has a cycle */
+    bool build();
+
+    void setFrameFinishedFunction(FrameFinishedFunction, void *userData);
+
+    /** fuse chains of filters with row kernels. Default: true */
+    void setFusionEnabled(bool);
+    bool isFusionEnabled() const;
+    /** @returns bytes of memory traffic per frame set avoided by fusing filters
+        @note known after the first frame set */
+    unsigned long long fusionSavedBytes();
+
+    unsigned int sourceCount() const;
+    unsigned int filterCount() const;
+    BaseFilter *filter(unsigned int filter) const;
+    /** @returns the filters, each one after all filters it depends on
+        @note valid after build() */
+    const std::vector<unsigned int> &order() const;
+
+    /* *** running *** */
+
+    /** processes a set of frames, one per source - blocks while all slots are busy
+        @returns false if the graph cannot be built */
+    bool submit(const CaptureDevice::FrameHandle *frames);
+
+    /** feeds the newest frames of the sources on an own thread, each time the first source publishes one
+        @note frames published while all slots are busy are skipped */
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    /** blocks until no frame set is in flight anymore */
+    void waitUntilIdle();
+
+    /**
+     * swaps a filter for a new one, e.g. out of a reloaded plugin - also while running
+     *
+     * At a frame boundary of the whole graph, not just of the filter: no frame set is
+     * submitted meanwhile, the ones in flight are finished first - so every filter pauses
+     * for the longest frame in flight plus the swap. The sources keep capturing, the feeder
+     * just skips their frames for that time. The state of the old filter is handed over, if both support it
+     * (see BaseFilter::saveState()).
+     *
+     * @returns false if the ports of the new filter differ - the old one stays then
+     * @note not from a FrameFinishedFunction
+     */
+    bool replaceFilter(unsigned int filter, CreateFilterFunction, DestroyFilterFunction);
+
+    /* *** results - for a slot handed to the FrameFinishedFunction *** */
+
+    const BaseFilter::Value &output(unsigned int slot, unsigned int filter, unsigned int outputPort) const;
+    const CaptureDevice::FrameHandle &frame(unsigned int slot, unsigned int source) const;
+    /** @returns number of the frame set, starting at 1 */
+    unsigned long long sequence(unsigned int slot) const;
+
+    /** @returns number of frame sets dropped because a filter rejected its inputs */
+    unsigned long long failedCount();
+
+private:
+
+    struct Connection
+    {
+        /** -1 if unconnected, -2 for a source */
+        int fromFilter;
+        /** output port, or source index for sources */
+        unsigned int from;
+        SourcePort sourcePort;
+    };
+
+    struct Node
+    {
+        FilterInstance *instance;
+        std::vector<Connection> inputs;
+        /** per output port: number of inputs it is connected to */
+        std::vector<unsigned int> consumerCount;
+        /** filters fed by this one, each listed once */
+        std::vector<unsigned int> successors;
+        unsigned int predecessorCount;
+
+        /** filters run as one pass by this one, itself included - empty if not the head of a chain */
+        std::vector<unsigned int> fusedChain;
+        /** head of the chain this filter is fused into, -1 if none */
+        int fusedInto;
+        FilterFusion *fusion;
+        std::vector<BaseFilter*> fusedFilters;
+        std::vector<BaseFilter::Image> fusedImages;
+        unsigned long long fusionSavedBytes;
+
+        /** sequence number of the frame set to be processed next */
+        unsigned long long nextSequence;
+        bool running;
+    };
+
+    struct Slot
+    {
+        bool busy;
+        bool failed;
+        unsigned long long sequence;
+        std::vector<CaptureDevice::FrameHandle> frames;
+        /** per filter: predecessors, which have not finished the slot yet */
+        std::vector<unsigned int> pendingPredecessors;
+        unsigned int remainingFilters;
+    };
+
+    struct Task
+    {
+        FilterGraph *graph;
+        unsigned int filter;
+        unsigned int slot;
+    };
+
+    /** @returns a free slot, -1 if none got free in time */
+    int acquireSlot(unsigned int timeoutMilliseconds);
+    /** frees an acquired slot without submitting it */
+    void releaseSlot(unsigned int slot);
+    void submitSlot(unsigned int slot, const CaptureDevice::FrameHandle *frames);
+
+    /** posts the filter for the slot if it is its turn and its inputs are ready
+        @pre m_mutex is locked */
+    void tryStart(unsigned int filter, unsigned int slot);
+    /** @returns the busy slot with that sequence number, -1 if none */
+    int slotOfSequence(unsigned long long sequence) const;
+    /** finds the chains of fusable filters
+        @pre m_order is set */
+    void fuse();
+    void setInputs(unsigned int filter, unsigned int slot);
+    void runFilter(unsigned int filter, unsigned int slot);
+    /** @returns false if a filter of the chain does not accept its inputs */
+    bool runFusedChain(unsigned int filter, unsigned int slot);
+    void finishSlot(unsigned int slot);
+
+    static void filterTask(void *task);
+    static void feederThread(FilterGraph*);
+
+    std::vector<CaptureDevice*> m_sources;
+    std::vector<Node> m_nodes;
+    std::vector<unsigned int> m_order;
+    bool m_built;
+    bool m_fusionEnabled;
+    /** no slots handed out while set - see replaceFilter() */
+    bool m_paused;
+
+    ThreadPool *m_threadPool;
+    const unsigned int m_framesInFlight;
+    std::vector<Slot> m_slots;
+    /** per filter and slot */
+    std::vector<Task> m_tasks;
+    unsigned long long m_submittedSequence;
+    /** sequence number of the last frame set reported */
+    unsigned long long m_finishedSequence;
+    unsigned long long m_failedCount;
+
+    FrameFinishedFunction m_frameFinishedFunction;
+    void *m_frameFinishedUserData;
+
+    std::mutex m_mutex;
+    std::condition_variable m_slotFinished;
+
+    std::thread *m_feederThread;
+    bool m_feederCancellationFlag;
+    FrameNotifier m_frameNotifier;
+};
+
+
+#endif /* FILTER_GRAPH_HPP */
@@ -0,0 +1,296 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filterinstance.hpp"
+#include "framepool.hpp"
+#include "pixelformat.hpp"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+
+/** @returns the array of values, 0 for none */
+static BaseFilter::Value *values(vector<BaseFilter::Value>&);
+
+
+FilterInstance::FilterInstance(CreateFilterFunction create, DestroyFilterFunction destroy,
+        unsigned int slotCount) :
+    m_filter(create()),
+    m_destroy(destroy),
+    m_slots(slotCount),
+    m_preparation(0),
+    m_preparationCount(0)
+{
+    assert(m_filter != 0);
+    assert(slotCount > 0);
+
+    const vector<BaseFilter::Port> &inputPorts = m_filter->inputPorts();
+    const vector<BaseFilter::Port> &outputPorts = m_filter->outputPorts();
+
+    m_preparedInputs.resize(inputPorts.size());
+    for (unsigned int a = 0; a < inputPorts.size(); ++a) {
+        memset(&m_preparedInputs[a], 0, sizeof(BaseFilter::Value));
+        m_preparedInputs[a].type = inputPorts[a].type;
+    }
+
+    m_preparedOutputs.resize(outputPorts.size());
+    for (unsigned int a = 0; a < outputPorts.size(); ++a) {
+        memset(&m_preparedOutputs[a], 0, sizeof(BaseFilter::Value));
+        m_preparedOutputs[a].type = outputPorts[a].type;
+    }
+
+    for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+        it->inputs = m_preparedInputs;
+        it->inputWritable.resize(inputPorts.size(), false);
+        it->outputs = m_preparedOutputs;
+        it->outputImages.resize(outputPorts.size(), 0);
+        it->outputPoints.resize(outputPorts.size());
+        it->preparation = 0;
+    }
+}
+
+
+FilterInstance::~FilterInstance()
+{
+    m_destroy(m_filter);
+
+    for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+        for (auto image = it->outputImages.begin(); image != it->outputImages.end(); ++image) {
+            FramePool::instance().release(*image);
+        }
+    }
+}
+
+
+BaseFilter *FilterInstance::filter() const
+{
+    return m_filter;
+}
+
+
+unsigned int FilterInstance::slotCount() const
+{
+    return m_slots.size();
+}
+
+
+void FilterInstance::setInput(unsigned int port, const BaseFilter::Value &value, bool writable, unsigned int slot)
+{
+    assert(slot < m_slots.size());
+    Slot &s = m_slots[slot];
+
+    assert(port < s.inputs.size());
+    assert(value.type == s.inputs[port].type);
+
+    s.inputs[port] = value;
+    s.inputWritable[port] = writable;
+}
+
+
+void FilterInstance::setInput(unsigned int port, const FrameRing::Buffer &buffer, unsigned int slot)
+{
+    assert(slot < m_slots.size());
+    Slot &s = m_slots[slot];
+
+    assert(port < s.inputs.size());
+    assert(s.inputs[port].type == BaseFilter::PortTypeImage);
+
+    BaseFilter::Image &image = s.inputs[port].image;
+    image.data = buffer.buffer;
+    image.width = buffer.width;
+    image.height = buffer.height;
+    image.bytesPerLine = buffer.bytesPerLine;
+    image.pixelFormat = buffer.pixelFormat;
+
+    s.inputWritable[port] = false;
+}
+
+
+bool FilterInstance::process(unsigned int slot)
+{
+    VT
+
+    if (prepareSlot(slot) == false) return false;
+
+    Slot &s = m_slots[slot];
+    m_filter->process(values(s.inputs), values(s.outputs));
+
+    return true;
+}
+
+
+bool FilterInstance::prepareSlot(unsigned int slot)
+{
+    assert(slot < m_slots.size());
+    Slot &s = m_slots[slot];
+
+    if (m_preparation == 0 || inputFormatChanged(s) == true) {
+        if (prepare(s) == false) return false;
+    }
+    if (s.preparation != m_preparation && allocateOutputs(s) == false) return false;
+
+    /* hand writable inputs of the same format over as output, if the filter can work in place */
+    const vector<BaseFilter::Port> &outputPorts = m_filter->outputPorts();
+    for (unsigned int a = 0; a < outputPorts.size(); ++a) {
+
+        if (outputPorts[a].type != BaseFilter::PortTypeImage) continue;
+
+        BaseFilter::Image &output = s.outputs[a].image;
+        output.data = s.outputImages[a];
+
+        int in = outputPorts[a].inPlaceInput;
+        if (in == -1 || s.inputWritable[in] == false) continue;
+
+        const BaseFilter::Image &input = s.inputs[in].image;
+        if (input.width == output.width && input.height == output.height
+                && input.bytesPerLine == output.bytesPerLine && input.pixelFormat == output.pixelFormat) {
+            output.data = input.data;
+        }
+    }
+
+    return true;
+}
+
+
+const BaseFilter::Value &FilterInstance::input(unsigned int port, unsigned int slot) const
+{
+    assert(slot < m_slots.size());
+    assert(port < m_slots[slot].inputs.size());
+
+    return m_slots[slot].inputs[port];
+}
+
+
+const BaseFilter::Value &FilterInstance::output(unsigned int port, unsigned int slot) const
+{
+    assert(slot < m_slots.size());
+    assert(port < m_slots[slot].outputs.size());
+
+    return m_slots[slot].outputs[port];
+}
+
+
+size_t FilterInstance::imageSize(const BaseFilter::Image &image)
+{
+    return PixelFormat::imageSize(image.pixelFormat, image.bytesPerLine, image.height);
+}
+
+
+unsigned int FilterInstance::minimumBytesPerLine(const BaseFilter::Image &image)
+{
+    return PixelFormat::minimumBytesPerLine(image.pixelFormat, image.width);
+}
+
+
+/* *** private ************************************************************ */
+bool FilterInstance::inputFormatChanged(const Slot &slot) const
+{
+    for (unsigned int a = 0; a < slot.inputs.size(); ++a) {
+
+        if (slot.inputs[a].type != BaseFilter::PortTypeImage) continue;
+
+        const BaseFilter::Image &current = slot.inputs[a].image;
+        const BaseFilter::Image &prepared = m_preparedInputs[a].image;
+        if (current.width != prepared.width || current.height != prepared.height
+                || current.bytesPerLine != prepared.bytesPerLine || current.pixelFormat != prepared.pixelFormat) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool FilterInstance::prepare(Slot &slot)
+{
+    VT
+
+    m_preparation = 0;
+
+    if (m_filter->prepare(values(slot.inputs), values(m_preparedOutputs)) == false) {
+        cerr << __PRETTY_FUNCTION__ << " filter \"" << m_filter->name() << "\" rejected its inputs" << endl;
+        return false;
+    }
+
+    for (auto it = m_preparedOutputs.begin(); it != m_preparedOutputs.end(); ++it) {
+
+        if (it->type != BaseFilter::PortTypeImage) continue;
+
+        if (it->image.bytesPerLine == 0) {
+            it->image.bytesPerLine = FramePool::paddedBytesPerLine(minimumBytesPerLine(it->image));
+        }
+
+        if (imageSize(it->image) == 0) {
+            cerr << __PRETTY_FUNCTION__ << " filter \"" << m_filter->name()
+                    << "\" set an unknown output pixel format" << endl;
+            return false;
+        }
+    }
+
+    m_preparedInputs = slot.inputs;
+
+    /* every slot allocates for the new formats, when it is processed next */
+    m_preparation = ++m_preparationCount;
+
+    return true;
+}
+
+
+bool FilterInstance::allocateOutputs(Slot &slot)
+{
+    VT
+
+    slot.outputs = m_preparedOutputs;
+
+    for (unsigned int a = 0; a < slot.outputs.size(); ++a) {
+
+        BaseFilter::Value &output = slot.outputs[a];
+
+        if (output.type == BaseFilter::PortTypeImage) {
+
+            /* the same format again gets the same memory back */
+            FramePool::instance().release(slot.outputImages[a]);
+            slot.outputImages[a] = FramePool::instance().allocate(imageSize(output.image));
+            output.image.data = slot.outputImages[a];
+
+            if (output.image.data == 0) {
+                cerr << __PRETTY_FUNCTION__ << " Cannot allocate the output image of filter \""
+                        << m_filter->name() << "\"" << endl;
+                return false;
+            }
+
+        } else if (output.type == BaseFilter::PortTypePointList) {
+
+            slot.outputPoints[a].resize(output.pointList.capacity + 1);
+            output.pointList.points = &slot.outputPoints[a][0];
+            output.pointList.count = 0;
+        }
+    }
+
+    slot.preparation = m_preparation;
+    return true;
+}
+
+
+/* *** static functions ***************************************************** */
+BaseFilter::Value *values(vector<BaseFilter::Value> &values)
+{
+    return values.empty() == true ? 0 : &values[0];
+}
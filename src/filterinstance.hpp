@@ -0,0 +1,115 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILTER_INSTANCE_HPP
+#define FILTER_INSTANCE_HPP
+
+#include "prereqs.hpp"
+
+#include "basefilter.hpp"
+#include "framering.hpp"
+
+#include <vector>
+
+
+/**
+ * host side of a filter: owns the filter and the memory of its outputs
+ *
+ * Outputs are (re)allocated only when the format of an input image changes, running the
+ * filter on a frame of the same format as the last one allocates nothing.
+ *
+ * Each slot has inputs and outputs of its own, so a pipeline can keep several frames in
+ * flight: the outputs of one slot are still read by the next filter, while this filter
+ * already works on the next slot.
+ *
+ * @note not thread safe - process one slot at a time. Reading the outputs of a slot,
+ *    while another slot is processed, is fine.
+ */
+class FilterInstance
+{
+public:
+
+    FilterInstance(CreateFilterFunction, DestroyFilterFunction, unsigned int slotCount = 1);
+    ~FilterInstance();
+    FilterInstance(const FilterInstance&) = delete;
+    FilterInstance &operator=(const FilterInstance&) = delete;
+
+    BaseFilter *filter() const;
+    unsigned int slotCount() const;
+
+    /** @param writable true if the filter may overwrite the image - lets it process in place
+        @note the value has to match the type of the port */
+    void setInput(unsigned int port, const BaseFilter::Value&, bool writable = false, unsigned int slot = 0);
+    /** uses a captured frame as image input - it is never written to
+        @note the buffer has to stay locked until process() returned */
+    void setInput(unsigned int port, const FrameRing::Buffer&, unsigned int slot = 0);
+
+    /** runs the filter on the current inputs of the slot
+        @returns false if the filter does not accept the inputs */
+    bool process(unsigned int slot = 0);
+    /** just the preparation part of process() - sets up the filter and the outputs of
+        the slot for the current inputs, for running the filter some other way
+        @returns false if the filter does not accept the inputs */
+    bool prepareSlot(unsigned int slot = 0);
+
+    const BaseFilter::Value &input(unsigned int port, unsigned int slot = 0) const;
+    /** @note valid until the slot is processed again */
+    const BaseFilter::Value &output(unsigned int port, unsigned int slot = 0) const;
+
+    /** @returns bytes needed for an image of that format, 0 for an unknown pixel format */
+    static size_t imageSize(const BaseFilter::Image&);
+    /** @returns the smallest stride for the width of the image, 0 for an unknown pixel format */
+    static unsigned int minimumBytesPerLine(const BaseFilter::Image&);
+
+private:
+
+    struct Slot
+    {
+        std::vector<BaseFilter::Value> inputs;
+        std::vector<bool> inputWritable;
+
+        std::vector<BaseFilter::Value> outputs;
+        /** memory of image and point list outputs, indexed like the outputs - the images from
+            the FramePool, 0 until allocated */
+        std::vector<unsigned char*> outputImages;
+        std::vector<std::vector<BaseFilter::Point> > outputPoints;
+        /** m_preparation, which the outputs are allocated for */
+        unsigned long long preparation;
+    };
+
+    /** @returns true if the format of an input image differs from the one prepared for */
+    bool inputFormatChanged(const Slot&) const;
+    bool prepare(Slot&);
+    /** @returns false if there is no memory left */
+    bool allocateOutputs(Slot&);
+
+    BaseFilter *m_filter;
+    DestroyFilterFunction m_destroy;
+
+    std::vector<Slot> m_slots;
+
+    /** identifies the last successful prepare(), 0 if none */
+    unsigned long long m_preparation;
+    unsigned long long m_preparationCount;
+    /** inputs and outputs as of the last prepare() */
+    std::vector<BaseFilter::Value> m_preparedInputs;
+    std::vector<BaseFilter::Value> m_preparedOutputs;
+};
+
+
+#endif /* FILTER_INSTANCE_HPP */
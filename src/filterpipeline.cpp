@@ -0,0 +1,399 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filterpipeline.hpp"
+
+#include "filtergraph.hpp"
+#include "filterinstance.hpp"
+#include "filterregistry.hpp"
+#include "tracer.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+using namespace std;
+
+
+/** @returns the first port of the type, -1 if none */
+static int firstPortOfType(const vector<BaseFilter::Port> &ports, BaseFilter::PortType type)
+{
+    for (unsigned int a = 0; a < ports.size(); ++a) {
+        if (ports[a].type == type) return a;
+    }
+    return -1;
+}
+
+
+/** writes the rows of a plane without their padding
+    @returns false on a write error */
+static bool writePlane(FILE *file, const unsigned char *plane, unsigned int bytesPerLine,
+        unsigned int rowLength, unsigned int rows)
+{
+    for (unsigned int y = 0; y < rows; ++y) {
+        if (fwrite(plane + (size_t) y * bytesPerLine, rowLength, 1, file) != 1) return false;
+    }
+    return true;
+}
+
+
+/** @returns the comma separated names, without the blanks around them */
+static vector<string> splitNames(const string &names)
+{
+    vector<string> ret;
+
+    string::size_type start = 0;
+    while (start <= names.length()) {
+        string::size_type end = names.find(',', start);
+        if (end == string::npos) end = names.length();
+
+        string name = names.substr(start, end - start);
+        string::size_type first = name.find_first_not_of(" \t");
+        string::size_type last = name.find_last_not_of(" \t");
+        if (first != string::npos) ret.push_back(name.substr(first, last - first + 1));
+
+        start = end + 1;
+    }
+
+    return ret;
+}
+
+
+FilterPipeline::FilterPipeline(CaptureDevice *device) :
+        m_device(device),
+        m_graph(0),
+        m_lastFilter(-1),
+        m_lastOutputPort(0),
+        m_outputFile(0),
+        m_outputFailed(false),
+        m_processedFrames(0)
+{
+    assert(device != 0);
+}
+
+
+FilterPipeline::~FilterPipeline()
+{
+    stop();
+    delete m_graph;
+}
+
+
+CaptureDevice *FilterPipeline::captureDevice() const
+{
+    return m_device;
+}
+
+
+void FilterPipeline::setFilterNames(const string &names)
+{
+    m_filterNames = names;
+}
+const string &FilterPipeline::filterNames() const
+{
+    return m_filterNames;
+}
+
+
+void FilterPipeline::setOutputFileName(const string &fileName)
+{
+    m_outputFileName = fileName;
+}
+const string &FilterPipeline::outputFileName() const
+{
+    return m_outputFileName;
+}
+
+
+bool FilterPipeline::build(FilterRegistry &registry)
+{
+    assert(isRunning() == false);
+
+    delete m_graph;
+    m_graph = 0;
+    m_lastFilter = -1;
+    m_registryFilters.clear();
+
+    vector<string> names = splitNames(m_filterNames);
+    if (checkChain(registry, names) == false) return false;
+
+    FilterGraph *graph = new FilterGraph();
+    unsigned int source = graph->addSource(m_device);
+
+    for (auto it = names.begin(); it != names.end(); ++it) {
+
+        int found = registry.find(*it);
+        CreateFilterFunction create;
+        DestroyFilterFunction destroy;
+        if (registry.load(found, &create, &destroy) == false) {
+            delete graph;
+            return false;
+        }
+
+        unsigned int filter = graph->addFilter(create, destroy);
+        m_registryFilters.push_back(found);
+        const vector<BaseFilter::Port> &inputs = graph->filter(filter)->inputPorts();
+
+        int imageInput = firstPortOfType(inputs, BaseFilter::PortTypeImage);
+        for (unsigned int a = 0; a < inputs.size(); ++a) {
+
+            if ((int) a == imageInput) {
+                if (m_lastFilter == -1) {
+                    graph->connectSource(source, FilterGraph::SourcePortImage, filter, a);
+                } else {
+                    graph->connect(m_lastFilter, m_lastOutputPort, filter, a);
+                }
+            } else if (inputs[a].type == BaseFilter::PortTypeTime) {
+                graph->connectSource(source, FilterGraph::SourcePortTime, filter, a);
+            } else {
+                cerr << __PRETTY_FUNCTION__ << " input \"" << inputs[a].name << "\" of filter \""
+                        << *it << "\" cannot be fed in a chain" << endl;
+                delete graph;
+                return false;
+            }
+        }
+
+        int imageOutput = firstPortOfType(graph->filter(filter)->outputPorts(), BaseFilter::PortTypeImage);
+        if (imageOutput == -1) {
+            cerr << __PRETTY_FUNCTION__ << " filter \"" << *it << "\" has no image output" << endl;
+            delete graph;
+            return false;
+        }
+
+        m_lastFilter = filter;
+        m_lastOutputPort = imageOutput;
+    }
+
+    if (graph->build() == false) {
+        delete graph;
+        return false;
+    }
+
+    graph->setFrameFinishedFunction(frameFinished, this);
+    m_graph = graph;
+
+    return true;
+}
+
+
+unsigned int FilterPipeline::replaceFilters(unsigned int filter, CreateFilterFunction create, DestroyFilterFunction destroy)
+{
+    unsigned int ret = 0;
+    if (m_graph == 0) return ret;
+
+    for (unsigned int a = 0; a < m_registryFilters.size(); ++a) {
+        if (m_registryFilters[a] == filter && m_graph->replaceFilter(a, create, destroy) == true) ++ret;
+    }
+
+    return ret;
+}
+
+
+bool FilterPipeline::start()
+{
+    assert(isRunning() == false);
+
+    if (m_graph == 0) {
+        cerr << __PRETTY_FUNCTION__ << " not built" << endl;
+        return false;
+    }
+
+    if (m_outputFileName.empty() == false) {
+        m_outputFile = fopen(m_outputFileName.c_str(), "w");
+        if (m_outputFile == 0) {
+            perror(__PRETTY_FUNCTION__);
+            return false;
+        }
+    }
+    m_outputFailed = false;
+
+    m_processedFrames = 0;
+    m_processingLatency.reset();
+    m_frameLatency.reset();
+
+    if (m_graph->start() == false) {
+        if (m_outputFile != 0) fclose(m_outputFile);
+        m_outputFile = 0;
+        return false;
+    }
+
+    return true;
+}
+
+
+void FilterPipeline::stop()
+{
+    if (isRunning() == false) return;
+
+    m_graph->stop();
+
+    if (m_outputFile != 0) {
+        if (fclose(m_outputFile) != 0) m_outputFailed = true;
+        m_outputFile = 0;
+        if (m_outputFailed == true) {
+            cerr << __PRETTY_FUNCTION__ << " writing \"" << m_outputFileName << "\" failed" << endl;
+        }
+    }
+}
+
+
+bool FilterPipeline::isRunning() const
+{
+    return m_graph != 0 && m_graph->isRunning() == true;
+}
+
+
+unsigned long long FilterPipeline::processedFrames() const
+{
+    return m_processedFrames;
+}
+
+
+unsigned long long FilterPipeline::failedFrames() const
+{
+    return m_graph == 0 ? 0 : m_graph->failedCount();
+}
+
+
+const LatencyHistogram &FilterPipeline::processingLatency() const
+{
+    return m_processingLatency;
+}
+
+
+const LatencyHistogram &FilterPipeline::frameLatency() const
+{
+    return m_frameLatency;
+}
+
+
+/* *** private ************************************************************** */
+bool FilterPipeline::checkChain(FilterRegistry &registry, const vector<string> &names) const
+{
+    /* the format going into the next filter, 0 once unknown */
+    unsigned int pixelFormat = m_device->pixelFormat();
+
+    for (auto it = names.begin(); it != names.end(); ++it) {
+
+        int found = registry.find(*it);
+        if (found == -1) {
+            cerr << __PRETTY_FUNCTION__ << " unknown filter \"" << *it << "\"" << endl;
+            return false;
+        }
+
+        /* without a descriptor, the filter tells in prepare() */
+        const BaseFilter::Descriptor *descriptor = registry.descriptor(found);
+        if (descriptor == 0) {
+            pixelFormat = 0;
+            continue;
+        }
+
+        for (unsigned int a = 0; a < descriptor->inputCount; ++a) {
+            unsigned int type = descriptor->inputs[a].type;
+            if (type != BaseFilter::PortTypeImage && type != BaseFilter::PortTypeTime) {
+                cerr << __PRETTY_FUNCTION__ << " input \"" << descriptor->inputs[a].name << "\" of filter \""
+                        << *it << "\" cannot be fed in a chain" << endl;
+                return false;
+            }
+        }
+
+        if (pixelFormat != 0 && descriptor->inputPixelFormats[0] != 0) {
+            bool taken = false;
+            for (unsigned int a = 0; a < BaseFilter::MaxDescriptorPixelFormats && descriptor->inputPixelFormats[a] != 0; ++a) {
+                if (descriptor->inputPixelFormats[a] == pixelFormat) taken = true;
+            }
+            if (taken == false) {
+                cerr << __PRETTY_FUNCTION__ << " filter \"" << *it << "\" does not take "
+                        << CaptureDevice::pixelFormatString(pixelFormat) << " images" << endl;
+                return false;
+            }
+        }
+
+        if (descriptor->outputPixelFormat != 0) pixelFormat = descriptor->outputPixelFormat;
+    }
+
+    return true;
+}
+
+
+/* *** static functions ***************************************************** */
+void FilterPipeline::frameFinished(FilterGraph *graph, unsigned int slot, void *pipelineArgument)
+{
+    VT
+
+    FilterPipeline *pipeline = (FilterPipeline*) pipelineArgument;
+    const CaptureDevice::Buffer &frame = *graph->frame(slot, 0);
+
+    /* called in order, one frame set at a time */
+    pipeline->m_processingLatency.recordSince(frame.publishTime);
+    if (pipeline->m_device->timestampSource() != CaptureDevice::TimestampRecorded) {
+        pipeline->m_frameLatency.recordSince(frame.time);
+    }
+    __sync_add_and_fetch(&pipeline->m_processedFrames, 1);
+
+    if (pipeline->m_outputFile == 0 || pipeline->m_outputFailed == true) return;
+
+    BaseFilter::Image image;
+    if (pipeline->m_lastFilter == -1) {
+        image.data = frame.buffer;
+        image.width = frame.width;
+        image.height = frame.height;
+        image.bytesPerLine = frame.bytesPerLine;
+        image.pixelFormat = frame.pixelFormat;
+    } else {
+        image = graph->output(slot, pipeline->m_lastFilter, pipeline->m_lastOutputPort).image;
+    }
+
+    /* row by row, the file has no padding */
+    unsigned int rowLength = FilterInstance::minimumBytesPerLine(image);
+    if (rowLength == 0) {
+        /* compressed frames are written as they are */
+        if (pipeline->m_lastFilter == -1 && fwrite(frame.buffer, frame.bytesUsed, 1, pipeline->m_outputFile) != 1) {
+            pipeline->m_outputFailed = true;
+        }
+        return;
+    }
+    bool written = writePlane(pipeline->m_outputFile, image.data, image.bytesPerLine, rowLength, image.height);
+
+    /* chroma planes below the luma plane, see PixelFormat - what FileCaptureDevice reads back */
+    const unsigned char *chroma = image.data + (size_t) image.bytesPerLine * image.height;
+    unsigned int chromaRows = (image.height + 1) / 2;
+
+    switch (image.pixelFormat) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+        /* interleaved, full stride */
+        written = written && writePlane(pipeline->m_outputFile, chroma, image.bytesPerLine, rowLength, chromaRows);
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        /* U, then V, each with half the stride */
+        written = written && writePlane(pipeline->m_outputFile, chroma, image.bytesPerLine / 2,
+                rowLength / 2, chromaRows);
+        written = written && writePlane(pipeline->m_outputFile,
+                chroma + (size_t) (image.bytesPerLine / 2) * chromaRows, image.bytesPerLine / 2,
+                rowLength / 2, chromaRows);
+        break;
+    default:
+        break;
+    }
+
+    if (written == false) pipeline->m_outputFailed = true;
+}
@@ -0,0 +1,122 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILTER_PIPELINE_HPP
+#define FILTER_PIPELINE_HPP
+
+#include "prereqs.hpp"
+
+#include "basefilter.hpp"
+#include "capturedevice.hpp"
+#include "latencyhistogram.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class FilterGraph;
+class FilterRegistry;
+
+
+/**
+ * a chain of filters, given by their names, running on the frames of a capture device - no GUI needed
+ *
+ * Each filter gets the image of the one before on its first image input (the first filter
+ * gets the frames) and the time of the frame on its time inputs. The chain runs on a
+ * FilterGraph, which feeds it the newest frames.
+ *
+ * Optionally the images coming out of the chain are written raw to a file, in a form
+ * FileCaptureDevice replays.
+ */
+class FilterPipeline
+{
+public:
+
+    explicit FilterPipeline(CaptureDevice *device);
+    /** stops */
+    ~FilterPipeline();
+    FilterPipeline(const FilterPipeline&) = delete;
+    FilterPipeline &operator=(const FilterPipeline&) = delete;
+
+    CaptureDevice *captureDevice() const;
+
+    /** names of the filters in processing order, comma separated, e.g. "grayscale,box blur".
+        Empty (default) for none - the frames are just taken out of the ring then
+        @note takes effect with the next build() */
+    void setFilterNames(const std::string&);
+    const std::string &filterNames() const;
+
+    /** empty (default) for writing nothing
+        @note takes effect with the next start() */
+    void setOutputFileName(const std::string&);
+    const std::string &outputFileName() const;
+
+    /** creates the filters, loading their plugins, and connects them
+        @returns false if a filter is unknown or cannot be part of a chain */
+    bool build(FilterRegistry&);
+
+    /** swaps the filters of the chain made by the plugin, also while running - see
+        FilterGraph::replaceFilter()
+        @param filter index in the registry
+        @returns number of filters swapped */
+    unsigned int replaceFilters(unsigned int filter, CreateFilterFunction, DestroyFilterFunction);
+
+    /** @returns false if not built or the output file cannot be created */
+    bool start();
+    /** waits for the frames in flight, closes the output file */
+    void stop();
+    bool isRunning() const;
+
+    /* *** statistics since the last start() - updated while running *** */
+    unsigned long long processedFrames() const;
+    /** frames a filter rejected */
+    unsigned long long failedFrames() const;
+    /** time from publishing a frame to its image coming out of the chain */
+    const LatencyHistogram &processingLatency() const;
+    /** time from taking a frame (Buffer::time) to its image coming out of the chain - none for recordings */
+    const LatencyHistogram &frameLatency() const;
+
+private:
+
+    /** rejects chains, which cannot work, by the descriptors of the filters - before creating any
+        @returns false if a filter is unknown, or does not take the output of the one before */
+    bool checkChain(FilterRegistry&, const std::vector<std::string> &names) const;
+
+    static void frameFinished(FilterGraph*, unsigned int slot, void *pipeline);
+
+    CaptureDevice *m_device;
+    std::string m_filterNames;
+    std::string m_outputFileName;
+
+    FilterGraph *m_graph;
+    /** per filter of the graph: its index in the registry */
+    std::vector<unsigned int> m_registryFilters;
+    /** the filter giving the result, -1 for the frames themselves */
+    int m_lastFilter;
+    unsigned int m_lastOutputPort;
+
+    FILE *m_outputFile;
+    bool m_outputFailed;
+
+    unsigned long long m_processedFrames;
+    LatencyHistogram m_processingLatency;
+    LatencyHistogram m_frameLatency;
+};
+
+
+#endif /* FILTER_PIPELINE_HPP */
@@ -0,0 +1,629 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filterregistry.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+using namespace std;
+
+
+static const char cacheMagic[] = "videocapture filter cache";
+
+
+/** @returns the ELF machine of this process, EM_NONE if unknown */
+static int hostMachine()
+{
+    static int machine = -1;
+
+    if (machine == -1) {
+        machine = EM_NONE;
+        ElfW(Ehdr) header;
+        int fileDescriptor = open("/proc/self/exe", O_RDONLY);
+        if (fileDescriptor != -1) {
+            if (pread(fileDescriptor, &header, sizeof(header), 0) == sizeof(header)) machine = header.e_machine;
+            close(fileDescriptor);
+        }
+    }
+
+    return machine;
+}
+
+
+/** @returns the BaseFilter::Simd flags of this processor */
+static unsigned int supportedSimd()
+{
+    unsigned int ret = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0) {
+        if ((edx & bit_SSE2) != 0) ret |= BaseFilter::SimdSse2;
+        if ((ecx & bit_SSE4_1) != 0) ret |= BaseFilter::SimdSse41;
+
+        /* AVX needs the operating system to save the registers as well */
+        bool osSavesAvx = false;
+        if ((ecx & bit_OSXSAVE) != 0) {
+            unsigned int xcr0Low, xcr0High;
+            __asm__ ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+            osSavesAvx = (xcr0Low & 6) == 6;
+        }
+        if ((ecx & bit_AVX) != 0 && osSavesAvx == true) {
+            ret |= BaseFilter::SimdAvx;
+            if (__get_cpuid_max(0, 0) >= 7) {
+                __cpuid_count(7, 0, eax, ebx, ecx, edx);
+                if ((ebx & (1 << 5)) != 0) ret |= BaseFilter::SimdAvx2;
+            }
+        }
+    }
+#elif defined(__ARM_NEON__)
+    ret |= BaseFilter::SimdNeon;
+#endif
+
+    return ret;
+}
+
+
+static bool readFully(int fileDescriptor, void *memory, size_t size, off_t offset)
+{
+    return pread(fileDescriptor, memory, size, offset) == (ssize_t) size;
+}
+
+
+FilterRegistry::FilterRegistry() :
+        m_scannedFiles(0),
+        m_cachedFiles(0),
+        m_probedFiles(0)
+{
+}
+
+
+FilterRegistry::~FilterRegistry()
+{
+    for (auto it = m_plugins.begin(); it != m_plugins.end(); ++it) {
+        if (it->handle == 0) continue;
+
+        int dlcloseRet = dlclose(it->handle);
+        assert(dlcloseRet == 0);
+    }
+
+    for (auto it = m_replacedHandles.begin(); it != m_replacedHandles.end(); ++it) {
+        int dlcloseRet = dlclose(*it);
+        assert(dlcloseRet == 0);
+    }
+}
+
+
+void FilterRegistry::addSearchDirectory(const string &directory)
+{
+    m_searchDirectories.push_back(directory);
+}
+
+
+const vector<string> &FilterRegistry::searchDirectories() const
+{
+    return m_searchDirectories;
+}
+
+
+void FilterRegistry::setCacheFileName(const string &fileName)
+{
+    m_cacheFileName = fileName;
+}
+const string &FilterRegistry::cacheFileName() const
+{
+    return m_cacheFileName;
+}
+
+
+void FilterRegistry::scan()
+{
+    VT
+
+    readCache();
+
+    m_files.clear();
+    m_filters.clear();
+    m_scannedFiles = 0;
+    m_cachedFiles = 0;
+    m_probedFiles = 0;
+    bool changed = false;
+
+    for (auto it = m_searchDirectories.begin(); it != m_searchDirectories.end(); ++it) {
+
+        DIR *directoryHandle = opendir(it->c_str());
+
+        if (directoryHandle == 0) {
+            cerr << "Cannot open directory \"" << *it << "\" " << errno << " " << strerror(errno) << endl;
+            continue;
+        }
+
+        for (;;) {
+            struct dirent *directoryEntry = readdir(directoryHandle);
+            if (directoryEntry == 0) break;
+
+            File file;
+            file.path = *it + '/' + directoryEntry->d_name;
+
+            /* follows links, libraries are often reached through one */
+            struct stat status;
+            if (stat(file.path.c_str(), &status) == -1 || S_ISREG(status.st_mode) == false) continue;
+            ++m_scannedFiles;
+
+            file.modificationTime = status.st_mtim;
+            file.size = status.st_size;
+            file.kind = KindOther;
+
+            const File *known = cached(file);
+            if (known != 0) {
+                file = *known;
+                ++m_cachedFiles;
+            } else {
+                examine(file);
+                changed = true;
+            }
+            m_files.push_back(file);
+
+            if (file.kind != KindFilter || find(file.name) != -1) continue;
+
+            /* the cache keeps no descriptors - the few plugins are read each time */
+            BaseFilter::Descriptor descriptor;
+            bool hasDescriptor = false;
+            if (readPluginFile(file.path, &descriptor, &hasDescriptor) == false) continue;
+            if (hasDescriptor == true && isSupported(descriptor, file.path) == false) continue;
+
+            /* the plugin stays loaded, if it was found before */
+            unsigned int plugin = 0;
+            while (plugin < m_plugins.size() && m_plugins[plugin].fileName != file.path) ++plugin;
+            if (plugin == m_plugins.size()) {
+                Plugin unloaded = {file.name, file.path, 0, 0, 0, false, BaseFilter::Descriptor()};
+                m_plugins.push_back(unloaded);
+            }
+            m_plugins[plugin].hasDescriptor = hasDescriptor;
+            m_plugins[plugin].descriptor = descriptor;
+            m_filters.push_back(plugin);
+        }
+
+        closedir(directoryHandle);
+    }
+
+    /* files gone since */
+    if (m_files.size() != m_cachedFiles || m_cache.size() != m_cachedFiles) changed = true;
+
+    if (changed == true) writeCache();
+}
+
+
+unsigned int FilterRegistry::filterCount() const
+{
+    return m_filters.size();
+}
+
+
+int FilterRegistry::find(const string &name) const
+{
+    for (unsigned int a = 0; a < m_filters.size(); ++a) {
+        if (m_plugins[m_filters[a]].name == name) return a;
+    }
+    return -1;
+}
+
+
+const string &FilterRegistry::name(unsigned int filter) const
+{
+    assert(filter < m_filters.size());
+    return m_plugins[m_filters[filter]].name;
+}
+
+
+const string &FilterRegistry::fileName(unsigned int filter) const
+{
+    assert(filter < m_filters.size());
+    return m_plugins[m_filters[filter]].fileName;
+}
+
+
+bool FilterRegistry::isLoaded(unsigned int filter) const
+{
+    assert(filter < m_filters.size());
+    return m_plugins[m_filters[filter]].handle != 0;
+}
+
+
+const BaseFilter::Descriptor *FilterRegistry::descriptor(unsigned int filter) const
+{
+    assert(filter < m_filters.size());
+    const Plugin &plugin = m_plugins[m_filters[filter]];
+    return plugin.hasDescriptor == true ? &plugin.descriptor : 0;
+}
+
+
+bool FilterRegistry::load(unsigned int filter, CreateFilterFunction *create, DestroyFilterFunction *destroy)
+{
+    assert(filter < m_filters.size());
+
+    int plugin = loadPlugin(m_plugins[m_filters[filter]].fileName);
+    if (plugin == -1) return false;
+
+    *create = m_plugins[plugin].create;
+    *destroy = m_plugins[plugin].destroy;
+    return true;
+}
+
+
+bool FilterRegistry::reload(unsigned int filter, CreateFilterFunction *create, DestroyFilterFunction *destroy)
+{
+    VT
+
+    assert(filter < m_filters.size());
+    Plugin &plugin = m_plugins[m_filters[filter]];
+
+    BaseFilter::Descriptor descriptor;
+    bool hasDescriptor = false;
+    if (readPluginFile(plugin.fileName, &descriptor, &hasDescriptor) == false) {
+        cerr << __PRETTY_FUNCTION__ << " \"" << plugin.fileName << "\" is no filter library (anymore)" << endl;
+        return false;
+    }
+    if (hasDescriptor == true && isSupported(descriptor, plugin.fileName) == false) return false;
+
+    /* dlopen() hands out the loaded library again for the same path - a copy under another name is new to it */
+    const char *temporaryDirectory = getenv("TMPDIR");
+    string copyName = string(temporaryDirectory != 0 ? temporaryDirectory : "/tmp") + "/videocapture-filter-XXXXXX";
+    vector<char> copyNameBuffer(copyName.begin(), copyName.end());
+    copyNameBuffer.push_back('\0');
+
+    int copyFileDescriptor = mkstemp(&copyNameBuffer[0]);
+    int fileDescriptor = open(plugin.fileName.c_str(), O_RDONLY);
+    bool copied = copyFileDescriptor != -1 && fileDescriptor != -1;
+    char buffer[65536];
+    while (copied == true) {
+        ssize_t bytes = read(fileDescriptor, buffer, sizeof(buffer));
+        if (bytes == 0) break;
+        if (bytes < 0 || write(copyFileDescriptor, buffer, bytes) != bytes) copied = false;
+    }
+    if (fileDescriptor != -1) close(fileDescriptor);
+    if (copyFileDescriptor != -1 && close(copyFileDescriptor) != 0) copied = false;
+
+    void *handle = 0;
+    if (copied == true) {
+        handle = dlopen(&copyNameBuffer[0], RTLD_LAZY | RTLD_LOCAL);
+        if (handle == 0) cerr << "Cannot open library \"" << plugin.fileName << "\" " << dlerror() << endl;
+    } else {
+        cerr << __PRETTY_FUNCTION__ << " Cannot copy \"" << plugin.fileName << "\" to \"" << &copyNameBuffer[0] << "\"" << endl;
+    }
+    /* mapped now, the name is not needed anymore */
+    if (copyFileDescriptor != -1) unlink(&copyNameBuffer[0]);
+    if (handle == 0) return false;
+
+    CreateFilterFunction newCreate = reinterpret_cast<CreateFilterFunction>(dlsym(handle, "create"));
+    DestroyFilterFunction newDestroy = reinterpret_cast<DestroyFilterFunction>(dlsym(handle, "destroy"));
+    if (newCreate == 0 || newDestroy == 0) {
+        cerr << "Cannot load filter library symbols \"" << plugin.fileName << "\" " << dlerror() << endl;
+        dlclose(handle);
+        return false;
+    }
+
+    if (plugin.handle != 0) m_replacedHandles.push_back(plugin.handle);
+    plugin.handle = handle;
+    plugin.create = newCreate;
+    plugin.destroy = newDestroy;
+    plugin.hasDescriptor = hasDescriptor;
+    plugin.descriptor = descriptor;
+
+    *create = newCreate;
+    *destroy = newDestroy;
+    return true;
+}
+
+
+unsigned int FilterRegistry::scannedFiles() const
+{
+    return m_scannedFiles;
+}
+
+
+unsigned int FilterRegistry::cachedFiles() const
+{
+    return m_cachedFiles;
+}
+
+
+unsigned int FilterRegistry::probedFiles() const
+{
+    return m_probedFiles;
+}
+
+
+/* *** private ************************************************************** */
+void FilterRegistry::readCache()
+{
+    m_cache.clear();
+    if (m_cacheFileName.empty() == true) return;
+
+    ifstream in(m_cacheFileName.c_str());
+    string line;
+
+    /* written for another version of the plugin functions - everything needs a new look */
+    ostringstream magic;
+    magic << cacheMagic << " " << BaseFilter::AbiVersion;
+    if (getline(in, line).fail() == true || line != magic.str()) return;
+
+    /* seconds, nanoseconds, size, kind, path, name - separated by tabs */
+    while (getline(in, line)) {
+        vector<string> fields;
+        string::size_type start = 0;
+        for (;;) {
+            string::size_type end = line.find('\t', start);
+            fields.push_back(line.substr(start, end == string::npos ? string::npos : end - start));
+            if (end == string::npos) break;
+            start = end + 1;
+        }
+        if (fields.size() != 6) continue;
+
+        File file;
+        file.modificationTime.tv_sec = strtoll(fields[0].c_str(), 0, 10);
+        file.modificationTime.tv_nsec = strtol(fields[1].c_str(), 0, 10);
+        file.size = strtoull(fields[2].c_str(), 0, 10);
+        file.kind = fields[3] == "filter" ? KindFilter : KindOther;
+        file.path = fields[4];
+        file.name = fields[5];
+        m_cache[file.path] = file;
+    }
+}
+
+
+void FilterRegistry::writeCache() const
+{
+    if (m_cacheFileName.empty() == true) return;
+
+    /* replaced at once, so a process scanning meanwhile reads the old or the new one */
+    string temporaryFileName = m_cacheFileName + ".new";
+    {
+        ofstream out(temporaryFileName.c_str());
+        out << cacheMagic << " " << BaseFilter::AbiVersion << "\n";
+
+        for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+            if (it->path.find_first_of("\t\n") != string::npos || it->name.find_first_of("\t\n") != string::npos) continue;
+
+            out << it->modificationTime.tv_sec << "\t" << it->modificationTime.tv_nsec << "\t" << it->size << "\t"
+                    << (it->kind == KindFilter ? "filter" : "other") << "\t" << it->path << "\t" << it->name << "\n";
+        }
+
+        if (out.flush().good() == false) {
+            cerr << __PRETTY_FUNCTION__ << " Cannot write \"" << temporaryFileName << "\"" << endl;
+            unlink(temporaryFileName.c_str());
+            return;
+        }
+    }
+
+    if (rename(temporaryFileName.c_str(), m_cacheFileName.c_str()) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot rename \"" << temporaryFileName << "\" " << errno << " " << strerror(errno) << endl;
+        unlink(temporaryFileName.c_str());
+    }
+}
+
+
+const FilterRegistry::File *FilterRegistry::cached(const File &file) const
+{
+    auto it = m_cache.find(file.path);
+    if (it == m_cache.end()) return 0;
+
+    const File &known = it->second;
+    if (known.modificationTime.tv_sec != file.modificationTime.tv_sec
+            || known.modificationTime.tv_nsec != file.modificationTime.tv_nsec
+            || known.size != file.size) {
+        return 0;
+    }
+    return &known;
+}
+
+
+void FilterRegistry::examine(File &file)
+{
+    VT
+
+    file.kind = KindOther;
+    file.name.clear();
+
+    BaseFilter::Descriptor descriptor;
+    bool hasDescriptor = false;
+    if (readPluginFile(file.path, &descriptor, &hasDescriptor) == false) return;
+
+    file.kind = KindFilter;
+    if (hasDescriptor == true) {
+        file.name = descriptor.name;
+        return;
+    }
+
+    int plugin = loadPlugin(file.path);
+    if (plugin == -1) {
+        file.kind = KindOther;
+        return;
+    }
+    ++m_probedFiles;
+
+    BaseFilter *filter = m_plugins[plugin].create();
+    file.name = filter->name();
+    m_plugins[plugin].destroy(filter);
+
+    m_plugins[plugin].name = file.name;
+}
+
+
+int FilterRegistry::loadPlugin(const string &fileName)
+{
+    unsigned int plugin = 0;
+    while (plugin < m_plugins.size() && m_plugins[plugin].fileName != fileName) ++plugin;
+    if (plugin < m_plugins.size() && m_plugins[plugin].handle != 0) return plugin;
+
+    /* symbols resolved on use - most of a plugin is never called */
+    void *handle = dlopen(fileName.c_str(), RTLD_LAZY | RTLD_LOCAL);
+    if (handle == 0) {
+        cerr << "Cannot open library \"" << fileName << "\" " << dlerror() << endl;
+        return -1;
+    }
+
+    CreateFilterFunction create = reinterpret_cast<CreateFilterFunction>(dlsym(handle, "create"));
+    DestroyFilterFunction destroy = reinterpret_cast<DestroyFilterFunction>(dlsym(handle, "destroy"));
+    if (create == 0 || destroy == 0) {
+        cerr << "Cannot load filter library symbols \"" << fileName << "\" " << dlerror() << endl;
+        dlclose(handle);
+        return -1;
+    }
+
+    if (plugin == m_plugins.size()) {
+        Plugin loaded = {string(), fileName, 0, 0, 0, false, BaseFilter::Descriptor()};
+        m_plugins.push_back(loaded);
+    }
+    m_plugins[plugin].handle = handle;
+    m_plugins[plugin].create = create;
+    m_plugins[plugin].destroy = destroy;
+
+    return plugin;
+}
+
+
+/* *** static functions ***************************************************** */
+bool FilterRegistry::readPluginFile(const string &fileName, BaseFilter::Descriptor *descriptor, bool *hasDescriptor)
+{
+    *hasDescriptor = false;
+
+    int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+    if (fileDescriptor == -1) return false;
+
+    bool create = false;
+    bool destroy = false;
+    unsigned int abiVersion = 0;
+    bool descriptorFound = false;
+
+    ElfW(Ehdr) header;
+    vector<ElfW(Shdr)> sections;
+
+    /* a shared library for this machine, with section headers we can read */
+    if (readFully(fileDescriptor, &header, sizeof(header), 0) == false
+            || memcmp(header.e_ident, ELFMAG, SELFMAG) != 0
+            || header.e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32)
+            || header.e_type != ET_DYN
+            || header.e_machine != hostMachine()
+            || header.e_shentsize != sizeof(ElfW(Shdr))
+            || header.e_shnum == 0) {
+        close(fileDescriptor);
+        return false;
+    }
+
+    sections.resize(header.e_shnum);
+    if (readFully(fileDescriptor, &sections[0], sections.size() * sizeof(ElfW(Shdr)), header.e_shoff) == false) {
+        close(fileDescriptor);
+        return false;
+    }
+
+    for (unsigned int a = 0; a < sections.size(); ++a) {
+        const ElfW(Shdr) &symbolSection = sections[a];
+        if (symbolSection.sh_type != SHT_DYNSYM || symbolSection.sh_link >= sections.size()) continue;
+        const ElfW(Shdr) &stringSection = sections[symbolSection.sh_link];
+
+        vector<ElfW(Sym)> symbols(symbolSection.sh_size / sizeof(ElfW(Sym)));
+        vector<char> strings(stringSection.sh_size + 1, '\0');
+        if (symbols.empty() == true
+                || readFully(fileDescriptor, &symbols[0], symbols.size() * sizeof(ElfW(Sym)), symbolSection.sh_offset) == false
+                || readFully(fileDescriptor, &strings[0], stringSection.sh_size, stringSection.sh_offset) == false) {
+            continue;
+        }
+
+        for (auto it = symbols.begin(); it != symbols.end(); ++it) {
+            if (it->st_shndx == SHN_UNDEF || it->st_shndx >= sections.size() || it->st_name >= stringSection.sh_size) continue;
+            const char *name = &strings[it->st_name];
+
+            if (strcmp(name, "create") == 0) create = true;
+            if (strcmp(name, "destroy") == 0) destroy = true;
+
+            /* the constants' values, straight from the file */
+            const ElfW(Shdr) &valueSection = sections[it->st_shndx];
+            if (valueSection.sh_type == SHT_NOBITS) continue;
+            off_t valueOffset = valueSection.sh_offset + (it->st_value - valueSection.sh_addr);
+
+            if (strcmp(name, "filterAbiVersion") == 0 && it->st_size == sizeof(abiVersion)) {
+                readFully(fileDescriptor, &abiVersion, sizeof(abiVersion), valueOffset);
+            }
+
+            /* older ones are shorter, newer ones longer - our part of it is what counts */
+            if (strcmp(name, "filterDescriptor") == 0 && it->st_size >= 2 * sizeof(unsigned int)) {
+                size_t size = min((size_t) it->st_size, sizeof(BaseFilter::Descriptor));
+                memset(descriptor, 0, sizeof(BaseFilter::Descriptor));
+                descriptorFound = readFully(fileDescriptor, descriptor, size, valueOffset);
+                descriptor->size = min(descriptor->size, (unsigned int) size);
+                memset((char*) descriptor + descriptor->size, 0, sizeof(BaseFilter::Descriptor) - descriptor->size);
+            }
+        }
+    }
+
+    close(fileDescriptor);
+
+    if (create == true && destroy == true && abiVersion != BaseFilter::AbiVersion) {
+        cerr << "Filter library \"" << fileName << "\" is built for version " << abiVersion
+                << " of the plugin functions, not " << BaseFilter::AbiVersion << endl;
+    }
+
+    if (create == false || destroy == false || abiVersion != BaseFilter::AbiVersion) return false;
+
+    if (descriptorFound == true) {
+        if (descriptor->version == 0 || descriptor->size < offsetof(BaseFilter::Descriptor, inputCount)
+                || memchr(descriptor->name, '\0', sizeof(descriptor->name)) == 0 || descriptor->name[0] == '\0'
+                || descriptor->inputCount > BaseFilter::MaxDescriptorPorts
+                || descriptor->outputCount > BaseFilter::MaxDescriptorPorts) {
+            cerr << "Filter library \"" << fileName << "\" has a broken descriptor" << endl;
+        } else {
+            *hasDescriptor = true;
+        }
+    }
+
+    return true;
+}
+
+
+bool FilterRegistry::isSupported(const BaseFilter::Descriptor &descriptor, const string &fileName)
+{
+    unsigned int missing = descriptor.simd & ~supportedSimd();
+    if (missing != 0) {
+        cerr << "Filter library \"" << fileName << "\" needs instructions this processor lacks (Simd flags "
+                << missing << ")" << endl;
+        return false;
+    }
+
+    return true;
+}
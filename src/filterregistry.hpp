@@ -0,0 +1,163 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILTER_REGISTRY_HPP
+#define FILTER_REGISTRY_HPP
+
+#include "prereqs.hpp"
+
+#include "basefilter.hpp"
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * finds the filter plugins in a set of directories and loads them when they are first used
+ *
+ * Nothing is loaded to find out what a file is: the ELF header and the dynamic symbol table
+ * are read out of the file - a plugin exports create, destroy and filterAbiVersion (see
+ * BaseFilter), the version has to match BaseFilter::AbiVersion. The plugin's descriptor is
+ * read out of the file as well, it tells the name, ports and formats of the filter. Plugins
+ * without one are loaded and a filter created once, to learn at least the name. Plugins using
+ * instructions this processor lacks are left out.
+ *
+ * What was found is kept in a cache file, keyed by path, modification time and size, so later
+ * scans stat() the other files and open none of them. The cache keeps no descriptors, so each
+ * scan reads the plugin files themselves again - the ELF headers and descriptors, nothing is
+ * loaded until a filter is used.
+ *
+ * A changed plugin can be loaded again while the old one is in use (reload()), the old one stays
+ * loaded until the registry is destroyed.
+ *
+ * @note not thread safe
+ */
+class FilterRegistry
+{
+public:
+
+    FilterRegistry();
+    /** unloads the plugins - no filter may be alive anymore */
+    ~FilterRegistry();
+    FilterRegistry(const FilterRegistry&) = delete;
+    FilterRegistry &operator=(const FilterRegistry&) = delete;
+
+    void addSearchDirectory(const std::string&);
+    const std::vector<std::string> &searchDirectories() const;
+    /** empty (default) for no cache */
+    void setCacheFileName(const std::string&);
+    const std::string &cacheFileName() const;
+
+    /** looks through the search directories, updates the cache file if something changed
+        @note forgets the filters found before, keeps the plugins loaded */
+    void scan();
+
+    unsigned int filterCount() const;
+    /** @returns the index of the filter, -1 if there is none of that name */
+    int find(const std::string &name) const;
+    const std::string &name(unsigned int filter) const;
+    const std::string &fileName(unsigned int filter) const;
+    bool isLoaded(unsigned int filter) const;
+    /** @returns 0 if the plugin has no descriptor */
+    const BaseFilter::Descriptor *descriptor(unsigned int filter) const;
+
+    /** loads the plugin, if not done yet
+        @returns false if it cannot be loaded */
+    bool load(unsigned int filter, CreateFilterFunction*, DestroyFilterFunction*);
+    /** loads the plugin anew from its file, for filters created from now on - the old one
+        stays loaded for the filters still alive
+        @returns false if the file is no usable plugin (anymore), the old one stays then */
+    bool reload(unsigned int filter, CreateFilterFunction*, DestroyFilterFunction*);
+
+    /* *** statistics of the last scan() *** */
+    /** files looked at */
+    unsigned int scannedFiles() const;
+    /** files known from the cache */
+    unsigned int cachedFiles() const;
+    /** plugins loaded to learn the name of their filter */
+    unsigned int probedFiles() const;
+
+private:
+
+    enum Kind
+    {
+        /** anything but a plugin of our version */
+        KindOther,
+        KindFilter
+    };
+
+    /** what is known about a file - a line of the cache */
+    struct File
+    {
+        std::string path;
+        timespec modificationTime;
+        unsigned long long size;
+        Kind kind;
+        /** the filter's name for KindFilter */
+        std::string name;
+    };
+
+    struct Plugin
+    {
+        std::string name;
+        std::string fileName;
+        void *handle;
+        CreateFilterFunction create;
+        DestroyFilterFunction destroy;
+        bool hasDescriptor;
+        BaseFilter::Descriptor descriptor;
+    };
+
+    void readCache();
+    void writeCache() const;
+    /** @returns the cached entry for the file, 0 if none or outdated */
+    const File *cached(const File&) const;
+    /** sets kind and name of the file, loading it if it is a plugin */
+    void examine(File&);
+    /** @returns the plugin of the file, loaded before or now - -1 if it cannot be loaded */
+    int loadPlugin(const std::string &fileName);
+
+    /** @returns true if the file is a shared library for this machine, exporting the plugin
+            functions and our filterAbiVersion - without loading it
+        @param descriptor set to the plugin's descriptor, if it has a valid one */
+    static bool readPluginFile(const std::string &fileName, BaseFilter::Descriptor *descriptor, bool *hasDescriptor);
+    /** @returns false if the plugin uses instructions this processor lacks */
+    static bool isSupported(const BaseFilter::Descriptor&, const std::string &fileName);
+
+    std::vector<std::string> m_searchDirectories;
+    std::string m_cacheFileName;
+
+    /** by path */
+    std::map<std::string, File> m_cache;
+    std::vector<File> m_files;
+    /** the found filters - indices into m_plugins */
+    std::vector<unsigned int> m_filters;
+    /** loaded or not, never removed - their filters might be alive */
+    std::vector<Plugin> m_plugins;
+    /** plugins replaced by reload() */
+    std::vector<void*> m_replacedHandles;
+
+    unsigned int m_scannedFiles;
+    unsigned int m_cachedFiles;
+    unsigned int m_probedFiles;
+};
+
+
+#endif /* FILTER_REGISTRY_HPP */
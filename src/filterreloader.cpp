@@ -0,0 +1,230 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "filterreloader.hpp"
+
+#include "filterpipeline.hpp"
+#include "filterregistry.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+static long long monotonicNanoseconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+
+FilterReloader::FilterReloader(FilterRegistry *registry) :
+        m_registry(registry),
+        m_settleTime(300000000),
+        m_inotifyFileDescriptor(-1),
+        m_reloadCount(0),
+        m_thread(0),
+        m_wakeupFileDescriptor(-1),
+        m_cancellationFlag(false)
+{
+    assert(registry != 0);
+}
+
+
+FilterReloader::~FilterReloader()
+{
+    stop();
+}
+
+
+void FilterReloader::addPipeline(FilterPipeline *pipeline)
+{
+    assert(isRunning() == false);
+
+    m_pipelines.push_back(pipeline);
+}
+
+
+void FilterReloader::setSettleTime(double seconds)
+{
+    assert(seconds >= 0.0);
+    m_settleTime = (long long) (seconds * 1e9);
+}
+double FilterReloader::settleTime() const
+{
+    return m_settleTime / 1e9;
+}
+
+
+bool FilterReloader::start()
+{
+    assert(isRunning() == false);
+
+    m_inotifyFileDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wakeupFileDescriptor = eventfd(0, EFD_NONBLOCK);
+    if (m_inotifyFileDescriptor == -1 || m_wakeupFileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " " << errno << " " << strerror(errno) << endl;
+        stop();
+        return false;
+    }
+
+    /* the directories, not the files - the linker replaces the files */
+    const vector<string> &directories = m_registry->searchDirectories();
+    for (auto it = directories.begin(); it != directories.end(); ++it) {
+        int watch = inotify_add_watch(m_inotifyFileDescriptor, it->c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch == -1) {
+            cerr << __PRETTY_FUNCTION__ << " Cannot watch \"" << *it << "\" " << errno << " " << strerror(errno) << endl;
+            continue;
+        }
+        m_watches[watch] = *it;
+    }
+
+    m_cancellationFlag = false;
+    m_thread = new thread(bind(reloaderThread, this));
+
+    return true;
+}
+
+
+void FilterReloader::stop()
+{
+    if (m_thread != 0) {
+        m_cancellationFlag = true;
+        eventfd_write(m_wakeupFileDescriptor, 1);
+        m_thread->join();
+        delete m_thread;
+        m_thread = 0;
+    }
+
+    if (m_inotifyFileDescriptor != -1) close(m_inotifyFileDescriptor);
+    if (m_wakeupFileDescriptor != -1) close(m_wakeupFileDescriptor);
+    m_inotifyFileDescriptor = -1;
+    m_wakeupFileDescriptor = -1;
+    m_watches.clear();
+}
+
+
+bool FilterReloader::isRunning() const
+{
+    return m_thread != 0;
+}
+
+
+unsigned int FilterReloader::reloadCount() const
+{
+    return m_reloadCount;
+}
+
+
+/* *** private ************************************************************** */
+void FilterReloader::reload(const string &fileName)
+{
+    VT
+
+    for (unsigned int a = 0; a < m_registry->filterCount(); ++a) {
+        if (m_registry->fileName(a) != fileName) continue;
+
+        CreateFilterFunction create;
+        DestroyFilterFunction destroy;
+        if (m_registry->reload(a, &create, &destroy) == false) continue;
+        __sync_add_and_fetch(&m_reloadCount, 1);
+
+        unsigned int replaced = 0;
+        for (auto it = m_pipelines.begin(); it != m_pipelines.end(); ++it) {
+            replaced += (*it)->replaceFilters(a, create, destroy);
+        }
+
+        cerr << "Reloaded \"" << m_registry->name(a) << "\" from \"" << fileName << "\", swapped "
+                << replaced << " running filters" << endl;
+    }
+}
+
+
+/* *** static functions ***************************************************** */
+void FilterReloader::reloaderThread(FilterReloader *reloader)
+{
+    Tracer::setThreadName("filter reloader");
+
+    /* file -> when it is quiet long enough */
+    map<string, long long> pending;
+    /* inotify events are aligned like this */
+    char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    while (reloader->m_cancellationFlag == false) {
+
+        int timeout = -1;
+        long long now = monotonicNanoseconds();
+        for (auto it = pending.begin(); it != pending.end(); ++it) {
+            int milliseconds = (int) max(0LL, (it->second - now + 999999) / 1000000);
+            if (timeout == -1 || milliseconds < timeout) timeout = milliseconds;
+        }
+
+        pollfd fileDescriptors[2] = {
+            {reloader->m_inotifyFileDescriptor, POLLIN, 0},
+            {reloader->m_wakeupFileDescriptor, POLLIN, 0}
+        };
+        if (poll(fileDescriptors, 2, timeout) == -1 && errno != EINTR) {
+            cerr << __PRETTY_FUNCTION__ << " poll " << errno << " " << strerror(errno) << endl;
+            break;
+        }
+
+        for (;;) {
+            ssize_t length = read(reloader->m_inotifyFileDescriptor, events, sizeof(events));
+            if (length <= 0) break;
+
+            for (char *it = events; it < events + length; ) {
+                const struct inotify_event *event = (const struct inotify_event*) it;
+                it += sizeof(struct inotify_event) + event->len;
+
+                auto directory = reloader->m_watches.find(event->wd);
+                if (event->len == 0 || directory == reloader->m_watches.end()) continue;
+
+                /* the registry's file names are put together the same way */
+                string fileName = directory->second + '/' + event->name;
+                for (unsigned int a = 0; a < reloader->m_registry->filterCount(); ++a) {
+                    if (reloader->m_registry->fileName(a) == fileName) {
+                        pending[fileName] = monotonicNanoseconds() + reloader->m_settleTime;
+                    }
+                }
+            }
+        }
+
+        now = monotonicNanoseconds();
+        for (auto it = pending.begin(); it != pending.end(); ) {
+            if (it->second > now) {
+                ++it;
+                continue;
+            }
+            reloader->reload(it->first);
+            pending.erase(it++);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FILTER_RELOADER_HPP
+#define FILTER_RELOADER_HPP
+
+#include "prereqs.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class FilterPipeline;
+class FilterRegistry;
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * loads filter plugins again, when their files change, and swaps the filters of the pipelines
+ *
+ * A thread waits for inotify events on the search directories of the registry. A plugin file is
+ * reloaded, once nothing has been written to it for settleTime() - the linker writes it in
+ * pieces. The pipelines swap their filters of that plugin at a frame boundary (see
+ * FilterGraph::replaceFilter()), capturing, recording and everything else goes on.
+ *
+ * @note while running, the registry is used by the reloader's thread - nobody else may use it
+ * @note replace a plugin file by a new one (as the linker does), do not overwrite it in place -
+ *       the filters loaded first still map the file itself
+ */
+class FilterReloader
+{
+public:
+
+    explicit FilterReloader(FilterRegistry*);
+    /** stops */
+    ~FilterReloader();
+    FilterReloader(const FilterReloader&) = delete;
+    FilterReloader &operator=(const FilterReloader&) = delete;
+
+    /** @note not while running */
+    void addPipeline(FilterPipeline*);
+
+    /** Default: 0.3 */
+    void setSettleTime(double seconds);
+    double settleTime() const;
+
+    /** @returns false if the directories cannot be watched */
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    /** plugins loaded again so far */
+    unsigned int reloadCount() const;
+
+private:
+
+    /** loads the plugin of the file again and hands it to the pipelines */
+    void reload(const std::string &fileName);
+
+    static void reloaderThread(FilterReloader*);
+
+    FilterRegistry *m_registry;
+    std::vector<FilterPipeline*> m_pipelines;
+    long long m_settleTime;
+
+    int m_inotifyFileDescriptor;
+    /** watch descriptor -> directory */
+    std::map<int, std::string> m_watches;
+    unsigned int m_reloadCount;
+
+    std::thread *m_thread;
+    int m_wakeupFileDescriptor;
+    bool m_cancellationFlag;
+};
+
+
+#endif /* FILTER_RELOADER_HPP */
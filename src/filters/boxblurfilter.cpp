@@ -0,0 +1,167 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "boxblurfilter.hpp"
+
+#include <linux/videodev2.h>
+
+
+using namespace std;
+
+
+const unsigned int filterAbiVersion = BaseFilter::AbiVersion;
+
+/* not reentrant - process() blurs through rows of its own */
+const BaseFilter::Descriptor filterDescriptor = {
+    BaseFilter::DescriptorVersion, sizeof(BaseFilter::Descriptor), "box blur",
+    1, {{"image", BaseFilter::PortTypeImage, -1}},
+    1, {{"blurred image", BaseFilter::PortTypeImage, -1}},
+    {V4L2_PIX_FMT_GREY, V4L2_PIX_FMT_RGB24}, 0,
+    BaseFilter::FusionSeparableStencil, FILTER_BUILD_SIMD, BaseFilter::FlagStateless
+};
+
+
+BaseFilter* create()
+{
+    return static_cast<BaseFilter*>(new BoxBlurFilter());
+}
+
+
+void destroy(BaseFilter* filter)
+{
+    delete filter;
+}
+
+
+BoxBlurFilter::BoxBlurFilter() : BaseFilter(),
+        m_channels(1),
+        m_rowLength(0)
+{
+    m_input = addInputPort("image", PortTypeImage);
+    m_output = addOutputPort("blurred image", PortTypeImage);
+}
+
+
+BoxBlurFilter::~BoxBlurFilter()
+{
+}
+
+
+string BoxBlurFilter::name() const
+{
+    return "box blur";
+}
+
+
+bool BoxBlurFilter::prepare(const Value *inputs, Value *outputs)
+{
+    const Image &input = inputs[m_input].image;
+
+    if (input.pixelFormat == V4L2_PIX_FMT_GREY) {
+        m_channels = 1;
+    } else if (input.pixelFormat == V4L2_PIX_FMT_RGB24) {
+        m_channels = 3;
+    } else {
+        return false;
+    }
+
+    outputs[m_output].image = input;
+    outputs[m_output].image.data = 0;
+    outputs[m_output].image.bytesPerLine = 0;
+
+    m_rowLength = input.width * m_channels;
+    m_rows.resize(3 * m_rowLength);
+
+    return true;
+}
+
+
+void BoxBlurFilter::process(const Value *inputs, Value *outputs)
+{
+    VT
+
+    const Image &input = inputs[m_input].image;
+    const Image &output = outputs[m_output].image;
+
+    /* the same two passes as when fused, the ring holds row y at y % 3 */
+    const unsigned char *rows[3];
+    unsigned int fetched = 0;
+
+    for (unsigned int y = 0; y < input.height; ++y) {
+
+        unsigned int last = y + 1 < input.height ? y + 1 : input.height - 1;
+        for (; fetched <= last; ++fetched) {
+            processRowHorizontal(input.data + fetched * input.bytesPerLine,
+                    &m_rows[(fetched % 3) * m_rowLength], input.width);
+        }
+
+        unsigned int above = y > 0 ? y - 1 : 0;
+        rows[0] = &m_rows[(above % 3) * m_rowLength];
+        rows[1] = &m_rows[(y % 3) * m_rowLength];
+        rows[2] = &m_rows[(last % 3) * m_rowLength];
+
+        processRowVertical(rows, output.data + y * output.bytesPerLine, input.width);
+    }
+}
+
+
+BaseFilter::Fusion BoxBlurFilter::fusion() const
+{
+    return FusionSeparableStencil;
+}
+
+
+unsigned int BoxBlurFilter::stencilRadius() const
+{
+    return 1;
+}
+
+
+void BoxBlurFilter::processRowHorizontal(const unsigned char *in, unsigned char *out, unsigned int width)
+{
+    const unsigned int c = m_channels;
+    const unsigned int length = width * c;
+
+    if (width < 2) {
+        for (unsigned int x = 0; x < length; ++x) out[x] = in[x];
+        return;
+    }
+
+    /* repeat the border pixels */
+    for (unsigned int x = 0; x < c; ++x) {
+        out[x] = (2 * in[x] + in[x + c] + 1) / 3;
+        out[length - c + x] = (in[length - 2 * c + x] + 2 * in[length - c + x] + 1) / 3;
+    }
+    for (unsigned int x = c; x < length - c; ++x) {
+        out[x] = (in[x - c] + in[x] + in[x + c] + 1) / 3;
+    }
+}
+
+
+void BoxBlurFilter::processRowVertical(const unsigned char * const *rows, unsigned char *out, unsigned int width)
+{
+    const unsigned int length = width * m_channels;
+    /* locals - out might alias rows otherwise, which prevents vectorizing */
+    const unsigned char *above = rows[0];
+    const unsigned char *center = rows[1];
+    const unsigned char *below = rows[2];
+
+    for (unsigned int x = 0; x < length; ++x) {
+        out[x] = (above[x] + center[x] + below[x] + 1) / 3;
+    }
+}
@@ -0,0 +1,64 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef BOX_BLUR_FILTER_HPP
+#define BOX_BLUR_FILTER_HPP
+
+
+#include "basefilter.hpp"
+
+#include <vector>
+
+
+
+extern "C" BaseFilter* create();
+extern "C" void destroy(BaseFilter*);
+extern "C" const unsigned int filterAbiVersion;
+extern "C" const BaseFilter::Descriptor filterDescriptor;
+
+
+/** 3x3 box blur of GREY or RGB24 images, done as a horizontal and a vertical pass */
+class BoxBlurFilter : public BaseFilter
+{
+public:
+    BoxBlurFilter();
+    virtual ~BoxBlurFilter();
+    BoxBlurFilter(const BoxBlurFilter&) = delete;
+    BoxBlurFilter& operator=(const BoxBlurFilter&) = delete;
+
+    virtual std::string name() const;
+    virtual bool prepare(const Value *inputs, Value *outputs);
+    virtual void process(const Value *inputs, Value *outputs);
+
+    virtual Fusion fusion() const;
+    virtual unsigned int stencilRadius() const;
+    virtual void processRowHorizontal(const unsigned char *in, unsigned char *out, unsigned int width);
+    virtual void processRowVertical(const unsigned char * const *rows, unsigned char *out, unsigned int width);
+
+private:
+    unsigned int m_input;
+    unsigned int m_output;
+    /** bytes per pixel */
+    unsigned int m_channels;
+    /** horizontally blurred rows for process(), allocated in prepare() */
+    std::vector<unsigned char> m_rows;
+    unsigned int m_rowLength;
+};
+
+
+#endif /* BOX_BLUR_FILTER_HPP */
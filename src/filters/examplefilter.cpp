@@ -19,9 +19,22 @@
 #include "examplefilter.hpp"
 #include <iostream>
 
+#include <linux/videodev2.h>
+
 using namespace std;
 
 
+const unsigned int filterAbiVersion = BaseFilter::AbiVersion;
+
+const BaseFilter::Descriptor filterDescriptor = {
+    BaseFilter::DescriptorVersion, sizeof(BaseFilter::Descriptor), "example filter",
+    1, {{"image", BaseFilter::PortTypeImage, -1}},
+    2, {{"inverted image", BaseFilter::PortTypeImage, 0}, {"brightness", BaseFilter::PortTypeFactor, -1}},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_GREY}, 0,
+    BaseFilter::FusionNone, FILTER_BUILD_SIMD, BaseFilter::FlagStateless | BaseFilter::FlagReentrant
+};
+
+
 BaseFilter* create()
 {
     return static_cast<BaseFilter*>(new ExampleFilter());
@@ -37,6 +50,10 @@ void destroy(BaseFilter* filter)
 ExampleFilter::ExampleFilter() : BaseFilter()
 {
     cerr << __PRETTY_FUNCTION__ << endl;
+
+    m_imageInput = addInputPort("image", PortTypeImage);
+    m_imageOutput = addOutputPort("inverted image", PortTypeImage, m_imageInput);
+    m_brightnessOutput = addOutputPort("brightness", PortTypeFactor);
 }
 
 
@@ -45,3 +62,50 @@ ExampleFilter::~ExampleFilter()
     cerr << __PRETTY_FUNCTION__ << endl;
 }
 
+
+string ExampleFilter::name() const
+{
+    return "example filter";
+}
+
+
+bool ExampleFilter::prepare(const Value *inputs, Value *outputs)
+{
+    const Image &input = inputs[m_imageInput].image;
+
+    if (input.pixelFormat != V4L2_PIX_FMT_RGB24 && input.pixelFormat != V4L2_PIX_FMT_GREY) {
+        return false;
+    }
+
+    /* same format - so the host may let us work in place */
+    outputs[m_imageOutput].image = input;
+    outputs[m_imageOutput].image.data = 0;
+
+    return true;
+}
+
+
+void ExampleFilter::process(const Value *inputs, Value *outputs)
+{
+    VT
+
+    const Image &input = inputs[m_imageInput].image;
+    Image &output = outputs[m_imageOutput].image;
+
+    unsigned int rowLength = input.pixelFormat == V4L2_PIX_FMT_RGB24 ? input.width * 3 : input.width;
+    unsigned long long sum = 0;
+
+    for (unsigned int y = 0; y < input.height; ++y) {
+
+        const unsigned char *in = input.data + y * input.bytesPerLine;
+        unsigned char *out = output.data + y * output.bytesPerLine;
+
+        for (unsigned int x = 0; x < rowLength; ++x) {
+            sum += in[x];
+            out[x] = 255 - in[x];
+        }
+    }
+
+    unsigned long long count = (unsigned long long) rowLength * input.height;
+    outputs[m_brightnessOutput].factor = count == 0 ? 0.0 : sum / (255.0 * count);
+}
@@ -26,8 +26,11 @@
 
 extern "C" BaseFilter* create();
 extern "C" void destroy(BaseFilter*);
+extern "C" const unsigned int filterAbiVersion;
+extern "C" const BaseFilter::Descriptor filterDescriptor;
 
 
+/** inverts an RGB24 or GREY image and measures its mean brightness */
 class ExampleFilter : public BaseFilter
 {
 public:
@@ -35,9 +38,16 @@ public:
     virtual ~ExampleFilter();
     ExampleFilter(const ExampleFilter&) = delete;
     ExampleFilter& operator=(const ExampleFilter&) = delete;
+
+    virtual std::string name() const;
+    virtual bool prepare(const Value *inputs, Value *outputs);
+    virtual void process(const Value *inputs, Value *outputs);
+
 private:
+    unsigned int m_imageInput;
+    unsigned int m_imageOutput;
+    unsigned int m_brightnessOutput;
 };
 
 
 #endif /* EXAMPLE_FILTER_HPP */
-
@@ -0,0 +1,108 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "grayscalefilter.hpp"
+
+#include <linux/videodev2.h>
+
+
+using namespace std;
+
+
+const unsigned int filterAbiVersion = BaseFilter::AbiVersion;
+
+const BaseFilter::Descriptor filterDescriptor = {
+    BaseFilter::DescriptorVersion, sizeof(BaseFilter::Descriptor), "grayscale",
+    1, {{"image", BaseFilter::PortTypeImage, -1}},
+    1, {{"gray image", BaseFilter::PortTypeImage, -1}},
+    {V4L2_PIX_FMT_RGB24}, V4L2_PIX_FMT_GREY,
+    BaseFilter::FusionPerPixel, FILTER_BUILD_SIMD, BaseFilter::FlagStateless | BaseFilter::FlagReentrant
+};
+
+
+BaseFilter* create()
+{
+    return static_cast<BaseFilter*>(new GrayscaleFilter());
+}
+
+
+void destroy(BaseFilter* filter)
+{
+    delete filter;
+}
+
+
+GrayscaleFilter::GrayscaleFilter() : BaseFilter()
+{
+    m_input = addInputPort("image", PortTypeImage);
+    m_output = addOutputPort("gray image", PortTypeImage);
+}
+
+
+GrayscaleFilter::~GrayscaleFilter()
+{
+}
+
+
+string GrayscaleFilter::name() const
+{
+    return "grayscale";
+}
+
+
+bool GrayscaleFilter::prepare(const Value *inputs, Value *outputs)
+{
+    const Image &input = inputs[m_input].image;
+
+    if (input.pixelFormat != V4L2_PIX_FMT_RGB24) return false;
+
+    Image &output = outputs[m_output].image;
+    output.width = input.width;
+    output.height = input.height;
+    output.bytesPerLine = 0;
+    output.pixelFormat = V4L2_PIX_FMT_GREY;
+
+    return true;
+}
+
+
+void GrayscaleFilter::process(const Value *inputs, Value *outputs)
+{
+    VT
+
+    const Image &input = inputs[m_input].image;
+    const Image &output = outputs[m_output].image;
+
+    for (unsigned int y = 0; y < input.height; ++y) {
+        processRow(input.data + y * input.bytesPerLine, output.data + y * output.bytesPerLine, input.width);
+    }
+}
+
+
+BaseFilter::Fusion GrayscaleFilter::fusion() const
+{
+    return FusionPerPixel;
+}
+
+
+void GrayscaleFilter::processRow(const unsigned char *in, unsigned char *out, unsigned int width)
+{
+    for (unsigned int x = 0; x < width; ++x, in += 3) {
+        out[x] = (77 * in[0] + 150 * in[1] + 29 * in[2] + 128) >> 8;
+    }
+}
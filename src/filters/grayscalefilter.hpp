@@ -0,0 +1,55 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef GRAYSCALE_FILTER_HPP
+#define GRAYSCALE_FILTER_HPP
+
+
+#include "basefilter.hpp"
+
+
+
+extern "C" BaseFilter* create();
+extern "C" void destroy(BaseFilter*);
+extern "C" const unsigned int filterAbiVersion;
+extern "C" const BaseFilter::Descriptor filterDescriptor;
+
+
+/** turns RGB24 into GREY, weighting the components like BT.601 luma */
+class GrayscaleFilter : public BaseFilter
+{
+public:
+    GrayscaleFilter();
+    virtual ~GrayscaleFilter();
+    GrayscaleFilter(const GrayscaleFilter&) = delete;
+    GrayscaleFilter& operator=(const GrayscaleFilter&) = delete;
+
+    virtual std::string name() const;
+    virtual bool prepare(const Value *inputs, Value *outputs);
+    virtual void process(const Value *inputs, Value *outputs);
+
+    virtual Fusion fusion() const;
+    virtual void processRow(const unsigned char *in, unsigned char *out, unsigned int width);
+
+private:
+    unsigned int m_input;
+    unsigned int m_output;
+};
+
+
+#endif /* GRAYSCALE_FILTER_HPP */
@@ -0,0 +1,56 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef THRESHOLD_FILTER_HPP
+#define THRESHOLD_FILTER_HPP
+
+
+#include "basefilter.hpp"
+
+
+
+extern "C" BaseFilter* create();
+extern "C" void destroy(BaseFilter*);
+extern "C" const unsigned int filterAbiVersion;
+extern "C" const BaseFilter::Descriptor filterDescriptor;
+
+
+/** GREY pixels at or above the threshold become white, the others black */
+class ThresholdFilter : public BaseFilter
+{
+public:
+    ThresholdFilter();
+    virtual ~ThresholdFilter();
+    ThresholdFilter(const ThresholdFilter&) = delete;
+    ThresholdFilter& operator=(const ThresholdFilter&) = delete;
+
+    virtual std::string name() const;
+    virtual bool prepare(const Value *inputs, Value *outputs);
+    virtual void process(const Value *inputs, Value *outputs);
+
+    virtual Fusion fusion() const;
+    virtual void processRow(const unsigned char *in, unsigned char *out, unsigned int width);
+
+private:
+    unsigned int m_input;
+    unsigned int m_output;
+    unsigned char m_threshold;
+};
+
+
+#endif /* THRESHOLD_FILTER_HPP */
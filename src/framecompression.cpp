@@ -0,0 +1,186 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "framecompression.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <lz4.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+static const size_t headerSize = 2 * sizeof(unsigned int);
+
+
+static size_t tileBound(unsigned int tileSize)
+{
+    return LZ4_compressBound(tileSize);
+}
+
+
+/* bytewise, wrapping around - as fast as the memory, it runs over every byte of every frame */
+static void subtract(const unsigned char *a, const unsigned char *b, unsigned char *difference, unsigned int size)
+{
+    unsigned int i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        _mm_storeu_si128((__m128i*) (difference + i), _mm_sub_epi8(x, y));
+    }
+#endif
+    for (; i < size; ++i) {
+        difference[i] = a[i] - b[i];
+    }
+}
+
+
+static void add(unsigned char *sum, const unsigned char *b, unsigned int size)
+{
+    unsigned int i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (sum + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        _mm_storeu_si128((__m128i*) (sum + i), _mm_add_epi8(x, y));
+    }
+#endif
+    for (; i < size; ++i) {
+        sum[i] += b[i];
+    }
+}
+
+
+unsigned int FrameCompression::tileCount(size_t rawSize, unsigned int tileSize)
+{
+    assert(tileSize > 0);
+    return (rawSize + tileSize - 1) / tileSize;
+}
+
+
+size_t FrameCompression::maximumSize(size_t rawSize, unsigned int tileSize)
+{
+    unsigned int tiles = tileCount(rawSize, tileSize);
+    return headerSize + tiles * sizeof(unsigned int) + tiles * tileBound(tileSize);
+}
+
+
+void FrameCompression::compressTile(const unsigned char *raw, size_t rawSize, unsigned int tileSize,
+        unsigned int tile, unsigned char *reference, bool keyFrame,
+        unsigned char *destination, unsigned char *scratch)
+{
+    assert(keyFrame == true || reference != 0);
+
+    unsigned int tiles = tileCount(rawSize, tileSize);
+    size_t begin = (size_t) tile * tileSize;
+    unsigned int size = min((size_t) tileSize, rawSize - begin);
+
+    const unsigned char *source = raw + begin;
+
+    if (keyFrame == false) {
+        /* wraps around, the decoder adds it back the same way */
+        subtract(source, reference + begin, scratch, size);
+        source = scratch;
+    }
+
+    unsigned int *sizes = (unsigned int*) (destination + headerSize);
+    char *tileDestination = (char*) destination + headerSize + tiles * sizeof(unsigned int) + tile * tileBound(tileSize);
+
+    int compressed = LZ4_compress_default((const char*) source, tileDestination, size, tileBound(tileSize));
+    if (compressed <= 0 || (unsigned int) compressed >= size) {
+        /* noise - stored as it is */
+        memcpy(tileDestination, source, size);
+        compressed = size;
+    }
+    sizes[tile] = compressed;
+
+    if (reference != 0) {
+        memcpy(reference + begin, raw + begin, size);
+    }
+}
+
+
+size_t FrameCompression::pack(unsigned char *destination, size_t rawSize, unsigned int tileSize)
+{
+    unsigned int tiles = tileCount(rawSize, tileSize);
+
+    unsigned int *header = (unsigned int*) destination;
+    header[0] = tiles;
+    header[1] = tileSize;
+
+    const unsigned int *sizes = header + 2;
+    unsigned char *tilesBegin = destination + headerSize + tiles * sizeof(unsigned int);
+
+    size_t position = 0;
+    for (unsigned int a = 0; a < tiles; ++a) {
+        memmove(tilesBegin + position, tilesBegin + a * tileBound(tileSize), sizes[a]);
+        position += sizes[a];
+    }
+
+    return headerSize + tiles * sizeof(unsigned int) + position;
+}
+
+
+bool FrameCompression::decompress(const unsigned char *data, size_t size,
+        unsigned char *raw, size_t rawSize, const unsigned char *reference)
+{
+    assert(raw != reference);
+
+    if (size < headerSize) return false;
+
+    const unsigned int *header = (const unsigned int*) data;
+    unsigned int tiles = header[0];
+    unsigned int tileSize = header[1];
+
+    if (tileSize == 0 || tiles != tileCount(rawSize, tileSize) ||
+            size < headerSize + tiles * sizeof(unsigned int)) {
+        return false;
+    }
+
+    const unsigned int *sizes = header + 2;
+    const unsigned char *source = data + headerSize + tiles * sizeof(unsigned int);
+    const unsigned char *end = data + size;
+
+    for (unsigned int a = 0; a < tiles; ++a) {
+        size_t begin = (size_t) a * tileSize;
+        unsigned int tileRawSize = min((size_t) tileSize, rawSize - begin);
+
+        if (sizes[a] > (size_t) (end - source)) return false;
+
+        if (sizes[a] == tileRawSize) {
+            memcpy(raw + begin, source, tileRawSize);
+        } else {
+            int decompressed = LZ4_decompress_safe((const char*) source, (char*) raw + begin, sizes[a], tileRawSize);
+            if (decompressed != (int) tileRawSize) return false;
+        }
+        source += sizes[a];
+
+        if (reference != 0) {
+            add(raw + begin, reference + begin, tileRawSize);
+        }
+    }
+
+    return true;
+}
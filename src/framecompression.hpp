@@ -0,0 +1,75 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FRAME_COMPRESSION_HPP
+#define FRAME_COMPRESSION_HPP
+
+#include "prereqs.hpp"
+
+#include <cstddef>
+
+
+/**
+ * lossless LZ4 compression of frames, tile by tile
+ *
+ * A frame is cut into tiles of a fixed number of bytes, each compressed on its own - so
+ * tiles can be compressed in parallel. A frame, which is no key frame, is stored as the
+ * bytewise difference to the frame before: static parts become zeros, which cost next to
+ * nothing. Tiles, which do not get smaller, are stored as they are.
+ *
+ * Layout of a compressed frame:
+ *  - unsigned int tile count, unsigned int tile size
+ *  - unsigned int stored size of each tile
+ *  - the tiles, one after the other
+ */
+class FrameCompression
+{
+public:
+
+    FrameCompression() = delete;
+
+    static unsigned int tileCount(size_t rawSize, unsigned int tileSize);
+    /** @returns bytes needed by compressTile() for the whole frame - at worst */
+    static size_t maximumSize(size_t rawSize, unsigned int tileSize);
+
+    /**
+     * compresses a tile into its place in destination - tiles may be compressed concurrently
+     *
+     * @param reference
+     *    in: the frame before, unless keyFrame, out: this frame. 0 for key frames only
+     * @param destination maximumSize() bytes, the same for all tiles of the frame
+     * @param scratch tileSize bytes of its own
+     */
+    static void compressTile(const unsigned char *raw, size_t rawSize, unsigned int tileSize,
+            unsigned int tile, unsigned char *reference, bool keyFrame,
+            unsigned char *destination, unsigned char *scratch);
+
+    /** moves the tiles together, once all of them are compressed
+        @returns bytes of the compressed frame */
+    static size_t pack(unsigned char *destination, size_t rawSize, unsigned int tileSize);
+
+    /**
+     * @param reference the frame before, 0 for a key frame - not raw itself
+     * @returns false if the data is corrupt
+     */
+    static bool decompress(const unsigned char *data, size_t size,
+            unsigned char *raw, size_t rawSize, const unsigned char *reference);
+};
+
+
+#endif /* FRAME_COMPRESSION_HPP */
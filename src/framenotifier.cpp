@@ -0,0 +1,66 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "framenotifier.hpp"
+
+#include <chrono>
+
+using namespace std;
+
+
+FrameNotifier::FrameNotifier() :
+        m_generation(0),
+        m_waiterCount(0)
+{
+}
+
+
+void FrameNotifier::notify()
+{
+    m_mutex.lock();
+    ++m_generation;
+    bool wake = m_waiterCount > 0;
+    m_mutex.unlock();
+
+    if (wake == true) m_condition.notify_all();
+}
+
+
+unsigned long long FrameNotifier::generation()
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_generation;
+}
+
+
+unsigned long long FrameNotifier::wait(unsigned long long seenGeneration, unsigned int timeoutMilliseconds)
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    if (m_generation == seenGeneration) {
+        MonotonicClock::time_point timeout = MonotonicClock::now() + chrono::milliseconds(timeoutMilliseconds);
+
+        ++m_waiterCount;
+        while (m_generation == seenGeneration) {
+            if (m_condition.wait_until(lock, timeout) == cv_status::timeout) break;
+        }
+        --m_waiterCount;
+    }
+
+    return m_generation;
+}
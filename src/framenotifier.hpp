@@ -0,0 +1,62 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FRAME_NOTIFIER_HPP
+#define FRAME_NOTIFIER_HPP
+
+#include "prereqs.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+
+/**
+ * wakes up consumers, when a capture device published a new frame
+ *
+ * One notifier can be subscribed to any number of capture devices, so a single thread
+ * can wait for all of them. To not miss a frame, take generation() before looking at the
+ * devices and pass it to wait() afterwards.
+ *
+ * @see CaptureDevice::subscribe
+ */
+class FrameNotifier
+{
+public:
+    FrameNotifier();
+    FrameNotifier(const FrameNotifier&) = delete;
+    FrameNotifier &operator=(const FrameNotifier&) = delete;
+
+    /** called by the producers - cheap, if nobody is waiting */
+    void notify();
+
+    /** @returns number of notify() calls so far */
+    unsigned long long generation();
+
+    /** blocks until generation() differs from seenGeneration or the timeout expired
+        @returns the current generation */
+    unsigned long long wait(unsigned long long seenGeneration, unsigned int timeoutMilliseconds);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    unsigned long long m_generation;
+    unsigned int m_waiterCount;
+};
+
+
+#endif /* FRAME_NOTIFIER_HPP */
@@ -0,0 +1,238 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "framepool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/mman.h>
+
+using namespace std;
+
+
+static size_t roundUp(size_t size, size_t multiple)
+{
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+
+FramePool &FramePool::instance()
+{
+    /* never destroyed - devices and filters may release their blocks during static destruction */
+    static FramePool *pool = new FramePool;
+    return *pool;
+}
+
+
+FramePool::FramePool() :
+        m_hugePages(false),
+        m_retainedBytes(256 * 1024 * 1024)
+{
+    memset(&m_statistics, 0, sizeof(Statistics));
+}
+
+
+FramePool::~FramePool()
+{
+    assert(m_usedBlocks.empty() == true);
+    trim();
+}
+
+
+unsigned char *FramePool::allocate(size_t size)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    ++m_statistics.allocations;
+
+    size_t rounded = roundUp(max(size, (size_t) 1), Alignment);
+    if (m_hugePages == true && rounded >= HugePageSize) rounded = roundUp(rounded, HugePageSize);
+
+    /* the smallest free block fitting - unless it would waste more than half the size */
+    auto it = m_freeBlocks.lower_bound(rounded);
+    if (it != m_freeBlocks.end() && it->first - rounded <= rounded / 2) {
+        Block block = it->second;
+        m_freeBlocks.erase(it);
+        m_statistics.freeBytes -= block.capacity;
+        m_statistics.usedBytes += block.capacity;
+        m_usedBlocks[block.memory] = block;
+        return block.memory;
+    }
+
+    Block block;
+    if (allocateBlock(rounded, &block) == false) return 0;
+
+    ++m_statistics.systemAllocations;
+    m_statistics.usedBytes += block.capacity;
+    m_usedBlocks[block.memory] = block;
+    return block.memory;
+}
+
+
+void FramePool::release(unsigned char *memory)
+{
+    if (memory == 0) return;
+
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_usedBlocks.find(memory);
+    assert(it != m_usedBlocks.end());
+
+    Block block = it->second;
+    m_usedBlocks.erase(it);
+    m_statistics.usedBytes -= block.capacity;
+
+    m_freeBlocks.insert(make_pair(block.capacity, block));
+    m_statistics.freeBytes += block.capacity;
+
+    shrink();
+}
+
+
+void FramePool::setHugePages(bool hugePages)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_hugePages = hugePages;
+}
+bool FramePool::hugePages() const
+{
+    return m_hugePages;
+}
+
+
+void FramePool::setRetainedBytes(size_t bytes)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_retainedBytes = bytes;
+    shrink();
+}
+size_t FramePool::retainedBytes() const
+{
+    return m_retainedBytes;
+}
+
+
+void FramePool::trim()
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    for (auto it = m_freeBlocks.begin(); it != m_freeBlocks.end(); ++it) {
+        freeBlock(it->second);
+    }
+    m_freeBlocks.clear();
+    m_statistics.freeBytes = 0;
+}
+
+
+FramePool::Statistics FramePool::statistics()
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+
+unsigned int FramePool::paddedBytesPerLine(unsigned int bytesPerLine)
+{
+    return roundUp(bytesPerLine, Alignment);
+}
+
+
+/* *** private ************************************************************** */
+bool FramePool::allocateBlock(size_t size, Block *block)
+{
+    assert(size % Alignment == 0);
+
+    if (m_hugePages == true && size >= HugePageSize) {
+
+        size_t capacity = size;
+        void *memory = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+        memory = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) ++m_statistics.hugePageBlocks;
+#endif
+
+        if (memory == MAP_FAILED) {
+            /* none reserved - a plain mapping, aligned to huge pages, so all of it can be backed by them */
+            void *mapping = mmap(0, capacity + HugePageSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED) {
+                perror(__PRETTY_FUNCTION__);
+                return false;
+            }
+
+            unsigned char *start = (unsigned char*) roundUp((size_t) mapping, HugePageSize);
+            size_t head = start - (unsigned char*) mapping;
+            if (head > 0) munmap(mapping, head);
+            munmap(start + capacity, HugePageSize - head);
+            memory = start;
+
+#ifdef MADV_HUGEPAGE
+            if (madvise(memory, capacity, MADV_HUGEPAGE) == 0) ++m_statistics.hugePageBlocks;
+#endif
+        }
+
+        block->memory = (unsigned char*) memory;
+        block->capacity = capacity;
+        block->mapped = true;
+
+    } else {
+
+        void *memory;
+        int ret = posix_memalign(&memory, Alignment, size);
+        if (ret != 0) {
+            cerr << __PRETTY_FUNCTION__ << " posix_memalign " << ret << " " << strerror(ret) << endl;
+            return false;
+        }
+
+        block->memory = (unsigned char*) memory;
+        block->capacity = size;
+        block->mapped = false;
+    }
+
+    /* fault the pages in now, not while the first frames go through */
+    memset(block->memory, 0, block->capacity);
+
+    return true;
+}
+
+
+void FramePool::freeBlock(const Block &block)
+{
+    if (block.mapped == true) {
+        munmap(block.memory, block.capacity);
+    } else {
+        free(block.memory);
+    }
+}
+
+
+void FramePool::shrink()
+{
+    while (m_statistics.freeBytes > m_retainedBytes) {
+        auto largest = --m_freeBlocks.end();
+        freeBlock(largest->second);
+        m_statistics.freeBytes -= largest->first;
+        m_freeBlocks.erase(largest);
+    }
+}
@@ -0,0 +1,128 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FRAME_POOL_HPP
+#define FRAME_POOL_HPP
+
+#include "prereqs.hpp"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+
+/**
+ * frame sized memory, kept for reuse instead of going back to the system
+ *
+ * Blocks are aligned to Alignment and faulted in when they come from the system. A released
+ * block goes to a free list and is handed out again for a request of about its size - a
+ * device initialized again at the same resolution, a filter prepared again for the same
+ * format, get their memory back without a system call or page fault. Capture buffers, filter
+ * outputs and converted images all come from the one pool (see instance()), so memory given
+ * up by one of them serves the others.
+ *
+ * With huge pages, blocks of at least HugePageSize are mapped from huge pages if the system
+ * has any reserved, transparent huge pages are asked for otherwise.
+ *
+ * @note thread-safe
+ */
+class FramePool
+{
+public:
+
+    /** of every block and of padded rows - a cache line, the widest SIMD load */
+    static const unsigned int Alignment = 64;
+    static const size_t HugePageSize = 2 * 1024 * 1024;
+
+    struct Statistics
+    {
+        /** calls of allocate() */
+        unsigned long long allocations;
+        /** allocations served by new memory from the system */
+        unsigned long long systemAllocations;
+        /** blocks mapped from reserved huge pages or advised to be backed by transparent ones */
+        unsigned long long hugePageBlocks;
+        size_t usedBytes;
+        size_t freeBytes;
+    };
+
+
+    /** the pool shared by capture devices, filters and image conversion */
+    static FramePool &instance();
+
+    FramePool();
+    /** returns the free blocks to the system - the used ones have to be released before */
+    ~FramePool();
+    FramePool(const FramePool&) = delete;
+    FramePool &operator=(const FramePool&) = delete;
+
+    /** @returns at least size bytes aligned to Alignment, 0 if the system has no memory left
+        @note the contents are undefined - zero for new memory, the previous user's otherwise */
+    unsigned char *allocate(size_t size);
+    /** hands a block of allocate() back, 0 is ignored */
+    void release(unsigned char*);
+
+    /** Default: false
+        @note takes effect for blocks allocated from the system afterwards */
+    void setHugePages(bool);
+    bool hugePages() const;
+
+    /** free bytes kept for reuse at most, the blocks released beyond go back to the system.
+        Default: 256 MiB */
+    void setRetainedBytes(size_t);
+    size_t retainedBytes() const;
+
+    /** returns all free blocks to the system */
+    void trim();
+
+    Statistics statistics();
+
+    /** @returns bytesPerLine rounded up to Alignment - rows starting on cache lines */
+    static unsigned int paddedBytesPerLine(unsigned int bytesPerLine);
+
+private:
+
+    struct Block
+    {
+        unsigned char *memory;
+        size_t capacity;
+        /** mmap()ed, not posix_memalign()ed */
+        bool mapped;
+    };
+
+    /** @param size a multiple of Alignment - of HugePageSize for huge pages
+        @returns false if the system has no memory left */
+    bool allocateBlock(size_t size, Block*);
+    void freeBlock(const Block&);
+    /** frees blocks until no more than m_retainedBytes are free, largest first */
+    void shrink();
+
+    std::mutex m_mutex;
+    bool m_hugePages;
+    size_t m_retainedBytes;
+
+    /** capacity -> free block */
+    std::multimap<size_t, Block> m_freeBlocks;
+    /** memory -> block in use */
+    std::map<unsigned char*, Block> m_usedBlocks;
+
+    Statistics m_statistics;
+};
+
+
+#endif /* FRAME_POOL_HPP */
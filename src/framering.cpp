@@ -0,0 +1,300 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "framering.hpp"
+
+#include <cassert>
+
+using namespace std;
+
+
+/* all __sync builtins are full barriers, these two cover the plain accesses */
+template <typename T>
+static T loadAcquire(const volatile T &t);
+template <typename T>
+static void storeRelease(volatile T &t, T value);
+
+
+FrameRing::FrameRing() :
+        m_buffers(0),
+        m_bufferCount(0),
+        m_publishedSequence(0)
+{
+}
+
+
+void FrameRing::setBuffers(Buffer *buffers, unsigned int count)
+{
+    assert((buffers == 0) == (count == 0));
+
+    m_buffers = buffers;
+    m_bufferCount = count;
+    m_slots.assign(count, 0);
+    m_publishedSequence = 0;
+
+    for (unsigned int a = 0; a < count; ++a) {
+        assert(m_buffers[a].readerCount == 0 || m_buffers[a].readerCount == Claimed);
+        m_buffers[a].sequence = 0;
+    }
+}
+
+
+FrameRing::Buffer *FrameRing::claimOldest()
+{
+    for (;;) {
+        Buffer *oldest = 0;
+
+        for (unsigned int a = 0; a < m_bufferCount; ++a) {
+            if (loadAcquire(m_buffers[a].readerCount) == 0 &&
+                    (oldest == 0 || m_buffers[a].sequence < oldest->sequence)) {
+                oldest = &m_buffers[a];
+            }
+        }
+
+        if (oldest == 0) return 0;
+
+        /* a consumer might have locked it in between - look again */
+        if (claim(oldest) == true) return oldest;
+    }
+}
+
+
+bool FrameRing::claim(Buffer *buffer)
+{
+    return __sync_bool_compare_and_swap(&buffer->readerCount, 0, Claimed);
+}
+
+
+void FrameRing::unclaim(Buffer *buffer)
+{
+    assert(buffer->readerCount == Claimed);
+    storeRelease(buffer->readerCount, 0);
+}
+
+
+void FrameRing::publish(Buffer *buffer)
+{
+    assert(buffer->readerCount == Claimed);
+    assert(m_bufferCount > 0);
+
+    /* only the producer writes these - no consumer can lock the buffer before readerCount is 0 */
+    unsigned long long sequence = m_publishedSequence + 1;
+    buffer->sequence = sequence;
+    storeRelease(m_slots[sequence % m_bufferCount], buffer);
+
+    storeRelease(buffer->readerCount, 0);
+    storeRelease(m_publishedSequence, sequence);
+}
+
+
+unsigned long long FrameRing::publishedSequence() const
+{
+    return loadAcquire(m_publishedSequence);
+}
+
+
+unsigned int FrameRing::lockNewest(unsigned int n, Handle *handles)
+{
+    unsigned int ret = 0;
+    unsigned long long newest = publishedSequence();
+
+    for (; ret < n && newest > ret; ++ret) {
+        Buffer *buffer = lockSequence(newest - ret);
+
+        if (buffer == 0 && ret == 0) {
+            /* overtaken by the producer while starting - try once more with the new newest */
+            newest = publishedSequence();
+            buffer = lockSequence(newest);
+        }
+
+        if (buffer == 0) break;
+
+        handles[ret] = Handle(buffer);
+    }
+
+    for (unsigned int a = ret; a < n; ++a) {
+        handles[a].reset();
+    }
+
+    return ret;
+}
+
+
+unsigned int FrameRing::lockNewer(unsigned long long sequence, unsigned int n, Handle *handles)
+{
+    unsigned int ret = 0;
+    unsigned long long newest = publishedSequence();
+    unsigned long long first = sequence + 1;
+
+    if (newest > n && newest - n + 1 > first) first = newest - n + 1;
+
+    for (unsigned long long a = first; a <= newest && ret < n; ++a) {
+        Buffer *buffer = lockSequence(a);
+        if (buffer == 0) continue;
+
+        handles[ret++] = Handle(buffer);
+    }
+
+    for (unsigned int a = ret; a < n; ++a) {
+        handles[a].reset();
+    }
+
+    return ret;
+}
+
+
+unsigned int FrameRing::newerThan(const timespec &newerThan)
+{
+    unsigned int ret = 0;
+    unsigned long long newest = publishedSequence();
+
+    for (; newest > ret; ++ret) {
+        Buffer *buffer = lockSequence(newest - ret);
+        if (buffer == 0) break;
+
+        bool isNewer = (buffer->time.tv_sec > newerThan.tv_sec) ||
+                ((buffer->time.tv_sec == newerThan.tv_sec) && (buffer->time.tv_nsec > newerThan.tv_nsec));
+        unlock(buffer);
+
+        if (isNewer == false) break;
+    }
+
+    return ret;
+}
+
+
+bool FrameRing::tryLock(Buffer *buffer)
+{
+    for (;;) {
+        int readers = loadAcquire(buffer->readerCount);
+        if (readers == Claimed) return false;
+        if (__sync_bool_compare_and_swap(&buffer->readerCount, readers, readers + 1)) return true;
+    }
+}
+
+
+void FrameRing::unlock(Buffer *buffer)
+{
+    int readers = __sync_sub_and_fetch(&buffer->readerCount, 1);
+    assert(readers >= 0); (void) readers;
+}
+
+
+FrameRing::Buffer *FrameRing::lockSequence(unsigned long long sequence)
+{
+    if (m_bufferCount == 0) return 0;
+
+    Buffer *buffer = loadAcquire(m_slots[sequence % m_bufferCount]);
+    if (buffer == 0 || tryLock(buffer) == false) return 0;
+
+    /* the slot may have been reused, or the buffer republished, before we got the lock */
+    if (loadAcquire(buffer->sequence) != sequence) {
+        unlock(buffer);
+        return 0;
+    }
+
+    return buffer;
+}
+
+
+/* *** Handle *************************************************************** */
+FrameRing::Handle::Handle() : m_buffer(0)
+{
+}
+
+
+FrameRing::Handle::Handle(Buffer *buffer) : m_buffer(buffer)
+{
+    assert(m_buffer != 0);
+    assert(m_buffer->readerCount > 0);
+}
+
+
+FrameRing::Handle::Handle(const Handle &other) : m_buffer(other.m_buffer)
+{
+    if (m_buffer != 0) __sync_fetch_and_add(&m_buffer->readerCount, 1);
+}
+
+
+FrameRing::Handle::~Handle()
+{
+    reset();
+}
+
+
+FrameRing::Handle &FrameRing::Handle::operator=(const Handle &other)
+{
+    /* lock first - handles self assignment */
+    if (other.m_buffer != 0) __sync_fetch_and_add(&other.m_buffer->readerCount, 1);
+    reset();
+    m_buffer = other.m_buffer;
+    return *this;
+}
+
+
+const FrameRing::Buffer *FrameRing::Handle::operator->() const
+{
+    assert(m_buffer != 0);
+    return m_buffer;
+}
+
+
+const FrameRing::Buffer &FrameRing::Handle::operator*() const
+{
+    assert(m_buffer != 0);
+    return *m_buffer;
+}
+
+
+const FrameRing::Buffer *FrameRing::Handle::get() const
+{
+    return m_buffer;
+}
+
+
+bool FrameRing::Handle::isNull() const
+{
+    return m_buffer == 0;
+}
+
+
+void FrameRing::Handle::reset()
+{
+    if (m_buffer != 0) {
+        unlock(m_buffer);
+        m_buffer = 0;
+    }
+}
+
+
+/* *** local *************************************************************** */
+template <typename T>
+T loadAcquire(const volatile T &t)
+{
+    T ret = t;
+    __sync_synchronize();
+    return ret;
+}
+
+
+template <typename T>
+void storeRelease(volatile T &t, T value)
+{
+    __sync_synchronize();
+    t = value;
+}
@@ -0,0 +1,170 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FRAME_RING_HPP
+#define FRAME_RING_HPP
+
+#include "prereqs.hpp"
+
+#include <cstddef>
+#include <ctime>
+#include <vector>
+
+
+/**
+ * lock-free single producer, multiple consumer ring of frame buffers
+ *
+ * The producer claims a buffer, fills it and publishes it under the next sequence number.
+ * Consumers lock the newest published buffers by sequence number. Neither side ever waits
+ * for the other: a consumer, who loses a race against the producer, just gets fewer buffers;
+ * the producer skips buffers, which are locked by consumers.
+ *
+ * State of a buffer, kept in Buffer::readerCount:
+ *  - Claimed (-1): owned by the producer (or the driver), not readable
+ *  - 0: readable, may be claimed by the producer
+ *  - > 0: readable, locked by that many consumers
+ */
+class FrameRing
+{
+public:
+
+    static const int Claimed = -1;
+
+    struct Buffer
+    {
+        /** CLOCK_MONOTONIC time the frame was taken, see CaptureDevice::timestampSource() */
+        timespec time;
+        /** CLOCK_REALTIME counterpart of time - for correlating with other machines */
+        timespec realTime;
+        /** the source's count of the frame - gaps are frames dropped before the ring */
+        unsigned long long frameNumber;
+        /** CLOCK_MONOTONIC time the buffer was published - for measuring latencies */
+        timespec publishTime;
+        /** see class description
+            @note only changed atomically */
+        int readerCount;
+        /** sequence number under which the buffer was published, 0 if never */
+        unsigned long long sequence;
+        unsigned char *buffer;
+        /** size of the memory pointed to by buffer */
+        size_t length;
+        /** size of the current picture - less than length for compressed formats */
+        size_t bytesUsed;
+
+        /** fourcc code of the picture's pixel format, see V4L2_PIX_FMT_* */
+        unsigned int pixelFormat;
+        unsigned int width;
+        unsigned int height;
+        /** stride of the first plane */
+        unsigned int bytesPerLine;
+
+        /** index of the driver buffer - only meaningful for mapped driver buffers */
+        unsigned int index;
+    };
+
+
+    /**
+     * a buffer locked for reading
+     *
+     * Copying a handle adds a reader, destroying it removes one. When the last handle
+     * to a buffer is gone, the producer may reuse the buffer or hand it back to the driver.
+     * No allocation, no search - it is just an atomically counted pointer.
+     */
+    class Handle
+    {
+    public:
+        Handle();
+        Handle(const Handle&);
+        ~Handle();
+        Handle &operator=(const Handle&);
+
+        const Buffer *operator->() const;
+        const Buffer &operator*() const;
+        const Buffer *get() const;
+        /** @returns true if no buffer is held */
+        bool isNull() const;
+        /** drops the buffer early */
+        void reset();
+
+    private:
+        friend class FrameRing;
+        /** takes over a lock already held on the buffer */
+        explicit Handle(Buffer*);
+
+        Buffer *m_buffer;
+    };
+
+
+    FrameRing();
+    FrameRing(const FrameRing&) = delete;
+    FrameRing &operator=(const FrameRing&) = delete;
+
+    /**
+     * @param buffers the buffers cycled through - owned by the caller,
+     *    readerCount has to be 0 or Claimed, 0 for no buffers
+     * @note not thread safe - neither producer nor consumers may be active
+     */
+    void setBuffers(Buffer *buffers, unsigned int count);
+
+    /* *** producer *** */
+
+    /** claims the free buffer published longest ago
+        @returns 0 if every buffer is locked or claimed */
+    Buffer *claimOldest();
+    /** @returns false if the buffer is locked or claimed already */
+    bool claim(Buffer*);
+    /** gives a claimed buffer back without publishing it */
+    void unclaim(Buffer*);
+    /** makes a claimed buffer the newest one */
+    void publish(Buffer*);
+
+    /* *** consumers *** */
+
+    /** @returns the sequence number of the newest buffer, 0 if nothing was published so far */
+    unsigned long long publishedSequence() const;
+
+    /** locks the n newest buffers, newest first, into handles[0..n-1]
+        @returns the number of buffers actually locked, the remaining handles are reset */
+    unsigned int lockNewest(unsigned int n, Handle *handles);
+    /** locks the buffers published after the given sequence number, oldest first, into
+        handles[0..n-1] - of more than n the n newest, those gone already are skipped
+        @returns the number of buffers actually locked, the remaining handles are reset */
+    unsigned int lockNewer(unsigned long long sequence, unsigned int n, Handle *handles);
+
+    /** @returns number of published buffers newer than the given time, which are still in the ring */
+    unsigned int newerThan(const timespec &newerThan);
+
+private:
+
+    /** @returns false if the buffer is claimed */
+    static bool tryLock(Buffer*);
+    static void unlock(Buffer*);
+
+    /** locks the buffer published under this sequence number, 0 if it is gone already */
+    Buffer *lockSequence(unsigned long long sequence);
+
+    Buffer *m_buffers;
+    unsigned int m_bufferCount;
+
+    /** published buffers, sequence number modulo size */
+    std::vector<Buffer*> m_slots;
+    volatile unsigned long long m_publishedSequence;
+};
+
+
+#endif /* FRAME_RING_HPP */
@@ -0,0 +1,377 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "framesynchronizer.hpp"
+
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <thread>
+
+using namespace std;
+
+
+static long long nanoseconds(const timespec &time)
+{
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+
+FrameSynchronizer::FrameSynchronizer() :
+        m_tolerance(5000000),
+        m_queueDepth(0),
+        m_statisticsWindow(1000),
+        m_tupleFunction(0),
+        m_tupleUserData(0),
+        m_matchedTuples(0),
+        m_thread(0),
+        m_cancellationFlag(false)
+{
+}
+
+
+FrameSynchronizer::~FrameSynchronizer()
+{
+    stop();
+}
+
+
+unsigned int FrameSynchronizer::addSource(CaptureDevice *device)
+{
+    assert(isRunning() == false);
+
+    m_sources.push_back(device);
+    return m_sources.size() - 1;
+}
+unsigned int FrameSynchronizer::sourceCount() const
+{
+    return m_sources.size();
+}
+
+
+void FrameSynchronizer::setTolerance(double seconds)
+{
+    assert(seconds >= 0.0);
+    m_tolerance = (long long) (seconds * 1e9);
+}
+double FrameSynchronizer::tolerance() const
+{
+    return m_tolerance / 1e9;
+}
+
+
+void FrameSynchronizer::setQueueDepth(unsigned int depth)
+{
+    m_queueDepth = depth;
+}
+unsigned int FrameSynchronizer::queueDepth() const
+{
+    return m_queueDepth;
+}
+
+
+void FrameSynchronizer::setStatisticsWindow(unsigned int tuples)
+{
+    assert(tuples > 0);
+    m_statisticsWindow = tuples;
+}
+unsigned int FrameSynchronizer::statisticsWindow() const
+{
+    return m_statisticsWindow;
+}
+
+
+void FrameSynchronizer::setTupleFunction(TupleFunction function, void *userData)
+{
+    m_tupleFunction = function;
+    m_tupleUserData = userData;
+}
+
+
+void FrameSynchronizer::start()
+{
+    assert(isRunning() == false);
+
+    reset();
+
+    /* frames published before are not ours */
+    for (unsigned int a = 0; a < m_sources.size(); ++a) {
+        m_queues[a].lastSequence = m_sources[a]->publishedSequence();
+    }
+
+    m_cancellationFlag = false;
+    m_thread = new thread(bind(synchronizerThread, this));
+}
+
+
+void FrameSynchronizer::stop()
+{
+    if (isRunning() == false) return;
+
+    m_cancellationFlag = true;
+    m_frameNotifier.notify();
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+
+    /* release the frames still waiting */
+    for (auto it = m_queues.begin(); it != m_queues.end(); ++it) {
+        while (it->count > 0) dropHead(*it, false);
+    }
+}
+
+
+bool FrameSynchronizer::isRunning() const
+{
+    return m_thread != 0;
+}
+
+
+void FrameSynchronizer::reset()
+{
+    assert(isRunning() == false);
+
+    m_queues.resize(m_sources.size());
+    for (unsigned int a = 0; a < m_sources.size(); ++a) {
+        Queue &queue = m_queues[a];
+        unsigned int depth = m_queueDepth;
+        if (depth == 0) {
+            assert(m_sources[a] != 0);
+            depth = max(m_sources[a]->bufferCount(), 2u) - 1;
+        }
+
+        queue.frames.assign(depth, CaptureDevice::FrameHandle());
+        queue.head = 0;
+        queue.count = 0;
+        queue.lastSequence = 0;
+        queue.unmatchedFrames = 0;
+    }
+    m_tuple.assign(m_sources.size(), CaptureDevice::FrameHandle());
+
+    m_mutex.lock();
+    m_matchedTuples = 0;
+    m_offsets.assign((size_t) m_statisticsWindow * m_sources.size(), 0);
+    m_mutex.unlock();
+}
+
+
+void FrameSynchronizer::push(unsigned int source, const CaptureDevice::FrameHandle &frame)
+{
+    assert(source < m_queues.size());
+    assert(frame.isNull() == false);
+
+    Queue &queue = m_queues[source];
+
+    /* the others are too far behind - the oldest frame cannot wait any longer */
+    if (queue.count == queue.frames.size()) {
+        dropHead(queue, true);
+    }
+
+    queue.frames[(queue.head + queue.count) % queue.frames.size()] = frame;
+    ++queue.count;
+
+    match();
+}
+
+
+unsigned long long FrameSynchronizer::matchedTuples()
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_matchedTuples;
+}
+
+
+unsigned long long FrameSynchronizer::unmatchedFrames(unsigned int source)
+{
+    assert(source < m_queues.size());
+    return m_queues[source].unmatchedFrames;
+}
+
+
+FrameSynchronizer::SkewStatistics FrameSynchronizer::skew(unsigned int first, unsigned int second)
+{
+    assert(first < m_sources.size());
+    assert(second < m_sources.size());
+
+    SkewStatistics ret = {0, 0.0, 0.0, 0.0, 0.0};
+    lock_guard<mutex> lock(m_mutex);
+
+    unsigned int n = m_sources.size();
+    unsigned long long count = min(m_matchedTuples, (unsigned long long) m_statisticsWindow);
+    if (count == 0) return ret;
+
+    long long minimum = numeric_limits<long long>::max();
+    long long maximum = numeric_limits<long long>::min();
+    double sum = 0.0;
+    for (unsigned long long a = 0; a < count; ++a) {
+        long long skew = m_offsets[a * n + first] - m_offsets[a * n + second];
+        minimum = min(minimum, skew);
+        maximum = max(maximum, skew);
+        sum += skew;
+    }
+    double mean = sum / count;
+
+    /* second pass - the skews are small differences of large times, no room for cancellation */
+    double squares = 0.0;
+    for (unsigned long long a = 0; a < count; ++a) {
+        double deviation = m_offsets[a * n + first] - m_offsets[a * n + second] - mean;
+        squares += deviation * deviation;
+    }
+
+    ret.count = count;
+    ret.mean = mean / 1e9;
+    ret.standardDeviation = sqrt(squares / count) / 1e9;
+    ret.minimum = minimum / 1e9;
+    ret.maximum = maximum / 1e9;
+    return ret;
+}
+
+
+/* *** private ************************************************************** */
+const CaptureDevice::FrameHandle &FrameSynchronizer::head(const Queue &queue) const
+{
+    return queue.frames[queue.head];
+}
+
+
+void FrameSynchronizer::dropHead(Queue &queue, bool unmatched)
+{
+    assert(queue.count > 0);
+
+    queue.frames[queue.head].reset();
+    queue.head = (queue.head + 1) % queue.frames.size();
+    --queue.count;
+
+    if (unmatched == true) __sync_add_and_fetch(&queue.unmatchedFrames, 1);
+}
+
+
+void FrameSynchronizer::match()
+{
+    unsigned int n = m_queues.size();
+
+    for (;;) {
+        /* the newest of the oldest frames - no source can match anything before it anymore */
+        long long anchor = numeric_limits<long long>::min();
+        for (unsigned int a = 0; a < n; ++a) {
+            if (m_queues[a].count == 0) return;
+            anchor = max(anchor, nanoseconds(head(m_queues[a])->time));
+        }
+
+        /* every source moves on to its frame closest to the anchor */
+        long long oldest = numeric_limits<long long>::max();
+        long long newest = numeric_limits<long long>::min();
+        unsigned int oldestSource = 0;
+        for (unsigned int a = 0; a < n; ++a) {
+            Queue &queue = m_queues[a];
+            while (queue.count > 1) {
+                long long next = nanoseconds(queue.frames[(queue.head + 1) % queue.frames.size()]->time);
+                if (llabs(next - anchor) > llabs(nanoseconds(head(queue)->time) - anchor)) break;
+                dropHead(queue, true);
+            }
+
+            long long time = nanoseconds(head(queue)->time);
+            if (time < oldest) {
+                oldest = time;
+                oldestSource = a;
+            }
+            newest = max(newest, time);
+        }
+
+        if (newest - oldest <= m_tolerance) {
+            emitTuple();
+        } else {
+            /* the source of the newest frame is past it for good */
+            dropHead(m_queues[oldestSource], true);
+        }
+    }
+}
+
+
+void FrameSynchronizer::emitTuple()
+{
+    unsigned int n = m_queues.size();
+
+    for (unsigned int a = 0; a < n; ++a) {
+        m_tuple[a] = head(m_queues[a]);
+        dropHead(m_queues[a], false);
+    }
+
+    m_mutex.lock();
+    long long reference = nanoseconds(m_tuple[0]->time);
+    long long *offsets = &m_offsets[(m_matchedTuples % m_statisticsWindow) * n];
+    for (unsigned int a = 0; a < n; ++a) {
+        offsets[a] = nanoseconds(m_tuple[a]->time) - reference;
+    }
+    ++m_matchedTuples;
+    m_mutex.unlock();
+
+    if (m_tupleFunction != 0) {
+        m_tupleFunction(this, &m_tuple[0], m_tupleUserData);
+    }
+
+    for (unsigned int a = 0; a < n; ++a) {
+        m_tuple[a].reset();
+    }
+}
+
+
+/* *** static functions ***************************************************** */
+void FrameSynchronizer::synchronizerThread(FrameSynchronizer *synchronizer)
+{
+    vector<CaptureDevice*> &sources = synchronizer->m_sources;
+    vector<vector<CaptureDevice::FrameHandle> > frames(sources.size());
+
+    Tracer::setThreadName("synchronizer");
+
+    for (unsigned int a = 0; a < sources.size(); ++a) {
+        frames[a].resize(sources[a]->bufferCount() - 1);
+        sources[a]->subscribe(&synchronizer->m_frameNotifier);
+    }
+
+    while (synchronizer->m_cancellationFlag == false) {
+
+        /* taken before looking, so a frame published meanwhile ends the wait below at once */
+        unsigned long long generation = synchronizer->m_frameNotifier.generation();
+        bool pushed = false;
+
+        for (unsigned int a = 0; a < sources.size(); ++a) {
+            Queue &queue = synchronizer->m_queues[a];
+            unsigned int locked = sources[a]->lockNewerBuffers(&queue.lastSequence, frames[a].size(), &frames[a][0]);
+
+            for (unsigned int b = 0; b < locked; ++b) {
+                synchronizer->push(a, frames[a][b]);
+                frames[a][b].reset();
+            }
+            if (locked > 0) pushed = true;
+        }
+
+        if (pushed == false) {
+            synchronizer->m_frameNotifier.wait(generation, 100);
+        }
+    }
+
+    for (unsigned int a = 0; a < sources.size(); ++a) {
+        sources[a]->unsubscribe(&synchronizer->m_frameNotifier);
+    }
+}
@@ -0,0 +1,161 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef FRAME_SYNCHRONIZER_HPP
+#define FRAME_SYNCHRONIZER_HPP
+
+#include "prereqs.hpp"
+
+#include "capturedevice.hpp"
+#include "framenotifier.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * matches the frames of several capture devices by capture time
+ *
+ * Emits tuples of one frame per source, whose times lie within the tolerance of each other.
+ * Frames wait for their partners in a queue per source of fixed depth - as locked handles,
+ * nothing is copied. A frame that cannot be matched anymore - the other sources are past it
+ * already - or that is pushed out of a full queue is unmatched.
+ *
+ * Matching anchors on the newest of the oldest waiting frames: each other source gets the
+ * frame closest to it, the frames before are unmatched. Every step either emits a tuple or
+ * drops a frame, so a tuple costs O(N) in the number of sources.
+ *
+ * The offsets of the sources within each tuple are kept for a window of recent tuples, the
+ * skew of any pair of sources is computed from them on request.
+ *
+ * @note waiting frames keep ring buffers locked - give the devices a buffer or two more
+ */
+class FrameSynchronizer
+{
+public:
+
+    /** called for each matched tuple, on the synchronizer's thread - or the one of push()
+        @param frames one per source, valid during the call - copy a handle to keep the frame */
+    typedef void (*TupleFunction)(FrameSynchronizer*, const CaptureDevice::FrameHandle *frames, void *userData);
+
+    /** in seconds, time of the first source minus time of the second */
+    struct SkewStatistics
+    {
+        unsigned long long count;
+        double mean;
+        double standardDeviation;
+        double minimum;
+        double maximum;
+    };
+
+
+    FrameSynchronizer();
+    FrameSynchronizer(const FrameSynchronizer&) = delete;
+    FrameSynchronizer &operator=(const FrameSynchronizer&) = delete;
+    /** stops */
+    ~FrameSynchronizer();
+
+    /** @returns index of the source
+        @note not while running - 0 instead of a device for a source fed by push() only,
+        which needs a queueDepth() then and no start() */
+    unsigned int addSource(CaptureDevice*);
+    unsigned int sourceCount() const;
+
+    /** greatest difference of capture times within a tuple, in seconds. Default: 0.005 */
+    void setTolerance(double seconds);
+    double tolerance() const;
+    /** frames per source waiting for a match, 0 for the source's buffer count - 1. Default: 0
+        @note takes effect with the next start() or reset() */
+    void setQueueDepth(unsigned int);
+    unsigned int queueDepth() const;
+    /** tuples the skew statistics are computed over. Default: 1000
+        @note takes effect with the next start() or reset() */
+    void setStatisticsWindow(unsigned int tuples);
+    unsigned int statisticsWindow() const;
+
+    void setTupleFunction(TupleFunction, void *userData);
+
+    /** matches the frames the sources publish from now on, on an own thread */
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    /** empties the queues and statistics - for push() without start()
+        @note not while running */
+    void reset();
+    /** matches a frame of a source, which has to be newer than the one pushed before
+        @pre not running, reset() or start() was called since adding the last source */
+    void push(unsigned int source, const CaptureDevice::FrameHandle&);
+
+    /* *** statistics since start() or reset() *** */
+    unsigned long long matchedTuples();
+    /** frames of the source dropped without a match */
+    unsigned long long unmatchedFrames(unsigned int source);
+    /** @returns skew of the two sources over the last statisticsWindow() tuples */
+    SkewStatistics skew(unsigned int first, unsigned int second);
+
+private:
+
+    /** fixed-size ring of frames, oldest at head */
+    struct Queue
+    {
+        std::vector<CaptureDevice::FrameHandle> frames;
+        unsigned int head;
+        unsigned int count;
+        /** ring sequence number of the frame taken last from the device */
+        unsigned long long lastSequence;
+        unsigned long long unmatchedFrames;
+    };
+
+    const CaptureDevice::FrameHandle &head(const Queue&) const;
+    void dropHead(Queue&, bool unmatched);
+    /** emits tuples and drops frames, as long as every queue has a frame */
+    void match();
+    void emitTuple();
+
+    static void synchronizerThread(FrameSynchronizer*);
+
+    std::vector<CaptureDevice*> m_sources;
+    long long m_tolerance;
+    unsigned int m_queueDepth;
+    unsigned int m_statisticsWindow;
+
+    TupleFunction m_tupleFunction;
+    void *m_tupleUserData;
+
+    std::vector<Queue> m_queues;
+    std::vector<CaptureDevice::FrameHandle> m_tuple;
+
+    /** guards the statistics */
+    std::mutex m_mutex;
+    unsigned long long m_matchedTuples;
+    /** per tuple in the window, per source: capture time minus the one of source 0, in nanoseconds */
+    std::vector<long long> m_offsets;
+
+    std::thread *m_thread;
+    bool m_cancellationFlag;
+    FrameNotifier m_frameNotifier;
+};
+
+
+#endif /* FRAME_SYNCHRONIZER_HPP */
@@ -0,0 +1,456 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "historyring.hpp"
+
+#include "filtergraph.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+using namespace std;
+
+
+/** signals caught so far by triggerOnSignal() */
+static volatile sig_atomic_t signalCount = 0;
+
+
+HistoryRing::HistoryRing(CaptureDevice *device) :
+        m_device(device),
+        m_duration(20.0),
+        m_frameRate(30.0),
+        m_flushLatency(2.0),
+        m_triggerFileName("history"),
+        m_arena(0),
+        m_arenaSize(0),
+        m_copiedFrames(0),
+        m_lastSequence(0),
+        m_copierThread(0),
+        m_copierCancellationFlag(false),
+        m_recorder(0),
+        m_flushEnd(0),
+        m_flushThread(0),
+        m_flushing(false),
+        m_triggerRequested(0),
+        m_signalCount(0),
+        m_triggerFilter(numeric_limits<unsigned int>::max()),
+        m_triggerOutputPort(0),
+        m_triggerThreshold(0.0),
+        m_triggerArmed(true),
+        m_flushedFrames(0),
+        m_lostFrames(0)
+{
+    assert(device != 0);
+}
+
+
+HistoryRing::~HistoryRing()
+{
+    stop();
+}
+
+
+void HistoryRing::setDuration(double seconds)
+{
+    assert(seconds > 0.0);
+    m_duration = seconds;
+}
+double HistoryRing::duration() const
+{
+    return m_duration;
+}
+
+
+void HistoryRing::setFrameRate(double framesPerSecond)
+{
+    assert(framesPerSecond > 0.0);
+    m_frameRate = framesPerSecond;
+}
+double HistoryRing::frameRate() const
+{
+    return m_frameRate;
+}
+
+
+void HistoryRing::setFlushLatency(double seconds)
+{
+    assert(seconds >= 0.0);
+    m_flushLatency = seconds;
+}
+double HistoryRing::flushLatency() const
+{
+    return m_flushLatency;
+}
+
+
+void HistoryRing::setTriggerFileName(const string &prefix)
+{
+    m_triggerFileName = prefix;
+}
+const string &HistoryRing::triggerFileName() const
+{
+    return m_triggerFileName;
+}
+
+
+void HistoryRing::start()
+{
+    assert(isRunning() == false);
+    assert(m_device->bufferSize() > 0);
+
+    /* *** the arena - headroom for a flush, and one slot more for the one being overwritten *** */
+    size_t slotSize = (m_device->bufferSize() + Recorder::Alignment - 1) / Recorder::Alignment * Recorder::Alignment;
+    unsigned int slotCount = (unsigned int) ceil((m_duration + m_flushLatency) * m_frameRate) + 1;
+
+    m_arenaSize = slotSize * slotCount;
+    void *arena = 0;
+    int ret = posix_memalign(&arena, Recorder::Alignment, m_arenaSize);
+    if (ret != 0) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot allocate " << m_arenaSize << " bytes" << endl;
+        abort();
+    }
+    m_arena = (unsigned char*) arena;
+
+    /* fault every page in now, not while capturing */
+    memset(m_arena, 0, m_arenaSize);
+
+    m_slots.resize(slotCount);
+    for (unsigned int a = 0; a < slotCount; ++a) {
+        Slot &slot = m_slots[a];
+        slot.version = 0;
+        slot.number = numeric_limits<unsigned long long>::max();
+        memset(&slot.frame, 0, sizeof(slot.frame));
+        slot.frame.buffer = m_arena + a * slotSize;
+        slot.frame.length = slotSize;
+    }
+
+    m_recorder.setChunkSize(max(m_recorder.chunkSize(), (unsigned int) slotSize));
+
+
+    m_copiedFrames = 0;
+    m_lastSequence = m_device->publishedSequence();
+
+    m_signalCount = signalCount;
+    m_triggerRequested = 0;
+    m_copierCancellationFlag = false;
+    m_copierThread = new thread(bind(copierThread, this));
+}
+
+
+void HistoryRing::stop()
+{
+    if (isRunning() == false) return;
+
+    m_copierCancellationFlag = true;
+    m_copierThread->join();
+    delete m_copierThread;
+    m_copierThread = 0;
+
+    waitForFlush();
+
+    m_slots.clear();
+    free(m_arena);
+    m_arena = 0;
+    m_arenaSize = 0;
+}
+
+
+bool HistoryRing::isRunning() const
+{
+    return m_copierThread != 0;
+}
+
+
+size_t HistoryRing::arenaSize() const
+{
+    return m_arenaSize;
+}
+
+
+bool HistoryRing::trigger(const string &fileName)
+{
+    assert(isRunning() == true);
+
+    lock_guard<mutex> lock(m_flushMutex);
+    if (m_flushing == true) return false;
+
+    startFlush(fileName);
+    return true;
+}
+
+
+void HistoryRing::requestTrigger()
+{
+    __sync_lock_test_and_set(&m_triggerRequested, 1);
+}
+
+
+bool HistoryRing::isFlushing() const
+{
+    return m_flushing;
+}
+
+
+void HistoryRing::waitForFlush()
+{
+    lock_guard<mutex> lock(m_flushMutex);
+
+    if (m_flushThread != 0) {
+        m_flushThread->join();
+        delete m_flushThread;
+        m_flushThread = 0;
+    }
+}
+
+
+void HistoryRing::triggerOnSignal(int signal)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(signal, &action, 0) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot handle signal " << signal << ". " << errno << " " << strerror(errno) << endl;
+    }
+}
+
+
+void HistoryRing::setTriggerOutput(unsigned int filter, unsigned int outputPort, double threshold)
+{
+    m_triggerFilter = filter;
+    m_triggerOutputPort = outputPort;
+    m_triggerThreshold = threshold;
+    m_triggerArmed = true;
+}
+
+
+unsigned long long HistoryRing::flushedFrames() const
+{
+    return m_flushedFrames;
+}
+
+
+unsigned long long HistoryRing::lostFrames() const
+{
+    return m_lostFrames;
+}
+
+
+/* *** private ************************************************************** */
+void HistoryRing::copyFrame(const CaptureDevice::Buffer &buffer)
+{
+    Slot &slot = m_slots[m_copiedFrames % m_slots.size()];
+
+    if (buffer.bytesUsed > slot.frame.length) return;
+
+    /* odd - a flush reading the slot meanwhile throws its copy away */
+    __sync_add_and_fetch(&slot.version, 1);
+
+    memcpy(slot.frame.buffer, buffer.buffer, buffer.bytesUsed);
+    slot.frame.time = buffer.time;
+    slot.frame.realTime = buffer.realTime;
+    slot.frame.frameNumber = buffer.frameNumber;
+    slot.frame.sequence = buffer.sequence;
+    slot.frame.bytesUsed = buffer.bytesUsed;
+    slot.frame.pixelFormat = buffer.pixelFormat;
+    slot.frame.width = buffer.width;
+    slot.frame.height = buffer.height;
+    slot.frame.bytesPerLine = buffer.bytesPerLine;
+    slot.number = m_copiedFrames;
+
+    __sync_add_and_fetch(&slot.version, 1);
+    __sync_add_and_fetch(&m_copiedFrames, 1);
+}
+
+
+void HistoryRing::startFlush(const string &fileName)
+{
+    assert(m_flushing == false);
+
+    /* the previous flush is done, just not joined yet */
+    if (m_flushThread != 0) {
+        m_flushThread->join();
+        delete m_flushThread;
+    }
+
+    m_flushFileName = fileName;
+    m_flushEnd = m_copiedFrames;
+    m_flushing = true;
+    m_flushThread = new thread(bind(flushThread, this));
+}
+
+
+void HistoryRing::flush()
+{
+    m_flushedFrames = 0;
+    m_lostFrames = 0;
+
+    unsigned long long end = m_flushEnd;
+    unsigned long long size = m_slots.size();
+    if (end == 0) return;
+
+    /* *** the frames of the last duration() seconds *** */
+    const CaptureDevice::Buffer &newest = m_slots[(end - 1) % size].frame;
+    long long oldestTime = newest.time.tv_sec * 1000000000LL + newest.time.tv_nsec - (long long) (m_duration * 1e9);
+
+    unsigned long long begin = end > size ? end - size : 0;
+    for (; begin < end - 1; ++begin) {
+        const CaptureDevice::Buffer &frame = m_slots[begin % size].frame;
+        if (frame.time.tv_sec * 1000000000LL + frame.time.tv_nsec >= oldestTime) break;
+    }
+
+
+    if (m_recorder.start(m_flushFileName) == false) {
+        m_lostFrames = end - begin;
+        return;
+    }
+
+    for (unsigned long long a = begin; a < end; ++a) {
+        Slot &slot = m_slots[a % size];
+
+        unsigned int version = slot.version;
+        __sync_synchronize();
+
+        /* being written, or overwritten already */
+        if ((version & 1) != 0 || slot.number != a) {
+            ++m_lostFrames;
+            continue;
+        }
+
+        CaptureDevice::Buffer frame = slot.frame;
+        bool recorded = m_recorder.record(frame);
+
+        __sync_synchronize();
+        if (slot.version != version) {
+            /* the copier caught up with us while copying */
+            if (recorded == true) m_recorder.discardLastFrame();
+            ++m_lostFrames;
+        } else if (recorded == true) {
+            ++m_flushedFrames;
+        } else {
+            ++m_lostFrames;
+        }
+    }
+
+    m_recorder.stop();
+}
+
+
+/* *** static functions ***************************************************** */
+void HistoryRing::copierThread(HistoryRing *ring)
+{
+    Tracer::setThreadName("history copier");
+
+    CaptureDevice *device = ring->m_device;
+    unsigned int n = device->bufferCount() - 1;
+    vector<CaptureDevice::FrameHandle> frames(n);
+
+    device->subscribe(&ring->m_frameNotifier);
+
+    while (ring->m_copierCancellationFlag == false) {
+
+        /* taken before looking, so a frame published meanwhile ends the wait below at once */
+        unsigned long long generation = ring->m_frameNotifier.generation();
+
+        unsigned int locked = device->lockNewerBuffers(&ring->m_lastSequence, n, &frames[0]);
+
+        /* each released as soon as it is copied */
+        for (unsigned int a = 0; a < locked; ++a) {
+            ring->copyFrame(*frames[a]);
+            frames[a].reset();
+        }
+
+        /* *** triggers requested meanwhile - never wait for a flush here *** */
+        if (signalCount != ring->m_signalCount) {
+            ring->m_signalCount = signalCount;
+            ring->requestTrigger();
+        }
+
+        if (ring->m_triggerRequested != 0 && ring->m_flushMutex.try_lock() == true) {
+            ring->m_triggerRequested = 0;
+
+            if (ring->m_flushing == false) {
+                char localTime[32];
+                time_t now = time(0);
+                struct tm brokenDown;
+                strftime(localTime, sizeof(localTime), "%Y%m%d-%H%M%S", localtime_r(&now, &brokenDown));
+
+                ring->startFlush(ring->m_triggerFileName + "-" + localTime + ".vcr");
+            } else {
+                cerr << "trigger ignored, still writing the last one" << endl;
+            }
+
+            ring->m_flushMutex.unlock();
+        }
+
+        if (locked == 0) {
+            ring->m_frameNotifier.wait(generation, 100);
+        }
+    }
+
+    device->unsubscribe(&ring->m_frameNotifier);
+}
+
+
+void HistoryRing::flushThread(HistoryRing *ring)
+{
+    Tracer::setThreadName("history flush");
+
+    ring->flush();
+
+    cout << "wrote " << ring->m_flushedFrames << " frames to " << ring->m_flushFileName
+            << ", lost " << ring->m_lostFrames << endl;
+
+    ring->m_flushing = false;
+}
+
+
+void HistoryRing::signalHandler(int)
+{
+    /* the copiers look at it */
+    signalCount = signalCount + 1;
+}
+
+
+void HistoryRing::filterTrigger(FilterGraph *graph, unsigned int slot, void *historyRing)
+{
+    HistoryRing *ring = (HistoryRing*) historyRing;
+    if (ring->m_triggerFilter == numeric_limits<unsigned int>::max()) return;
+
+    const BaseFilter::Value &value = graph->output(slot, ring->m_triggerFilter, ring->m_triggerOutputPort);
+    assert(value.type == BaseFilter::PortTypeFactor);
+
+    bool reached = value.factor >= ring->m_triggerThreshold;
+    if (reached == true && ring->m_triggerArmed == true) {
+        ring->requestTrigger();
+    }
+    ring->m_triggerArmed = reached == false;
+}
@@ -0,0 +1,179 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef HISTORY_RING_HPP
+#define HISTORY_RING_HPP
+
+#include "prereqs.hpp"
+
+#include "capturedevice.hpp"
+#include "framenotifier.hpp"
+#include "recorder.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class FilterGraph;
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * keeps the last seconds of a capture device in memory and writes them to disk on a trigger
+ *
+ * Independent of the device's own ring (see CaptureDevice::setBufferCount()): a copier thread
+ * copies every new frame into the next slot of an arena allocated and touched once by start().
+ *
+ * A trigger writes the frames of the last duration() seconds to a recording (see Recorder) on
+ * an own thread. Capturing and the copier go on meanwhile, overwriting the oldest slots - a
+ * flush is a race against the copier, which the flush wins as long as the disk is faster
+ * than the camera and the flush gets going within flushLatency(), the headroom of the arena
+ * beyond duration(). Frames overwritten before being written are skipped and counted as lost,
+ * the slots are seqlocks for that.
+ *
+ * Triggers: trigger() with a file name, or requestTrigger() (thread safe, e.g. from a
+ * FilterGraph callback) and signals (triggerOnSignal()), which write to
+ * triggerFileName() + "-<local time>.vcr".
+ */
+class HistoryRing
+{
+public:
+
+    explicit HistoryRing(CaptureDevice*);
+    HistoryRing(const HistoryRing&) = delete;
+    HistoryRing &operator=(const HistoryRing&) = delete;
+    /** stops, after a running flush finished */
+    ~HistoryRing();
+
+    /** seconds kept. Default: 20
+        @note takes effect with the next start() */
+    void setDuration(double seconds);
+    double duration() const;
+    /** the frame rate the arena is sized for - at higher rates less than duration() is kept.
+        Default: 30
+        @note takes effect with the next start() */
+    void setFrameRate(double framesPerSecond);
+    double frameRate() const;
+    /** seconds a flush may take to open the file and catch up with the oldest frames, before
+        the copier overwrites them - kept on top of duration(). Default: 2
+        @note takes effect with the next start() */
+    void setFlushLatency(double seconds);
+    double flushLatency() const;
+
+    /** prefix of the files written by requested triggers. Default: "history" */
+    void setTriggerFileName(const std::string&);
+    const std::string &triggerFileName() const;
+
+    /** allocates the arena and starts keeping frames
+        @pre the device is initialized - the arena is sized for its buffer size */
+    void start();
+    void stop();
+    bool isRunning() const;
+    /** bytes of memory kept */
+    size_t arenaSize() const;
+
+    /* *** triggers *** */
+
+    /** writes the kept frames, returns at once
+        @returns false if a flush is running already */
+    bool trigger(const std::string &fileName);
+    /** triggers on the copier thread at its next chance - safe from any thread */
+    void requestTrigger();
+    bool isFlushing() const;
+    void waitForFlush();
+
+    /** every running HistoryRing triggers on the signal, e.g. SIGUSR1 */
+    static void triggerOnSignal(int signal);
+
+    /** each time the output of the filter, a factor, reaches the threshold, a trigger is requested
+        @note takes effect, if filterTrigger() is the FrameFinishedFunction of the graph */
+    void setTriggerOutput(unsigned int filter, unsigned int outputPort, double threshold);
+    /** FilterGraph::FrameFinishedFunction with the HistoryRing as userData */
+    static void filterTrigger(FilterGraph*, unsigned int slot, void *historyRing);
+
+    /* *** statistics of the last flush *** */
+    unsigned long long flushedFrames() const;
+    unsigned long long lostFrames() const;
+
+private:
+
+    struct Slot
+    {
+        /** odd while being written */
+        volatile unsigned int version;
+        /** the how many-th copied frame it holds */
+        unsigned long long number;
+        CaptureDevice::Buffer frame;
+    };
+
+    void copyFrame(const CaptureDevice::Buffer&);
+    /** @pre m_flushMutex is held, no flush is running */
+    void startFlush(const std::string &fileName);
+    void flush();
+
+    static void copierThread(HistoryRing*);
+    static void flushThread(HistoryRing*);
+    static void signalHandler(int);
+
+    CaptureDevice *m_device;
+    FrameNotifier m_frameNotifier;
+
+    double m_duration;
+    double m_frameRate;
+    double m_flushLatency;
+    std::string m_triggerFileName;
+
+    unsigned char *m_arena;
+    size_t m_arenaSize;
+    std::vector<Slot> m_slots;
+    /** frames copied so far - the next one goes to slot m_copiedFrames % size */
+    volatile unsigned long long m_copiedFrames;
+    unsigned long long m_lastSequence;
+
+    std::thread *m_copierThread;
+    bool m_copierCancellationFlag;
+
+    Recorder m_recorder;
+    std::string m_flushFileName;
+    /** frames copied, when the trigger came - the last one flushed */
+    unsigned long long m_flushEnd;
+    std::thread *m_flushThread;
+    std::mutex m_flushMutex;
+    volatile bool m_flushing;
+    /** requests by requestTrigger(), handled by the copier */
+    volatile int m_triggerRequested;
+    /** signals seen so far */
+    int m_signalCount;
+
+    unsigned int m_triggerFilter;
+    unsigned int m_triggerOutputPort;
+    double m_triggerThreshold;
+    /** below the threshold last time - a trigger needs a rising edge */
+    bool m_triggerArmed;
+
+    unsigned long long m_flushedFrames;
+    unsigned long long m_lostFrames;
+};
+
+
+#endif /* HISTORY_RING_HPP */
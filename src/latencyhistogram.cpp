@@ -0,0 +1,155 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "latencyhistogram.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+
+/* *** buckets: 128 exact ones, then 64 per power of two from 2^7 to 2^41 *** */
+static const unsigned int subBucketBits = 6;
+static const unsigned int subBucketCount = 1 << subBucketBits;
+static const unsigned int exactBucketCount = 2 * subBucketCount;
+static const unsigned int highestBit = 41;
+static const unsigned int bucketCount = exactBucketCount + (highestBit - subBucketBits) * subBucketCount;
+
+
+static long long nanosecondsSince(const timespec &then)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - then.tv_sec) * 1000000000LL + (now.tv_nsec - then.tv_nsec);
+}
+
+
+static string milliseconds(long long nanoseconds)
+{
+    ostringstream os;
+    os << fixed;
+    os.precision(2);
+    os << nanoseconds / 1e6 << " ms";
+    return os.str();
+}
+
+
+LatencyHistogram::LatencyHistogram() :
+        m_buckets(bucketCount, 0),
+        m_count(0),
+        m_maximum(0)
+{
+}
+
+
+void LatencyHistogram::reset()
+{
+    fill(m_buckets.begin(), m_buckets.end(), 0);
+    m_count = 0;
+    m_maximum = 0;
+}
+
+
+void LatencyHistogram::record(long long nanoseconds)
+{
+    if (nanoseconds < 0) nanoseconds = 0;
+
+    __sync_fetch_and_add(&m_buckets[bucketOf(nanoseconds)], 1);
+    __sync_fetch_and_add(&m_count, 1);
+
+    long long maximum = m_maximum;
+    while (nanoseconds > maximum) {
+        if (__sync_bool_compare_and_swap(&m_maximum, maximum, nanoseconds) == true) break;
+        maximum = m_maximum;
+    }
+}
+
+
+void LatencyHistogram::recordSince(const timespec &then)
+{
+    record(nanosecondsSince(then));
+}
+
+
+unsigned long long LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+
+long long LatencyHistogram::maximum() const
+{
+    return m_maximum;
+}
+
+
+long long LatencyHistogram::percentile(double fraction) const
+{
+    assert(fraction >= 0.0 && fraction <= 1.0);
+
+    /* the buckets themselves, not m_count - they might be a recording ahead of each other */
+    unsigned long long total = 0;
+    for (unsigned int a = 0; a < bucketCount; ++a) total += m_buckets[a];
+    if (total == 0) return 0;
+
+    unsigned long long rank = max(1ULL, (unsigned long long) ceil(fraction * total));
+    unsigned long long seen = 0;
+    unsigned int bucket = 0;
+    for (; bucket < bucketCount - 1; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen >= rank) break;
+    }
+
+    return min((long long) bucketEnd(bucket), m_maximum);
+}
+
+
+string LatencyHistogram::summary() const
+{
+    if (count() == 0) return "-";
+
+    return "p50 " + milliseconds(percentile(0.5)) + ", p99 " + milliseconds(percentile(0.99))
+            + ", max " + milliseconds(maximum());
+}
+
+
+/* *** private ************************************************************** */
+unsigned int LatencyHistogram::bucketOf(unsigned long long nanoseconds)
+{
+    if (nanoseconds < exactBucketCount) return nanoseconds;
+
+    unsigned int bit = 63 - __builtin_clzll(nanoseconds);
+    if (bit > highestBit) return bucketCount - 1;
+
+    /* the 7 bits below and including the highest one, the highest one dropped */
+    unsigned int subBucket = (nanoseconds >> (bit - subBucketBits)) - subBucketCount;
+    return exactBucketCount + (bit - subBucketBits - 1) * subBucketCount + subBucket;
+}
+
+
+unsigned long long LatencyHistogram::bucketEnd(unsigned int bucket)
+{
+    if (bucket < exactBucketCount) return bucket;
+
+    unsigned int bit = (bucket - exactBucketCount) / subBucketCount + subBucketBits + 1;
+    unsigned long long subBucket = (bucket - exactBucketCount) % subBucketCount + subBucketCount;
+    return ((subBucket + 1) << (bit - subBucketBits)) - 1;
+}
@@ -0,0 +1,77 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include "prereqs.hpp"
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+
+/**
+ * distribution of latencies, in nanoseconds - for percentiles and the maximum
+ *
+ * Buckets are log-linear like in HdrHistogram: exact up to 127 ns, above 64 buckets per power
+ * of two, so a percentile is off by 1.6 % at most. Up to 2^41 ns (about 36 minutes), beyond
+ * the last bucket catches all. The maximum is kept exactly.
+ *
+ * Recording is O(1) and lock-free, from any number of threads. Queries run concurrently,
+ * they see each recorded value either completely or not at all.
+ */
+class LatencyHistogram
+{
+public:
+
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram&) = delete;
+
+    /** @note not while recording */
+    void reset();
+
+    /** negative latencies (clocks of different sources) count as 0 */
+    void record(long long nanoseconds);
+    /** records the time from then until now
+        @param then CLOCK_MONOTONIC */
+    void recordSince(const timespec &then);
+
+    unsigned long long count() const;
+    long long maximum() const;
+    /** @returns the latency, which the given fraction (0 .. 1) of the recorded ones does not
+            exceed, rounded up to the end of its bucket - 0 if nothing was recorded */
+    long long percentile(double fraction) const;
+
+    /** @returns e.g. "p50 1.2 ms, p99 3.4 ms, max 5.6 ms", "-" if nothing was recorded */
+    std::string summary() const;
+
+private:
+
+    static unsigned int bucketOf(unsigned long long nanoseconds);
+    /** @returns the greatest latency in the bucket */
+    static unsigned long long bucketEnd(unsigned int bucket);
+
+    std::vector<unsigned int> m_buckets;
+    unsigned long long m_count;
+    long long m_maximum;
+};
+
+
+#endif /* LATENCY_HISTOGRAM_HPP */
@@ -20,29 +20,119 @@
 
 #include "basefilter.hpp"
 #include "capturedevice.hpp"
+#include "capturereactor.hpp"
+#include "filecapturedevice.hpp"
+#include "filterpipeline.hpp"
+#include "filterregistry.hpp"
+#include "filterreloader.hpp"
+#include "framepool.hpp"
+#include "historyring.hpp"
 #include "mainwindow.hpp"
+#include "recorder.hpp"
+#include "recordingcapturedevice.hpp"
+#include "syntheticcapturedevice.hpp"
+#include "tracer.hpp"
 
 #include <QApplication>
 
 #include <cassert>
-#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <list>
 #include <set>
 #include <string>
+#include <vector>
 
-#include <dirent.h>
-#include <dlfcn.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 using namespace std;
 
 
+/** set by SIGINT and SIGTERM in headless mode */
+static volatile sig_atomic_t stopRequested = 0;
+
+
+static void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+
+/** captures until SIGINT, SIGTERM or the duration is over, prints the rates and latencies every second
+    @param duration 0 for no limit */
+static void runHeadless(const set<CaptureDevice*> &captureDevices, const vector<FilterPipeline*> &pipelines, double duration)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+
+    for (auto it = captureDevices.begin(); it != captureDevices.end(); ++it) {
+        (*it)->startCapturing();
+    }
+
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    vector<unsigned long long> lastProcessedFrames(pipelines.size(), 0);
+    int lastReport = 0;
+
+    while (stopRequested == 0) {
+
+        /* a signal ends it early */
+        timespec step = {0, 100000000};
+        nanosleep(&step, 0);
+
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+        if (duration > 0.0 && elapsed >= duration) break;
+        if ((int) elapsed == lastReport) continue;
+        lastReport = (int) elapsed;
+
+        for (auto it = captureDevices.begin(); it != captureDevices.end(); ++it) {
+            RateEstimator::Estimate estimate = (*it)->rateEstimator().estimate();
+            cout << (*it)->fileName() << ": " << estimate.count << " frames";
+            if (estimate.recentMean > 0.0) cout << ", " << 1.0 / estimate.recentMean << " fps";
+            cout << ", publish latency " << (*it)->publishLatency().summary();
+            if ((*it)->hasFailed() == true) cout << ", failed";
+            cout << endl;
+        }
+        for (unsigned int a = 0; a < pipelines.size(); ++a) {
+            unsigned long long processedFrames = pipelines[a]->processedFrames();
+            cout << pipelines[a]->captureDevice()->fileName() << " -> [" << pipelines[a]->filterNames() << "]: "
+                    << processedFrames - lastProcessedFrames[a] << " frames/s, processing latency "
+                    << pipelines[a]->processingLatency().summary() << endl;
+            lastProcessedFrames[a] = processedFrames;
+        }
+    }
+
+    for (auto it = captureDevices.begin(); it != captureDevices.end(); ++it) {
+        (*it)->stopCapturing();
+    }
+}
+
+
 int main(int argc, char **args)
 {
     VT
 
-    QApplication app(argc, args);
+    /* without a display there is no QApplication at all - the GUI is never set up */
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        if (string(args[i]) == "--headless") headless = true;
+    }
+
+    QApplication *application = 0;
+    if (headless == false) {
+        application = new QApplication(argc, args);
+        Tracer::setThreadName("gui");
+    }
 
 
     string executablePath(args[0]);
@@ -59,6 +149,25 @@ int main(int argc, char **args)
     }
 
     set<CaptureDevice*> captureDevices;
+    /* the device given last, for options referring to it */
+    CaptureDevice *lastCaptureDevice = 0;
+    vector<Recorder*> recorders;
+    vector<HistoryRing*> historyRings;
+    vector<FilterPipeline*> pipelines;
+    /* headless: 0 -> until SIGINT or SIGTERM */
+    double duration = 0.0;
+    /* swap the filters of the pipelines, when their plugins are rebuilt */
+    bool reloadFilters = false;
+    /* for the recordings following */
+    Recorder::Compression compression = Recorder::CompressionNone;
+    /* 0 -> one capture thread per device */
+    int reactorThreadCount = 0;
+    /* for the devices following */
+    __u32 pixelFormat = V4L2_PIX_FMT_RGB24;
+    /* frames each following device keeps more for the synchronizer, 0 -> no synchronizer */
+    unsigned int synchronizerQueueDepth = 0;
+    /* empty -> no tracing */
+    string traceFileName;
 
     /* *** evaluate arguments start *** */
     auto it = argList.begin();
@@ -77,6 +186,8 @@ int main(int argc, char **args)
 
             newCaptureDevice->setFileName(deviceFile);
             newCaptureDevice->setCaptureSize(width, height);
+            newCaptureDevice->setPixelFormat(pixelFormat);
+            newCaptureDevice->setBufferCount(newCaptureDevice->bufferCount() + synchronizerQueueDepth);
 
             bool initialized = newCaptureDevice->init();
             assert(initialized);
@@ -88,14 +199,186 @@ int main(int argc, char **args)
 
             assert(captureDevices.find(newCaptureDevice) == captureDevices.end());
             captureDevices.insert(newCaptureDevice);
+            lastCaptureDevice = newCaptureDevice;
+
+        } else if (*it == "-s" || *it == "--synthetic") {
+            SyntheticCaptureDevice *newCaptureDevice = new SyntheticCaptureDevice();
+
+            int width = atoi((++it)->c_str());
+            int height = atoi((++it)->c_str());
+            double frameRate = atof((++it)->c_str());
+
+            assert(width > 0);
+            assert(height > 0);
+            assert(frameRate >= 0.0);
+
+            newCaptureDevice->setCaptureSize(width, height);
+            newCaptureDevice->setPixelFormat(pixelFormat);
+            newCaptureDevice->setFrameRate(frameRate);
+            newCaptureDevice->setBufferCount(newCaptureDevice->bufferCount() + synchronizerQueueDepth);
+
+            bool initialized = newCaptureDevice->init();
+            assert(initialized);
+
+            captureDevices.insert(newCaptureDevice);
+            lastCaptureDevice = newCaptureDevice;
+
+        } else if (*it == "-p" || *it == "--play") {
+            FileCaptureDevice *newCaptureDevice = new FileCaptureDevice();
+
+            string file = *(++it);
+            int width = atoi((++it)->c_str());
+            int height = atoi((++it)->c_str());
+            double frameRate = atof((++it)->c_str());
+
+            assert(file.empty() == false);
+            assert(width > 0);
+            assert(height > 0);
+            assert(frameRate >= 0.0);
+
+            newCaptureDevice->setFileName(file);
+            newCaptureDevice->setCaptureSize(width, height);
+            newCaptureDevice->setPixelFormat(pixelFormat);
+            newCaptureDevice->setFrameRate(frameRate);
+            newCaptureDevice->setBufferCount(newCaptureDevice->bufferCount() + synchronizerQueueDepth);
+
+            bool initialized = newCaptureDevice->init();
+            assert(initialized);
+
+            cout << file << ": " << newCaptureDevice->frameCount() << " frames" << endl;
+
+            captureDevices.insert(newCaptureDevice);
+            lastCaptureDevice = newCaptureDevice;
+
+        } else if (*it == "-R" || *it == "--replay") {
+            RecordingCaptureDevice *newCaptureDevice = new RecordingCaptureDevice();
+
+            string file = *(++it);
+            double speed = atof((++it)->c_str());
+
+            assert(file.empty() == false);
+            assert(speed >= 0.0);
+
+            newCaptureDevice->setFileName(file);
+            newCaptureDevice->setSpeed(speed);
+            newCaptureDevice->setBufferCount(newCaptureDevice->bufferCount() + synchronizerQueueDepth);
+
+            bool initialized = newCaptureDevice->init();
+            assert(initialized);
+
+            cout << file << ": " << newCaptureDevice->frameCount() << " frames" << endl;
+
+            captureDevices.insert(newCaptureDevice);
+            lastCaptureDevice = newCaptureDevice;
+
+        } else if (*it == "-o" || *it == "--record") {
+            assert(lastCaptureDevice != 0);
+
+            Recorder *recorder = new Recorder(lastCaptureDevice);
+            recorder->setCompression(compression);
+            bool started = recorder->start(*(++it));
+            assert(started);
+
+            recorders.push_back(recorder);
+
+        } else if (*it == "-c" || *it == "--compress") {
+            compression = Recorder::CompressionLz4;
+
+        } else if (*it == "-H" || *it == "--history") {
+            assert(lastCaptureDevice != 0);
+
+            double seconds = atof((++it)->c_str());
+            assert(seconds > 0.0);
+
+            HistoryRing *historyRing = new HistoryRing(lastCaptureDevice);
+            historyRing->setDuration(seconds);
+            historyRing->start();
+            HistoryRing::triggerOnSignal(SIGUSR1);
+
+            historyRings.push_back(historyRing);
+
+        } else if (*it == "-F" || *it == "--filters") {
+            assert(lastCaptureDevice != 0);
+
+            FilterPipeline *pipeline = new FilterPipeline(lastCaptureDevice);
+            pipeline->setFilterNames(*(++it));
+
+            pipelines.push_back(pipeline);
+
+        } else if (*it == "-w" || *it == "--write") {
+            assert(pipelines.empty() == false);
+
+            pipelines.back()->setOutputFileName(*(++it));
+
+        } else if (*it == "--reload") {
+            reloadFilters = true;
+
+        } else if (*it == "--headless") {
+            /* see above */
+
+        } else if (*it == "-D" || *it == "--duration") {
+            duration = atof((++it)->c_str());
+            assert(duration > 0.0);
+
+        } else if (*it == "-f" || *it == "--format") {
+            pixelFormat = CaptureDevice::pixelFormatFromString(*(++it));
+            assert(pixelFormat != 0);
+
+        } else if (*it == "-S" || *it == "--synchronize") {
+            int frames = atoi((++it)->c_str());
+            assert(frames > 0);
+            synchronizerQueueDepth = frames;
+
+        } else if (*it == "-r" || *it == "--reactor") {
+            reactorThreadCount = atoi((++it)->c_str());
+            assert(reactorThreadCount > 0);
+
+        } else if (*it == "--huge-pages") {
+            FramePool::instance().setHugePages(true);
+
+        } else if (*it == "-t" || *it == "--trace") {
+            traceFileName = *(++it);
+            Tracer::setEnabled(true);
 
         } else if (*it == "-h" || *it == "--help") {
             cout
-                << "videocapture [-d ...] [-d ...] [-d ...] ..." << endl
+                << "videocapture [-d ...] [-s ...] [-p ...] ..." << endl
                 << endl
                 << "  arguments:" << endl
                 << "    -d <device file> <res width> <res height>   use this device" << endl
+                << "    -s, --synthetic <width> <height> <fps>      capture generated test pictures," << endl
+                << "                                                fps 0 for as fast as possible" << endl
+                << "    -p, --play <file> <width> <height> <fps>    replay raw frames from a file" << endl
+                << "    -R, --replay <recording> <speed>            replay a recording, speed 1 for the recorded" << endl
+                << "                                                pace, 0 for as fast as possible" << endl
+                << "    -o, --record <file>                         record the frames of the device given last" << endl
+                << "    -c, --compress                              compress the following recordings (LZ4)" << endl
+                << "    -H, --history <seconds>                     keep that many seconds of the device given last" << endl
+                << "                                                in memory, written to disk on SIGUSR1" << endl
+                << "    -F, --filters <name,name,...>               run these filters one after another on the" << endl
+                << "                                                frames of the device given last, e.g." << endl
+                << "                                                \"grayscale,box blur\" - also without GUI" << endl
+                << "    -w, --write <file>                          write the images of the filters given last" << endl
+                << "                                                raw to the file" << endl
+                << "    --reload                                    load filter plugins again when they are" << endl
+                << "                                                rebuilt, the filters given swap at once" << endl
+                << "    --headless                                  no GUI: capture, run the filters and print" << endl
+                << "                                                rates and latencies, until SIGINT or SIGTERM" << endl
+                << "    -D, --duration <seconds>                    headless: stop after that many seconds" << endl
+                << "    -f, --format <fourcc>                       pixel format of the following devices," << endl
+                << "                                                e.g. YUYV, default RGB3 (RGB24)" << endl
+                << "    -S, --synchronize <frames>                  match the frames of all devices by time and" << endl
+                << "                                                show their skew - give it before the devices," << endl
+                << "                                                each keeps that many frames more for it, e.g. 2" << endl
+                << "    -r, --reactor <threads>                     capture all devices on that many" << endl
+                << "                                                epoll threads instead of one thread each" << endl
+                << "    --huge-pages                                frame buffers of 2 MiB and more of the following" << endl
+                << "                                                devices and of all filters from huge pages" << endl
+                << "    -t, --trace <file>                          trace capturing, converting, filtering and" << endl
+                << "                                                painting, written to the file at exit - for" << endl
+                << "                                                chrome://tracing or ui.perfetto.dev" << endl
                 << "    -h, --help                                  show this message" << endl;
+            delete application;
             return 0;
         } else {
             cerr << "unknown argument: \"" << *it << endl;
@@ -103,69 +386,113 @@ int main(int argc, char **args)
     }
     /* *** evaluate arguments end *** */
 
-    set<pair<CreateFilterFunction, DestroyFilterFunction> > filters;
-    set<void*> filterLibraryHandles;
-    /* *** load filters *** */
+    CaptureReactor *captureReactor = 0;
+    if (reactorThreadCount > 0) {
+        captureReactor = new CaptureReactor(reactorThreadCount);
+        for (auto it = captureDevices.begin(); it != captureDevices.end(); ++it) {
+            (*it)->setCaptureReactor(captureReactor);
+        }
+    }
+
+    FilterRegistry filters;
+    /* *** find filters - loaded when used *** */
     set<string> filterSearchDirectories;
     filterSearchDirectories.insert(".");
     filterSearchDirectories.insert(executablePath);
-
     for (auto it = filterSearchDirectories.begin(); it != filterSearchDirectories.end(); ++it) {
+        filters.addSearchDirectory(*it);
+    }
 
-        DIR *directoryHandle = opendir(it->c_str());
-
-        if (directoryHandle == 0) {
-            cerr << "Cannot open directory \"" << *it << "\" " << errno << " " << strerror(errno) << endl;
-            continue;
-        }
+    /* what the files are is kept across runs */
+    string cacheHome;
+    if (getenv("XDG_CACHE_HOME") != 0) cacheHome = getenv("XDG_CACHE_HOME");
+    else if (getenv("HOME") != 0) cacheHome = string(getenv("HOME")) + "/.cache";
+    if (cacheHome.empty() == false) {
+        mkdir(cacheHome.c_str(), 0700);
+        filters.setCacheFileName(cacheHome + "/videocapture-filters");
+    }
 
-        for(;;)
-        {
-            struct dirent *directoryEntry = readdir(directoryHandle);
-            if (directoryEntry == 0) break;
+    filters.scan();
+    /* *** find filters end *** */
 
-            string fileName = *it + '/' + directoryEntry->d_name;
+    for (auto it = pipelines.begin(); it != pipelines.end(); ++it) {
+        bool started = (*it)->build(filters) == true && (*it)->start() == true;
+        assert(started);
+    }
 
-            void *handle = dlopen(fileName.c_str(), RTLD_NOW);
-            if (handle == 0) {
-                /* it is not a library */
-                //cerr << "Cannot open library \"" << fileName << "\" " << dlerror() << endl; 
-                continue;
-            }
+    FilterReloader *filterReloader = 0;
+    if (reloadFilters == true) {
+        filterReloader = new FilterReloader(&filters);
+        for (auto it = pipelines.begin(); it != pipelines.end(); ++it) {
+            filterReloader->addPipeline(*it);
+        }
+        bool started = filterReloader->start();
+        assert(started);
+    }
 
-            CreateFilterFunction create = reinterpret_cast<CreateFilterFunction>(dlsym(handle, "create"));
-            DestroyFilterFunction destroy = reinterpret_cast<DestroyFilterFunction>(dlsym(handle, "destroy"));
+    int ret = 0;
+    if (headless == true) {
+        runHeadless(captureDevices, pipelines, duration);
+    } else {
+        MainWindow mainWindow(0, captureDevices, filters, synchronizerQueueDepth);
+        mainWindow.show();
 
-            if (create != 0 && destroy != 0) {
+        ret = application->exec();
+    }
 
-                filterLibraryHandles.insert(handle);
-                filters.insert(make_pair(create, destroy));
 
-            } else {
-                /* it is a library, but has not the create() function, because it probably is not a filter plugin */
-                cerr << "Cannot load filter library symbols \"" << fileName << "\" " << dlerror() << endl;
-            }
+    /* before the pipelines it swaps filters in */
+    delete filterReloader;
 
-        }
+    for (auto it = pipelines.begin(); it != pipelines.end(); ++it) {
+        (*it)->stop();
+        cout << (*it)->captureDevice()->fileName() << " -> [" << (*it)->filterNames() << "]: processed "
+                << (*it)->processedFrames() << " frames, " << (*it)->failedFrames() << " failed" << endl
+                << "    processing latency " << (*it)->processingLatency().summary() << endl
+                << "    frame to result " << (*it)->frameLatency().summary() << endl;
+        delete *it;
     }
-    /* *** load filters end *** */
-
 
-    MainWindow mainWindow(0, captureDevices, filters);
-    mainWindow.show();
 
-    int ret = app.exec();
+    for (auto it = historyRings.begin(); it != historyRings.end(); ++it) {
+        delete *it;
+    }
 
+    for (auto it = recorders.begin(); it != recorders.end(); ++it) {
+        cout << "recorded " << (*it)->recordedFrames() << " frames, dropped " << (*it)->droppedFrames();
+        if ((*it)->writtenBytes() > 0) {
+            cout << ", compression ratio " << (double) (*it)->rawBytes() / (*it)->writtenBytes();
+        }
+        cout << endl;
+        delete *it;
+    }
 
     for (auto it = captureDevices.begin(); it != captureDevices.end(); ++it) {
+        if ((*it)->droppedFrames() > 0) {
+            cout << (*it)->fileName() << ": " << (*it)->droppedFrames() << " frames dropped by the source" << endl;
+        }
+        if ((*it)->publishLatency().count() > 0) {
+            cout << (*it)->fileName() << ": publish latency " << (*it)->publishLatency().summary() << endl;
+        }
         (*it)->finish();
     }
 
-    for (auto it = filterLibraryHandles.begin(); it != filterLibraryHandles.end(); ++it) {
-        int dlcloseRet = dlclose(*it);
-        assert(dlcloseRet == 0);
+    /* after the devices, which might still be capturing through it */
+    delete captureReactor;
+
+    FramePool::Statistics pool = FramePool::instance().statistics();
+    cout << "frame pool: " << pool.allocations << " buffers handed out, " << pool.systemAllocations
+            << " allocated, " << pool.hugePageBlocks << " of them on huge pages" << endl;
+
+    if (traceFileName.empty() == false) {
+        Tracer::setEnabled(false);
+        if (Tracer::writeChromeTrace(traceFileName) == true) {
+            cout << "trace written to " << traceFileName << ", " << Tracer::lostEvents() << " events lost" << endl;
+        }
     }
 
+    delete application;
+
     return ret;
 }
 
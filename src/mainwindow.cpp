@@ -28,12 +28,12 @@ using namespace std;
 
 
 MainWindow::MainWindow(QWidget *parent, const set<CaptureDevice*> &captureDevices,
-        const set<pair<CreateFilterFunction, DestroyFilterFunction> > &filters) :
+        FilterRegistry &filters, unsigned int synchronizerQueueDepth) :
         QMainWindow(parent)
 {
     m_centralWidget = new QTabWidget(this);
 
-    m_centralWidget->addTab(new CaptureDevicesTab(m_centralWidget, captureDevices), tr("Capture Devices"));
+    m_centralWidget->addTab(new CaptureDevicesTab(m_centralWidget, captureDevices, synchronizerQueueDepth), tr("Capture Devices"));
     m_centralWidget->addTab(new FilterEditorTab(m_centralWidget, filters), tr("Filter Editor"));
     m_centralWidget->addTab(new ViewsTab(m_centralWidget), tr("Views"));
 
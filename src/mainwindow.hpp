@@ -21,14 +21,13 @@
 
 #include "prereqs.hpp"
 
-#include "basefilter.hpp"
-
 #include <QMainWindow>
 
 #include <set>
 
 class QTabWidget;
 class CaptureDevice;
+class FilterRegistry;
 
 class MainWindow : public QMainWindow
 {
@@ -36,8 +35,9 @@ class MainWindow : public QMainWindow
 
 public:
 
+    /** @param synchronizerQueueDepth see CaptureDevicesTab */
     MainWindow(QWidget *parent, const std::set<CaptureDevice*> &captureDevices,
-            const std::set<std::pair<CreateFilterFunction, DestroyFilterFunction> > &filters);
+            FilterRegistry &filters, unsigned int synchronizerQueueDepth);
     ~MainWindow();
 
 private:
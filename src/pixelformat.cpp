@@ -0,0 +1,121 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "pixelformat.hpp"
+
+#include <cassert>
+
+#include <linux/videodev2.h>
+
+using namespace std;
+
+
+unsigned int PixelFormat::minimumBytesPerLine(unsigned int pixelFormat, unsigned int width)
+{
+    switch (pixelFormat) {
+    case V4L2_PIX_FMT_GREY:
+        return width;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+        return (width + 1) & ~1u;
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+        return ((width + 1) & ~1u) * 2;
+    case V4L2_PIX_FMT_RGB24:
+    case V4L2_PIX_FMT_BGR24:
+        return width * 3;
+    case V4L2_PIX_FMT_RGB32:
+    case V4L2_PIX_FMT_BGR32:
+        return width * 4;
+    default:
+        return 0;
+    }
+}
+
+
+size_t PixelFormat::imageSize(unsigned int pixelFormat, unsigned int bytesPerLine, unsigned int height)
+{
+    switch (pixelFormat) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+        /* chroma planes below the luma plane */
+        return (size_t) bytesPerLine * (height + (height + 1) / 2);
+    default:
+        if (minimumBytesPerLine(pixelFormat, 1) == 0) return 0;
+        return (size_t) bytesPerLine * height;
+    }
+}
+
+
+void PixelFormat::setPixel(unsigned char *image, unsigned int pixelFormat, unsigned int bytesPerLine,
+        unsigned int height, unsigned int x, unsigned int y,
+        unsigned char red, unsigned char green, unsigned char blue)
+{
+    /* BT.601 limited range */
+    int r = red, g = green, b = blue;
+    unsigned char luma = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    unsigned char u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    unsigned char v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+
+    unsigned char *row = image + y * bytesPerLine;
+    unsigned char *chroma = image + bytesPerLine * height;
+
+    switch (pixelFormat) {
+    case V4L2_PIX_FMT_RGB24:
+        row[3 * x] = red; row[3 * x + 1] = green; row[3 * x + 2] = blue;
+        break;
+    case V4L2_PIX_FMT_BGR24:
+        row[3 * x] = blue; row[3 * x + 1] = green; row[3 * x + 2] = red;
+        break;
+    case V4L2_PIX_FMT_RGB32:
+        row[4 * x] = 0; row[4 * x + 1] = red; row[4 * x + 2] = green; row[4 * x + 3] = blue;
+        break;
+    case V4L2_PIX_FMT_BGR32:
+        row[4 * x] = blue; row[4 * x + 1] = green; row[4 * x + 2] = red; row[4 * x + 3] = 0;
+        break;
+    case V4L2_PIX_FMT_GREY:
+        row[x] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+        break;
+    case V4L2_PIX_FMT_YUYV:
+        row[2 * x] = luma;
+        row[4 * (x / 2) + 1] = u;
+        row[4 * (x / 2) + 3] = v;
+        break;
+    case V4L2_PIX_FMT_UYVY:
+        row[2 * x + 1] = luma;
+        row[4 * (x / 2)] = u;
+        row[4 * (x / 2) + 2] = v;
+        break;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+        row[x] = luma;
+        chroma += (y / 2) * bytesPerLine + 2 * (x / 2);
+        chroma[0] = pixelFormat == V4L2_PIX_FMT_NV12 ? u : v;
+        chroma[1] = pixelFormat == V4L2_PIX_FMT_NV12 ? v : u;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        row[x] = luma;
+        chroma[(y / 2) * (bytesPerLine / 2) + x / 2] = u;
+        chroma[(bytesPerLine / 2) * ((height + 1) / 2) + (y / 2) * (bytesPerLine / 2) + x / 2] = v;
+        break;
+    default:
+        assert(0);
+    }
+}
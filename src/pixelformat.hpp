@@ -0,0 +1,53 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PIXEL_FORMAT_HPP
+#define PIXEL_FORMAT_HPP
+
+#include "prereqs.hpp"
+
+#include <cstddef>
+
+
+/**
+ * memory layout of uncompressed V4L2 pixel formats
+ *
+ * Known: RGB24, BGR24, RGB32, BGR32, GREY, YUYV, UYVY, NV12, NV21 and YUV420,
+ * planar formats with their chroma planes below the luma plane.
+ */
+class PixelFormat
+{
+public:
+
+    PixelFormat() = delete;
+
+    /** @returns the smallest stride of the first plane, 0 for an unknown pixel format */
+    static unsigned int minimumBytesPerLine(unsigned int pixelFormat, unsigned int width);
+
+    /** @returns bytes of a whole picture, 0 for an unknown pixel format */
+    static size_t imageSize(unsigned int pixelFormat, unsigned int bytesPerLine, unsigned int height);
+
+    /** sets a pixel given in RGB, for planar and subsampled formats the chroma of the
+        pixel's block is set too - meant for drawing test pictures, not for speed */
+    static void setPixel(unsigned char *image, unsigned int pixelFormat, unsigned int bytesPerLine,
+            unsigned int height, unsigned int x, unsigned int y,
+            unsigned char red, unsigned char green, unsigned char blue);
+};
+
+
+#endif /* PIXEL_FORMAT_HPP */
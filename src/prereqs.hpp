@@ -23,6 +23,17 @@
 /* more to come */
 
 
+#include <chrono>
+
+/** clock for timed waits, it must not jump with the wall clock -
+    libstdc++ calls it monotonic_clock before gcc 4.7 */
+#if defined(__GNUC__) && __GNUC__ == 4 && __GNUC_MINOR__ < 7
+typedef std::chrono::monotonic_clock MonotonicClock;
+#else
+typedef std::chrono::steady_clock MonotonicClock;
+#endif
+
+
 #ifdef HAVE_VAMPIRTRACE
 
     #include <vt_user.h>
@@ -48,7 +59,7 @@
         @note needs HAVE_VAMPIRTRACE to be defined */
     #define VT_END VTN_END(__func__)
 
-#else /* HAVE_VAMPIRTRACE */
+#elif defined(NO_TRACING)
 
     #define VTN(name)
     #define VTN_START(name)
@@ -58,6 +69,22 @@
     #define VT_START
     #define VT_END
 
+#else /* HAVE_VAMPIRTRACE */
+
+    /* the built-in tracer - switched on at runtime, see Tracer */
+    #include "tracer.hpp"
+
+    #define VT_CONCATENATE_(a, b) a ## b
+    #define VT_CONCATENATE(a, b) VT_CONCATENATE_(a, b)
+
+    #define VTN(name) TraceScope VT_CONCATENATE(traceScope, __LINE__)(name);
+    #define VTN_START(name) Tracer::begin(name);
+    #define VTN_END(name) Tracer::end(name);
+
+    #define VT VTN(__func__)
+    #define VT_START VTN_START(__func__)
+    #define VT_END VTN_END(__func__)
+
 #endif /* HAVE_VAMPIRTRACE */
 
 
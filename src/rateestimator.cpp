@@ -0,0 +1,149 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "rateestimator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+
+/* *** histogram: 1 microsecond to 100 seconds, 1 % per bucket *** */
+static const double smallestPeriod = 1e-6;
+static const double bucketGrowth = 1.01;
+static const unsigned int bucketCount = 1852;
+
+
+RateEstimator::RateEstimator() :
+        m_smoothing(0.05),
+        m_version(0),
+        m_buckets(bucketCount, 0)
+{
+    reset();
+}
+
+
+void RateEstimator::setSmoothing(double weight)
+{
+    assert(weight > 0.0 && weight <= 1.0);
+    m_smoothing = weight;
+}
+double RateEstimator::smoothing() const
+{
+    return m_smoothing;
+}
+
+
+void RateEstimator::reset()
+{
+    __sync_add_and_fetch(&m_version, 1);
+
+    Estimate empty = {0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    m_state.estimate = empty;
+    m_state.squares = 0.0;
+    m_state.recentVariance = 0.0;
+    fill(m_buckets.begin(), m_buckets.end(), 0);
+
+    __sync_add_and_fetch(&m_version, 1);
+}
+
+
+void RateEstimator::add(double seconds)
+{
+    assert(seconds > 0.0);
+
+    __sync_fetch_and_add(&m_buckets[bucketOf(seconds)], 1);
+
+    __sync_add_and_fetch(&m_version, 1);
+
+    Estimate &estimate = m_state.estimate;
+
+    if (estimate.count == 0) {
+        estimate.minimum = estimate.maximum = seconds;
+        estimate.recentMean = seconds;
+    }
+    ++estimate.count;
+
+    /* Welford */
+    double delta = seconds - estimate.mean;
+    estimate.mean += delta / estimate.count;
+    m_state.squares += delta * (seconds - estimate.mean);
+    estimate.standardDeviation = sqrt(m_state.squares / estimate.count);
+
+    /* exponentially weighted, the variance updated incrementally as well */
+    double recentDelta = seconds - estimate.recentMean;
+    estimate.recentMean += m_smoothing * recentDelta;
+    m_state.recentVariance = (1.0 - m_smoothing) * (m_state.recentVariance + m_smoothing * recentDelta * recentDelta);
+    estimate.recentStandardDeviation = sqrt(m_state.recentVariance);
+
+    estimate.minimum = min(estimate.minimum, seconds);
+    estimate.maximum = max(estimate.maximum, seconds);
+
+    __sync_add_and_fetch(&m_version, 1);
+}
+
+
+RateEstimator::Estimate RateEstimator::estimate() const
+{
+    Estimate ret;
+    unsigned int version;
+
+    /* retry, while the adding thread was in the middle of an update */
+    do {
+        version = m_version;
+        __sync_synchronize();
+        ret = m_state.estimate;
+        __sync_synchronize();
+    } while ((version & 1) != 0 || version != m_version);
+
+    return ret;
+}
+
+
+double RateEstimator::percentile(double fraction) const
+{
+    assert(fraction >= 0.0 && fraction <= 1.0);
+
+    unsigned long long total = 0;
+    for (unsigned int a = 0; a < bucketCount; ++a) total += m_buckets[a];
+    if (total == 0) return 0.0;
+
+    /* the rank of the period asked for, counted from 1 */
+    unsigned long long rank = max(1ULL, (unsigned long long) ceil(fraction * total));
+    unsigned long long seen = 0;
+    unsigned int bucket = 0;
+    for (; bucket < bucketCount - 1; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen >= rank) break;
+    }
+
+    /* the middle of the bucket - geometrically */
+    return smallestPeriod * pow(bucketGrowth, bucket + 0.5);
+}
+
+
+/* *** private ************************************************************** */
+unsigned int RateEstimator::bucketOf(double seconds)
+{
+    if (seconds <= smallestPeriod) return 0;
+
+    double bucket = log(seconds / smallestPeriod) / log(bucketGrowth);
+    return min((unsigned int) bucket, bucketCount - 1);
+}
@@ -0,0 +1,100 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef RATE_ESTIMATOR_HPP
+#define RATE_ESTIMATOR_HPP
+
+#include "prereqs.hpp"
+
+#include <vector>
+
+
+/**
+ * estimates period and jitter of a stream of frames, online
+ *
+ * Three views on the periods added:
+ *  - mean and standard deviation of all of them (Welford's algorithm - no cancellation,
+ *    no matter how many)
+ *  - exponentially weighted mean and standard deviation, following changes of the rate
+ *  - a histogram with logarithmic buckets of 1 % width, for percentiles
+ *
+ * One thread adds, any number of threads query - without locks, queries never block the
+ * adding thread and never wait for it. Memory is fixed, adding is O(1).
+ */
+class RateEstimator
+{
+public:
+
+    /** in seconds */
+    struct Estimate
+    {
+        /** periods added */
+        unsigned long long count;
+        double mean;
+        double standardDeviation;
+        /** exponentially weighted */
+        double recentMean;
+        double recentStandardDeviation;
+        double minimum;
+        double maximum;
+    };
+
+
+    RateEstimator();
+    RateEstimator(const RateEstimator&) = delete;
+    RateEstimator &operator=(const RateEstimator&) = delete;
+
+    /** weight of the newest period in the recent mean, 0 < weight <= 1. Default: 0.05 */
+    void setSmoothing(double weight);
+    double smoothing() const;
+
+    /** forgets every period added
+        @note not while adding */
+    void reset();
+    /** @param seconds a period, > 0 */
+    void add(double seconds);
+
+    Estimate estimate() const;
+    /** @returns the period, which the given fraction (0 .. 1) of the periods does not exceed,
+            within 1 % - 0 if nothing was added */
+    double percentile(double fraction) const;
+
+private:
+
+    /** what the seqlock guards */
+    struct State
+    {
+        Estimate estimate;
+        /** sum of squared deviations from the mean */
+        double squares;
+        double recentVariance;
+    };
+
+    static unsigned int bucketOf(double seconds);
+
+    double m_smoothing;
+
+    /** odd while the state is being written */
+    volatile unsigned int m_version;
+    State m_state;
+    /** counts per bucket - read without the seqlock, each one is consistent on its own */
+    std::vector<unsigned int> m_buckets;
+};
+
+
+#endif /* RATE_ESTIMATOR_HPP */
@@ -0,0 +1,714 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "recorder.hpp"
+
+#include "framecompression.hpp"
+#include "threadpool.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+static const char dataMagic[8] = {'V', 'C', 'D', 'A', 'T', 'A', '0', '1'};
+static const char indexMagic[8] = {'V', 'C', 'I', 'N', 'D', 'E', 'X', '1'};
+static const unsigned int indexVersion = 3;
+
+
+static unsigned long long roundUp(unsigned long long size, unsigned long long alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+
+Recorder::Recorder(CaptureDevice *device) :
+        m_device(device),
+        m_chunkSize(16 * 1024 * 1024),
+        m_chunkCount(8),
+        m_dataFileDescriptor(-1),
+        m_indexFileDescriptor(-1),
+        m_direct(false),
+        m_fileOffset(0),
+        m_currentChunk(0),
+        m_lastSequence(0),
+        m_compression(CompressionNone),
+        m_keyFrameInterval(30),
+        m_tileSize(256 * 1024),
+        m_compressionThreadCount(0),
+        m_compressionPool(0),
+        m_framesSinceKeyFrame(-1),
+        m_stagingSlotSize(0),
+        m_compressedFrame(0),
+        m_compressedKeyFrame(false),
+        m_compressedDestination(0),
+        m_pendingTiles(0),
+        m_copierThread(0),
+        m_writerThread(0),
+        m_copierCancellationFlag(false),
+        m_writerCancellationFlag(false),
+        m_writeFailed(false),
+        m_recordedFrames(0),
+        m_droppedFrames(0),
+        m_writtenBytes(0),
+        m_rawBytes(0)
+{
+}
+
+
+Recorder::~Recorder()
+{
+    stop();
+}
+
+
+void Recorder::setChunkSize(unsigned int size)
+{
+    assert(size > 0);
+    m_chunkSize = roundUp(size, Alignment);
+}
+unsigned int Recorder::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+
+void Recorder::setChunkCount(unsigned int count)
+{
+    assert(count > 1);
+    m_chunkCount = count;
+}
+unsigned int Recorder::chunkCount() const
+{
+    return m_chunkCount;
+}
+
+
+void Recorder::setCompression(Compression compression)
+{
+    m_compression = compression;
+}
+Recorder::Compression Recorder::compression() const
+{
+    return m_compression;
+}
+
+
+void Recorder::setKeyFrameInterval(unsigned int interval)
+{
+    assert(interval > 0);
+    assert(isRecording() == false);
+    m_keyFrameInterval = interval;
+}
+unsigned int Recorder::keyFrameInterval() const
+{
+    return m_keyFrameInterval;
+}
+
+
+void Recorder::setTileSize(unsigned int size)
+{
+    assert(size > 0);
+    assert(isRecording() == false);
+    m_tileSize = size;
+}
+unsigned int Recorder::tileSize() const
+{
+    return m_tileSize;
+}
+
+
+void Recorder::setCompressionThreadCount(unsigned int count)
+{
+    m_compressionThreadCount = count;
+}
+unsigned int Recorder::compressionThreadCount() const
+{
+    return m_compressionThreadCount;
+}
+
+
+bool Recorder::start(const string &fileName)
+{
+    assert(isRecording() == false);
+    assert(fileName.empty() == false);
+
+    /* *** open the files *** */
+    m_direct = true;
+    m_dataFileDescriptor = open(fileName.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT|O_CLOEXEC, 0644);
+    if (m_dataFileDescriptor == -1 && errno == EINVAL) {
+        /* the file system does not do direct I/O, e.g. tmpfs */
+        m_direct = false;
+        m_dataFileDescriptor = open(fileName.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    }
+    if (m_dataFileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot create '" << fileName << "'. "
+                << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    string indexFileName = fileName + indexFileSuffix();
+    m_indexFileDescriptor = open(indexFileName.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_APPEND|O_CLOEXEC, 0644);
+    if (m_indexFileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot create '" << indexFileName << "'. "
+                << errno << " " << strerror(errno) << endl;
+        close(m_dataFileDescriptor); m_dataFileDescriptor = -1;
+        return false;
+    }
+
+
+    /* *** chunks - at least one frame each *** */
+    unsigned int chunkSize = m_chunkSize;
+    if (m_device != 0) {
+        chunkSize = max((unsigned long long) chunkSize, roundUp(m_device->bufferSize(), Alignment));
+    }
+    if (m_compression != CompressionNone) {
+        /* whatever fits uncompressed, fits compressed at worst */
+        chunkSize = roundUp(FrameCompression::maximumSize(chunkSize, m_tileSize), Alignment);
+
+        m_compressionPool = new ThreadPool(m_compressionThreadCount);
+        m_framesSinceKeyFrame = -1;
+
+        if (m_device != 0) {
+            unsigned int slotCount = m_device->bufferCount() - 1;
+            m_stagingSlotSize = m_device->bufferSize();
+            m_staging.resize(slotCount * m_stagingSlotSize);
+            m_stagedFrames.reserve(slotCount);
+        }
+    }
+
+    m_chunks.resize(m_chunkCount);
+    m_freeChunks.clear();
+    m_fullChunks.clear();
+    for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it) {
+        void *memory = 0;
+        int ret = posix_memalign(&memory, Alignment, chunkSize);
+        assert(ret == 0); (void) ret;
+        it->memory = (unsigned char*) memory;
+        it->used = 0;
+        it->offset = 0;
+        it->records.reserve(chunkSize / Alignment);
+        m_freeChunks.push_back(&*it);
+    }
+    m_chunkSize = chunkSize;
+
+
+    /* *** headers - the data header fills a page, so frames stay aligned *** */
+    IndexHeader indexHeader;
+    memcpy(indexHeader.magic, indexMagic, sizeof(indexMagic));
+    indexHeader.version = indexVersion;
+    indexHeader.recordSize = sizeof(IndexRecord);
+
+    Chunk *first = takeFreeChunk(false);
+    memset(first->memory, 0, Alignment);
+    memcpy(first->memory, dataMagic, sizeof(dataMagic));
+    first->used = Alignment;
+    first->offset = 0;
+
+    if (write(m_indexFileDescriptor, &indexHeader, sizeof(indexHeader)) != sizeof(indexHeader)) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot write index header. " << errno << " " << strerror(errno) << endl;
+    }
+
+
+    m_currentChunk = first;
+    m_fileOffset = 0;
+    m_recordedFrames = 0;
+    m_droppedFrames = 0;
+    m_writtenBytes = 0;
+    m_rawBytes = 0;
+
+    m_copierCancellationFlag = false;
+    m_writerCancellationFlag = false;
+    m_writeFailed = false;
+    m_writerThread = new thread(bind(writerThread, this));
+
+    if (m_device != 0) {
+        /* frames published from now on */
+        m_lastSequence = m_device->publishedSequence();
+
+        m_copierThread = new thread(bind(copierThread, this));
+    }
+
+    return true;
+}
+
+
+void Recorder::stop()
+{
+    if (isRecording() == false) return;
+
+    if (m_copierThread != 0) {
+        /* the copier hands over its last chunk when quitting */
+        m_copierCancellationFlag = true;
+        m_copierThread->join();
+        delete m_copierThread;
+        m_copierThread = 0;
+    } else {
+        submitCurrentChunk();
+    }
+
+    m_mutex.lock();
+    m_writerCancellationFlag = true;
+    m_mutex.unlock();
+    m_condition.notify_all();
+
+    m_writerThread->join();
+    delete m_writerThread;
+    m_writerThread = 0;
+
+    delete m_compressionPool;
+    m_compressionPool = 0;
+    m_reference.clear();
+    m_scratch.clear();
+    m_staging.clear();
+    m_stagedFrames.clear();
+
+
+    close(m_indexFileDescriptor);
+    m_indexFileDescriptor = -1;
+    close(m_dataFileDescriptor);
+    m_dataFileDescriptor = -1;
+
+    for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it) {
+        free(it->memory);
+    }
+    m_chunks.clear();
+    m_freeChunks.clear();
+}
+
+
+bool Recorder::isRecording() const
+{
+    return m_writerThread != 0;
+}
+
+
+bool Recorder::record(const CaptureDevice::Buffer &buffer)
+{
+    assert(isRecording() == true);
+    assert(m_device == 0);
+
+    return copyFrame(buffer, true);
+}
+
+
+void Recorder::discardLastFrame()
+{
+    assert(m_device == 0);
+    assert(m_currentChunk != 0 && m_currentChunk->records.empty() == false);
+
+    /* a chunk is handed over only before appending, so the last frame is still in the current one */
+    m_currentChunk->used -= roundUp(m_currentChunk->records.back().size, Alignment);
+    m_currentChunk->records.pop_back();
+
+    /* the next frame must not be a difference to this one */
+    m_framesSinceKeyFrame = -1;
+}
+
+
+unsigned long long Recorder::recordedFrames() const
+{
+    return m_recordedFrames;
+}
+
+
+unsigned long long Recorder::droppedFrames() const
+{
+    return m_droppedFrames;
+}
+
+
+unsigned long long Recorder::writtenBytes() const
+{
+    return m_writtenBytes;
+}
+
+
+unsigned long long Recorder::rawBytes() const
+{
+    return m_rawBytes;
+}
+
+
+bool Recorder::isDirect() const
+{
+    return m_direct;
+}
+
+
+const char *Recorder::indexFileSuffix()
+{
+    return ".index";
+}
+
+
+bool Recorder::isDataHeader(const void *memory, size_t size)
+{
+    return size >= Alignment && memcmp(memory, dataMagic, sizeof(dataMagic)) == 0;
+}
+
+
+bool Recorder::isIndexHeader(const IndexHeader &header)
+{
+    return memcmp(header.magic, indexMagic, sizeof(indexMagic)) == 0 &&
+            header.version == indexVersion && header.recordSize == sizeof(IndexRecord);
+}
+
+
+/* *** private ************************************************************** */
+Recorder::Chunk *Recorder::takeFreeChunk(bool wait)
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    while (wait == true && m_freeChunks.empty() == true) {
+        m_condition.wait(lock);
+    }
+
+    if (m_freeChunks.empty() == true) return 0;
+
+    Chunk *ret = m_freeChunks.back();
+    m_freeChunks.pop_back();
+    ret->used = 0;
+    ret->records.clear();
+    return ret;
+}
+
+
+void Recorder::submitCurrentChunk()
+{
+    if (m_currentChunk == 0 || m_currentChunk->used == 0) return;
+
+    /* the next chunk continues where this one ends */
+    m_fileOffset = m_currentChunk->offset + m_currentChunk->used;
+
+    m_mutex.lock();
+    m_fullChunks.push_back(m_currentChunk);
+    m_mutex.unlock();
+    m_condition.notify_all();
+
+    m_currentChunk = 0;
+}
+
+
+bool Recorder::copyFrame(const CaptureDevice::Buffer &buffer, bool wait)
+{
+    VT
+
+    unsigned int alignedSize = roundUp(buffer.bytesUsed, Alignment);
+    if (m_compression != CompressionNone) {
+        alignedSize = roundUp(FrameCompression::maximumSize(buffer.bytesUsed, m_tileSize), Alignment);
+    }
+
+    if (alignedSize > m_chunkSize) {
+        /* only when the picture grew after start() */
+        __sync_add_and_fetch(&m_droppedFrames, 1);
+        m_framesSinceKeyFrame = -1;
+        return false;
+    }
+
+    if (m_currentChunk != 0 && m_currentChunk->used + alignedSize > m_chunkSize) {
+        submitCurrentChunk();
+    }
+
+    if (m_currentChunk == 0) {
+        m_currentChunk = takeFreeChunk(wait);
+        if (m_currentChunk == 0) {
+            /* the disk is behind, every chunk is queued for writing */
+            __sync_add_and_fetch(&m_droppedFrames, 1);
+            m_framesSinceKeyFrame = -1;
+            return false;
+        }
+        m_currentChunk->offset = m_fileOffset;
+    }
+
+    IndexRecord record;
+    record.sequence = buffer.frameNumber;
+    record.seconds = buffer.time.tv_sec;
+    record.nanoseconds = buffer.time.tv_nsec;
+    record.realSeconds = buffer.realTime.tv_sec;
+    record.realNanoseconds = buffer.realTime.tv_nsec;
+    record.offset = m_currentChunk->offset + m_currentChunk->used;
+    record.rawSize = buffer.bytesUsed;
+    record.pixelFormat = buffer.pixelFormat;
+    record.width = buffer.width;
+    record.height = buffer.height;
+    record.bytesPerLine = buffer.bytesPerLine;
+    record.compression = m_compression;
+    record.flags = 0;
+
+    unsigned char *destination = m_currentChunk->memory + m_currentChunk->used;
+
+    if (m_compression == CompressionNone) {
+        memcpy(destination, buffer.buffer, buffer.bytesUsed);
+        record.size = buffer.bytesUsed;
+        record.flags = FlagKeyFrame;
+    } else {
+        if (__sync_bool_compare_and_swap(&m_writeFailed, true, false) == true) {
+            m_framesSinceKeyFrame = -1;
+        }
+
+        /* a difference only to a frame of the same kind, right before - replay takes a gap
+           in the sequence numbers for lost records */
+        bool keyFrame = m_framesSinceKeyFrame == -1 ||
+                record.sequence != m_referenceRecord.sequence + 1 ||
+                (unsigned int) m_framesSinceKeyFrame + 1 >= m_keyFrameInterval ||
+                m_referenceRecord.rawSize != record.rawSize ||
+                m_referenceRecord.pixelFormat != record.pixelFormat ||
+                m_referenceRecord.width != record.width ||
+                m_referenceRecord.height != record.height ||
+                m_referenceRecord.bytesPerLine != record.bytesPerLine;
+
+        record.size = compressFrame(buffer, keyFrame, destination);
+        if (keyFrame == true) record.flags = FlagKeyFrame;
+
+        m_framesSinceKeyFrame = keyFrame == true ? 0 : m_framesSinceKeyFrame + 1;
+        m_referenceRecord = record;
+    }
+
+    size_t storedSize = roundUp(record.size, Alignment);
+    memset(destination + record.size, 0, storedSize - record.size);
+
+    m_currentChunk->records.push_back(record);
+    m_currentChunk->used += storedSize;
+
+    return true;
+}
+
+
+bool Recorder::stageFrame(const CaptureDevice::Buffer &buffer)
+{
+    size_t offset = m_stagedFrames.size() * m_stagingSlotSize;
+
+    if (buffer.bytesUsed > m_stagingSlotSize || offset + m_stagingSlotSize > m_staging.size()) {
+        /* only when the picture or the ring grew after start() */
+        __sync_add_and_fetch(&m_droppedFrames, 1);
+        m_framesSinceKeyFrame = -1;
+        return false;
+    }
+
+    m_stagedFrames.push_back(buffer);
+    m_stagedFrames.back().buffer = &m_staging[offset];
+    m_stagedFrames.back().length = m_stagingSlotSize;
+    memcpy(m_stagedFrames.back().buffer, buffer.buffer, buffer.bytesUsed);
+
+    return true;
+}
+
+
+size_t Recorder::compressFrame(const CaptureDevice::Buffer &buffer, bool keyFrame, unsigned char *destination)
+{
+    unsigned int tiles = FrameCompression::tileCount(buffer.bytesUsed, m_tileSize);
+
+    /* without differences there is no need to keep the frame */
+    if (m_keyFrameInterval > 1 && m_reference.size() < buffer.bytesUsed) {
+        m_reference.resize(buffer.bytesUsed);
+    }
+    if (m_scratch.size() < (size_t) tiles * m_tileSize) {
+        m_scratch.resize((size_t) tiles * m_tileSize);
+    }
+    if (m_tileTasks.size() < tiles) {
+        m_tileTasks.resize(tiles);
+    }
+
+    m_compressedFrame = &buffer;
+    m_compressedKeyFrame = keyFrame;
+    m_compressedDestination = destination;
+
+    m_tileMutex.lock();
+    m_pendingTiles = tiles;
+    m_tileMutex.unlock();
+
+    for (unsigned int a = 0; a < tiles; ++a) {
+        m_tileTasks[a].recorder = this;
+        m_tileTasks[a].tile = a;
+        m_compressionPool->post(compressTileTask, &m_tileTasks[a]);
+    }
+
+    /* only the copier waits - on a staged copy, the ring has the frame back already */
+    unique_lock<mutex> lock(m_tileMutex);
+    while (m_pendingTiles > 0) {
+        m_tileCondition.wait(lock);
+    }
+    lock.unlock();
+
+    return FrameCompression::pack(destination, buffer.bytesUsed, m_tileSize);
+}
+
+
+bool Recorder::writeChunk(Chunk *chunk)
+{
+    VT
+
+    unsigned int done = 0;
+
+    while (done < chunk->used) {
+        ssize_t ret = pwrite(m_dataFileDescriptor, chunk->memory + done, chunk->used - done, chunk->offset + done);
+
+        if (ret == -1 && errno == EINTR) continue;
+
+        if (ret == -1 && errno == EINVAL && m_direct == true) {
+            /* opened fine, but the file system does not do direct I/O after all */
+            fcntl(m_dataFileDescriptor, F_SETFL, fcntl(m_dataFileDescriptor, F_GETFL) & ~O_DIRECT);
+            m_direct = false;
+            continue;
+        }
+
+        if (ret <= 0) {
+            cerr << __PRETTY_FUNCTION__ << " Write error. " << errno << " " << strerror(errno) << endl;
+            return false;
+        }
+        done += ret;
+    }
+
+    /* only now the frames are there to be found */
+    size_t indexSize = chunk->records.size() * sizeof(IndexRecord);
+    if (indexSize > 0 && write(m_indexFileDescriptor, &chunk->records[0], indexSize) != (ssize_t) indexSize) {
+        cerr << __PRETTY_FUNCTION__ << " Index write error. " << errno << " " << strerror(errno) << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+/* *** static functions ***************************************************** */
+void Recorder::copierThread(Recorder *recorder)
+{
+    Tracer::setThreadName("recorder copier");
+
+    CaptureDevice *device = recorder->m_device;
+    unsigned int n = device->bufferCount() - 1;
+    vector<CaptureDevice::FrameHandle> frames(n);
+
+    device->subscribe(&recorder->m_frameNotifier);
+
+    while (recorder->m_copierCancellationFlag == false) {
+
+        /* taken before looking, so a frame published meanwhile ends the wait below at once */
+        unsigned long long generation = recorder->m_frameNotifier.generation();
+
+        unsigned long long previous = recorder->m_lastSequence;
+        unsigned int locked = device->lockNewerBuffers(&recorder->m_lastSequence, n, &frames[0]);
+
+        /* each released as soon as it is copied */
+        for (unsigned int a = 0; a < locked; ++a) {
+            const CaptureDevice::Buffer &buffer = *frames[a];
+
+            if (buffer.sequence > previous + 1) {
+                /* left the ring before we got to them */
+                __sync_add_and_fetch(&recorder->m_droppedFrames, buffer.sequence - previous - 1);
+            }
+            previous = buffer.sequence;
+
+            if (recorder->m_compression == CompressionNone) {
+                recorder->copyFrame(buffer, false);
+            } else {
+                recorder->stageFrame(buffer);
+            }
+
+            frames[a].reset();
+        }
+
+        /* compressed with every frame back in the ring */
+        for (auto it = recorder->m_stagedFrames.begin(); it != recorder->m_stagedFrames.end(); ++it) {
+            recorder->copyFrame(*it, false);
+        }
+        recorder->m_stagedFrames.clear();
+
+        if (locked == 0 && recorder->m_frameNotifier.wait(generation, 100) == generation) {
+            /* nothing for a while - get what we have to disk */
+            recorder->submitCurrentChunk();
+        }
+    }
+
+    device->unsubscribe(&recorder->m_frameNotifier);
+
+    recorder->submitCurrentChunk();
+}
+
+
+void Recorder::writerThread(Recorder *recorder)
+{
+    Tracer::setThreadName("recorder writer");
+
+    unique_lock<mutex> lock(recorder->m_mutex);
+
+    for (;;) {
+
+        while (recorder->m_fullChunks.empty() == true && recorder->m_writerCancellationFlag == false) {
+            recorder->m_condition.wait(lock);
+        }
+
+        /* queued chunks are written before quitting */
+        if (recorder->m_fullChunks.empty() == true) break;
+
+        Chunk *chunk = recorder->m_fullChunks.front();
+        recorder->m_fullChunks.pop_front();
+
+        lock.unlock();
+
+        if (recorder->writeChunk(chunk) == true) {
+            unsigned long long rawBytes = 0;
+            for (auto it = chunk->records.begin(); it != chunk->records.end(); ++it) {
+                rawBytes += it->rawSize;
+            }
+            __sync_add_and_fetch(&recorder->m_recordedFrames, chunk->records.size());
+            __sync_add_and_fetch(&recorder->m_writtenBytes, chunk->used);
+            __sync_add_and_fetch(&recorder->m_rawBytes, rawBytes);
+        } else {
+            __sync_add_and_fetch(&recorder->m_droppedFrames, chunk->records.size());
+            /* frames compressed meanwhile may still refer to them, replay stops at the gap */
+            __sync_bool_compare_and_swap(&recorder->m_writeFailed, false, true);
+        }
+
+        lock.lock();
+        recorder->m_freeChunks.push_back(chunk);
+        /* for record() waiting for a chunk */
+        recorder->m_condition.notify_all();
+    }
+}
+
+
+void Recorder::compressTileTask(void *argument)
+{
+    TileTask *task = (TileTask*) argument;
+    Recorder *recorder = task->recorder;
+    const CaptureDevice::Buffer &frame = *recorder->m_compressedFrame;
+
+    unsigned char *reference = recorder->m_reference.empty() == true ? 0 : &recorder->m_reference[0];
+    FrameCompression::compressTile(frame.buffer, frame.bytesUsed, recorder->m_tileSize, task->tile,
+            reference, recorder->m_compressedKeyFrame, recorder->m_compressedDestination,
+            &recorder->m_scratch[(size_t) task->tile * recorder->m_tileSize]);
+
+    recorder->m_tileMutex.lock();
+    bool last = --recorder->m_pendingTiles == 0;
+    recorder->m_tileMutex.unlock();
+
+    if (last == true) recorder->m_tileCondition.notify_all();
+}
@@ -0,0 +1,290 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include "prereqs.hpp"
+
+#include "capturedevice.hpp"
+#include "framenotifier.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * records the frames of a capture device raw to disk
+ *
+ * A recording consists of two append-only files:
+ *  - the data file: a header page, followed by the frames, each starting at a multiple of
+ *    Alignment. Nothing but the index tells where a frame is.
+ *  - the index file (data file name + ".index"): an IndexHeader followed by one IndexRecord
+ *    per frame, in capture order. A record is appended only after its frame is on disk.
+ *
+ * Two threads per recorder: the copier takes every new frame out of the ring and copies it
+ * into the current chunk - a large aligned buffer out of a fixed pool. The writer writes full
+ * chunks with O_DIRECT (plain writes, where the file system refuses it). The capture thread
+ * never waits for either: if the copier falls behind, frames leave the ring unrecorded; if the
+ * disk falls behind, the pool runs dry and frames are dropped. Both count as dropped.
+ *
+ * Without a device, frames are pushed with record() instead - e.g. by HistoryRing.
+ *
+ * With compression (see FrameCompression) the copier cuts each frame into tiles and has a
+ * thread pool compress them straight into the chunk, so it takes as many cores as needed
+ * to keep up - still without the capture thread waiting for anything. The new frames are
+ * copied out of the ring into a staging area first, so the ring has them back while they
+ * are compressed.
+ *
+ * @see RecordingCaptureDevice
+ */
+class Recorder
+{
+public:
+
+    /** alignment of frames, chunks and file offsets - what O_DIRECT needs */
+    static const unsigned int Alignment = 4096;
+
+    enum Compression
+    {
+        CompressionNone,
+        /** see FrameCompression */
+        CompressionLz4
+    };
+
+    enum IndexFlags
+    {
+        /** compressed without the frame before - otherwise a difference to the record before,
+            whose sequence number is one less */
+        FlagKeyFrame = 1
+    };
+
+    struct IndexHeader
+    {
+        /** "VCINDEX1" */
+        char magic[8];
+        unsigned int version;
+        /** sizeof(IndexRecord) of the writer */
+        unsigned int recordSize;
+    };
+
+    struct IndexRecord
+    {
+        /** the source's frame number (Buffer::frameNumber) - gaps are dropped frames */
+        unsigned long long sequence;
+        /** CLOCK_MONOTONIC capture time */
+        long long seconds;
+        long long nanoseconds;
+        /** CLOCK_REALTIME capture time */
+        long long realSeconds;
+        long long realNanoseconds;
+        /** position in the data file, a multiple of Alignment */
+        unsigned long long offset;
+        /** bytes of the frame in the data file */
+        unsigned long long size;
+        /** bytes of the frame, once decompressed */
+        unsigned long long rawSize;
+        unsigned int pixelFormat;
+        unsigned int width;
+        unsigned int height;
+        unsigned int bytesPerLine;
+        /** see Compression */
+        unsigned int compression;
+        /** see IndexFlags */
+        unsigned int flags;
+    };
+
+
+    /** @param device 0 for frames pushed with record() */
+    explicit Recorder(CaptureDevice *device);
+    Recorder(const Recorder&) = delete;
+    Recorder &operator=(const Recorder&) = delete;
+    /** stops recording */
+    ~Recorder();
+
+    /** bytes written at once, rounded up to Alignment. Default: 16 MiB
+        @note takes effect with the next start() */
+    void setChunkSize(unsigned int);
+    unsigned int chunkSize() const;
+    /** chunks in the pool - chunkCount * chunkSize is how far the disk may lag behind.
+        Default: 8
+        @note takes effect with the next start() */
+    void setChunkCount(unsigned int);
+    unsigned int chunkCount() const;
+
+    /** Default: CompressionNone
+        @note takes effect with the next start() */
+    void setCompression(Compression);
+    Compression compression() const;
+    /** every n-th frame is a key frame, the others are stored as difference to the frame
+        before. 1 for key frames only. Default: 30
+        @note takes effect with the next start() */
+    void setKeyFrameInterval(unsigned int);
+    unsigned int keyFrameInterval() const;
+    /** bytes compressed on their own, the unit of parallelism. Default: 256 KiB
+        @note takes effect with the next start() */
+    void setTileSize(unsigned int);
+    unsigned int tileSize() const;
+    /** 0 for one per processor. Default: 0
+        @note takes effect with the next start() */
+    void setCompressionThreadCount(unsigned int);
+    unsigned int compressionThreadCount() const;
+
+    /** creates (truncates) the files and starts recording the frames published from now on
+        @returns false if the files cannot be created */
+    bool start(const std::string &fileName);
+    /** writes everything copied so far and closes the files */
+    void stop();
+    bool isRecording() const;
+
+    /** copies a frame into the recording, blocks while the disk is behind
+        @returns false if the frame does not fit into a chunk
+        @pre recording without a device */
+    bool record(const CaptureDevice::Buffer&);
+    /** takes the frame recorded last out again - as long as no other frame followed */
+    void discardLastFrame();
+
+    /* *** statistics of the current or last recording - updated while recording *** */
+    unsigned long long recordedFrames() const;
+    unsigned long long droppedFrames() const;
+    /** bytes written to the data file */
+    unsigned long long writtenBytes() const;
+    /** bytes of the recorded frames before compression */
+    unsigned long long rawBytes() const;
+    /** true if the data file is written with O_DIRECT */
+    bool isDirect() const;
+
+    static const char *indexFileSuffix();
+    /** @returns true if the memory starts with the header of a data file */
+    static bool isDataHeader(const void*, size_t size);
+    /** @returns true if the header is one of an index file this version reads */
+    static bool isIndexHeader(const IndexHeader&);
+
+private:
+
+    struct Chunk
+    {
+        unsigned char *memory;
+        /** position in the data file */
+        unsigned long long offset;
+        /** bytes in use, a multiple of Alignment */
+        unsigned int used;
+        std::vector<IndexRecord> records;
+    };
+
+    struct TileTask
+    {
+        Recorder *recorder;
+        unsigned int tile;
+    };
+
+    /** @returns a chunk out of the pool, 0 if it is empty and we shall not wait */
+    Chunk *takeFreeChunk(bool wait);
+    /** hands the current chunk to the writer */
+    void submitCurrentChunk();
+    /** @returns false if the frame was dropped */
+    bool copyFrame(const CaptureDevice::Buffer&, bool wait);
+    /** copies a frame out of the ring into the next staging slot
+        @returns false if the frame was dropped */
+    bool stageFrame(const CaptureDevice::Buffer&);
+    /** compresses the frame into destination on the thread pool
+        @returns bytes of the compressed frame */
+    size_t compressFrame(const CaptureDevice::Buffer&, bool keyFrame, unsigned char *destination);
+
+    bool writeChunk(Chunk*);
+
+    static void copierThread(Recorder*);
+    static void writerThread(Recorder*);
+    static void compressTileTask(void *task);
+
+    CaptureDevice *m_device;
+    FrameNotifier m_frameNotifier;
+
+    unsigned int m_chunkSize;
+    unsigned int m_chunkCount;
+
+    int m_dataFileDescriptor;
+    int m_indexFileDescriptor;
+    bool m_direct;
+    /** where the next chunk goes - used by the copier (or the caller of record()) only */
+    unsigned long long m_fileOffset;
+
+    std::vector<Chunk> m_chunks;
+    /** used by the copier (or the caller of record()) only */
+    Chunk *m_currentChunk;
+    unsigned long long m_lastSequence;
+
+    Compression m_compression;
+    unsigned int m_keyFrameInterval;
+    unsigned int m_tileSize;
+    unsigned int m_compressionThreadCount;
+    ThreadPool *m_compressionPool;
+    /** the frame compressed last, what the next one is a difference to */
+    std::vector<unsigned char> m_reference;
+    IndexRecord m_referenceRecord;
+    /** frames since the last key frame, -1 to force one */
+    int m_framesSinceKeyFrame;
+    std::vector<unsigned char> m_scratch;
+    /** frames copied out of the ring by the copier, waiting to be compressed - one slot
+        per frame the copier locks at once */
+    std::vector<unsigned char> m_staging;
+    size_t m_stagingSlotSize;
+    std::vector<CaptureDevice::Buffer> m_stagedFrames;
+
+    /* *** the frame being compressed - for the tile tasks *** */
+    std::vector<TileTask> m_tileTasks;
+    const CaptureDevice::Buffer *m_compressedFrame;
+    bool m_compressedKeyFrame;
+    unsigned char *m_compressedDestination;
+    unsigned int m_pendingTiles;
+    std::mutex m_tileMutex;
+    std::condition_variable m_tileCondition;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<Chunk*> m_freeChunks;
+    std::deque<Chunk*> m_fullChunks;
+
+    std::thread *m_copierThread;
+    std::thread *m_writerThread;
+    bool m_copierCancellationFlag;
+    /** set after the copier quit - the writer drains the queue first */
+    bool m_writerCancellationFlag;
+    /** set by the writer when a chunk could not be written - its frames are no reference
+        anymore, the next compressed frame is a key frame */
+    bool m_writeFailed;
+
+    unsigned long long m_recordedFrames;
+    unsigned long long m_droppedFrames;
+    unsigned long long m_writtenBytes;
+    unsigned long long m_rawBytes;
+};
+
+
+#endif /* RECORDER_HPP */
@@ -0,0 +1,476 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "recordingcapturedevice.hpp"
+
+#include "framecompression.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+/** maps a whole file read only
+    @returns 0 on failure */
+static void *mapFile(const string &fileName, size_t *size)
+{
+    int fileDescriptor = open(fileName.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fileDescriptor == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot open '" << fileName << "'. " << errno << " " << strerror(errno) << endl;
+        return 0;
+    }
+
+    struct stat st;
+    void *ret = 0;
+    if (fstat(fileDescriptor, &st) == -1) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot identify file. " << errno << " " << strerror(errno) << endl;
+    } else if (st.st_size == 0) {
+        cerr << __PRETTY_FUNCTION__ << " '" << fileName << "' is empty" << endl;
+    } else {
+        ret = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+        if (ret == MAP_FAILED) {
+            cerr << __PRETTY_FUNCTION__ << " Cannot map '" << fileName << "'. " << errno << " " << strerror(errno) << endl;
+            ret = 0;
+        }
+        *size = st.st_size;
+    }
+
+    /* the mapping stays valid */
+    close(fileDescriptor);
+
+    return ret;
+}
+
+
+RecordingCaptureDevice::RecordingCaptureDevice() :
+        m_speed(1.0),
+        m_data(0),
+        m_dataSize(0),
+        m_index(0),
+        m_indexSize(0),
+        m_records(0),
+        m_frameCount(0),
+        m_compressed(false),
+        m_referenceIndex(-1),
+        m_position(0),
+        m_seekRequest(-1),
+        m_paceStartIndex(0)
+{
+    m_paceStart.tv_sec = 0;
+    m_paceStart.tv_nsec = 0;
+}
+
+
+void RecordingCaptureDevice::setSpeed(double speed)
+{
+    assert(speed >= 0.0);
+    m_speed = speed;
+}
+double RecordingCaptureDevice::speed() const
+{
+    return m_speed;
+}
+
+
+unsigned int RecordingCaptureDevice::frameCount() const
+{
+    return m_frameCount;
+}
+
+
+const Recorder::IndexRecord &RecordingCaptureDevice::record(unsigned int index) const
+{
+    assert(index < m_frameCount);
+    return m_records[index];
+}
+
+
+unsigned int RecordingCaptureDevice::indexOfTime(const timespec &time) const
+{
+    if (m_frameCount == 0) return 0;
+
+    long long wanted = time.tv_sec * 1000000000LL + time.tv_nsec;
+    long long first = nanoseconds(m_records[0]);
+    long long last = nanoseconds(m_records[m_frameCount-1]);
+
+    if (wanted <= first) return 0;
+    if (wanted > last) return m_frameCount;
+
+    /* guess from the average frame period, then widen the search around the guess,
+       so it takes a few steps for steady frame rates and log(n) at worst */
+    unsigned int guess = (double) (wanted - first) / (last - first) * (m_frameCount - 1);
+    unsigned int low = guess;
+    unsigned int high = guess;
+    unsigned int step = 1;
+
+    if (nanoseconds(m_records[guess]) < wanted) {
+        /* the answer is above the guess */
+        while (high < m_frameCount - 1 && nanoseconds(m_records[high]) < wanted) {
+            low = high;
+            high = min(m_frameCount - 1, guess + step);
+            step *= 2;
+        }
+    } else {
+        while (low > 0 && nanoseconds(m_records[low]) >= wanted) {
+            high = low;
+            low = guess > step ? guess - step : 0;
+            step *= 2;
+        }
+    }
+
+    /* first record in [low, high] not before the wanted time */
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (nanoseconds(m_records[middle]) < wanted) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+
+void RecordingCaptureDevice::seek(unsigned int index)
+{
+    assert(index <= m_frameCount);
+    assert(index <= (unsigned int) numeric_limits<int>::max());
+
+    __sync_lock_test_and_set(&m_seekRequest, (int) index);
+
+    if (m_fileDescriptor != -1) {
+        /* wake up the capturing thread, even if it reached the end already */
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        armFrameTimer(now);
+    }
+}
+
+
+unsigned int RecordingCaptureDevice::position() const
+{
+    int request = m_seekRequest;
+    return request != -1 ? request : m_position;
+}
+
+
+CaptureDevice::FrameHandle RecordingCaptureDevice::frame(unsigned int index)
+{
+    assert(isCapturing() == false);
+    assert(index < m_frameCount);
+
+    Buffer *buffer = m_ring.claimOldest();
+    if (buffer == 0) return FrameHandle();
+
+    if (publishFrame(buffer, index) == false) return FrameHandle();
+
+    /* we are the only producer, so the newest one is ours */
+    return lockNewestBuffer();
+}
+
+
+/* *** protected ************************************************************ */
+bool RecordingCaptureDevice::initSource()
+{
+    assert(m_fileName.empty() == false);
+
+    m_ioMethod = IoMethodGenerated;
+
+
+    /* *** map the files *** */
+    m_data = (unsigned char*) mapFile(m_fileName, &m_dataSize);
+    if (m_data == 0) return false;
+
+    if (Recorder::isDataHeader(m_data, m_dataSize) == false) {
+        cerr << __PRETTY_FUNCTION__ << " '" << m_fileName << "' is no recording" << endl;
+        return false;
+    }
+
+    string indexFileName = m_fileName + Recorder::indexFileSuffix();
+    m_index = mapFile(indexFileName, &m_indexSize);
+    if (m_index == 0) return false;
+
+    if (m_indexSize < sizeof(Recorder::IndexHeader) ||
+            Recorder::isIndexHeader(*(const Recorder::IndexHeader*) m_index) == false) {
+        cerr << __PRETTY_FUNCTION__ << " '" << indexFileName << "' is no index of this version" << endl;
+        return false;
+    }
+
+    m_records = (const Recorder::IndexRecord*) ((const char*) m_index + sizeof(Recorder::IndexHeader));
+    m_frameCount = (m_indexSize - sizeof(Recorder::IndexHeader)) / sizeof(Recorder::IndexRecord);
+
+    /* a recording cut short ends with the last frame, which is there completely */
+    for (unsigned int a = 0; a < m_frameCount; ++a) {
+        if (m_records[a].offset + m_records[a].size > m_dataSize) {
+            m_frameCount = a;
+            break;
+        }
+    }
+
+    if (m_frameCount == 0) {
+        cerr << __PRETTY_FUNCTION__ << " '" << m_fileName << "' holds no frame" << endl;
+        return false;
+    }
+
+
+    /* *** the picture, as far as it is the same for all frames *** */
+    m_captureWidth = m_records[0].width;
+    m_captureHeight = m_records[0].height;
+    m_pixelFormat = m_records[0].pixelFormat;
+    m_bytesPerLine = m_records[0].bytesPerLine;
+
+    m_compressed = false;
+    m_bufferSize = 0;
+    for (unsigned int a = 0; a < m_frameCount; ++a) {
+        if (m_records[a].compression != Recorder::CompressionNone) m_compressed = true;
+        m_bufferSize = max(m_bufferSize, (unsigned int) m_records[a].rawSize);
+    }
+
+    if (m_compressed == true) {
+        /* decompressed into buffers of our own */
+        if (initMemoryBuffers() == false) return false;
+        m_referenceIndex = -1;
+    } else {
+        /* buffers without memory - views into the mapping */
+        m_buffers.resize(m_bufferCount);
+        for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+            it->time = {numeric_limits<time_t>::min(), 0};
+            it->readerCount = 0;
+            it->buffer = 0;
+            it->length = 0;
+            it->index = it - m_buffers.begin();
+        }
+        m_ring.setBuffers(&m_buffers[0], m_buffers.size());
+    }
+
+    m_position = 0;
+    m_seekRequest = -1;
+    m_paceStartIndex = 0;
+    m_paceStart.tv_sec = 0;
+    m_paceStart.tv_nsec = 0;
+
+    /* fired once per frame, the first one right away */
+    if (initFrameTimer(0.0) == false) return false;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return armFrameTimer(now);
+}
+
+
+void RecordingCaptureDevice::finishSource()
+{
+    finishFrameTimer();
+    if (m_compressed == true && m_buffers.empty() == false) {
+        finishMemoryBuffers();
+    }
+    m_buffers.clear();
+    m_reference.clear();
+    m_decoded.clear();
+    m_compressed = false;
+
+    if (m_index != 0) {
+        munmap(m_index, m_indexSize);
+        m_index = 0;
+        m_indexSize = 0;
+    }
+    if (m_data != 0) {
+        munmap(m_data, m_dataSize);
+        m_data = 0;
+        m_dataSize = 0;
+    }
+
+    m_records = 0;
+    m_frameCount = 0;
+}
+
+
+void RecordingCaptureDevice::captureFrame()
+{
+    if (consumeFrameTimer() == 0) return;
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int request = __sync_lock_test_and_set(&m_seekRequest, -1);
+    if (request != -1) {
+        m_position = request;
+        m_paceStart.tv_sec = 0;
+        restartFrameNumbering();
+    }
+
+    if (m_position >= m_frameCount) {
+        /* the end - the timer stays quiet until the next seek */
+        return;
+    }
+
+    /* the pace is measured from the first frame after starting or seeking */
+    if (m_paceStart.tv_sec == 0) {
+        m_paceStart = now;
+        m_paceStartIndex = m_position;
+    }
+
+    Buffer *buffer = m_ring.claimOldest();
+    if (buffer != 0) {
+        publishFrame(buffer, m_position);
+    }
+    /* else every buffer is locked - like a device, we go on without the consumers */
+
+    ++m_position;
+
+    if (m_position < m_frameCount) {
+        if (m_speed == 0.0) {
+            armFrameTimer(now);
+        } else {
+            armForPosition();
+        }
+    }
+}
+
+
+void RecordingCaptureDevice::captureIdle()
+{
+}
+
+
+/* *** private ************************************************************** */
+bool RecordingCaptureDevice::publishFrame(Buffer *buffer, unsigned int index)
+{
+    const Recorder::IndexRecord &record = m_records[index];
+
+    if (m_compressed == true) {
+        if (decompress(index, buffer->buffer) == false) {
+            cerr << __PRETTY_FUNCTION__ << " frame " << index << " of '" << m_fileName << "' is corrupt" << endl;
+            m_ring.unclaim(buffer);
+            return false;
+        }
+    } else {
+        buffer->buffer = m_data + record.offset;
+        buffer->length = record.size;
+    }
+    buffer->bytesUsed = record.rawSize;
+
+    /* gaps in the recording show as dropped frames, like they did while recording */
+    timespec time;
+    time.tv_sec = record.seconds;
+    time.tv_nsec = record.nanoseconds;
+    stampFrame(buffer, record.sequence, time, TimestampRecorded);
+    buffer->realTime.tv_sec = record.realSeconds;
+    buffer->realTime.tv_nsec = record.realNanoseconds;
+    buffer->pixelFormat = record.pixelFormat;
+    buffer->width = record.width;
+    buffer->height = record.height;
+    buffer->bytesPerLine = record.bytesPerLine;
+
+    /* read ahead the next frame, while this one is being processed */
+    if (index + 1 < m_frameCount) {
+        const Recorder::IndexRecord &next = m_records[index+1];
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t start = next.offset / pageSize * pageSize;
+        madvise(m_data + start, next.offset + next.size - start, MADV_WILLNEED);
+    }
+
+    publish(buffer);
+    return true;
+}
+
+
+bool RecordingCaptureDevice::decompress(unsigned int index, unsigned char *destination)
+{
+    const Recorder::IndexRecord &record = m_records[index];
+    const unsigned char *data = m_data + record.offset;
+
+    if (record.compression == Recorder::CompressionNone) {
+        memcpy(destination, data, record.rawSize);
+    } else if ((record.flags & Recorder::FlagKeyFrame) != 0) {
+        if (FrameCompression::decompress(data, record.size, destination, record.rawSize, 0) == false) return false;
+    } else {
+        if (index == 0 || record.sequence != m_records[index-1].sequence + 1 ||
+                decompressReference(index - 1) == false) return false;
+        if (FrameCompression::decompress(data, record.size, destination, record.rawSize, &m_reference[0]) == false) return false;
+    }
+
+    /* the next frame probably is a difference to this one */
+    if (m_reference.size() < record.rawSize) m_reference.resize(record.rawSize);
+    memcpy(&m_reference[0], destination, record.rawSize);
+    m_referenceIndex = index;
+
+    return true;
+}
+
+
+bool RecordingCaptureDevice::decompressReference(unsigned int index)
+{
+    if (m_referenceIndex == (int) index) return true;
+
+    /* after seeking - from the key frame before, without records lost in between */
+    unsigned int keyFrame = index;
+    while (keyFrame > 0 && (m_records[keyFrame].flags & Recorder::FlagKeyFrame) == 0 &&
+            m_records[keyFrame].sequence == m_records[keyFrame-1].sequence + 1) {
+        --keyFrame;
+    }
+    if ((m_records[keyFrame].flags & Recorder::FlagKeyFrame) == 0) return false;
+
+    if (m_reference.size() < m_bufferSize) m_reference.resize(m_bufferSize);
+    if (m_decoded.size() < m_bufferSize) m_decoded.resize(m_bufferSize);
+
+    for (unsigned int a = keyFrame; a <= index; ++a) {
+        const Recorder::IndexRecord &record = m_records[a];
+        bool isKeyFrame = a == keyFrame;
+
+        if (record.compression == Recorder::CompressionNone) {
+            memcpy(&m_decoded[0], m_data + record.offset, record.rawSize);
+        } else if (FrameCompression::decompress(m_data + record.offset, record.size, &m_decoded[0],
+                record.rawSize, isKeyFrame == true ? 0 : &m_reference[0]) == false) {
+            m_referenceIndex = -1;
+            return false;
+        }
+        m_reference.swap(m_decoded);
+    }
+
+    m_referenceIndex = index;
+    return true;
+}
+
+
+void RecordingCaptureDevice::armForPosition()
+{
+    long long recorded = nanoseconds(m_records[m_position]) - nanoseconds(m_records[m_paceStartIndex]);
+    long long due = m_paceStart.tv_sec * 1000000000LL + m_paceStart.tv_nsec + (long long) (recorded / m_speed);
+
+    timespec time;
+    time.tv_sec = due / 1000000000LL;
+    time.tv_nsec = due % 1000000000LL;
+    armFrameTimer(time);
+}
+
+
+long long RecordingCaptureDevice::nanoseconds(const Recorder::IndexRecord &record)
+{
+    return record.seconds * 1000000000LL + record.nanoseconds;
+}
@@ -0,0 +1,124 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef RECORDING_CAPTURE_DEVICE_HPP
+#define RECORDING_CAPTURE_DEVICE_HPP
+
+#include "prereqs.hpp"
+
+#include "capturedevice.hpp"
+#include "recorder.hpp"
+
+#include <cstddef>
+#include <ctime>
+#include <vector>
+
+
+/**
+ * replays a recording made by Recorder
+ *
+ * Data and index file are mapped, a frame is a view into the mapping - the ring holds no
+ * memory of its own, nothing is copied. Compressed recordings are decompressed into buffers
+ * of our own instead; seeking to a frame, which is no key frame, decompresses from the key
+ * frame before. Buffers carry the recorded capture time.
+ *
+ * Two ways to get frames:
+ *  - capture (startCapturing()) like from any device, at the recorded pace times speed(),
+ *    or as fast as the consumers take them for speed 0. Slow consumers miss frames.
+ *  - frame(): publishes any frame right away - for feeding every frame into e.g.
+ *    FilterGraph::submit(), which then only goes as fast as the filters do.
+ *
+ * fileName() is the data file. captureSize() and pixelFormat() are the recorded ones.
+ */
+class RecordingCaptureDevice : public CaptureDevice
+{
+public:
+    RecordingCaptureDevice();
+
+    /** 1 for the recorded pace, 2 for twice as fast, 0 for as fast as possible. Default: 1 */
+    void setSpeed(double);
+    double speed() const;
+
+    /* *** after initialization *** */
+
+    unsigned int frameCount() const;
+    const Recorder::IndexRecord &record(unsigned int index) const;
+
+    /** @returns index of the first frame captured at or after the time, frameCount() if none
+        @note close to O(1) for steady frame rates */
+    unsigned int indexOfTime(const timespec&) const;
+
+    /** captures continue with this frame */
+    void seek(unsigned int index);
+    /** @returns index of the frame captured next */
+    unsigned int position() const;
+
+    /** publishes the frame and locks it
+        @returns a null handle if every buffer is locked or the frame is corrupt
+        @pre not capturing */
+    FrameHandle frame(unsigned int index);
+
+protected:
+
+    virtual bool initSource();
+    virtual void finishSource();
+    virtual void captureFrame();
+    virtual void captureIdle();
+
+private:
+
+    /** points a claimed buffer at the frame, or decompresses it into it, and publishes it
+        @returns false if the frame is corrupt */
+    bool publishFrame(Buffer*, unsigned int index);
+    bool decompress(unsigned int index, unsigned char *destination);
+    /** makes m_reference the decompressed frame */
+    bool decompressReference(unsigned int index);
+    /** arms the timer for the frame at m_position */
+    void armForPosition();
+
+    static long long nanoseconds(const Recorder::IndexRecord&);
+
+    double m_speed;
+
+    unsigned char *m_data;
+    size_t m_dataSize;
+    void *m_index;
+    size_t m_indexSize;
+    const Recorder::IndexRecord *m_records;
+    unsigned int m_frameCount;
+
+    bool m_compressed;
+    /** the frame decompressed last */
+    std::vector<unsigned char> m_reference;
+    /** index of the frame in m_reference, -1 for none */
+    int m_referenceIndex;
+    /** decompression target while seeking */
+    std::vector<unsigned char> m_decoded;
+
+    /** only touched by the capturing thread - seek() goes through m_seekRequest */
+    unsigned int m_position;
+    /** index requested by seek(), -1 for none */
+    int m_seekRequest;
+
+    /** when and from which frame the pace is measured */
+    timespec m_paceStart;
+    unsigned int m_paceStartIndex;
+};
+
+
+#endif /* RECORDING_CAPTURE_DEVICE_HPP */
@@ -0,0 +1,155 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "syntheticcapturedevice.hpp"
+
+#include "framepool.hpp"
+#include "pixelformat.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+
+/** 75% color bars, RGB */
+static const unsigned char bars[8][3] = {
+    {191, 191, 191}, {191, 191, 0}, {0, 191, 191}, {0, 191, 0},
+    {191, 0, 191}, {191, 0, 0}, {0, 0, 191}, {0, 0, 0}};
+
+
+SyntheticCaptureDevice::SyntheticCaptureDevice() :
+        m_frameRate(30.0),
+        m_boxSize(0),
+        m_frameNumber(0)
+{
+}
+
+
+void SyntheticCaptureDevice::setFrameRate(double framesPerSecond)
+{
+    assert(framesPerSecond >= 0.0);
+    m_frameRate = framesPerSecond;
+}
+double SyntheticCaptureDevice::frameRate() const
+{
+    return m_frameRate;
+}
+
+
+/* *** protected ************************************************************ */
+bool SyntheticCaptureDevice::initSource()
+{
+    assert(m_captureWidth > 0);
+    assert(m_captureHeight > 0);
+
+    m_ioMethod = IoMethodGenerated;
+
+    m_bytesPerLine = PixelFormat::minimumBytesPerLine(m_pixelFormat, m_captureWidth);
+    if (m_bytesPerLine == 0) {
+        cerr << __PRETTY_FUNCTION__ << " Cannot generate pixel format "
+                << pixelFormatString(m_pixelFormat) << endl;
+        return false;
+    }
+    /* no driver to dictate the stride - rows start on cache lines */
+    m_bytesPerLine = FramePool::paddedBytesPerLine(m_bytesPerLine);
+    m_bufferSize = PixelFormat::imageSize(m_pixelFormat, m_bytesPerLine, m_captureHeight);
+
+
+    /* *** draw the still part once *** */
+    m_pattern.assign(m_bufferSize, 0);
+    for (unsigned int y = 0; y < m_captureHeight; ++y) {
+        for (unsigned int x = 0; x < m_captureWidth; ++x) {
+            const unsigned char *bar = bars[x * 8 / m_captureWidth];
+            PixelFormat::setPixel(&m_pattern[0], m_pixelFormat, m_bytesPerLine, m_captureHeight,
+                    x, y, bar[0], bar[1], bar[2]);
+        }
+    }
+
+    /* even, so it covers whole chroma blocks */
+    m_boxSize = min(32u, min(m_captureWidth, m_captureHeight)) & ~1u;
+    m_frameNumber = 0;
+
+
+    if (initMemoryBuffers() == false) {
+        return false;
+    }
+
+    return initFrameTimer(m_frameRate);
+}
+
+
+void SyntheticCaptureDevice::finishSource()
+{
+    finishFrameTimer();
+    if (m_buffers.empty() == false) {
+        finishMemoryBuffers();
+    }
+    m_pattern.clear();
+}
+
+
+void SyntheticCaptureDevice::captureFrame()
+{
+    unsigned long long elapsed = consumeFrameTimer();
+    if (elapsed == 0) return;
+
+    /* periods missed are skipped, the box moves with the time */
+    m_frameNumber += elapsed;
+
+    Buffer *buffer = m_ring.claimOldest();
+    if (buffer == 0) {
+        /* every buffer is locked - drop the frame */
+        return;
+    }
+
+    /* periods missed, or frames not taken for lack of a buffer, are gaps - dropped frames */
+    stampFrame(buffer, m_frameNumber);
+
+    memcpy(buffer->buffer, &m_pattern[0], m_bufferSize);
+
+    if (m_boxSize > 0) {
+        /* diagonally, wrapping around, on even positions */
+        unsigned int x = (m_frameNumber * 4) % (m_captureWidth - m_boxSize + 1) & ~1u;
+        unsigned int y = (m_frameNumber * 2) % (m_captureHeight - m_boxSize + 1) & ~1u;
+        drawBox(buffer->buffer, x, y);
+    }
+
+    buffer->bytesUsed = m_bufferSize;
+
+    publish(buffer);
+}
+
+
+void SyntheticCaptureDevice::captureIdle()
+{
+}
+
+
+/* *** private ************************************************************** */
+void SyntheticCaptureDevice::drawBox(unsigned char *image, unsigned int x, unsigned int y)
+{
+    for (unsigned int row = y; row < y + m_boxSize; ++row) {
+        for (unsigned int column = x; column < x + m_boxSize; ++column) {
+            PixelFormat::setPixel(image, m_pixelFormat, m_bytesPerLine, m_captureHeight,
+                    column, row, 255, 255, 255);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef SYNTHETIC_CAPTURE_DEVICE_HPP
+#define SYNTHETIC_CAPTURE_DEVICE_HPP
+
+#include "prereqs.hpp"
+
+#include "capturedevice.hpp"
+
+#include <vector>
+
+
+/**
+ * captures a generated test picture instead of a device
+ *
+ * Color bars with a box moving across them, in any format PixelFormat knows, at a fixed
+ * frame rate. The picture is drawn once at initialization, so producing a frame costs a
+ * copy - fast enough to load the ring, the filters and the display at high frame rates.
+ *
+ * A frame timer stands in for the device's file descriptor, so capture threads and the
+ * CaptureReactor treat the source like any device. fileName() is not used.
+ */
+class SyntheticCaptureDevice : public CaptureDevice
+{
+public:
+    SyntheticCaptureDevice();
+
+    /** frames per second, 0 for as fast as the consumers allow. Default: 30 */
+    void setFrameRate(double);
+    double frameRate() const;
+
+protected:
+
+    virtual bool initSource();
+    virtual void finishSource();
+    virtual void captureFrame();
+    virtual void captureIdle();
+
+private:
+
+    void drawBox(unsigned char *image, unsigned int x, unsigned int y);
+
+    double m_frameRate;
+
+    std::vector<unsigned char> m_pattern;
+    unsigned int m_boxSize;
+    /** frame periods elapsed since initialization - moves the box */
+    unsigned long long m_frameNumber;
+};
+
+
+#endif /* SYNTHETIC_CAPTURE_DEVICE_HPP */
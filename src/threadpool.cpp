@@ -0,0 +1,115 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "threadpool.hpp"
+
+#include "tracer.hpp"
+#include <cassert>
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+
+ThreadPool::ThreadPool(unsigned int threadCount) :
+        m_tasks(64),
+        m_head(0),
+        m_taskCount(0),
+        m_cancellationFlag(false)
+{
+    if (threadCount == 0) threadCount = thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+
+    for (unsigned int a = 0; a < threadCount; ++a) {
+        m_threads.push_back(new thread(bind(workerThread, this)));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    m_mutex.lock();
+    m_cancellationFlag = true;
+    m_mutex.unlock();
+    m_condition.notify_all();
+
+    for (auto it = m_threads.begin(); it != m_threads.end(); ++it) {
+        (*it)->join();
+        delete *it;
+    }
+
+    assert(m_taskCount == 0);
+}
+
+
+void ThreadPool::post(TaskFunction function, void *argument)
+{
+    assert(function != 0);
+
+    m_mutex.lock();
+
+    /* full - twice the room, the queued tasks moved to the front */
+    if (m_taskCount == m_tasks.size()) {
+        vector<pair<TaskFunction, void*> > tasks(2 * m_tasks.size());
+        for (unsigned int a = 0; a < m_taskCount; ++a) {
+            tasks[a] = m_tasks[(m_head + a) % m_tasks.size()];
+        }
+        m_tasks.swap(tasks);
+        m_head = 0;
+    }
+
+    m_tasks[(m_head + m_taskCount) % m_tasks.size()] = make_pair(function, argument);
+    ++m_taskCount;
+
+    m_mutex.unlock();
+
+    m_condition.notify_one();
+}
+
+
+unsigned int ThreadPool::threadCount() const
+{
+    return m_threads.size();
+}
+
+
+/* *** static functions ***************************************************** */
+void ThreadPool::workerThread(ThreadPool *pool)
+{
+    Tracer::setThreadName("pool");
+
+    unique_lock<mutex> lock(pool->m_mutex);
+
+    for (;;) {
+
+        while (pool->m_taskCount == 0 && pool->m_cancellationFlag == false) {
+            pool->m_condition.wait(lock);
+        }
+
+        /* queued tasks are finished before quitting */
+        if (pool->m_taskCount == 0) break;
+
+        pair<TaskFunction, void*> task = pool->m_tasks[pool->m_head];
+        pool->m_head = (pool->m_head + 1) % pool->m_tasks.size();
+        --pool->m_taskCount;
+
+        lock.unlock();
+        task.first(task.second);
+        lock.lock();
+    }
+}
@@ -0,0 +1,74 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include "prereqs.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace std
+{
+    class thread;
+};
+
+
+/**
+ * a fixed number of threads working off a queue of tasks
+ *
+ * Tasks are plain function pointers with an argument, queued in a ring, so posting one does
+ * not allocate (apart from the ring growing, when more tasks are queued than ever before).
+ */
+class ThreadPool
+{
+public:
+
+    typedef void (*TaskFunction)(void*);
+
+    /** @param threadCount 0 for one thread per processor */
+    explicit ThreadPool(unsigned int threadCount = 0);
+    /** finishes the queued tasks first */
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+
+    void post(TaskFunction, void *argument);
+
+    unsigned int threadCount() const;
+
+private:
+
+    static void workerThread(ThreadPool*);
+
+    std::vector<std::thread*> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    /** ring of m_taskCount tasks starting at m_head */
+    std::vector<std::pair<TaskFunction, void*> > m_tasks;
+    unsigned int m_head;
+    unsigned int m_taskCount;
+    bool m_cancellationFlag;
+};
+
+
+#endif /* THREAD_POOL_HPP */
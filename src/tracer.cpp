@@ -0,0 +1,208 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "tracer.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+volatile bool Tracer::s_enabled = false;
+__thread Tracer::ThreadBuffer *Tracer::s_threadBuffer = 0;
+Tracer::ThreadBuffer *volatile Tracer::s_threadBuffers = 0;
+
+static unsigned int bufferCapacity = 65536;
+/** set before the thread traced the first time, copied into its buffer then */
+static __thread char threadName[32];
+
+/* *** ticks and CLOCK_MONOTONIC nanoseconds, taken at the same time *** */
+static bool calibrated = false;
+static unsigned long long calibrationTicks = 0;
+static long long calibrationNanoseconds = 0;
+
+
+static long long monotonicNanoseconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+
+static void writeJsonString(FILE *file, const char *string)
+{
+    fputc('"', file);
+    for (const char *it = string; *it != '\0'; ++it) {
+        if (*it == '"' || *it == '\\') {
+            fputc('\\', file);
+            fputc(*it, file);
+        } else if ((unsigned char) *it < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned int) (unsigned char) *it);
+        } else {
+            fputc(*it, file);
+        }
+    }
+    fputc('"', file);
+}
+
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled == true && calibrated == false) {
+        calibrationNanoseconds = monotonicNanoseconds();
+        calibrationTicks = now();
+        calibrated = true;
+    }
+    s_enabled = enabled;
+}
+
+
+void Tracer::setBufferCapacity(unsigned int events)
+{
+    bufferCapacity = events;
+}
+
+
+void Tracer::setThreadName(const char *name)
+{
+    strncpy(threadName, name, sizeof(threadName) - 1);
+    if (s_threadBuffer != 0) {
+        strncpy(s_threadBuffer->name, name, sizeof(s_threadBuffer->name) - 1);
+    }
+}
+
+
+bool Tracer::writeChromeTrace(const string &fileName)
+{
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (file == 0) {
+        perror(__PRETTY_FUNCTION__);
+        return false;
+    }
+
+    /* the longer the span between the two measurements, the better the rate */
+    double nanosecondsPerTick = 1.0;
+#if defined(__x86_64__) || defined(__i386__)
+    long long nanoseconds = monotonicNanoseconds();
+    while (calibrated == true && nanoseconds - calibrationNanoseconds < 10000000) {
+        nanoseconds = monotonicNanoseconds();
+    }
+    unsigned long long ticks = now();
+    if (ticks > calibrationTicks) {
+        nanosecondsPerTick = (double) (nanoseconds - calibrationNanoseconds) / (ticks - calibrationTicks);
+    }
+#endif
+
+    int processId = getpid();
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for (ThreadBuffer *buffer = s_threadBuffers; buffer != 0; buffer = buffer->next) {
+
+        if (buffer->name[0] != '\0') {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                    first == true ? "" : ",\n", processId, buffer->threadId);
+            writeJsonString(file, buffer->name);
+            fprintf(file, "}}");
+            first = false;
+        }
+
+        /* the events up to the count are complete */
+        unsigned int count = buffer->count;
+        __sync_synchronize();
+
+        for (unsigned int a = 0; a < count; ++a) {
+            const Event &event = buffer->events[a];
+
+#if defined(__x86_64__) || defined(__i386__)
+            double start = calibrationNanoseconds + ((long long) (event.start - calibrationTicks)) * nanosecondsPerTick;
+#else
+            double start = event.start;
+#endif
+
+            fprintf(file, "%s{\"name\":", first == true ? "" : ",\n");
+            writeJsonString(file, event.name);
+            fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,", (char) event.phase, start / 1000.0);
+            if (event.phase == PhaseComplete) {
+                fprintf(file, "\"dur\":%.3f,", (event.end - event.start) * nanosecondsPerTick / 1000.0);
+            }
+            fprintf(file, "\"pid\":%d,\"tid\":%d}", processId, buffer->threadId);
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0) failed = true;
+    if (failed == true) {
+        perror(__PRETTY_FUNCTION__);
+        return false;
+    }
+
+    return true;
+}
+
+
+unsigned long long Tracer::lostEvents()
+{
+    unsigned long long ret = 0;
+    for (ThreadBuffer *buffer = s_threadBuffers; buffer != 0; buffer = buffer->next) {
+        ret += buffer->lostEvents;
+    }
+    return ret;
+}
+
+
+void Tracer::clear()
+{
+    for (ThreadBuffer *buffer = s_threadBuffers; buffer != 0; buffer = buffer->next) {
+        buffer->count = 0;
+        buffer->lostEvents = 0;
+    }
+}
+
+
+/* *** private ************************************************************** */
+Tracer::ThreadBuffer *Tracer::registerThread()
+{
+    ThreadBuffer *buffer = new ThreadBuffer;
+    buffer->events = new Event[bufferCapacity];
+    /* fault the pages in now, not one by one while tracing */
+    memset(buffer->events, 0, sizeof(Event) * bufferCapacity);
+    buffer->capacity = bufferCapacity;
+    buffer->count = 0;
+    buffer->lostEvents = 0;
+    buffer->threadId = syscall(SYS_gettid);
+    memcpy(buffer->name, threadName, sizeof(buffer->name));
+
+    /* the buffers outlive their threads - a trace is written afterwards */
+    ThreadBuffer *head;
+    do {
+        head = s_threadBuffers;
+        buffer->next = head;
+    } while (__sync_bool_compare_and_swap(&s_threadBuffers, head, buffer) == false);
+
+    s_threadBuffer = buffer;
+    return buffer;
+}
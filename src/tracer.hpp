@@ -0,0 +1,208 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+/* no prereqs.hpp - it includes this file */
+
+#include <ctime>
+#include <string>
+
+
+/**
+ * records where the time goes - per thread, into memory, written as Chrome trace afterwards
+ *
+ * Every thread appends to an own buffer, nobody else writes to it: no locks, no atomic
+ * operations, no system calls - a scope costs two time stamp counter reads and a store of
+ * 32 bytes, a few nanoseconds. While disabled, a scope costs a load and a branch. A full
+ * buffer drops further events, see lostEvents().
+ *
+ * Buffers are written by writeChromeTrace() - also while tracing goes on - in the JSON format
+ * read by chrome://tracing and Perfetto (ui.perfetto.dev). Time stamp counter ticks are
+ * converted to CLOCK_MONOTONIC nanoseconds by measuring both at enabling and at writing,
+ * which needs an invariant counter (any x86 of the last years). Elsewhere clock_gettime() is
+ * used directly.
+ *
+ * Usually used through the VT macros of prereqs.hpp.
+ */
+class Tracer
+{
+public:
+
+    enum Phase
+    {
+        PhaseComplete = 'X',
+        PhaseBegin = 'B',
+        PhaseEnd = 'E'
+    };
+
+    struct Event
+    {
+        /** has to live until the trace is written - usually a literal or __func__ */
+        const char *name;
+        unsigned long long start;
+        /** for PhaseComplete */
+        unsigned long long end;
+        /** see Phase */
+        unsigned int phase;
+    };
+
+
+    /** off by default - the first enabling calibrates the clock */
+    static void setEnabled(bool);
+    static bool isEnabled();
+
+    /** events per thread buffer, for threads tracing the first time from now on. Default: 65536 */
+    static void setBufferCapacity(unsigned int events);
+    /** names the calling thread in the trace, at most 31 characters */
+    static void setThreadName(const char*);
+
+    /** @returns time stamp counter ticks */
+    static unsigned long long now();
+
+    static void record(const char *name, unsigned long long start, unsigned long long end, Phase);
+    static void begin(const char *name);
+    static void end(const char *name);
+
+    /** @returns false if the file cannot be written */
+    static bool writeChromeTrace(const std::string &fileName);
+    /** @returns events dropped because a thread buffer was full */
+    static unsigned long long lostEvents();
+    /** empties the buffers
+        @note not while tracing */
+    static void clear();
+
+private:
+
+    struct ThreadBuffer;
+
+    /** creates the buffer of the calling thread */
+    static ThreadBuffer *registerThread();
+
+    static volatile bool s_enabled;
+    static __thread ThreadBuffer *s_threadBuffer;
+    /** every buffer ever registered - only ever prepended to */
+    static ThreadBuffer *volatile s_threadBuffers;
+};
+
+
+/** records the time from construction to destruction, if tracing was enabled at construction */
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name);
+    ~TraceScope();
+
+private:
+    TraceScope(const TraceScope&);
+    TraceScope &operator=(const TraceScope&);
+
+    const char *m_name;
+    unsigned long long m_start;
+};
+
+
+/* *** inline ************************************************************** */
+struct Tracer::ThreadBuffer
+{
+    Event *events;
+    unsigned int capacity;
+    /** events written - only the owner writes it, after the event */
+    volatile unsigned int count;
+    unsigned long long lostEvents;
+    int threadId;
+    char name[32];
+    /** the buffer registered before */
+    ThreadBuffer *next;
+};
+
+
+inline bool Tracer::isEnabled()
+{
+    return s_enabled;
+}
+
+
+inline unsigned long long Tracer::now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+    return ((unsigned long long) high << 32) | low;
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+
+inline void Tracer::record(const char *name, unsigned long long start, unsigned long long end, Phase phase)
+{
+    ThreadBuffer *buffer = s_threadBuffer;
+    if (buffer == 0) buffer = registerThread();
+
+    unsigned int count = buffer->count;
+    if (count == buffer->capacity) {
+        ++buffer->lostEvents;
+        return;
+    }
+
+    Event &event = buffer->events[count];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.phase = phase;
+
+    /* the event before the count - stores are not reordered on x86, the compiler must not either */
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__ ("" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+    buffer->count = count + 1;
+}
+
+
+inline void Tracer::begin(const char *name)
+{
+    if (isEnabled() == true) record(name, now(), 0, PhaseBegin);
+}
+
+
+inline void Tracer::end(const char *name)
+{
+    if (isEnabled() == true) record(name, now(), 0, PhaseEnd);
+}
+
+
+inline TraceScope::TraceScope(const char *name) :
+        m_name(name),
+        m_start(Tracer::isEnabled() == true ? Tracer::now() : 0)
+{
+}
+
+
+inline TraceScope::~TraceScope()
+{
+    if (m_start != 0) Tracer::record(m_name, m_start, Tracer::now(), Tracer::PhaseComplete);
+}
+
+
+#endif /* TRACER_HPP */
@@ -0,0 +1,175 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* benchmark of the memory allocations per frame
+ *
+ * Runs a filter pipeline on a SyntheticCaptureDevice, which is initialized again at
+ * changing resolutions, and counts every malloc(), calloc(), realloc() and
+ * posix_memalign() of the process - this program replaces them with counting ones.
+ * In the steady state of each cycle no memory should be allocated at all; the cycles
+ * after the first should get their frames from FramePool instead of the system.
+ *
+ * usage: allocationbenchmark [filter names [plugin directory]]
+ * Default: "grayscale,box blur,threshold" out of ".." - see "make filters" in the top
+ * directory.
+ */
+
+#include "filterpipeline.hpp"
+#include "filterregistry.hpp"
+#include "framepool.hpp"
+#include "syntheticcapturedevice.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+using namespace std;
+
+
+/* *** counting allocation functions - operator new ends up in malloc() too *** */
+
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void*, size_t);
+extern "C" void *__libc_memalign(size_t, size_t);
+
+static unsigned long long allocations = 0;
+static unsigned long long allocatedBytes = 0;
+
+static void count(size_t size)
+{
+    __sync_add_and_fetch(&allocations, 1);
+    __sync_add_and_fetch(&allocatedBytes, size);
+}
+
+extern "C" void *malloc(size_t size)
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count_, size_t size)
+{
+    count(count_ * size);
+    return __libc_calloc(count_, size);
+}
+
+extern "C" void *realloc(void *memory, size_t size)
+{
+    count(size);
+    return __libc_realloc(memory, size);
+}
+
+extern "C" int posix_memalign(void **memory, size_t alignment, size_t size)
+{
+    count(size);
+    *memory = __libc_memalign(alignment, size);
+    return *memory == 0 ? ENOMEM : 0;
+}
+
+
+static const double frameRate = 120.0;
+/** seconds after start, before counting */
+static const double warmUp = 0.5;
+static const double duration = 1.0;
+static const unsigned int cycleCount = 6;
+
+
+static void sleepFor(double seconds)
+{
+    struct timespec time = {(time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9)};
+    nanosleep(&time, 0);
+}
+
+
+/** initializes the device at the size, runs the pipeline and prints the allocations
+    @returns false if the device or pipeline does not start */
+static bool runCycle(SyntheticCaptureDevice &device, FilterPipeline &pipeline,
+        unsigned int width, unsigned int height, const char *label)
+{
+    unsigned long long cycleAllocations = allocations;
+    unsigned long long cycleBytes = allocatedBytes;
+    FramePool::Statistics cyclePool = FramePool::instance().statistics();
+
+    device.setCaptureSize(width, height);
+    if (device.init() == false || pipeline.start() == false) return false;
+    device.startCapturing();
+    sleepFor(warmUp);
+
+    unsigned long long steadyAllocations = allocations;
+    unsigned long long steadyBytes = allocatedBytes;
+    unsigned long long steadyFrames = pipeline.processedFrames();
+    FramePool::Statistics steadyPool = FramePool::instance().statistics();
+
+    sleepFor(duration);
+
+    unsigned long long frames = pipeline.processedFrames() - steadyFrames;
+    FramePool::Statistics pool = FramePool::instance().statistics();
+    printf("%-16s steady: %4llu frames, %.3f allocations and %.0f bytes per frame, pool %llu handed out\n",
+            label, frames, frames == 0 ? 0.0 : (double) (allocations - steadyAllocations) / frames,
+            frames == 0 ? 0.0 : (double) (allocatedBytes - steadyBytes) / frames,
+            pool.allocations - steadyPool.allocations);
+
+    device.stopCapturing();
+    pipeline.stop();
+    device.finish();
+
+    pool = FramePool::instance().statistics();
+    printf("%-16s whole cycle: %llu allocations, %llu bytes, pool %llu of %llu blocks from the system\n",
+            "", allocations - cycleAllocations, allocatedBytes - cycleBytes,
+            pool.systemAllocations - cyclePool.systemAllocations, pool.allocations - cyclePool.allocations);
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    string filterNames = argc > 1 ? argv[1] : "grayscale,box blur,threshold";
+    string pluginDirectory = argc > 2 ? argv[2] : "..";
+
+    FilterRegistry filters;
+    filters.addSearchDirectory(pluginDirectory);
+    filters.scan();
+
+    SyntheticCaptureDevice device;
+    device.setFrameRate(frameRate);
+    device.setBufferCount(4);
+    device.setCaptureSize(640, 480);
+    if (device.init() == false) return EXIT_FAILURE;
+
+    FilterPipeline pipeline(&device);
+    pipeline.setFilterNames(filterNames);
+    if (pipeline.build(filters) == false) {
+        fprintf(stderr, "cannot build \"%s\" out of %s\n", filterNames.c_str(), pluginDirectory.c_str());
+        device.finish();
+        return EXIT_FAILURE;
+    }
+    device.finish();
+
+    for (unsigned int a = 0; a < cycleCount; ++a) {
+        bool large = a % 2 == 1;
+        const char *label = large == true ? "init 1280x720" : "init 640x480";
+        if (runCycle(device, pipeline, large == true ? 1280 : 640, large == true ? 720 : 480, label) == false) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
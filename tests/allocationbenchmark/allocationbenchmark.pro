@@ -0,0 +1,68 @@
+# videocapture is a tool with no special purpose
+# 
+# Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+
+
+TARGET = allocationbenchmark
+
+include(../tests.pri)
+
+# the filter plugins link against the program
+QMAKE_LFLAGS += -Wl,-export-dynamic
+
+CONFIG += link_pkgconfig
+PKGCONFIG += libv4l2
+
+LIBS += -ldl
+
+
+HEADERS += ../../src/basefilter.hpp \
+           ../../src/capturedevice.hpp \
+           ../../src/capturereactor.hpp \
+           ../../src/filterfusion.hpp \
+           ../../src/filtergraph.hpp \
+           ../../src/filterinstance.hpp \
+           ../../src/filterpipeline.hpp \
+           ../../src/filterregistry.hpp \
+           ../../src/framenotifier.hpp \
+           ../../src/framepool.hpp \
+           ../../src/framering.hpp \
+           ../../src/latencyhistogram.hpp \
+           ../../src/pixelformat.hpp \
+           ../../src/rateestimator.hpp \
+           ../../src/syntheticcapturedevice.hpp \
+           ../../src/threadpool.hpp \
+           ../../src/tracer.hpp
+
+SOURCES += ../../src/basefilter.cpp \
+           ../../src/capturedevice.cpp \
+           ../../src/capturereactor.cpp \
+           ../../src/filterfusion.cpp \
+           ../../src/filtergraph.cpp \
+           ../../src/filterinstance.cpp \
+           ../../src/filterpipeline.cpp \
+           ../../src/filterregistry.cpp \
+           ../../src/framenotifier.cpp \
+           ../../src/framepool.cpp \
+           ../../src/framering.cpp \
+           ../../src/latencyhistogram.cpp \
+           ../../src/pixelformat.cpp \
+           ../../src/rateestimator.cpp \
+           ../../src/syntheticcapturedevice.cpp \
+           ../../src/threadpool.cpp \
+           ../../src/tracer.cpp \
+           ./allocationbenchmark.cpp
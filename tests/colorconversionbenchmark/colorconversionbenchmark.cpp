@@ -0,0 +1,98 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* benchmark of ColorConversion
+ *
+ * Converts a 1920x1080 picture of every source format to RGB24 with every
+ * instruction set the CPU supports and prints milliseconds per frame and the
+ * speedup over the scalar kernels.
+ */
+
+#include "colorconversion.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+using namespace std;
+
+
+static const unsigned int width = 1920;
+static const unsigned int height = 1080;
+/** seconds per format and instruction set */
+static const double duration = 0.5;
+
+
+static double seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+int main()
+{
+    static const unsigned int pixelFormats[] = {
+        V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_NV12,
+        V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_GREY
+    };
+
+    vector<unsigned char> source(width * height * 2);
+    vector<unsigned char> destination(width * height * 3);
+    srand(1);
+    for (auto it = source.begin(); it != source.end(); ++it) {
+        *it = rand();
+    }
+
+    ColorConversion::InstructionSet fastest = ColorConversion::detectInstructionSet();
+    printf("%ux%u to RGB24, ms per frame\n", width, height);
+
+    for (size_t f = 0; f < sizeof(pixelFormats) / sizeof(pixelFormats[0]); ++f) {
+        unsigned int pixelFormat = pixelFormats[f];
+        unsigned int bytesPerLine =
+                pixelFormat == V4L2_PIX_FMT_YUYV || pixelFormat == V4L2_PIX_FMT_UYVY ? width * 2 : width;
+        double scalarTime = 0;
+
+        printf("%.4s", reinterpret_cast<const char*>(&pixelFormat));
+
+        for (int i = ColorConversion::Scalar; i <= fastest; ++i) {
+            ColorConversion::InstructionSet instructionSet = static_cast<ColorConversion::InstructionSet>(i);
+            ColorConversion::setInstructionSet(instructionSet);
+
+            unsigned int frames = 0;
+            double start = seconds();
+            do {
+                ColorConversion::convert(&source[0], pixelFormat, width, height, bytesPerLine,
+                        &destination[0], ColorConversion::Rgb24, width * 3);
+                ++frames;
+            } while (seconds() - start < duration);
+            double frameTime = (seconds() - start) / frames;
+
+            if (instructionSet == ColorConversion::Scalar) scalarTime = frameTime;
+            printf("  %s %6.2f (%4.1fx)", ColorConversion::instructionSetName(instructionSet),
+                    frameTime * 1e3, scalarTime / frameTime);
+        }
+        printf("\n");
+    }
+
+    return EXIT_SUCCESS;
+}
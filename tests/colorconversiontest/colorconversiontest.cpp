@@ -0,0 +1,200 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* bit exactness test of ColorConversion
+ *
+ * Converts random pictures of every source format with odd and even sizes,
+ * padded strides and both output formats, and compares every instruction set
+ * the CPU supports byte by byte with the scalar kernels - the padding of the
+ * destination rows included, which must stay untouched. Every kernel is also
+ * checked against the fixed point formula for every combination of Y, U and V.
+ */
+
+#include "colorconversion.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+using namespace std;
+
+
+static const unsigned int pixelFormats[] = {
+    V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_GREY
+};
+/** around the 16 and 32 pixel blocks of the SIMD kernels */
+static const unsigned int widths[] = {1, 2, 15, 16, 17, 31, 32, 33, 63, 510, 511, 512, 513, 1030};
+static const unsigned int maximumHeight = 5;
+/** destination padding, filled before converting */
+static const unsigned char paddingByte = 0x5a;
+
+
+static string fourcc(unsigned int pixelFormat)
+{
+    return string(reinterpret_cast<const char*>(&pixelFormat), 4);
+}
+
+
+/** @returns a stride with some padding, even for the subsampled formats */
+static unsigned int sourceBytesPerLine(unsigned int pixelFormat, unsigned int width)
+{
+    if (pixelFormat == V4L2_PIX_FMT_YUYV || pixelFormat == V4L2_PIX_FMT_UYVY) {
+        return (width + 1) / 2 * 4 + 6;
+    }
+    return (width + 8) & ~1u;
+}
+
+
+/** @returns the number of mismatching conversions */
+static unsigned int compareInstructionSets()
+{
+    ColorConversion::InstructionSet fastest = ColorConversion::detectInstructionSet();
+    unsigned int mismatches = 0;
+
+    srand(1);
+
+    for (size_t f = 0; f < sizeof(pixelFormats) / sizeof(pixelFormats[0]); ++f) {
+        unsigned int pixelFormat = pixelFormats[f];
+
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+            unsigned int width = widths[w];
+            unsigned int bytesPerLine = sourceBytesPerLine(pixelFormat, width);
+
+            for (unsigned int height = 1; height <= maximumHeight; ++height) {
+                /* enough for the chroma planes of every format */
+                vector<unsigned char> source(bytesPerLine * height * 2);
+                for (auto it = source.begin(); it != source.end(); ++it) {
+                    *it = rand();
+                }
+
+                for (int o = ColorConversion::Rgb24; o <= ColorConversion::Rgbx32; ++o) {
+                    ColorConversion::OutputFormat outputFormat = static_cast<ColorConversion::OutputFormat>(o);
+                    unsigned int destinationBytesPerLine = width * (o == ColorConversion::Rgb24 ? 3 : 4) + 5;
+                    vector<unsigned char> reference(destinationBytesPerLine * height, paddingByte);
+
+                    ColorConversion::setInstructionSet(ColorConversion::Scalar);
+                    ColorConversion::convert(&source[0], pixelFormat, width, height, bytesPerLine,
+                            &reference[0], outputFormat, destinationBytesPerLine);
+
+                    for (int i = ColorConversion::Scalar + 1; i <= fastest; ++i) {
+                        ColorConversion::InstructionSet instructionSet = static_cast<ColorConversion::InstructionSet>(i);
+                        vector<unsigned char> destination(destinationBytesPerLine * height, paddingByte);
+
+                        ColorConversion::setInstructionSet(instructionSet);
+                        ColorConversion::convert(&source[0], pixelFormat, width, height, bytesPerLine,
+                                &destination[0], outputFormat, destinationBytesPerLine);
+
+                        if (destination != reference) {
+                            cerr << ColorConversion::instructionSetName(instructionSet) << " differs from "
+                                 << ColorConversion::instructionSetName(ColorConversion::Scalar) << ": "
+                                 << fourcc(pixelFormat) << " " << width << "x" << height
+                                 << (o == ColorConversion::Rgb24 ? " to RGB24" : " to RGBX32") << endl;
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    ColorConversion::setInstructionSet(fastest);
+    return mismatches;
+}
+
+
+/** the documented fixed point BT.601 formula, see colorconversion.cpp */
+static unsigned char clampedShift(int value)
+{
+    value >>= 6;
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+
+/** @returns the number of instruction sets, which are off the formula for any Y, U and V */
+static unsigned int checkFormula()
+{
+    /* YUYV, pixel pair k holds Y = k and 255 - k, row r holds V = r, one picture per U */
+    const unsigned int width = 512;
+    const unsigned int height = 256;
+    vector<unsigned char> source(width * 2 * height);
+    vector<unsigned char> destination(width * 3 * height);
+
+    ColorConversion::InstructionSet fastest = ColorConversion::detectInstructionSet();
+    unsigned int failures = 0;
+
+    for (int i = ColorConversion::Scalar; i <= fastest; ++i) {
+        ColorConversion::InstructionSet instructionSet = static_cast<ColorConversion::InstructionSet>(i);
+        ColorConversion::setInstructionSet(instructionSet);
+        bool exact = true;
+
+        for (int u = 0; u < 256 && exact == true; ++u) {
+            for (unsigned int row = 0; row < height; ++row) {
+                unsigned char *packed = &source[row * width * 2];
+                for (unsigned int k = 0; k < width / 2; ++k) {
+                    packed[4 * k] = k;
+                    packed[4 * k + 1] = u;
+                    packed[4 * k + 2] = 255 - k;
+                    packed[4 * k + 3] = row;
+                }
+            }
+
+            ColorConversion::convert(&source[0], V4L2_PIX_FMT_YUYV, width, height, width * 2,
+                    &destination[0], ColorConversion::Rgb24, width * 3);
+
+            for (unsigned int a = 0; a < width * height && exact == true; ++a) {
+                int y = source[2 * a];
+                int uu = u - 128;
+                int vv = static_cast<int>(a / width) - 128;
+                int yy = (y - 16) * 74;
+                const unsigned char *rgb = &destination[3 * a];
+
+                if (rgb[0] != clampedShift(yy + 102 * vv + 32) ||
+                        rgb[1] != clampedShift(yy - 52 * vv - 25 * uu + 32) ||
+                        rgb[2] != clampedShift(yy + 129 * uu + 32)) {
+                    cerr << ColorConversion::instructionSetName(instructionSet) << ": YUV " << y << " " << u
+                         << " " << vv + 128 << " gives RGB " << (int) rgb[0] << " " << (int) rgb[1]
+                         << " " << (int) rgb[2] << " - off the formula" << endl;
+                    exact = false;
+                }
+            }
+        }
+
+        if (exact == false) ++failures;
+    }
+
+    ColorConversion::setInstructionSet(fastest);
+    return failures;
+}
+
+
+int main()
+{
+    cout << "comparing up to "
+         << ColorConversion::instructionSetName(ColorConversion::detectInstructionSet())
+         << " with the scalar kernels" << endl;
+
+    unsigned int failures = compareInstructionSets() + checkFormula();
+
+    cout << (failures == 0 ? "PASSED" : "FAILED") << endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* test of FilterFusion against the filters run one after another
+ *
+ * Runs chains of the filter plugins on frames of a SyntheticCaptureDevice through two
+ * FilterGraphs, one fusing the chain and one not, and compares the images of the last
+ * filter byte by byte - at odd sizes and at heights of one and two rows too, where the
+ * stencil ring of the box blur wraps at its edges.
+ *
+ * usage: filterfusiontest [plugin directory]
+ * Default: ".." - see "make filters" in the top directory.
+ */
+
+#include "filtergraph.hpp"
+#include "filterregistry.hpp"
+#include "pixelformat.hpp"
+#include "syntheticcapturedevice.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+using namespace std;
+
+
+static const char *chains[][3] = {
+    {"grayscale", "box blur", "threshold"},
+    {"grayscale", "box blur", 0}
+};
+static const unsigned int widths[] = {1, 2, 3, 17, 63, 640};
+static const unsigned int heights[] = {1, 2, 3, 5, 480};
+/** frames compared per size, the box of the synthetic picture moves between them */
+static const unsigned int frameCount = 3;
+
+
+/** the image of the last filter, without padding */
+struct Result
+{
+    unsigned int filter;
+    vector<unsigned char> image;
+};
+
+
+static void frameFinished(FilterGraph *graph, unsigned int slot, void *resultArgument)
+{
+    Result *result = static_cast<Result*>(resultArgument);
+    const BaseFilter::Image &image = graph->output(slot, result->filter, 0).image;
+    unsigned int rowLength = PixelFormat::minimumBytesPerLine(image.pixelFormat, image.width);
+
+    result->image.clear();
+    for (unsigned int y = 0; y < image.height; ++y) {
+        const unsigned char *row = image.data + (size_t) y * image.bytesPerLine;
+        result->image.insert(result->image.end(), row, row + rowLength);
+    }
+}
+
+
+/** @returns false if a filter is missing */
+static bool buildChain(FilterRegistry &filters, const char * const *names, CaptureDevice *device,
+        FilterGraph *graph, Result *result)
+{
+    int last = -1;
+
+    for (unsigned int a = 0; a < 3 && names[a] != 0; ++a) {
+        int found = filters.find(names[a]);
+        CreateFilterFunction create;
+        DestroyFilterFunction destroy;
+        if (found == -1 || filters.load(found, &create, &destroy) == false) {
+            cerr << "filter \"" << names[a] << "\" not found" << endl;
+            return false;
+        }
+
+        unsigned int filter = graph->addFilter(create, destroy);
+        if (last == -1) {
+            graph->connectSource(graph->addSource(device), FilterGraph::SourcePortImage, filter, 0);
+        } else {
+            graph->connect(last, 0, filter, 0);
+        }
+        last = filter;
+    }
+
+    result->filter = last;
+    graph->setFrameFinishedFunction(frameFinished, result);
+    return graph->build();
+}
+
+
+/** @returns the newest frame published after the one given */
+static CaptureDevice::FrameHandle nextFrame(CaptureDevice &device, unsigned long long sequence)
+{
+    for (;;) {
+        CaptureDevice::FrameHandle frame = device.lockNewestBuffer();
+        if (frame.isNull() == false && frame->sequence > sequence) return frame;
+
+        struct timespec wait = {0, 1000000};
+        nanosleep(&wait, 0);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    FilterRegistry filters;
+    filters.addSearchDirectory(argc > 1 ? argv[1] : "..");
+    filters.scan();
+
+    unsigned int failures = 0;
+    unsigned int comparisons = 0;
+
+    for (size_t c = 0; c < sizeof(chains) / sizeof(chains[0]); ++c) {
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+            for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); ++h) {
+
+                SyntheticCaptureDevice device;
+                device.setCaptureSize(widths[w], heights[h]);
+                device.setPixelFormat(V4L2_PIX_FMT_RGB24);
+                device.setFrameRate(1000.0);
+                if (device.init() == false) return EXIT_FAILURE;
+
+                FilterGraph fused(1, 1);
+                FilterGraph unfused(1, 1);
+                Result fusedResult;
+                Result unfusedResult;
+                fused.setFusionEnabled(true);
+                unfused.setFusionEnabled(false);
+
+                if (buildChain(filters, chains[c], &device, &fused, &fusedResult) == false ||
+                        buildChain(filters, chains[c], &device, &unfused, &unfusedResult) == false) {
+                    device.finish();
+                    cout << "FAILED" << endl;
+                    return EXIT_FAILURE;
+                }
+
+                device.startCapturing();
+                unsigned long long sequence = 0;
+
+                for (unsigned int a = 0; a < frameCount; ++a) {
+                    CaptureDevice::FrameHandle frame = nextFrame(device, sequence);
+                    sequence = frame->sequence;
+
+                    fused.submit(&frame);
+                    fused.waitUntilIdle();
+                    unfused.submit(&frame);
+                    unfused.waitUntilIdle();
+
+                    ++comparisons;
+                    if (fusedResult.image.empty() == true || fusedResult.image != unfusedResult.image) {
+                        cerr << chains[c][0] << " -> " << chains[c][1] << (chains[c][2] != 0 ? " -> " : "")
+                             << (chains[c][2] != 0 ? chains[c][2] : "") << " at " << widths[w] << "x"
+                             << heights[h] << ", frame " << a << ": fused output differs" << endl;
+                        ++failures;
+                    }
+                }
+
+                device.stopCapturing();
+                fused.stop();
+                unfused.stop();
+                device.finish();
+            }
+        }
+    }
+
+    cout << comparisons << " frames compared" << endl;
+    cout << (failures == 0 ? "PASSED" : "FAILED") << endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
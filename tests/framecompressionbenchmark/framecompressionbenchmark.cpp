@@ -0,0 +1,156 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* benchmark of FrameCompression
+ *
+ * Compresses 1920x1080 RGB24 frames of several kinds of content on one thread, with
+ * key frames only and with a key frame every 30 frames, and prints the compression
+ * ratio and MB/s per core for compressing and decompressing. Recorder runs the tiles on
+ * a thread pool, so a recording scales from there with the cores. Every frame is
+ * decompressed and compared - a mismatch fails the benchmark.
+ */
+
+#include "framecompression.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+using namespace std;
+
+
+static const unsigned int width = 1920;
+static const unsigned int height = 1080;
+static const size_t frameSize = width * height * 3;
+static const unsigned int frameCount = 30;
+/** Recorder's default */
+static const unsigned int tileSize = 256 * 1024;
+
+
+enum Content
+{
+    /** color bars with a moving box - like SyntheticCaptureDevice */
+    ContentBars,
+    /** a gradient with sensor noise */
+    ContentStatic,
+    /** the gradient panning, with noise */
+    ContentPanning,
+    ContentRandom,
+    ContentCount
+};
+
+static const char *contentNames[ContentCount] = {
+    "synthetic bars", "static camera with noise", "panning camera with noise", "random"
+};
+
+
+static double seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+static void fillFrame(unsigned char *frame, Content content, unsigned int number)
+{
+    for (unsigned int y = 0; y < height; ++y) {
+        for (unsigned int x = 0; x < width; ++x) {
+            for (unsigned int c = 0; c < 3; ++c) {
+                unsigned char &value = frame[(y * width + x) * 3 + c];
+
+                switch (content) {
+                case ContentBars:
+                    value = ((x * 8 / width) & (1 << c)) != 0 ? 191 : 0;
+                    if (x >= number * 4 && x < number * 4 + 32 && y < 32) value = 255;
+                    break;
+                case ContentStatic:
+                    value = x / 8 + y / 4 + c * 40 + rand() % 5 - 2;
+                    break;
+                case ContentPanning:
+                    value = (x + number * 3) / 8 + y / 4 + c * 40 + rand() % 5 - 2;
+                    break;
+                default:
+                    value = rand();
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    unsigned int tiles = FrameCompression::tileCount(frameSize, tileSize);
+    vector<unsigned char> compressed(FrameCompression::maximumSize(frameSize, tileSize));
+    vector<unsigned char> scratch(tileSize);
+    vector<unsigned char> decompressed(frameSize);
+    vector<unsigned char> previous(frameSize);
+    bool exact = true;
+
+    srand(1);
+    printf("%ux%u RGB24, %u frames, tiles of %u KiB, one core\n", width, height, frameCount, tileSize / 1024);
+
+    for (int c = 0; c < ContentCount; ++c) {
+        vector<vector<unsigned char> > frames(frameCount, vector<unsigned char>(frameSize));
+        for (unsigned int f = 0; f < frameCount; ++f) {
+            fillFrame(&frames[f][0], static_cast<Content>(c), f);
+        }
+
+        for (unsigned int keyFrameInterval = 1; keyFrameInterval <= 30; keyFrameInterval += 29) {
+            vector<unsigned char> reference(frameSize);
+            size_t compressedBytes = 0;
+            double compressTime = 0.0;
+            double decompressTime = 0.0;
+
+            for (unsigned int f = 0; f < frameCount; ++f) {
+                bool keyFrame = f % keyFrameInterval == 0;
+
+                double start = seconds();
+                for (unsigned int t = 0; t < tiles; ++t) {
+                    FrameCompression::compressTile(&frames[f][0], frameSize, tileSize, t,
+                            keyFrameInterval > 1 ? &reference[0] : 0, keyFrame, &compressed[0], &scratch[0]);
+                }
+                size_t size = FrameCompression::pack(&compressed[0], frameSize, tileSize);
+                compressTime += seconds() - start;
+                compressedBytes += size;
+
+                start = seconds();
+                bool valid = FrameCompression::decompress(&compressed[0], size, &decompressed[0], frameSize,
+                        keyFrame == true ? 0 : &previous[0]);
+                decompressTime += seconds() - start;
+
+                if (valid == false || memcmp(&decompressed[0], &frames[f][0], frameSize) != 0) {
+                    fprintf(stderr, "%s, frame %u does not decompress to the original\n", contentNames[c], f);
+                    exact = false;
+                }
+                previous.swap(decompressed);
+            }
+
+            double rawBytes = (double) frameSize * frameCount;
+            printf("%-26s key frame every %2u: ratio %7.2f, compress %6.0f MB/s, decompress %6.0f MB/s\n",
+                    contentNames[c], keyFrameInterval, rawBytes / compressedBytes,
+                    rawBytes / compressTime / 1e6, rawBytes / decompressTime / 1e6);
+        }
+    }
+
+    return exact == true ? EXIT_SUCCESS : EXIT_FAILURE;
+}
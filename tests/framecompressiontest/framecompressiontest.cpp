@@ -0,0 +1,230 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* round trips of FrameCompression, on its own and through a recording
+ *
+ * First a key frame and a difference frame straight through FrameCompression, with a
+ * tile of noise, which is stored as it is, and a last tile shorter than the others. Then
+ * frames recorded compressed by a Recorder and read back by a RecordingCaptureDevice,
+ * in order and after seeking to frames between key frames - with a frame missing, after
+ * which the recorder has to start over with a key frame.
+ */
+
+#include "framecompression.hpp"
+#include "recorder.hpp"
+#include "recordingcapturedevice.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <linux/videodev2.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+static const unsigned int tileSize = 4096;
+/** tile 1 is noise, tile 3 is short */
+static const size_t rawSize = 3 * tileSize + 1000;
+
+static const unsigned int width = 61;
+static const unsigned int height = 37;
+static const unsigned int frameCount = 24;
+static const unsigned int keyFrameInterval = 8;
+/** not recorded - as if the driver dropped it */
+static const unsigned int missingFrame = 13;
+
+
+static unsigned int failures = 0;
+
+static void expect(bool condition, const string &what)
+{
+    if (condition == false) {
+        cerr << what << endl;
+        ++failures;
+    }
+}
+
+
+static void fillFrame(unsigned char *frame, size_t size, unsigned int number)
+{
+    for (size_t a = 0; a < size; ++a) {
+        frame[a] = a / 64 + (a % 64 == number % 64 ? 100 : 0);
+    }
+}
+
+
+/** @returns size of the compressed frame */
+static size_t compress(const vector<unsigned char> &raw, vector<unsigned char> *reference, bool keyFrame,
+        vector<unsigned char> *compressed)
+{
+    vector<unsigned char> scratch(tileSize);
+    unsigned int tiles = FrameCompression::tileCount(raw.size(), tileSize);
+
+    compressed->resize(FrameCompression::maximumSize(raw.size(), tileSize));
+    for (unsigned int a = 0; a < tiles; ++a) {
+        FrameCompression::compressTile(&raw[0], raw.size(), tileSize, a, &(*reference)[0], keyFrame,
+                &(*compressed)[0], &scratch[0]);
+    }
+    return FrameCompression::pack(&(*compressed)[0], raw.size(), tileSize);
+}
+
+
+/** @returns true if the tile went into the frame as it is - its size in the frame's header */
+static bool isStored(const vector<unsigned char> &compressed, unsigned int tile, size_t size)
+{
+    const unsigned int *sizes = (const unsigned int*) &compressed[0] + 2;
+    return sizes[tile] == size;
+}
+
+
+static void testFrameCompression()
+{
+    expect(FrameCompression::tileCount(rawSize, tileSize) == 4, "compression: wrong tile count");
+
+    vector<unsigned char> key(rawSize);
+    vector<unsigned char> difference(rawSize);
+    fillFrame(&key[0], rawSize, 0);
+    fillFrame(&difference[0], rawSize, 1);
+    for (size_t a = tileSize; a < 2 * tileSize; ++a) {
+        key[a] = rand();
+        difference[a] = rand();
+    }
+    /* only in the short tile */
+    difference[rawSize - 1] ^= 0x55;
+
+    vector<unsigned char> reference(rawSize);
+    vector<unsigned char> compressed;
+    vector<unsigned char> decompressed(rawSize);
+
+    /* *** key frame *** */
+    size_t size = compress(key, &reference, true, &compressed);
+    expect(reference == key, "compression: reference is not the key frame");
+    expect(isStored(compressed, 1, tileSize) == true, "compression: noise of the key frame not stored");
+    expect(isStored(compressed, 0, tileSize) == false, "compression: key frame not compressed");
+    expect(FrameCompression::decompress(&compressed[0], size, &decompressed[0], rawSize, 0) == true &&
+            decompressed == key, "compression: key frame differs");
+
+    /* *** difference frame *** */
+    size = compress(difference, &reference, false, &compressed);
+    expect(reference == difference, "compression: reference is not the difference frame");
+    expect(isStored(compressed, 1, tileSize) == true, "compression: noise of the difference frame not stored");
+    expect(FrameCompression::decompress(&compressed[0], size, &decompressed[0], rawSize, &key[0]) == true &&
+            decompressed == difference, "compression: difference frame differs");
+
+    /* *** truncated *** */
+    expect(FrameCompression::decompress(&compressed[0], size - 1, &decompressed[0], rawSize, &key[0]) == false,
+            "compression: truncated frame not detected");
+}
+
+
+static void testRecording()
+{
+    ostringstream fileName;
+    fileName << "/tmp/framecompressiontest-" << getpid() << ".vcr";
+
+    size_t bytesPerLine = width * 3;
+    vector<vector<unsigned char> > frames(frameCount, vector<unsigned char>(bytesPerLine * height));
+
+    Recorder recorder(0);
+    recorder.setCompression(Recorder::CompressionLz4);
+    recorder.setKeyFrameInterval(keyFrameInterval);
+    recorder.setTileSize(tileSize);
+    if (recorder.start(fileName.str()) == false) {
+        expect(false, "recording: cannot create " + fileName.str());
+        return;
+    }
+
+    for (unsigned int a = 0; a < frameCount; ++a) {
+        fillFrame(&frames[a][0], frames[a].size(), a);
+        if (a == missingFrame) continue;
+
+        CaptureDevice::Buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.time.tv_sec = 1 + a / 30;
+        buffer.time.tv_nsec = a % 30 * 33333333;
+        buffer.frameNumber = a;
+        buffer.buffer = &frames[a][0];
+        buffer.length = frames[a].size();
+        buffer.bytesUsed = frames[a].size();
+        buffer.pixelFormat = V4L2_PIX_FMT_RGB24;
+        buffer.width = width;
+        buffer.height = height;
+        buffer.bytesPerLine = bytesPerLine;
+        expect(recorder.record(buffer) == true, "recording: frame not recorded");
+    }
+    recorder.stop();
+
+    RecordingCaptureDevice device;
+    device.setFileName(fileName.str());
+    if (device.init() == false) {
+        expect(false, "recording: cannot open " + fileName.str());
+    } else {
+        expect(device.frameCount() == frameCount - 1, "recording: wrong frame count");
+
+        for (unsigned int a = 0; a < device.frameCount(); ++a) {
+            unsigned int number = device.record(a).sequence;
+            bool keyFrame = (device.record(a).flags & Recorder::FlagKeyFrame) != 0;
+            /* every keyFrameInterval frames, and after the gap */
+            bool expected = number == 0 || number == keyFrameInterval || number == missingFrame + 1 ||
+                    number == missingFrame + 1 + keyFrameInterval;
+            expect(keyFrame == expected, "recording: key frame at the wrong place");
+        }
+
+        /* in order, then seeking - to frames between key frames, backwards, and right after the gap */
+        vector<unsigned int> order;
+        for (unsigned int a = 0; a < device.frameCount(); ++a) order.push_back(a);
+        unsigned int seeks[] = {5, 3, 20, 12, 14, 0, 22, 13, 7};
+        order.insert(order.end(), seeks, seeks + sizeof(seeks) / sizeof(seeks[0]));
+
+        for (auto it = order.begin(); it != order.end(); ++it) {
+            CaptureDevice::FrameHandle frame = device.frame(*it);
+            ostringstream what;
+            what << "recording: frame " << *it;
+
+            if (frame.isNull() == true) {
+                expect(false, what.str() + " is corrupt");
+                continue;
+            }
+            const vector<unsigned char> &original = frames[frame->frameNumber];
+            expect(frame->bytesUsed == original.size() && memcmp(frame->buffer, &original[0], original.size()) == 0,
+                    what.str() + " differs");
+        }
+
+        device.finish();
+    }
+
+    remove(fileName.str().c_str());
+    remove((fileName.str() + ".index").c_str());
+}
+
+
+int main()
+{
+    srand(1);
+
+    testFrameCompression();
+    testRecording();
+
+    cout << (failures == 0 ? "PASSED" : "FAILED") << endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
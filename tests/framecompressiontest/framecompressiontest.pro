@@ -0,0 +1,54 @@
+# videocapture is a tool with no special purpose
+# 
+# Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+
+TARGET = framecompressiontest
+
+include(../tests.pri)
+
+CONFIG += link_pkgconfig
+PKGCONFIG += libv4l2 liblz4
+
+
+HEADERS += ../../src/capturedevice.hpp \
+           ../../src/capturereactor.hpp \
+           ../../src/framecompression.hpp \
+           ../../src/framenotifier.hpp \
+           ../../src/framepool.hpp \
+           ../../src/framering.hpp \
+           ../../src/latencyhistogram.hpp \
+           ../../src/pixelformat.hpp \
+           ../../src/rateestimator.hpp \
+           ../../src/recorder.hpp \
+           ../../src/recordingcapturedevice.hpp \
+           ../../src/threadpool.hpp \
+           ../../src/tracer.hpp
+
+SOURCES += ../../src/capturedevice.cpp \
+           ../../src/capturereactor.cpp \
+           ../../src/framecompression.cpp \
+           ../../src/framenotifier.cpp \
+           ../../src/framepool.cpp \
+           ../../src/framering.cpp \
+           ../../src/latencyhistogram.cpp \
+           ../../src/pixelformat.cpp \
+           ../../src/rateestimator.cpp \
+           ../../src/recorder.cpp \
+           ../../src/recordingcapturedevice.cpp \
+           ../../src/threadpool.cpp \
+           ../../src/tracer.cpp \
+           ./framecompressiontest.cpp
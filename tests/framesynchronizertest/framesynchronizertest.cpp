@@ -0,0 +1,170 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* test of FrameSynchronizer's matching, fed by push() without devices
+ *
+ * Two sources with frames of made-up capture times: one 2 ms behind the other with
+ * 0.5 ms of jitter and two frames lost, and one at 30 frames/s against one at 25. Checks
+ * the tuples matched, the frames left unmatched and the skew statistics, and that
+ * reset() starts over.
+ */
+
+#include "framering.hpp"
+#include "framesynchronizer.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+
+static const unsigned int queueDepth = 4;
+static const long long start = 1000000000LL;
+
+
+/** hands out frames with the times asked for, as a device's ring would */
+class Source
+{
+public:
+    Source() :
+        m_buffers(queueDepth * 2)
+    {
+        memset(&m_buffers[0], 0, m_buffers.size() * sizeof(FrameRing::Buffer));
+        m_ring.setBuffers(&m_buffers[0], m_buffers.size());
+    }
+
+    CaptureDevice::FrameHandle frame(long long nanoseconds)
+    {
+        FrameRing::Buffer *buffer = m_ring.claimOldest();
+        buffer->time.tv_sec = nanoseconds / 1000000000LL;
+        buffer->time.tv_nsec = nanoseconds % 1000000000LL;
+        m_ring.publish(buffer);
+
+        CaptureDevice::FrameHandle ret;
+        m_ring.lockNewest(1, &ret);
+        return ret;
+    }
+
+private:
+    FrameRing m_ring;
+    vector<FrameRing::Buffer> m_buffers;
+};
+
+
+static unsigned int failures = 0;
+
+static void expect(const char *what, double value, double expected, double tolerance = 0.0)
+{
+    if (fabs(value - expected) > tolerance) {
+        cerr << what << ": " << value << ", expected " << expected << endl;
+        ++failures;
+    }
+}
+
+
+/** tuples whose frames lie further apart than the tolerance */
+static unsigned int spreadTuples = 0;
+
+static void tupleFunction(FrameSynchronizer *synchronizer, const CaptureDevice::FrameHandle *frames, void *)
+{
+    long long first = frames[0]->time.tv_sec * 1000000000LL + frames[0]->time.tv_nsec;
+    long long second = frames[1]->time.tv_sec * 1000000000LL + frames[1]->time.tv_nsec;
+    if (llabs(first - second) > synchronizer->tolerance() * 1e9) ++spreadTuples;
+}
+
+
+int main()
+{
+    FrameSynchronizer synchronizer;
+    synchronizer.addSource(0);
+    synchronizer.addSource(0);
+    synchronizer.setQueueDepth(queueDepth);
+    synchronizer.setTupleFunction(tupleFunction, 0);
+
+    /* *** 30 frames/s, the second source 2 ms behind, +-0.5 ms, frames 50 and 51 lost *** */
+    {
+        Source first;
+        Source second;
+        synchronizer.setTolerance(0.005);
+        synchronizer.reset();
+
+        for (int a = 0; a < 100; ++a) {
+            long long time = start + a * 33333333LL;
+            synchronizer.push(0, first.frame(time));
+            if (a == 50 || a == 51) continue;
+            synchronizer.push(1, second.frame(time + 2000000 + (a % 2 == 0 ? 500000 : -500000)));
+        }
+
+        FrameSynchronizer::SkewStatistics skew = synchronizer.skew(0, 1);
+        expect("offset: matched tuples", synchronizer.matchedTuples(), 98);
+        expect("offset: unmatched frames of the first", synchronizer.unmatchedFrames(0), 2);
+        expect("offset: unmatched frames of the second", synchronizer.unmatchedFrames(1), 0);
+        expect("offset: skew count", skew.count, 98);
+        expect("offset: skew mean", skew.mean, -0.002, 1e-9);
+        expect("offset: skew deviation", skew.standardDeviation, 0.0005, 1e-9);
+        expect("offset: skew minimum", skew.minimum, -0.0025, 1e-9);
+        expect("offset: skew maximum", skew.maximum, -0.0015, 1e-9);
+    }
+
+    /* *** starting over *** */
+    synchronizer.reset();
+    expect("reset: matched tuples", synchronizer.matchedTuples(), 0);
+    expect("reset: unmatched frames", synchronizer.unmatchedFrames(0) + synchronizer.unmatchedFrames(1), 0);
+    expect("reset: skew count", synchronizer.skew(0, 1).count, 0);
+
+    /* *** 30 against 25 frames/s for 10 s - they meet every 0.2 s *** */
+    {
+        Source first;
+        Source second;
+        synchronizer.setTolerance(0.005);
+        synchronizer.reset();
+
+        /* in the order of their times, as the devices would deliver them */
+        int a = 0;
+        int b = 0;
+        while (a < 300 || b < 250) {
+            long long firstTime = start + a * 33333333LL;
+            long long secondTime = start + b * 40000000LL;
+            if (b == 250 || (a < 300 && firstTime <= secondTime)) {
+                synchronizer.push(0, first.frame(firstTime));
+                ++a;
+            } else {
+                synchronizer.push(1, second.frame(secondTime));
+                ++b;
+            }
+        }
+
+        /* every sixth frame of the first is 2 ns early per meeting: 0, -2, ... -98 ns */
+        FrameSynchronizer::SkewStatistics skew = synchronizer.skew(0, 1);
+        expect("frame rates: matched tuples", synchronizer.matchedTuples(), 50);
+        /* the others are unmatched, but the newest frame of the first still waiting */
+        expect("frame rates: unmatched frames of the first", synchronizer.unmatchedFrames(0), 300 - 50 - 1);
+        expect("frame rates: unmatched frames of the second", synchronizer.unmatchedFrames(1), 250 - 50);
+        expect("frame rates: skew count", skew.count, 50);
+        expect("frame rates: skew mean", skew.mean, -49e-9, 1e-12);
+        expect("frame rates: skew deviation", skew.standardDeviation, 2e-9 * sqrt((50.0 * 50.0 - 1.0) / 12.0), 1e-12);
+    }
+
+    expect("tuples beyond the tolerance", spreadTuples, 0);
+
+    cout << (failures == 0 ? "PASSED" : "FAILED") << endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,48 @@
+# videocapture is a tool with no special purpose
+# 
+# Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+
+TARGET = framesynchronizertest
+
+include(../tests.pri)
+
+CONFIG += link_pkgconfig
+PKGCONFIG += libv4l2
+
+
+HEADERS += ../../src/capturedevice.hpp \
+           ../../src/capturereactor.hpp \
+           ../../src/framenotifier.hpp \
+           ../../src/framepool.hpp \
+           ../../src/framering.hpp \
+           ../../src/framesynchronizer.hpp \
+           ../../src/latencyhistogram.hpp \
+           ../../src/pixelformat.hpp \
+           ../../src/rateestimator.hpp \
+           ../../src/tracer.hpp
+
+SOURCES += ../../src/capturedevice.cpp \
+           ../../src/capturereactor.cpp \
+           ../../src/framenotifier.cpp \
+           ../../src/framepool.cpp \
+           ../../src/framering.cpp \
+           ../../src/framesynchronizer.cpp \
+           ../../src/latencyhistogram.cpp \
+           ../../src/pixelformat.cpp \
+           ../../src/rateestimator.cpp \
+           ../../src/tracer.cpp \
+           ./framesynchronizertest.cpp
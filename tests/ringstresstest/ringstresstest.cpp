@@ -0,0 +1,192 @@
+/* videocapture is a tool with no special purpose
+ *
+ * Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* stress test of FrameRing
+ *
+ * A synthetic producer publishes frames as fast as it can while several readers
+ * lock the newest ones and hold them for a while - half of them with lockNewest(), half
+ * like a consumer of every frame with lockNewer(). Every frame is filled with its
+ * sequence number, so a reader sees a torn frame if the producer ever writes into
+ * a locked buffer. Fails if a frame is torn, if frames come out of order or if the
+ * producer does not reach minimumFrameRate.
+ */
+
+#include "framering.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+static const unsigned int bufferCount = 4;
+/** 160x120 YUYV */
+static const size_t frameSize = 160 * 120 * 2;
+static const unsigned int readerCount = 6;
+/** frames locked per reader at once */
+static const unsigned int lockCount = 3;
+static const double duration = 2.0;
+static const double minimumFrameRate = 10000.0;
+
+
+static FrameRing ring;
+static volatile bool cancellationFlag = false;
+static unsigned long long tornFrames = 0;
+static unsigned long long outOfOrderFrames = 0;
+static unsigned long long lockedFrames = 0;
+
+
+static double secondsSince(const timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+/** @returns true if the whole frame holds its sequence number */
+static bool isIntact(const FrameRing::Handle &handle)
+{
+    const unsigned long long *words = reinterpret_cast<const unsigned long long*>(handle->buffer);
+    for (size_t a = 0; a < frameSize / sizeof(unsigned long long); ++a) {
+        if (words[a] != handle->sequence) return false;
+    }
+    return true;
+}
+
+
+static void readerThread(unsigned int seed)
+{
+    FrameRing::Handle handles[lockCount];
+    unsigned long long torn = 0;
+    unsigned long long outOfOrder = 0;
+    unsigned long long locked = 0;
+    unsigned long long lastSequence = 0;
+
+    while (cancellationFlag == false) {
+        bool newest = seed % 2 == 0;
+        unsigned int count = newest == true ? ring.lockNewest(lockCount, handles)
+                                            : ring.lockNewer(lastSequence, lockCount, handles);
+        locked += count;
+
+        for (unsigned int a = 0; a < count; ++a) {
+            if (isIntact(handles[a]) == false) ++torn;
+            /* newest first, or oldest first */
+            if (a > 0 && newest == true && handles[a]->sequence >= handles[a - 1]->sequence) ++outOfOrder;
+            if (a > 0 && newest == false && handles[a]->sequence <= handles[a - 1]->sequence) ++outOfOrder;
+        }
+        if (count > 0 && newest == true) {
+            if (handles[0]->sequence < lastSequence) ++outOfOrder;
+            lastSequence = handles[0]->sequence;
+        }
+        if (count > 0 && newest == false) {
+            /* never one seen before */
+            if (handles[0]->sequence <= lastSequence) ++outOfOrder;
+            lastSequence = handles[count - 1]->sequence;
+        }
+
+        /* hold the frames up to 100us, like a slow consumer */
+        struct timespec hold = {0, static_cast<long>(rand_r(&seed) % 100000)};
+        nanosleep(&hold, 0);
+
+        /* still intact after the producer went on */
+        for (unsigned int a = 0; a < count; ++a) {
+            if (isIntact(handles[a]) == false) ++torn;
+            handles[a].reset();
+        }
+    }
+
+    __sync_fetch_and_add(&tornFrames, torn);
+    __sync_fetch_and_add(&outOfOrderFrames, outOfOrder);
+    __sync_fetch_and_add(&lockedFrames, locked);
+}
+
+
+int main()
+{
+    vector<FrameRing::Buffer> buffers(bufferCount);
+    for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+        it->readerCount = 0;
+        it->sequence = 0;
+        it->buffer = static_cast<unsigned char*>(malloc(frameSize));
+        it->length = frameSize;
+        it->bytesUsed = frameSize;
+    }
+    ring.setBuffers(&buffers[0], bufferCount);
+
+    vector<thread*> readers;
+    for (unsigned int a = 0; a < readerCount; ++a) {
+        readers.push_back(new thread(readerThread, a));
+    }
+
+    unsigned long long published = 0;
+    unsigned long long dropped = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (secondsSince(start) < duration) {
+        FrameRing::Buffer *buffer = ring.claimOldest();
+        if (buffer == 0) {
+            ++dropped;
+            continue;
+        }
+
+        unsigned long long sequence = ring.publishedSequence() + 1;
+        unsigned long long *words = reinterpret_cast<unsigned long long*>(buffer->buffer);
+        for (size_t a = 0; a < frameSize / sizeof(unsigned long long); ++a) {
+            words[a] = sequence;
+        }
+        ring.publish(buffer);
+        ++published;
+    }
+
+    double seconds = secondsSince(start);
+    cancellationFlag = true;
+    for (auto it = readers.begin(); it != readers.end(); ++it) {
+        (*it)->join();
+        delete *it;
+    }
+    for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+        free(it->buffer);
+    }
+
+    double frameRate = published / seconds;
+    cout << "published " << published << " frames (" << static_cast<unsigned long long>(frameRate) << " frames/s), "
+         << dropped << " times no free buffer, " << lockedFrames << " frames locked by "
+         << readerCount << " readers" << endl;
+
+    bool passed = true;
+    if (tornFrames != 0) {
+        cerr << tornFrames << " torn frames" << endl;
+        passed = false;
+    }
+    if (outOfOrderFrames != 0) {
+        cerr << outOfOrderFrames << " frames out of order" << endl;
+        passed = false;
+    }
+    if (frameRate < minimumFrameRate) {
+        cerr << "producer below " << minimumFrameRate << " frames/s" << endl;
+        passed = false;
+    }
+
+    cout << (passed == true ? "PASSED" : "FAILED") << endl;
+    return passed == true ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,41 @@
+# videocapture is a tool with no special purpose
+# 
+# Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+
+
+# settings shared by the test and benchmark programs - each one is a small
+# console program linking only the sources it exercises
+
+TEMPLATE = app
+DESTDIR = .
+
+QMAKE_CXX = g++-4.4
+QMAKE_CXXFLAGS = -std=c++0x -O2
+QMAKE_CC = gcc-4.4
+QMAKE_CFLAGS = 
+QMAKE_LINK = g++-4.4
+QMAKE_LFLAGS = -std=c++0x
+
+CONFIG -= qt
+CONFIG += console warn_on
+
+INCLUDEPATH += ../../src
+
+LIBS += -lrt -lpthread
+
+
+OBJECTS_DIR = tmp/
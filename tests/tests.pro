@@ -0,0 +1,39 @@
+# videocapture is a tool with no special purpose
+# 
+# Copyright (C) 2009 Ronny Brendel <ronnybrendel@gmail.com>
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+
+
+TEMPLATE = subdirs
+
+SUBDIRS += allocationbenchmark \
+           colorconversionbenchmark \
+           colorconversiontest \
+           filterfusiontest \
+           framecompressionbenchmark \
+           framecompressiontest \
+           framesynchronizertest \
+           ringstresstest
+
+
+# runs the tests, the benchmarks are run by hand
+QMAKE_EXTRA_TARGETS += check
+
+check.commands = ./colorconversiontest/colorconversiontest && \
+                 ./filterfusiontest/filterfusiontest && \
+                 ./framecompressiontest/framecompressiontest && \
+                 ./framesynchronizertest/framesynchronizertest && \
+                 ./ringstresstest/ringstresstest
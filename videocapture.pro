@@ -30,7 +30,7 @@ QMAKE_LFLAGS = -std=c++0x -Wl,-export-dynamic
 CONFIG += warn_on debug
 
 CONFIG += link_pkgconfig
-PKGCONFIG += libv4l2
+PKGCONFIG += libv4l2 liblz4
 
 
 DEFINES += 
@@ -50,16 +50,62 @@ OBJECTS_DIR = tmp/
 HEADERS += ./src/basefilter.hpp \
            ./src/capturedevice.hpp \
            ./src/capturedevicesTab.hpp \
+           ./src/capturereactor.hpp \
+           ./src/colorconversion.hpp \
+           ./src/filecapturedevice.hpp \
            ./src/filtereditorTab.hpp \
+           ./src/filterfusion.hpp \
+           ./src/filtergraph.hpp \
+           ./src/filterinstance.hpp \
+           ./src/filterpipeline.hpp \
+           ./src/filterregistry.hpp \
+           ./src/filterreloader.hpp \
+           ./src/framecompression.hpp \
+           ./src/framenotifier.hpp \
+           ./src/framepool.hpp \
+           ./src/framering.hpp \
+           ./src/framesynchronizer.hpp \
+           ./src/historyring.hpp \
+           ./src/latencyhistogram.hpp \
            ./src/mainwindow.hpp \
+           ./src/pixelformat.hpp \
+           ./src/rateestimator.hpp \
+           ./src/recorder.hpp \
+           ./src/recordingcapturedevice.hpp \
+           ./src/syntheticcapturedevice.hpp \
+           ./src/threadpool.hpp \
+           ./src/tracer.hpp \
            ./src/viewstab.hpp
 
 SOURCES += ./src/basefilter.cpp \
            ./src/capturedevice.cpp \
            ./src/capturedevicesTab.cpp \
+           ./src/capturereactor.cpp \
+           ./src/colorconversion.cpp \
+           ./src/filecapturedevice.cpp \
            ./src/filtereditortab.cpp \
+           ./src/filterfusion.cpp \
+           ./src/filtergraph.cpp \
+           ./src/filterinstance.cpp \
+           ./src/filterpipeline.cpp \
+           ./src/filterregistry.cpp \
+           ./src/filterreloader.cpp \
+           ./src/framecompression.cpp \
+           ./src/framenotifier.cpp \
+           ./src/framepool.cpp \
+           ./src/framering.cpp \
+           ./src/framesynchronizer.cpp \
+           ./src/historyring.cpp \
+           ./src/latencyhistogram.cpp \
            ./src/main.cpp \
            ./src/mainwindow.cpp \
+           ./src/pixelformat.cpp \
+           ./src/rateestimator.cpp \
+           ./src/recorder.cpp \
+           ./src/recordingcapturedevice.cpp \
+           ./src/syntheticcapturedevice.cpp \
+           ./src/threadpool.cpp \
+           ./src/tracer.cpp \
            ./src/viewstab.cpp
 
 